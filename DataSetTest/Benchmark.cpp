@@ -0,0 +1,998 @@
+#include "Precomp.h"
+#include "Benchmark.h"
+#include "BriefDescriptor.h"
+#include "Convolution.h"
+#include "DescriptorMatcher.h"
+#include "FastCorners.h"
+#include "HarrisCorners.h"
+#include "ImagePyramid.h"
+#include "PlaybackFrameProvider.h"
+#include "PngDecoder.h"
+#include "PointUndistorter.h"
+#include "ThreadPool.h"
+#include "Undistorter.h"
+#include "Utilities.h"
+
+// Average milliseconds per call of func over iterations calls
+template <typename Func>
+static double MeasureMs(Func const &func, int32_t const iterations)
+{
+    auto const start = std::chrono::high_resolution_clock::now();
+    for (int32_t i = 0; i < iterations; ++i)
+    {
+        func();
+    }
+    auto const end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+static void PrintResult(char const *label, double const ms, int32_t const width, int32_t const height, int64_t const checksum)
+{
+    double const mpixels_per_second = (static_cast<double>(width) * height) / (ms * 1000.0);
+    printf("  %-40s %9.3f ms  %8.1f Mpixel/s  (checksum %" PRId64 ")\n", label, ms, mpixels_per_second, checksum);
+}
+
+// Deterministic noise, so results are comparable between runs
+static void GenerateNoise(std::vector<uint8_t> *out_image, int32_t const width, int32_t const height)
+{
+    uint32_t state = 12345;
+    out_image->resize(static_cast<size_t>(width) * height);
+    for (uint8_t &pixel : *out_image)
+    {
+        state = state * 1664525u + 1013904223u;
+        pixel = static_cast<uint8_t>(state >> 24);
+    }
+}
+
+static void BenchmarkConvolve()
+{
+    int32_t const width = 1920;
+    int32_t const height = 1080;
+    int32_t const iterations = 5;
+
+    std::vector<uint8_t> image;
+    GenerateNoise(&image, width, height);
+    uint8_t const *input = image.data();
+
+    printf("Convolve, %dx%d noise\n", width, height);
+
+    // 3x3 Sobel over the interior
+    static float const sobel_x_float[] =
+    {
+        -1, 0, 1,
+        -2, 0, 2,
+        -1, 0, 1
+    };
+    static int32_t const sobel_x_int[] =
+    {
+        -1, 0, 1,
+        -2, 0, 2,
+        -1, 0, 1
+    };
+
+    int64_t checksum = 0;
+    double ms = MeasureMs([&]()
+    {
+        checksum = 0;
+        for (int32_t y = 1; y < height - 1; ++y)
+        {
+            for (int32_t x = 1; x < width - 1; ++x)
+            {
+                checksum += Convolve(input, width, x, y, sobel_x_float, 3, 3);
+            }
+        }
+    }, iterations);
+    PrintResult("Sobel X, runtime float Convolve", ms, width, height, checksum);
+
+    ms = MeasureMs([&]()
+    {
+        checksum = 0;
+        for (int32_t y = 1; y < height - 1; ++y)
+        {
+            for (int32_t x = 1; x < width - 1; ++x)
+            {
+                checksum += Convolve<3, 3>(input, width, x, y, sobel_x_int);
+            }
+        }
+    }, iterations);
+    PrintResult("Sobel X, Convolve<3, 3>", ms, width, height, checksum);
+
+    ms = MeasureMs([&]()
+    {
+        checksum = 0;
+        for (int32_t y = 1; y < height - 1; ++y)
+        {
+            for (int32_t x = 1; x < width - 1; ++x)
+            {
+                checksum += Convolve<SobelX>(input, width, x, y);
+            }
+        }
+    }, iterations);
+    PrintResult("Sobel X, Convolve<SobelX>", ms, width, height, checksum);
+
+    // 9 tap horizontal Gaussian over the interior, as used by SmoothImage
+    GaussianKernel kernel;
+    GenerateGaussian(0.5f, 9, &kernel);
+
+    int32_t gaussian_int[9];
+    for (int32_t i = 0; i < 9; ++i)
+    {
+        gaussian_int[i] = kernel.fixed_values[i];
+    }
+
+    ms = MeasureMs([&]()
+    {
+        checksum = 0;
+        for (int32_t y = 0; y < height; ++y)
+        {
+            for (int32_t x = 4; x < width - 4; ++x)
+            {
+                checksum += static_cast<int32_t>(Convolve(input, width, x, y, kernel.values.data(), 1, 9) * kernel.scale);
+            }
+        }
+    }, iterations);
+    PrintResult("Gaussian 1x9, runtime float Convolve", ms, width, height, checksum);
+
+    ms = MeasureMs([&]()
+    {
+        checksum = 0;
+        for (int32_t y = 0; y < height; ++y)
+        {
+            for (int32_t x = 4; x < width - 4; ++x)
+            {
+                checksum += (Convolve<1, 9>(input, width, x, y, gaussian_int) + (1 << (GaussianFixedShift - 1))) >> GaussianFixedShift;
+            }
+        }
+    }, iterations);
+    PrintResult("Gaussian 1x9, Convolve<1, 9>", ms, width, height, checksum);
+
+    std::vector<uint8_t> row(width);
+    ms = MeasureMs([&]()
+    {
+        checksum = 0;
+        for (int32_t y = 0; y < height; ++y)
+        {
+            SmoothRowHorizontal(input + y * width, width, kernel, row.data());
+            for (int32_t x = 4; x < width - 4; ++x)
+            {
+                checksum += row[x];
+            }
+        }
+    }, iterations);
+    PrintResult("Gaussian 1x9, SmoothRowHorizontal (SIMD)", ms, width, height, checksum);
+}
+
+// Blurred noise, with enough structure for Harris to find a realistic number of corners
+static void GenerateTexture(std::vector<uint8_t> *out_image, int32_t const width, int32_t const height)
+{
+    std::vector<uint8_t> noise;
+    std::vector<uint8_t> scratch(static_cast<size_t>(width) * height);
+    GenerateNoise(&noise, width, height);
+
+    GaussianKernel kernel;
+    GenerateGaussian(1.0f, 7, &kernel);
+    out_image->resize(noise.size());
+    SmoothImage(noise.data(), width, height, kernel, scratch.data(), out_image->data(), nullptr);
+}
+
+static void BenchmarkThreads()
+{
+    int32_t const width = 4000;
+    int32_t const height = 3000;
+    int32_t const iterations = 5;
+
+    std::vector<uint8_t> image;
+    GenerateTexture(&image, width, height);
+
+    std::vector<uint8_t> scratch(image.size());
+    std::vector<uint8_t> smoothed(image.size());
+    GaussianKernel kernel;
+    GenerateGaussian(0.5f, 9, &kernel);
+
+    printf("Thread scaling, %dx%d texture\n", width, height);
+
+    uint32_t const max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    double baseline_ms[3]{};
+    for (uint32_t num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+    {
+        ThreadPool pool;
+        pool.Initialize(num_threads);
+
+        HarrisDetector harris;
+        harris.SetThreadPool(&pool);
+        std::vector<HarrisFeature> features;
+
+        double const smooth_ms = MeasureMs([&]()
+        {
+            SmoothImage(image.data(), width, height, kernel, scratch.data(), smoothed.data(), &pool);
+        }, iterations);
+        double const harris_ms = MeasureMs([&]()
+        {
+            harris.Detect(smoothed.data(), width, height, &features);
+        }, iterations);
+        double const fused_ms = MeasureMs([&]()
+        {
+            harris.DetectFused(image.data(), width, height, kernel, &features);
+        }, iterations);
+
+        if (1 == num_threads)
+        {
+            baseline_ms[0] = smooth_ms;
+            baseline_ms[1] = harris_ms;
+            baseline_ms[2] = fused_ms;
+        }
+
+        printf("  %2u threads: SmoothImage %8.3f ms (%5.2fx)  Harris %8.3f ms (%5.2fx)  fused %8.3f ms (%5.2fx)  %zu features\n",
+            num_threads, smooth_ms, baseline_ms[0] / smooth_ms, harris_ms, baseline_ms[1] / harris_ms,
+            fused_ms, baseline_ms[2] / fused_ms, features.size());
+
+        // Always include the full machine, even when it isn't a power of 2
+        if (num_threads < max_threads && num_threads * 2 > max_threads)
+        {
+            num_threads = max_threads / 2;
+        }
+    }
+}
+
+static void BenchmarkFast()
+{
+    int32_t const width = 640;
+    int32_t const height = 480;
+    int32_t const iterations = 200;
+
+    std::vector<uint8_t> image;
+    GenerateTexture(&image, width, height);
+
+    printf("FAST, %dx%d texture\n", width, height);
+
+    FastDetector detector;
+    std::vector<FastFeature> features;
+    for (int32_t const segment_size : { 9, 12 })
+    {
+        for (bool const nonmax_suppression : { false, true })
+        {
+            FastParams params;
+            params.segment_size = segment_size;
+            params.nonmax_suppression = nonmax_suppression;
+            detector.SetParams(params);
+
+            char label[64];
+            sprintf_s(label, "FAST-%d%s", segment_size, nonmax_suppression ? " + NMS" : "");
+            double const ms = MeasureMs([&]() { detector.Detect(image.data(), width, height, width, &features); }, iterations);
+            PrintResult(label, ms, width, height, static_cast<int64_t>(features.size()));
+
+            sprintf_s(label, "FAST-%d%s reference", segment_size, nonmax_suppression ? " + NMS" : "");
+            double const reference_ms = MeasureMs([&]() { FastDetectReference(image.data(), width, height, width, params, &features); }, 5);
+            PrintResult(label, reference_ms, width, height, static_cast<int64_t>(features.size()));
+        }
+    }
+}
+
+static void BenchmarkPyramid()
+{
+    int32_t const width = 1920;
+    int32_t const height = 1080;
+    int32_t const iterations = 20;
+
+    std::vector<uint8_t> image;
+    GenerateTexture(&image, width, height);
+
+    std::vector<uint8_t> scratch(image.size());
+    std::vector<uint8_t> smoothed(image.size());
+    GaussianKernel kernel;
+    GenerateGaussian(0.5f, 9, &kernel);
+
+    printf("Pyramid, %dx%d texture\n", width, height);
+
+    // What each level is compared against: smoothing & detecting at full resolution
+    HarrisDetector harris;
+    std::vector<HarrisFeature> harris_features;
+    double const full_ms = MeasureMs([&]()
+    {
+        SmoothImage(image.data(), width, height, kernel, scratch.data(), smoothed.data(), nullptr);
+        harris.Detect(smoothed.data(), width, height, &harris_features);
+    }, iterations);
+    PrintResult("full resolution smooth + Harris", full_ms, width, height, static_cast<int64_t>(harris_features.size()));
+
+    FastDetector fast;
+    std::vector<FastFeature> fast_features;
+    std::vector<PyramidFeature> features;
+    for (float const scale_factor : { 2.0f, 1.2f })
+    {
+        PyramidParams params;
+        params.scale_factor = scale_factor;
+        params.num_levels = (2.0f == scale_factor) ? 4 : 8;
+
+        ImagePyramid pyramid;
+        pyramid.SetParams(params);
+        pyramid.Build(image.data(), width, height, kernel);
+
+        char label[64];
+        sprintf_s(label, "build, %d levels x%.1f", params.num_levels, scale_factor);
+        double const build_ms = MeasureMs([&]() { pyramid.Build(image.data(), width, height, kernel); }, iterations);
+        PrintResult(label, build_ms, width, height, pyramid.GetLevelCount());
+
+        sprintf_s(label, "build + Harris, %d levels x%.1f", params.num_levels, scale_factor);
+        double const harris_ms = MeasureMs([&]()
+        {
+            pyramid.Build(image.data(), width, height, kernel);
+            DetectPyramidHarris(pyramid, &harris, &harris_features, &features);
+        }, iterations);
+        PrintResult(label, harris_ms, width, height, static_cast<int64_t>(features.size()));
+        printf("    %.2fx the cost of full resolution only\n", harris_ms / full_ms);
+
+        sprintf_s(label, "build + FAST, %d levels x%.1f", params.num_levels, scale_factor);
+        double const fast_ms = MeasureMs([&]()
+        {
+            pyramid.Build(image.data(), width, height, kernel);
+            DetectPyramidFast(pyramid, &fast, &fast_features, &features);
+        }, iterations);
+        PrintResult(label, fast_ms, width, height, static_cast<int64_t>(features.size()));
+    }
+}
+
+static void BenchmarkBrief()
+{
+    int32_t const width = 640;
+    int32_t const height = 480;
+    int32_t const iterations = 50;
+
+    std::vector<uint8_t> image;
+    GenerateTexture(&image, width, height);
+
+    FastDetector detector;
+    std::vector<FastFeature> features;
+    detector.Detect(image.data(), width, height, width, &features);
+
+    printf("BRIEF, %zu FAST features on a %dx%d texture\n", features.size(), width, height);
+
+    BriefExtractor extractor;
+    std::vector<BriefFeature> described;
+    double const batch_ms = MeasureMs([&]()
+    {
+        described.clear();
+        extractor.Compute(image.data(), width, height, features.data(), static_cast<uint32_t>(features.size()), &described);
+    }, iterations);
+
+    double const reference_ms = MeasureMs([&]()
+    {
+        for (auto &feature : described)
+        {
+            ComputeBriefReference(image.data(), width, feature.x, feature.y, &feature.angle, &feature.descriptor);
+        }
+    }, 5);
+
+    size_t const count = std::max(described.size(), static_cast<size_t>(1));
+    printf("  %-40s %9.3f ms  %8.1f ns/feature\n", "batched", batch_ms, batch_ms * 1.0e6 / count);
+    printf("  %-40s %9.3f ms  %8.1f ns/feature\n", "reference", reference_ms, reference_ms * 1.0e6 / count);
+}
+
+// Train features with random descriptors & positions, and queries that are the same features moved a few
+// pixels with a few bits flipped, as between consecutive frames
+static void GenerateMatchFeatures(uint32_t const count, std::vector<BriefFeature> *out_train, std::vector<BriefFeature> *out_queries)
+{
+    uint32_t state = 12345;
+    auto const next = [&state]()
+    {
+        state = state * 1664525u + 1013904223u;
+        return state;
+    };
+
+    out_train->resize(count);
+    out_queries->resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        BriefFeature &train = (*out_train)[i];
+        train.x = static_cast<int32_t>(next() % 640);
+        train.y = static_cast<int32_t>(next() % 480);
+        train.level = 0;
+        train.scale = 1.0f;
+        train.index = i;
+        train.angle = 0.0f;
+        for (uint64_t &word : train.descriptor.bits)
+        {
+            word = (static_cast<uint64_t>(next()) << 32) | next();
+        }
+
+        BriefFeature &query = (*out_queries)[i];
+        query = train;
+        query.x += static_cast<int32_t>(next() % 9) - 4;
+        query.y += static_cast<int32_t>(next() % 9) - 4;
+        for (int32_t flip = 0; flip < 12; ++flip)
+        {
+            uint32_t const bit = next() % 256;
+            query.descriptor.bits[bit / 64] ^= 1ull << (bit % 64);
+        }
+    }
+}
+
+static void BenchmarkMatch()
+{
+    int32_t const iterations = 5;
+
+    for (uint32_t const count : { 2000u, 10000u })
+    {
+        std::vector<BriefFeature> train;
+        std::vector<BriefFeature> queries;
+        GenerateMatchFeatures(count, &train, &queries);
+
+        printf("Match, %u queries against %u train features\n", count, count);
+
+        std::vector<DescriptorMatch> matches;
+        double const naive_ms = MeasureMs([&]()
+        {
+            matches.clear();
+            for (uint32_t q = 0; q < count; ++q)
+            {
+                uint32_t best_distance = UINT32_MAX;
+                uint32_t best_train = 0;
+                for (uint32_t t = 0; t < count; ++t)
+                {
+                    uint32_t const distance = HammingDistance(queries[q].descriptor, train[t].descriptor);
+                    if (distance < best_distance)
+                    {
+                        best_distance = distance;
+                        best_train = t;
+                    }
+                }
+                matches.push_back({ q, best_train, best_distance });
+            }
+        }, 1);
+        printf("  %-40s %9.3f ms  %8zu matches\n", "naive nearest", naive_ms, matches.size());
+
+        // Brute force with every distance kernel compiled in, each checked against HammingDistance
+        struct Kernel
+        {
+            char const    *label;
+            DistanceKernel kernel;
+        };
+        static Kernel const kernels[] =
+        {
+            { "brute force, scalar kernel",  DistanceKernel::Scalar },
+            { "brute force, AVX2 kernel",    DistanceKernel::Avx2 },
+            { "brute force, AVX-512 kernel", DistanceKernel::Avx512 },
+        };
+
+        std::vector<uint32_t> distances(count);
+        for (auto const &kernel : kernels)
+        {
+            DescriptorMatcher matcher;
+            if (!DescriptorMatcher::IsKernelCompiled(kernel.kernel))
+            {
+                printf("  %-40s not compiled in\n", kernel.label);
+                continue;
+            }
+            matcher.SetDistanceKernel(kernel.kernel);
+            matcher.SetTrain(train.data(), count);
+
+            uint64_t differing = 0;
+            for (uint32_t q = 0; q < count; ++q)
+            {
+                matcher.GetDistances(queries[q].descriptor, distances.data());
+                for (uint32_t t = 0; t < count; ++t)
+                {
+                    differing += distances[t] != HammingDistance(queries[q].descriptor, train[t].descriptor) ? 1 : 0;
+                }
+            }
+
+            double const match_ms = MeasureMs([&]()
+            {
+                matches.clear();
+                matcher.Match(queries.data(), count, &matches);
+            }, iterations);
+            printf("  %-40s %9.3f ms  %8zu matches, %" PRIu64 " distances differ\n", kernel.label, match_ms, matches.size(), differing);
+        }
+
+        struct Config
+        {
+            char const *label;
+            MatchMode   mode;
+            uint32_t    max_distance;
+        };
+        static Config const configs[] =
+        {
+            { "brute force",                  MatchMode::BruteForce, 64 },
+            { "grid, radius 32",              MatchMode::Grid,       64 },
+            { "multi-index, max distance 31", MatchMode::MultiIndex, 31 },
+        };
+
+        DescriptorMatcher matcher;
+        for (auto const &config : configs)
+        {
+            MatcherParams params;
+            params.mode = config.mode;
+            params.max_distance = config.max_distance;
+            matcher.SetParams(params);
+
+            double const train_ms = MeasureMs([&]() { matcher.SetTrain(train.data(), count); }, iterations);
+            double const match_ms = MeasureMs([&]()
+            {
+                matches.clear();
+                matcher.Match(queries.data(), count, &matches);
+            }, iterations);
+
+            char label[64];
+            sprintf_s(label, "%s, train", config.label);
+            printf("  %-40s %9.3f ms\n", label, train_ms);
+            printf("  %-40s %9.3f ms  %8zu matches\n", config.label, match_ms, matches.size());
+        }
+    }
+}
+
+// The calibration of the shapes sequences, for frames scale times their 240x180
+static void GetShapesCameraModel(int32_t const scale, CameraModel *out_model)
+{
+    out_model->fx = 199.092366542f * scale;
+    out_model->fy = 198.82882047f * scale;
+    out_model->cx = 132.192071378f * scale;
+    out_model->cy = 110.712660011f * scale;
+    out_model->k1 = -0.368436311798f;
+    out_model->k2 = 0.150947243557f;
+    out_model->p1 = -0.000296130534385f;
+    out_model->p2 = -0.000759431726241f;
+    out_model->k3 = 0.0f;
+}
+
+static void BenchmarkUndistort()
+{
+    int32_t const iterations = 20;
+
+    ThreadPool pool;
+    pool.Initialize(0);
+
+    for (int32_t const scale : { 1, 8 })
+    {
+        int32_t const width = 240 * scale;
+        int32_t const height = 180 * scale;
+
+        CameraModel model;
+        GetShapesCameraModel(scale, &model);
+
+        std::vector<uint8_t> image;
+        GenerateTexture(&image, width, height);
+        std::vector<uint8_t> reference(image.size());
+        std::vector<uint8_t> undistorted(image.size());
+
+        printf("Undistort, %dx%d texture\n", width, height);
+
+        double const reference_ms = MeasureMs([&]() { UndistortImageReference(model, image.data(), width, height, reference.data()); }, iterations);
+        auto const sum = [](std::vector<uint8_t> const &pixels)
+        {
+            int64_t total = 0;
+            for (uint8_t const pixel : pixels)
+            {
+                total += pixel;
+            }
+            return total;
+        };
+        PrintResult("per pixel model (reference)", reference_ms, width, height, sum(reference));
+
+        Undistorter undistorter;
+        double const build_ms = MeasureMs([&]() { undistorter.Initialize(model, width, height); }, 1);
+        printf("  %-40s %9.3f ms\n", "build table", build_ms);
+
+        for (ThreadPool *threads : { static_cast<ThreadPool *>(nullptr), &pool })
+        {
+            undistorter.SetThreadPool(threads);
+            double const ms = MeasureMs([&]() { undistorter.Undistort(image.data(), undistorted.data()); }, iterations);
+            PrintResult(threads ? "table, threaded" : "table, single thread", ms, width, height, sum(undistorted));
+        }
+
+        int32_t max_difference = 0;
+        for (size_t i = 0; i < image.size(); ++i)
+        {
+            max_difference = std::max(max_difference, abs(undistorted[i] - reference[i]));
+        }
+        printf("    within %d of the reference\n", max_difference);
+    }
+}
+
+static void BenchmarkPoints()
+{
+    int32_t const iterations = 100;
+    int32_t const scale = 8;
+    int32_t const width = 240 * scale;
+    int32_t const height = 180 * scale;
+    uint32_t const count = 500;
+
+    CameraModel model;
+    GetShapesCameraModel(scale, &model);
+
+    // Features at random pixels, as detection would return them
+    uint32_t state = 12345;
+    std::vector<int32_t> pixel_us(count);
+    std::vector<int32_t> pixel_vs(count);
+    std::vector<float> us(count);
+    std::vector<float> vs(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        state = state * 1664525u + 1013904223u;
+        pixel_us[i] = static_cast<int32_t>((state >> 8) % width);
+        state = state * 1664525u + 1013904223u;
+        pixel_vs[i] = static_cast<int32_t>((state >> 8) % height);
+        us[i] = static_cast<float>(pixel_us[i]);
+        vs[i] = static_cast<float>(pixel_vs[i]);
+    }
+
+    std::vector<float> reference_xs(count);
+    std::vector<float> reference_ys(count);
+    std::vector<float> xs(count);
+    std::vector<float> ys(count);
+
+    printf("Undistort points, %u features of a %dx%d frame\n", count, width, height);
+
+    double const reference_ms = MeasureMs([&]() { UndistortPointsReference(model, us.data(), vs.data(), count, reference_xs.data(), reference_ys.data()); }, iterations);
+    printf("  %-40s %9.4f ms\n", "iterate to convergence (reference)", reference_ms);
+
+    PointUndistorter undistorter;
+    undistorter.Initialize(model);
+    double const batched_ms = MeasureMs([&]() { undistorter.Undistort(us.data(), vs.data(), count, xs.data(), ys.data()); }, iterations);
+
+    // Largest error, in pixels of the undistorted image
+    auto const max_error = [&]()
+    {
+        float error = 0.0f;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            error = std::max(error, fabsf(xs[i] - reference_xs[i]) * model.fx);
+            error = std::max(error, fabsf(ys[i] - reference_ys[i]) * model.fy);
+        }
+        return error;
+    };
+    printf("  %-40s %9.4f ms  max error %.5f pixels\n", "batched", batched_ms, max_error());
+
+    double const build_ms = MeasureMs([&]() { undistorter.BuildCache(width, height); }, 1);
+    printf("  %-40s %9.4f ms\n", "build per pixel cache", build_ms);
+    double const cached_ms = MeasureMs([&]() { undistorter.UndistortPixels(pixel_us.data(), pixel_vs.data(), count, xs.data(), ys.data()); }, iterations);
+    printf("  %-40s %9.4f ms  max error %.5f pixels\n", "cached", cached_ms, max_error());
+
+    // What it would take to remap the whole frame instead
+    std::vector<uint8_t> image;
+    GenerateTexture(&image, width, height);
+    std::vector<uint8_t> undistorted(image.size());
+    Undistorter image_undistorter;
+    image_undistorter.Initialize(model, width, height);
+    double const dense_ms = MeasureMs([&]() { image_undistorter.Undistort(image.data(), undistorted.data()); }, 10);
+    printf("  %-40s %9.4f ms  (%.0fx the batched cost)\n", "dense remap of the frame", dense_ms, dense_ms / batched_ms);
+}
+
+// Image sizes the sweep runs at, from that of our datasets up to 4K
+static struct
+{
+    int32_t width;
+    int32_t height;
+} const SweepSizes[] = { { 240, 180 }, { 640, 480 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+
+// Dataset whose first frame is the real content of the sweep, relative to the working directory
+static char const SweepDatasetRoot[] = "Data/shapes_6dof";
+
+enum class SweepContent
+{
+    Flat,           // no gradients at all
+    Noise,          // gradients everywhere
+    Checkerboard,   // 8 pixel squares, a corner every 8 pixels
+    Real,           // a dataset frame, mirrored to fill the size
+};
+
+static char const *GetSweepContentName(SweepContent const content)
+{
+    switch (content)
+    {
+    case SweepContent::Flat:         return "flat";
+    case SweepContent::Noise:        return "noise";
+    case SweepContent::Checkerboard: return "checkerboard";
+    case SweepContent::Real:         return "real";
+    default:                         return "unknown";
+    }
+}
+
+// Returns false for real content when the dataset isn't there
+static bool GenerateSweepContent(SweepContent const content, int32_t const width, int32_t const height, std::vector<uint8_t> *out_image)
+{
+    out_image->resize(static_cast<size_t>(width) * height);
+    switch (content)
+    {
+    case SweepContent::Flat:
+        std::fill(out_image->begin(), out_image->end(), static_cast<uint8_t>(128));
+        return true;
+
+    case SweepContent::Noise:
+        GenerateNoise(out_image, width, height);
+        return true;
+
+    case SweepContent::Checkerboard:
+        for (int32_t y = 0; y < height; ++y)
+        {
+            for (int32_t x = 0; x < width; ++x)
+            {
+                (*out_image)[static_cast<size_t>(y) * width + x] = (((x >> 3) ^ (y >> 3)) & 1) ? 192 : 64;
+            }
+        }
+        return true;
+
+    case SweepContent::Real:
+    {
+        // Tiles are mirrored, so there are no seams for detectors to pick up
+        static std::vector<uint8_t> frame;
+        static uint32_t frame_width = 0;
+        static uint32_t frame_height = 0;
+        if (frame.empty())
+        {
+            std::vector<DatasetImage> images;
+            PngDecoder decoder;
+            BufferPool pool;
+            ImageBuffer pixels;
+            if (!ReadImageList(SweepDatasetRoot, &images) ||
+                !decoder.Decode(images[0].file_path.c_str(), &pool, &frame_width, &frame_height, &pixels))
+            {
+                return false;
+            }
+            frame.assign(pixels.GetData(), pixels.GetData() + pixels.GetSize());
+        }
+
+        int32_t const fw = static_cast<int32_t>(frame_width);
+        int32_t const fh = static_cast<int32_t>(frame_height);
+        for (int32_t y = 0; y < height; ++y)
+        {
+            int32_t const tile_y = y / fh;
+            int32_t const sy = (tile_y & 1) ? fh - 1 - y % fh : y % fh;
+            for (int32_t x = 0; x < width; ++x)
+            {
+                int32_t const tile_x = x / fw;
+                int32_t const sx = (tile_x & 1) ? fw - 1 - x % fw : x % fw;
+                (*out_image)[static_cast<size_t>(y) * width + x] = frame[sy * fw + sx];
+            }
+        }
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+// 1, 2, 4... up to and including every hardware thread
+static std::vector<uint32_t> GetSweepThreadCounts()
+{
+    uint32_t const max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<uint32_t> counts;
+    for (uint32_t num_threads = 1; num_threads < max_threads; num_threads *= 2)
+    {
+        counts.push_back(num_threads);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+struct SweepTiming
+{
+    double ms = 0.0;        // per call
+    double cycles = 0.0;    // per call, in time stamp counter ticks, which run at the nominal clock rate
+};
+
+// Each sweep measurement repeats for at least this long, and this many times
+static double const SweepMinMs = 100.0;
+static int32_t const SweepMinIterations = 3;
+
+// Repeats func for long enough to be stable, after a warmup call
+static SweepTiming MeasureSweep(std::function<void()> const &func)
+{
+    func();
+
+    int32_t iterations = 0;
+    uint64_t const start_cycles = __rdtsc();
+    auto const start = std::chrono::high_resolution_clock::now();
+    double elapsed_ms = 0.0;
+    do
+    {
+        func();
+        ++iterations;
+        elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    } while (elapsed_ms < SweepMinMs || iterations < SweepMinIterations);
+    uint64_t const end_cycles = __rdtsc();
+
+    SweepTiming timing;
+    timing.ms = elapsed_ms / iterations;
+    timing.cycles = static_cast<double>(end_cycles - start_cycles) / iterations;
+    return timing;
+}
+
+// Rates are per pixel processed, which is fewer than width x height for kernels that skip a border.
+// suffix is appended to the line, for whatever keeps the work from being optimized out
+static void PrintSweepResult(char const *label, int32_t const width, int32_t const height, double const pixels, char const *content, uint32_t const num_threads, SweepTiming const &timing, char const *suffix)
+{
+    char size[32];
+    sprintf_s(size, "%dx%d", width, height);
+    printf("  %-16s %-10s %-13s %2u threads %10.3f ms %9.1f Mpixel/s %8.2f cycles/pixel%s%s\n",
+        label, size, content, num_threads, timing.ms, pixels / (timing.ms * 1000.0), timing.cycles / pixels, suffix[0] ? " " : "", suffix);
+}
+
+static void BenchmarkSweep()
+{
+    std::vector<uint32_t> const thread_counts = GetSweepThreadCounts();
+    SweepContent const contents[] = { SweepContent::Flat, SweepContent::Noise, SweepContent::Checkerboard, SweepContent::Real };
+    std::vector<uint8_t> image;
+
+    // Convolve and SmoothImage do the same work whatever the pixels, so only run on noise
+    printf("Sweep: Convolve, runtime float kernel per pixel\n");
+    for (auto const &size : SweepSizes)
+    {
+        GenerateNoise(&image, size.width, size.height);
+        for (int32_t const taps : { 3, 5, 7 })
+        {
+            std::vector<float> kernel(static_cast<size_t>(taps) * taps, 1.0f / (taps * taps));
+            int32_t const radius = taps / 2;
+            int64_t checksum = 0;
+            SweepTiming const timing = MeasureSweep([&]()
+            {
+                checksum = 0;
+                for (int32_t y = radius; y < size.height - radius; ++y)
+                {
+                    for (int32_t x = radius; x < size.width - radius; ++x)
+                    {
+                        checksum += Convolve(image.data(), size.width, x, y, kernel.data(), taps, taps);
+                    }
+                }
+            });
+
+            // Only pixels whose whole kernel is inside the image are convolved
+            double const pixels = static_cast<double>(size.width - 2 * radius) * (size.height - 2 * radius);
+            char label[32];
+            sprintf_s(label, "%dx%d", taps, taps);
+            char checksum_text[48];
+            sprintf_s(checksum_text, "(checksum %" PRId64 ")", checksum);
+            PrintSweepResult(label, size.width, size.height, pixels, "noise", 1, timing, checksum_text);
+        }
+    }
+
+    printf("Sweep: SmoothImage\n");
+    for (auto const &size : SweepSizes)
+    {
+        GenerateNoise(&image, size.width, size.height);
+        std::vector<uint8_t> scratch(image.size());
+        std::vector<uint8_t> smoothed(image.size());
+        for (uint32_t const taps : { 3u, 5u, 9u, 15u })
+        {
+            GaussianKernel kernel;
+            GenerateGaussian(taps / 6.0f, taps, &kernel);
+            for (uint32_t const num_threads : thread_counts)
+            {
+                ThreadPool pool;
+                pool.Initialize(num_threads);
+                SweepTiming const timing = MeasureSweep([&]()
+                {
+                    SmoothImage(image.data(), size.width, size.height, kernel, scratch.data(), smoothed.data(), &pool);
+                });
+
+                char label[32];
+                sprintf_s(label, "%u taps", taps);
+                PrintSweepResult(label, size.width, size.height, static_cast<double>(image.size()), "noise", num_threads, timing, "");
+            }
+        }
+    }
+
+    // Detection cost depends on how many candidates pass the early tests, so it runs on every content
+    printf("Sweep: HarrisDetect and FAST\n");
+    for (auto const &size : SweepSizes)
+    {
+        for (SweepContent const content : contents)
+        {
+            if (!GenerateSweepContent(content, size.width, size.height, &image))
+            {
+                printf("  skipping %s content, as [%s] isn't there\n", GetSweepContentName(content), SweepDatasetRoot);
+                continue;
+            }
+
+            for (uint32_t const num_threads : thread_counts)
+            {
+                ThreadPool pool;
+                pool.Initialize(num_threads);
+
+                HarrisDetector harris;
+                harris.SetThreadPool(&pool);
+                std::vector<HarrisFeature> harris_features;
+                SweepTiming const harris_timing = MeasureSweep([&]() { harris.Detect(image.data(), size.width, size.height, &harris_features); });
+                PrintSweepResult("Harris", size.width, size.height, static_cast<double>(image.size()), GetSweepContentName(content), num_threads, harris_timing, "");
+
+                FastDetector fast;
+                fast.SetThreadPool(&pool);
+                std::vector<FastFeature> fast_features;
+                SweepTiming const fast_timing = MeasureSweep([&]() { fast.Detect(image.data(), size.width, size.height, size.width, &fast_features); });
+                PrintSweepResult("FAST", size.width, size.height, static_cast<double>(image.size()), GetSweepContentName(content), num_threads, fast_timing, "");
+            }
+        }
+    }
+
+    // Distances from one descriptor to every one of a set, from cache resident to main memory sized sets
+    printf("Sweep: HammingDistance\n");
+    for (uint32_t const count : { 1024u, 65536u, 1048576u })
+    {
+        uint32_t state = 12345;
+        std::vector<BriefDescriptor> descriptors(count);
+        for (BriefDescriptor &descriptor : descriptors)
+        {
+            for (uint64_t &bits : descriptor.bits)
+            {
+                state = state * 1664525u + 1013904223u;
+                uint64_t const high = state;
+                state = state * 1664525u + 1013904223u;
+                bits = (high << 32) | state;
+            }
+        }
+
+        uint64_t checksum = 0;
+        SweepTiming const timing = MeasureSweep([&]()
+        {
+            BriefDescriptor const &query = descriptors[checksum % count];
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                checksum += HammingDistance(query, descriptors[i]);
+            }
+        });
+        printf("  %8u descriptors %10.3f ms %9.1f Mdistance/s %8.2f cycles/distance  (checksum %" PRIu64 ")\n",
+            count, timing.ms, count / (timing.ms * 1000.0), timing.cycles / count, checksum);
+    }
+}
+
+bool RunBenchmark(char const *name)
+{
+    bool const all = (0 == strcmp(name, "all"));
+    bool found = false;
+
+    if (all || 0 == strcmp(name, "convolve"))
+    {
+        BenchmarkConvolve();
+        found = true;
+    }
+
+    if (all || 0 == strcmp(name, "brief"))
+    {
+        BenchmarkBrief();
+        found = true;
+    }
+
+    if (all || 0 == strcmp(name, "fast"))
+    {
+        BenchmarkFast();
+        found = true;
+    }
+
+    if (all || 0 == strcmp(name, "match"))
+    {
+        BenchmarkMatch();
+        found = true;
+    }
+
+    if (all || 0 == strcmp(name, "pyramid"))
+    {
+        BenchmarkPyramid();
+        found = true;
+    }
+
+    if (all || 0 == strcmp(name, "undistort"))
+    {
+        BenchmarkUndistort();
+        found = true;
+    }
+
+    if (all || 0 == strcmp(name, "points"))
+    {
+        BenchmarkPoints();
+        found = true;
+    }
+
+    if (all || 0 == strcmp(name, "threads"))
+    {
+        BenchmarkThreads();
+        found = true;
+    }
+
+    // Takes a while, so only on its own
+    if (0 == strcmp(name, "sweep"))
+    {
+        BenchmarkSweep();
+        found = true;
+    }
+
+    return found;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Runs the named kernel benchmark and prints its timings. Returns false if there's no benchmark with that name
+bool RunBenchmark(char const *name);
@@ -0,0 +1,374 @@
+#include "Precomp.h"
+#include "BriefDescriptor.h"
+#include "FastCorners.h"
+#include "ImagePyramid.h"
+
+static float const Pi = 3.141592654f;
+
+// Number of point pairs, one per descriptor bit
+static int32_t const PatternSize = 256;
+
+// Strides whose offset tables are kept, enough for every level of any pyramid
+static size_t const MaxCachedStrides = 16;
+
+// Point pairs (x1, y1, x2, y2) compared by each bit. Drawn once from an isotropic Gaussian with sigma = 31 / 5
+// (BRIEF's G II sampling) with a fixed seed, and kept within radius 13 so every rotation stays inside the patch
+static int8_t const Pattern[PatternSize][4] =
+{
+    {  -3,   8,   2,   6 }, {  -1, -10,  -5,  10 }, {  -1,  -7,   0,  -7 }, {  -3,   4,   3,   4 },
+    {  -2,  -9,   1,  -9 }, {   1,  -3,   0, -10 }, {   5,  -8,   4,  -2 }, {   6,   3,   1,  -9 },
+    {   0,  -1,   2,  -9 }, { -11,   5,  -2,   4 }, {  -9,  -6,   0,   0 }, {   5,  -2,  -7,   1 },
+    {  -3,  -9,   1,   0 }, {  12,   4,   0,  10 }, {  -1,   8,   3,   1 }, { -11,  -6,  -1,  -1 },
+    {   1,  -8,  -8,  -8 }, {   5,  10,   0,  -1 }, {   1,  -9,   4,  -9 }, {   4,   1,  -5,   0 },
+    {  -8,   2,   0,  -7 }, {   0,   4,   5,  -2 }, {  11,  -1,   3,   7 }, {  -2,  -6,   9,   0 },
+    {   1,   1,  -5,   5 }, {  -7,   4, -10,   8 }, {   2,   9,  -4,   1 }, {  -9,   9,  -9,  -3 },
+    {   6,  -5,   7,  -2 }, {  -2,   0,   3,   6 }, {   3,  -8,   4,   4 }, {  -6,   8,  -3,  -3 },
+    {  -4,   1,   5,   3 }, {   0,  -4,   4,   2 }, {   4,   0,  -2,  -4 }, {  -2,  -3,   2,  -9 },
+    {   0,  -2,  -7,  -4 }, {  -1,   2,   2,  10 }, {  -3,   3,  -1,   1 }, {   9,  -4,  11,   2 },
+    {   0,   1,  -4,  -2 }, {  -4,  -1,   6,  -3 }, {  -7,  10,  -2,   4 }, {  -6,  -5,   4,  11 },
+    {   5,  -9,  -3,  -4 }, {   5,   8,  -1,  -7 }, {  -9,  -7,  -5,  -2 }, {   1,   6,  -6,  -3 },
+    {  -3,   9,  -2,   3 }, {   5,  -2,   8,   3 }, {  -1,   8,   0,   1 }, {  -7,   2,   0,   0 },
+    {  -2,  -8,   5,   5 }, {  -6,   1, -13,   0 }, {   4,  -2,   2,   4 }, {  -4,  -1,  -7,  -1 },
+    {  -2,  -1,   2,   7 }, {  -7,  -6,  10,   2 }, {  -4,   3,   2,   3 }, {   7,  -9,   0,   0 },
+    {   7,   9,  -6,  -8 }, {  -5,  -1,  -2,   0 }, {   0,  -6,  -7,  -6 }, {  10,   4,   1,   0 },
+    {   4,  -7,  -9,   0 }, {   0,   6,   1,   8 }, {  -5,  -6,   1,   9 }, {  -7,   0,  -4,   1 },
+    {  -9,   0,  -1,   2 }, {  -7,   1,  -2,   0 }, {   4,   2,  -1,  -3 }, {  -7,   1,   2,   1 },
+    {   7,   0,  -2,  -3 }, {  -4,   5,   2,  -4 }, {   4,  -4,  -1,  -2 }, {  -5,  -2,   3,   0 },
+    {   1,   6,   1,  -4 }, {   4,   5,  -4,   9 }, {  -2,   3,   2,  -3 }, {  -3,  -1,  -5,   1 },
+    {   6,   0,  -6,   1 }, {   8,   9, -13,   0 }, {  -1,  -1,   6,   1 }, {  -1,  -2,  -4,  -7 },
+    {   1,  10,   2,   3 }, {  -8,  -6,  -2,  -3 }, {  -7,  -6,  -9,   6 }, {  -1,  -5,   8,   9 },
+    {  -1,  -5,  -5,  -4 }, {   7,   7,  -4,  -3 }, {   1,  -2,   0,   0 }, {   5,   8,  -4,  -8 },
+    {   0,  -3, -10,   3 }, {  11,   0,  -8,  -6 }, {  -1,   3,  -2,  -5 }, {  -7,   7,   8,  -8 },
+    {   5,   0,  -1,   3 }, {   7,   7,  -2,   0 }, {   2, -11,   6,  -2 }, { -11,  -6,  -2,   6 },
+    {  -2, -10,   1,   4 }, {  -2,   4,  -4,  -4 }, {  -4,   0,   1,  -1 }, {  -6,   1,   3,   5 },
+    {  -6,   5,   0,  -1 }, {  11,   3,   1,   1 }, {   1,  -1,   4,  -4 }, {   0,   5,   1,  -1 },
+    {   2,   9,   3,  -9 }, {   2,  -7,   8,   8 }, {   2,   7,  -2,  -7 }, {   1,   0,  -6,  -2 },
+    {  -1,   2,   9,  -1 }, {  -7,   2,   0,  10 }, {   1,  -1,  -6,   1 }, {  -2,   3, -10,  -1 },
+    {   3,   2,   2,   0 }, {  -4,  -3,   0, -13 }, {   4,  -1,   9,  -1 }, {   5,  -2,  -3,  -4 },
+    {   2,  -2,  -1,  -7 }, {  -2,  -8,  -2,   4 }, {  -3,   4,   2,   4 }, {  -2,  -3,  -1,   1 },
+    {   2,   3, -10,  -7 }, {  -4,   5,   9,   7 }, {  -3,  -9,  -7,  -9 }, {  -7,   1,  -5,   8 },
+    {   1,  -2,  -1, -10 }, { -10,   8,  -2,   8 }, {  -8,  -8,   9,  -3 }, {   2,   4,   6,   0 },
+    {  -5,   3,   0,  -6 }, {  -4,   1,  -1,   5 }, {  -2,  -1,   5,  -9 }, {  -9,   0,   5,  -6 },
+    {   5,  10,  -2,   1 }, {  -1,   2,   6,   9 }, {  -7,  -7,  -4,  -2 }, {   6,   6,   3,   5 },
+    {   3,  -3,  -2,   6 }, {   8,  -1,   4,   3 }, {  -2,   3,  -5,  -8 }, { -10,   5, -10,   8 },
+    {   1,   8,   5,  -4 }, {  -2,   3,   2,   8 }, {   1,  11,   4,  -1 }, {  -5,  -3,  -5,   4 },
+    {  -3,   4,  -2, -11 }, {  -1,   0,  -1,  -6 }, {  -4,   6,  -3,   0 }, {  -3,   1,   7,   1 },
+    {   3,   1,   3,   4 }, {   3,  -1,   7,   5 }, {   2,  -2,   0,   9 }, {  -3,   4,  -2,  -1 },
+    {  11,   0,   4,  -5 }, {  -5,   1,  -4,   1 }, {  -5,   0,   0,  -9 }, {   0,  -5,   7,   0 },
+    {  -3,   3,   5,  -9 }, {   8,   0,  -3, -11 }, {   2,  -1,   4,   5 }, {   1,   9,   5,   3 },
+    {  -1,  -1,   4,  11 }, {   7,   0,  11,  -3 }, {  -7,  10,   9,  -7 }, {   9,  -1, -13,   0 },
+    {   8,  -5,   5,  -1 }, {  -3,  -7,   2,  11 }, {  -4,  -4,  -8,  -1 }, {  -5,   1,   4,  -2 },
+    {  -5,  -1,   5,  -5 }, { -10,   3,  -1,  -7 }, {   8,   4,  -2,   1 }, {   1,   1,  -8,   3 },
+    {  -3, -10,   3,   5 }, {  -4,   5,   2,   7 }, {   4,   1,  10,  -6 }, {   6,  -3,   2,  -4 },
+    {   2,  -6,   7,  -8 }, {   9,   2,   5,  -2 }, {   5,  -1,  -8,  -1 }, {   6,   9,  -9,  -1 },
+    {   4,   0,  -2,   1 }, {  -1,  -6,  -3,   4 }, {  -2,   0,   3,   3 }, {  -4,   4,   3,   6 },
+    {   2,  -4,   6,   5 }, {   4,  -2,   2,  10 }, {  -7,  -7,  -1,  -7 }, {   0,   4,  -5,  -5 },
+    {  -6,  -7,  11,   2 }, {   4,   4,   2,   2 }, {  -3,  -6,   5,  -2 }, {   7,  -5,   4,   1 },
+    {   2,   0,  -2,   0 }, {   3,  -4,  -4,   1 }, {  -2,   2,  -1,   3 }, {   3,   3,   3,  -1 },
+    {   1,   2,   5,   1 }, {   4,   6,  -3,  12 }, {  -9,  -3,  -7,  -4 }, {   1,   1,  -8,  -3 },
+    {  -2,   8,   3,   1 }, {  -3,  -5,   4,   8 }, { -10,   7,   1,   2 }, {  -2,   4,   1,   4 },
+    {  -7,  -3,   8,   4 }, {   6,  -9,  -2,  -1 }, {   0,  -7,   3,  -5 }, {  -1,   6,   5,  -3 },
+    {   0,   1,   7,   0 }, {  -5,  -5,   0,  -4 }, {   5,  -2,   6,  10 }, {  -8,  -8,   8,   7 },
+    {   4,  -8,  -1,   3 }, {  -8,   3,   2,  -5 }, {   5,  -2,   3,   9 }, {   2,   6,   4,   5 },
+    {  -8,  -1,  -1,   2 }, {   3,   0,   3,  -4 }, {   2,  -7,  -5,   5 }, {  -7,  -6,  -2,   3 },
+    {  -3,   1,  -1,  -2 }, {  -3,  -3,   2,   2 }, {   1,  -4,  -5,   0 }, {   5,   3,   7,  -6 },
+    {   0,   5, -12,  -4 }, {   7,   2,  12,  -2 }, {   5,   4,   5,  -2 }, {  -1,   3,   1,   5 },
+    {  -3,  -6,  -1,   7 }, {   0,  -9,  -6,   9 }, {   3,   9,  -4,  -7 }, {   6,  -4,  -3,   5 },
+    {   4,   5,   6,   1 }, {  -6,   8,  -2,   1 }, { -11,   1,   6,  -5 }, {   8,  -3,   2,  11 },
+    {   5,   7,  -5,   8 }, {   4,  -8,   7,  -1 }, {   9,  -4,  -2,   0 }, {   8,  -3,  -4,   0 },
+    {  -5,  -6,   5,   3 }, {   3,  -3,   9,   9 }, {  -1,  -1,   7,   1 }, {  -3,   2,  -3,  -9 },
+    {  -2,   4,   4,  -5 }, {   5,   0,   4,  -3 }, {   7,  -7,  -4,  -8 }, {   9,   2,   1,  11 },
+    {   8,   1,   0,  -2 }, {  -1,  -3,   0,   5 }, {  -3,  -9,   3,  11 }, {   2,  -1,   5,   3 },
+};
+
+// Half width of row dy of the circular patch
+static inline int32_t PatchHalfWidth(int32_t const dy)
+{
+    int32_t half_width = BriefPatchRadius;
+    while (half_width * half_width + dy * dy > BriefPatchRadius * BriefPatchRadius)
+    {
+        --half_width;
+    }
+    return half_width;
+}
+
+static inline int32_t AngleToBin(float const angle)
+{
+    int32_t const bin = static_cast<int32_t>(floorf(angle * BriefAngleBins / (2.0f * Pi) + 0.5f));
+    return (bin % BriefAngleBins + BriefAngleBins) % BriefAngleBins;
+}
+
+static void RotatePattern(int32_t const bin, int8_t *out_pattern)
+{
+    float const angle = bin * 2.0f * Pi / BriefAngleBins;
+    float const c = cosf(angle);
+    float const s = sinf(angle);
+    for (int32_t i = 0; i < PatternSize; ++i)
+    {
+        for (int32_t point = 0; point < 2; ++point)
+        {
+            float const x = Pattern[i][2 * point + 0];
+            float const y = Pattern[i][2 * point + 1];
+            out_pattern[4 * i + 2 * point + 0] = static_cast<int8_t>(lroundf(c * x - s * y));
+            out_pattern[4 * i + 2 * point + 1] = static_cast<int8_t>(lroundf(s * x + c * y));
+        }
+    }
+}
+
+BriefExtractor::BriefExtractor()
+{
+    rotated_pattern_.resize(BriefAngleBins * PatternSize * 4);
+    for (int32_t bin = 0; bin < BriefAngleBins; ++bin)
+    {
+        RotatePattern(bin, &rotated_pattern_[bin * PatternSize * 4]);
+    }
+}
+
+int32_t const *BriefExtractor::GetOffsetTables(int32_t const stride)
+{
+    for (OffsetTables const &tables : offset_tables_)
+    {
+        if (stride == tables.stride)
+        {
+            return tables.offsets.data();
+        }
+    }
+
+    // Only grows past a pyramid's levels when image sizes keep changing, in which case start over
+    if (offset_tables_.size() >= MaxCachedStrides)
+    {
+        offset_tables_.clear();
+    }
+
+    offset_tables_.emplace_back();
+    OffsetTables &tables = offset_tables_.back();
+    tables.stride = stride;
+    tables.offsets.resize(BriefAngleBins * PatternSize * 2);
+    for (int32_t bin = 0; bin < BriefAngleBins; ++bin)
+    {
+        int8_t const *pattern = &rotated_pattern_[bin * PatternSize * 4];
+        int32_t *first = &tables.offsets[bin * PatternSize * 2];
+        int32_t *second = first + PatternSize;
+        for (int32_t i = 0; i < PatternSize; ++i)
+        {
+            first[i] = pattern[4 * i + 1] * stride + pattern[4 * i + 0];
+            second[i] = pattern[4 * i + 3] * stride + pattern[4 * i + 2];
+        }
+    }
+    return tables.offsets.data();
+}
+
+//
+// Intensity centroid moments of the circular patch around center:
+// m10 = sum(dx * I), m01 = sum(dy * I)
+//
+#ifdef __AVX2__
+// Per patch row, 32 bytes of dx weights for columns [-15, 16] (0 outside the circle), then 32 bytes that are 1 inside it
+struct MomentWeights
+{
+    int8_t values[2 * BriefPatchRadius + 1][64];
+};
+
+static MomentWeights GenerateMomentWeights()
+{
+    MomentWeights weights{};
+    for (int32_t dy = -BriefPatchRadius; dy <= BriefPatchRadius; ++dy)
+    {
+        int32_t const half_width = PatchHalfWidth(dy);
+        for (int32_t dx = -half_width; dx <= half_width; ++dx)
+        {
+            weights.values[dy + BriefPatchRadius][dx + BriefPatchRadius] = static_cast<int8_t>(dx);
+            weights.values[dy + BriefPatchRadius][32 + dx + BriefPatchRadius] = 1;
+        }
+    }
+    return weights;
+}
+#endif
+
+static inline void ComputeMoments(uint8_t const *center, int32_t const stride, int32_t *out_m10, int32_t *out_m01)
+{
+#ifdef __AVX2__
+    static MomentWeights const weights = GenerateMomentWeights();
+
+    // maddubs multiplies the pixels by the weights & adds pairs, and madd adds pairs again into 32 bits
+    __m256i const ones = _mm256_set1_epi16(1);
+    __m256i sum_x = _mm256_setzero_si256();
+    __m256i sum_y = _mm256_setzero_si256();
+    for (int32_t dy = -BriefPatchRadius; dy <= BriefPatchRadius; ++dy)
+    {
+        int8_t const *row_weights = weights.values[dy + BriefPatchRadius];
+        __m256i const pixels = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(center + dy * stride - BriefPatchRadius));
+        __m256i const dx_weights = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(row_weights));
+        __m256i const inside = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(row_weights + 32));
+        sum_x = _mm256_add_epi32(sum_x, _mm256_madd_epi16(_mm256_maddubs_epi16(pixels, dx_weights), ones));
+        sum_y = _mm256_add_epi32(sum_y, _mm256_madd_epi16(_mm256_maddubs_epi16(pixels, inside), _mm256_set1_epi16(static_cast<int16_t>(dy))));
+    }
+
+    // Horizontal sums of both at once
+    __m256i sums = _mm256_hadd_epi32(sum_x, sum_y);
+    sums = _mm256_hadd_epi32(sums, sums);
+    __m128i const total = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    *out_m10 = _mm_cvtsi128_si32(total);
+    *out_m01 = _mm_extract_epi32(total, 1);
+#else
+    int32_t m10 = 0;
+    int32_t m01 = 0;
+    for (int32_t dy = -BriefPatchRadius; dy <= BriefPatchRadius; ++dy)
+    {
+        uint8_t const *row = center + dy * stride;
+        int32_t const half_width = PatchHalfWidth(dy);
+        int32_t row_sum = 0;
+        for (int32_t dx = -half_width; dx <= half_width; ++dx)
+        {
+            m10 += dx * row[dx];
+            row_sum += row[dx];
+        }
+        m01 += dy * row_sum;
+    }
+    *out_m10 = m10;
+    *out_m01 = m01;
+#endif
+}
+
+// Bit i is set when the first point of pair i is darker than the second
+static inline void SampleDescriptor(uint8_t const *center, int32_t const *first, int32_t const *second, BriefDescriptor *out_descriptor)
+{
+#ifdef __AVX2__
+    // Gathers read 4 bytes at each offset. The pattern stays within radius 13, so that's still inside the patch
+    __m256i const low_byte = _mm256_set1_epi32(0xFF);
+    int const *base = reinterpret_cast<int const *>(center);
+    for (int32_t word = 0; word < 4; ++word)
+    {
+        uint64_t bits = 0;
+        for (int32_t i = 0; i < 64; i += 8)
+        {
+            __m256i const a_offsets = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(first + word * 64 + i));
+            __m256i const b_offsets = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(second + word * 64 + i));
+            __m256i const a = _mm256_and_si256(_mm256_i32gather_epi32(base, a_offsets, 1), low_byte);
+            __m256i const b = _mm256_and_si256(_mm256_i32gather_epi32(base, b_offsets, 1), low_byte);
+            uint32_t const darker = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a))));
+            bits |= static_cast<uint64_t>(darker) << i;
+        }
+        out_descriptor->bits[word] = bits;
+    }
+#else
+    for (int32_t word = 0; word < 4; ++word)
+    {
+        uint64_t bits = 0;
+        for (int32_t i = 0; i < 64; ++i)
+        {
+            bits |= static_cast<uint64_t>(center[first[word * 64 + i]] < center[second[word * 64 + i]]) << i;
+        }
+        out_descriptor->bits[word] = bits;
+    }
+#endif
+}
+
+void BriefExtractor::ComputeBatch(uint8_t const *image, int32_t const stride, BriefFeature *features, uint32_t const count)
+{
+    int32_t const *offset_tables = GetOffsetTables(stride);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        int32_t m10 = 0;
+        int32_t m01 = 0;
+        ComputeMoments(image + features[i].y * stride + features[i].x, stride, &m10, &m01);
+        features[i].angle = atan2f(static_cast<float>(m01), static_cast<float>(m10));
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        int32_t const *first = &offset_tables[AngleToBin(features[i].angle) * PatternSize * 2];
+        SampleDescriptor(image + features[i].y * stride + features[i].x, first, first + PatternSize, &features[i].descriptor);
+    }
+}
+
+static inline bool HasFullPatch(int32_t const x, int32_t const y, int32_t const width, int32_t const height)
+{
+    return x >= BriefBorder && x < width - BriefBorder && y >= BriefBorder && y < height - BriefBorder;
+}
+
+void BriefExtractor::Compute(uint8_t const *image, int32_t const width, int32_t const height, FastFeature const *features, uint32_t const count, std::vector<BriefFeature> *out_features)
+{
+    TRACE_SCOPE("BriefExtractor::Compute");
+    size_t const first = out_features->size();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (HasFullPatch(features[i].x, features[i].y, width, height))
+        {
+            BriefFeature feature{};
+            feature.x = features[i].x;
+            feature.y = features[i].y;
+            feature.scale = 1.0f;
+            feature.index = i;
+            out_features->push_back(feature);
+        }
+    }
+
+    if (out_features->size() > first)
+    {
+        ComputeBatch(image, width, &(*out_features)[first], static_cast<uint32_t>(out_features->size() - first));
+    }
+}
+
+void BriefExtractor::Compute(ImagePyramid const &pyramid, PyramidFeature const *features, uint32_t const count, std::vector<BriefFeature> *out_features)
+{
+    TRACE_SCOPE("BriefExtractor::Compute pyramid");
+    for (uint32_t level_index = 0; level_index < pyramid.GetLevelCount(); ++level_index)
+    {
+        ImagePyramid::Level const &level = pyramid.GetLevel(level_index);
+
+        size_t const first = out_features->size();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (features[i].level == static_cast<int32_t>(level_index) && HasFullPatch(features[i].x, features[i].y, level.width, level.height))
+            {
+                BriefFeature feature{};
+                feature.x = features[i].x;
+                feature.y = features[i].y;
+                feature.level = features[i].level;
+                feature.scale = level.scale;
+                feature.index = i;
+                out_features->push_back(feature);
+            }
+        }
+
+        if (out_features->size() > first)
+        {
+            ComputeBatch(level.smoothed, level.width, &(*out_features)[first], static_cast<uint32_t>(out_features->size() - first));
+        }
+    }
+}
+
+void ComputeBriefReference(uint8_t const *image, int32_t const width, int32_t const x, int32_t const y, float *out_angle, BriefDescriptor *out_descriptor)
+{
+    int32_t m10 = 0;
+    int32_t m01 = 0;
+    for (int32_t dy = -BriefPatchRadius; dy <= BriefPatchRadius; ++dy)
+    {
+        for (int32_t dx = -BriefPatchRadius; dx <= BriefPatchRadius; ++dx)
+        {
+            if (dx * dx + dy * dy <= BriefPatchRadius * BriefPatchRadius)
+            {
+                int32_t const value = image[(y + dy) * width + (x + dx)];
+                m10 += dx * value;
+                m01 += dy * value;
+            }
+        }
+    }
+    *out_angle = atan2f(static_cast<float>(m01), static_cast<float>(m10));
+
+    int8_t pattern[PatternSize * 4];
+    RotatePattern(AngleToBin(*out_angle), pattern);
+
+    memset(out_descriptor, 0, sizeof(*out_descriptor));
+    for (int32_t i = 0; i < PatternSize; ++i)
+    {
+        uint8_t const a = image[(y + pattern[4 * i + 1]) * width + (x + pattern[4 * i + 0])];
+        uint8_t const b = image[(y + pattern[4 * i + 3]) * width + (x + pattern[4 * i + 2])];
+        if (a < b)
+        {
+            out_descriptor->bits[i / 64] |= 1ull << (i % 64);
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+struct FastFeature;
+struct PyramidFeature;
+class ImagePyramid;
+
+// 256 binary intensity comparisons
+struct BriefDescriptor
+{
+    uint64_t bits[4];
+};
+
+static inline uint32_t HammingDistance(BriefDescriptor const &a, BriefDescriptor const &b)
+{
+    return static_cast<uint32_t>(
+        _mm_popcnt_u64(a.bits[0] ^ b.bits[0]) + _mm_popcnt_u64(a.bits[1] ^ b.bits[1]) +
+        _mm_popcnt_u64(a.bits[2] ^ b.bits[2]) + _mm_popcnt_u64(a.bits[3] ^ b.bits[3]));
+}
+
+struct BriefFeature
+{
+    int32_t         x, y;       // position in its level
+    int32_t         level;      // pyramid level, 0 without a pyramid
+    float           scale;      // of the level. Level 0 position is (x + 0.5) * scale - 0.5
+    uint32_t        index;      // of the feature it was computed for
+    float           angle;      // orientation by intensity centroid, in radians
+    BriefDescriptor descriptor;
+};
+
+// Radius of the circular patch the orientation is measured over
+static int32_t const BriefPatchRadius = 15;
+
+// Features closer than this to any edge have no full patch, and get no descriptor
+static int32_t const BriefBorder = BriefPatchRadius + 1;
+
+// Number of orientations the pattern is pre-rotated to
+static int32_t const BriefAngleBins = 30;
+
+//
+// Rotated BRIEF descriptor extractor
+//
+// The sampling pattern is a fixed table, so descriptors are the same from run to run. Each feature's orientation
+// is the direction of the intensity centroid of its patch, quantized to BriefAngleBins. The pattern is
+// pre-rotated to every bin and turned into pixel offset tables, so sampling a feature is 512 table-driven
+// loads, done 8 at a time with AVX2 gathers.
+//
+// Features are processed in batches: all orientations first, then all descriptors.
+// Sample from a smoothed image, as single pixel comparisons are very sensitive to noise.
+//
+class BriefExtractor : private NonCopyable
+{
+public:
+    BriefExtractor();
+
+    // Appends a descriptor for each of features that is far enough from the border to out_features.
+    // BriefFeature::index is the position of the feature in features
+    void Compute(uint8_t const *image, int32_t const width, int32_t const height, FastFeature const *features, uint32_t const count, std::vector<BriefFeature> *out_features);
+
+    // Same, for features detected on a pyramid. Each one is sampled from the smoothed pixels of its level
+    void Compute(ImagePyramid const &pyramid, PyramidFeature const *features, uint32_t const count, std::vector<BriefFeature> *out_features);
+
+private:
+    // Computes angle & descriptor of features that already have x, y & level set
+    void ComputeBatch(uint8_t const *image, int32_t const stride, BriefFeature *features, uint32_t const count);
+
+    // Offsets from the center pixel of every point of every rotated pattern, for images of stride: the 256 first
+    // points, then the 256 second, per angle bin. Built on first use for each stride, such as each pyramid level's
+    int32_t const *GetOffsetTables(int32_t const stride);
+
+private:
+    struct OffsetTables
+    {
+        int32_t              stride;
+        std::vector<int32_t> offsets;
+    };
+
+private:
+    // Pattern rotated to every angle bin, as x1, y1, x2, y2 per comparison
+    std::vector<int8_t>        rotated_pattern_;
+    std::vector<OffsetTables>  offset_tables_;  // per stride seen
+};
+
+// Scalar reference implementation for a single feature, which must be at least BriefBorder from every edge.
+// Produces the same angle & descriptor as BriefExtractor, and is only meant for validating it
+void ComputeBriefReference(uint8_t const *image, int32_t const width, int32_t const x, int32_t const y, float *out_angle, BriefDescriptor *out_descriptor);
@@ -0,0 +1,131 @@
+#include "Precomp.h"
+#include "BufferPool.h"
+
+// State that released buffers need, kept alive by every block until the last one is gone
+struct BufferPoolShared
+{
+    std::mutex                 lock;
+    std::vector<PooledBlock *> free_blocks; // reserved for every allocated block, so releasing never allocates
+    uint32_t                   allocated_count = 0;
+    bool                       closed = false;  // the pool is gone, and released blocks are freed
+};
+
+static void ReleaseBlock(PooledBlock *block)
+{
+    BufferPoolShared *shared = block->shared.get();
+    {
+        std::lock_guard<std::mutex> lock(shared->lock);
+        if (!shared->closed)
+        {
+            shared->free_blocks.push_back(block);
+            return;
+        }
+    }
+
+    // May free shared too, when this was the last block
+    delete block;
+}
+
+ImageBuffer &ImageBuffer::operator=(ImageBuffer const &other)
+{
+    if (block_ != other.block_)
+    {
+        Reset();
+        block_ = other.block_;
+        AddReference();
+    }
+    return *this;
+}
+
+ImageBuffer &ImageBuffer::operator=(ImageBuffer &&other)
+{
+    if (this != &other)
+    {
+        Reset();
+        block_ = other.block_;
+        other.block_ = nullptr;
+    }
+    return *this;
+}
+
+void ImageBuffer::Reset()
+{
+    if (block_)
+    {
+        if (1 == block_->references.fetch_sub(1, std::memory_order_acq_rel))
+        {
+            ReleaseBlock(block_);
+        }
+        block_ = nullptr;
+    }
+}
+
+BufferPool::BufferPool()
+    : shared_(std::make_shared<BufferPoolShared>())
+{
+}
+
+BufferPool::~BufferPool()
+{
+    std::vector<PooledBlock *> free_blocks;
+    {
+        std::lock_guard<std::mutex> lock(shared_->lock);
+        shared_->closed = true;
+        std::swap(free_blocks, shared_->free_blocks);
+    }
+
+    for (PooledBlock *block : free_blocks)
+    {
+        delete block;
+    }
+}
+
+ImageBuffer BufferPool::Acquire(size_t const size)
+{
+    PooledBlock *block = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(shared_->lock);
+        std::vector<PooledBlock *> &free_blocks = shared_->free_blocks;
+
+        size_t best = free_blocks.size();
+        for (size_t i = 0; i < free_blocks.size(); ++i)
+        {
+            if (free_blocks[i]->capacity >= size && (best == free_blocks.size() || free_blocks[i]->capacity < free_blocks[best]->capacity))
+            {
+                best = i;
+            }
+        }
+
+        if (best < free_blocks.size())
+        {
+            block = free_blocks[best];
+            free_blocks[best] = free_blocks.back();
+            free_blocks.pop_back();
+        }
+        else
+        {
+            ++shared_->allocated_count;
+            free_blocks.reserve(shared_->allocated_count);
+        }
+    }
+
+    if (!block)
+    {
+        block = new PooledBlock;
+        block->capacity = (std::max(size, static_cast<size_t>(1)) + BufferAlignment - 1) & ~(BufferAlignment - 1);
+        block->storage.reset(new uint8_t[block->capacity + BufferAlignment]);
+        uintptr_t const address = reinterpret_cast<uintptr_t>(block->storage.get());
+        block->data = block->storage.get() + ((BufferAlignment - address % BufferAlignment) % BufferAlignment);
+        block->shared = shared_;
+    }
+
+    block->size = size;
+    block->references.store(1, std::memory_order_relaxed);
+    return ImageBuffer(block);
+}
+
+uint32_t BufferPool::GetAllocatedCount() const
+{
+    std::lock_guard<std::mutex> lock(shared_->lock);
+    return shared_->allocated_count;
+}
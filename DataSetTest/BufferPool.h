@@ -0,0 +1,78 @@
+#pragma once
+
+// Alignment of every pooled buffer, enough for any SIMD load
+static size_t const BufferAlignment = 64;
+
+class BufferPool;
+struct BufferPoolShared;
+
+// Storage of one pooled buffer
+struct PooledBlock
+{
+    std::atomic<uint32_t>      references{ 0 };
+    size_t                     size = 0;       // requested by the current owner
+    size_t                     capacity = 0;
+    uint8_t                   *data = nullptr; // BufferAlignment aligned, inside storage
+    std::unique_ptr<uint8_t[]> storage;
+    std::shared_ptr<BufferPoolShared> shared;
+};
+
+//
+// Counted reference to a pooled buffer
+//
+// Copies share the buffer, and it goes back to its pool when the last reference goes away, on whichever thread
+// that happens. Buffers may outlive their pool, in which case they are freed instead.
+//
+class ImageBuffer
+{
+public:
+    ImageBuffer() = default;
+    ImageBuffer(ImageBuffer const &other) : block_(other.block_) { AddReference(); }
+    ImageBuffer(ImageBuffer &&other) : block_(other.block_) { other.block_ = nullptr; }
+    ~ImageBuffer() { Reset(); }
+
+    ImageBuffer &operator=(ImageBuffer const &other);
+    ImageBuffer &operator=(ImageBuffer &&other);
+
+    // Drops this reference
+    void Reset();
+
+    uint8_t *GetData() const { return block_ ? block_->data : nullptr; }
+    size_t GetSize() const { return block_ ? block_->size : 0; }
+
+    // Whether other references to the same buffer exist. Only write to buffers that aren't shared
+    bool IsShared() const { return block_ && block_->references.load(std::memory_order_acquire) > 1; }
+
+    explicit operator bool() const { return nullptr != block_; }
+
+private:
+    friend class BufferPool;
+    explicit ImageBuffer(PooledBlock *block) : block_(block) {}
+
+    void AddReference() { if (block_) { block_->references.fetch_add(1, std::memory_order_relaxed); } }
+
+private:
+    PooledBlock *block_ = nullptr;
+};
+
+//
+// Pool of aligned buffers
+//
+// Acquire reuses the smallest released buffer that is large enough, and only allocates when there is none, so
+// a steady stream of same-sized frames stops allocating once enough buffers are in flight. Thread safe.
+//
+class BufferPool : private NonCopyable
+{
+public:
+    BufferPool();
+    ~BufferPool();
+
+    // Buffer of size bytes, with a single reference. Its contents are undefined
+    ImageBuffer Acquire(size_t const size);
+
+    // Buffers allocated so far, in use or not
+    uint32_t GetAllocatedCount() const;
+
+private:
+    std::shared_ptr<BufferPoolShared> shared_;
+};
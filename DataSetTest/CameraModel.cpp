@@ -0,0 +1,48 @@
+#include "Precomp.h"
+#include "CameraModel.h"
+#include "MappedFile.h"
+#include "TextReader.h"
+
+bool LoadCameraModel(char const *path, CameraModel *out_model)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        return false;
+    }
+
+    char const *text = reinterpret_cast<char const *>(file.GetData());
+    TextReader reader(text, text + file.GetSize());
+
+    CameraModel model;
+    if (!reader.NextLine() ||
+        !reader.ReadFloat(&model.fx) || !reader.ReadFloat(&model.fy) || !reader.ReadFloat(&model.cx) || !reader.ReadFloat(&model.cy) ||
+        !reader.ReadFloat(&model.k1) || !reader.ReadFloat(&model.k2) || !reader.ReadFloat(&model.p1) || !reader.ReadFloat(&model.p2) ||
+        !reader.ReadFloat(&model.k3) || !reader.AtLineEnd())
+    {
+        LOGE("[%s] isn't a calibration of fx fy cx cy k1 k2 p1 p2 k3", path);
+        return false;
+    }
+
+    if (!(model.fx > 0.0f) || !(model.fy > 0.0f))
+    {
+        LOGE("[%s] has invalid focal lengths", path);
+        return false;
+    }
+
+    *out_model = model;
+    LOGD("Loaded calibration from [%s]: f = (%.2f, %.2f), c = (%.2f, %.2f), k = (%g, %g, %g), p = (%g, %g)", path,
+        model.fx, model.fy, model.cx, model.cy, model.k1, model.k2, model.k3, model.p1, model.p2);
+    return true;
+}
+
+void DistortPoint(CameraModel const &model, double const x, double const y, double *out_u, double *out_v)
+{
+    double const r2 = x * x + y * y;
+    double const radial = 1.0 + r2 * (model.k1 + r2 * (model.k2 + r2 * model.k3));
+    double const xd = x * radial + 2.0 * model.p1 * x * y + model.p2 * (r2 + 2.0 * x * x);
+    double const yd = y * radial + model.p1 * (r2 + 2.0 * y * y) + 2.0 * model.p2 * x * y;
+
+    *out_u = model.fx * xd + model.cx;
+    *out_v = model.fy * yd + model.cy;
+}
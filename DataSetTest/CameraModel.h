@@ -0,0 +1,28 @@
+#pragma once
+
+//
+// Pinhole camera with radial-tangential (Brown-Conrady) distortion, as calibrated in calib.txt
+//
+// A point (x, y) in normalized coordinates, at r^2 = x^2 + y^2 from the optical axis, is seen at
+//   x_d = x (1 + k1 r^2 + k2 r^4 + k3 r^6) + 2 p1 x y + p2 (r^2 + 2 x^2)
+//   y_d = y (1 + k1 r^2 + k2 r^4 + k3 r^6) + p1 (r^2 + 2 y^2) + 2 p2 x y
+// which lands on pixel (fx x_d + cx, fy y_d + cy).
+//
+struct CameraModel
+{
+    float fx = 0.0f;
+    float fy = 0.0f;
+    float cx = 0.0f;
+    float cy = 0.0f;
+    float k1 = 0.0f;
+    float k2 = 0.0f;
+    float p1 = 0.0f;
+    float p2 = 0.0f;
+    float k3 = 0.0f;
+};
+
+// Reads a calib.txt holding the single line "fx fy cx cy k1 k2 p1 p2 k3"
+bool LoadCameraModel(char const *path, CameraModel *out_model);
+
+// Distorted pixel position of the normalized point (x, y). In double precision, for building tables
+void DistortPoint(CameraModel const &model, double const x, double const y, double *out_u, double *out_v);
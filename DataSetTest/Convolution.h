@@ -0,0 +1,70 @@
+#pragma once
+
+//
+// Compile-time specialized convolution
+//
+// Operators with known coefficients are described by FixedOperator, and Convolve<Operator> expands
+// into one multiply-add per tap with the coefficient as an immediate, so zero taps disappear and the
+// whole operator is straight-line integer code. Convolve<Rows, Columns> keeps the coefficients at
+// runtime but fixes the size, which is still enough for the compiler to fully unroll it.
+//
+// The runtime-sized Convolve in Utilities.h remains the fallback for everything else.
+//
+
+template <int32_t RowCount, int32_t ColumnCount, int32_t... Coefficients>
+struct FixedOperator
+{
+    static int32_t const Rows = RowCount;
+    static int32_t const Columns = ColumnCount;
+
+    static_assert(sizeof...(Coefficients) == RowCount * ColumnCount, "coefficient count doesn't match operator size");
+};
+
+using SobelX = FixedOperator<3, 3,
+    -1, 0, 1,
+    -2, 0, 2,
+    -1, 0, 1>;
+
+using SobelY = FixedOperator<3, 3,
+    -1, -2, -1,
+     0,  0,  0,
+     1,  2,  1>;
+
+// Offset of a tap from the center of the operator, in pixels
+template <int32_t Rows, int32_t Columns>
+constexpr int32_t TapOffset(int32_t const index, int32_t const stride)
+{
+    return (index / Columns - Rows / 2) * stride + (index % Columns - Columns / 2);
+}
+
+template <int32_t Rows, int32_t Columns, int32_t... Coefficients, int32_t... Indices>
+inline int32_t ConvolveTaps(FixedOperator<Rows, Columns, Coefficients...>, std::integer_sequence<int32_t, Indices...>, uint8_t const *center, int32_t const stride)
+{
+    int32_t const terms[] = { (Coefficients * center[TapOffset<Rows, Columns>(Indices, stride)])... };
+    int32_t accum = 0;
+    for (int32_t const term : terms)
+    {
+        accum += term;
+    }
+    return accum;
+}
+
+// Applies a FixedOperator centered on (x, y)
+template <typename Operator>
+inline int32_t Convolve(uint8_t const *input, int32_t const stride, int32_t const x, int32_t const y)
+{
+    return ConvolveTaps(Operator(), std::make_integer_sequence<int32_t, Operator::Rows * Operator::Columns>(), input + y * stride + x, stride);
+}
+
+// Applies a Rows x Columns integer kernel centered on (x, y)
+template <int32_t Rows, int32_t Columns>
+inline int32_t Convolve(uint8_t const *input, int32_t const stride, int32_t const x, int32_t const y, int32_t const (&kernel)[Rows * Columns])
+{
+    uint8_t const *center = input + y * stride + x;
+    int32_t accum = 0;
+    for (int32_t i = 0; i < Rows * Columns; ++i)
+    {
+        accum += kernel[i] * center[TapOffset<Rows, Columns>(i, stride)];
+    }
+    return accum;
+}
@@ -0,0 +1,259 @@
+#include "Precomp.h"
+#include "DatasetBenchmark.h"
+#include "BriefDescriptor.h"
+#include "DescriptorMatcher.h"
+#include "FastCorners.h"
+#include "HarrisCorners.h"
+#include "PlaybackFrameProvider.h"
+#include "PngDecoder.h"
+#include "ThreadPool.h"
+#include "ToolSupport.h"
+#include "Utilities.h"
+
+static double GetElapsedMs(std::chrono::steady_clock::time_point const start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ComputeLatencyStats(std::vector<double> *inout_samples_ms, LatencyStats *out_stats)
+{
+    *out_stats = LatencyStats();
+    std::vector<double> &samples = *inout_samples_ms;
+    if (samples.empty())
+    {
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t const count = samples.size();
+    auto const percentile = [&](double const p)
+    {
+        size_t const rank = static_cast<size_t>(ceil(p * count));
+        return samples[std::min(std::max(rank, static_cast<size_t>(1)), count) - 1];
+    };
+
+    double sum = 0.0;
+    for (double const sample : samples)
+    {
+        sum += sample;
+    }
+
+    out_stats->min_ms = samples.front();
+    out_stats->p50_ms = percentile(0.5);
+    out_stats->p99_ms = percentile(0.99);
+    out_stats->max_ms = samples.back();
+    out_stats->mean_ms = sum / count;
+}
+
+char const *GetDatasetStageName(DatasetStage const stage)
+{
+    switch (stage)
+    {
+    case DatasetStage::Decode:   return "decode";
+    case DatasetStage::Smooth:   return "smooth";
+    case DatasetStage::Harris:   return "harris";
+    case DatasetStage::Fast:     return "fast";
+    case DatasetStage::Describe: return "describe";
+    case DatasetStage::Match:    return "match";
+    default:                     return "unknown";
+    }
+}
+
+bool RunDatasetBenchmark(DatasetBenchmarkParams const &params, DatasetBenchmarkReport *out_report)
+{
+    *out_report = DatasetBenchmarkReport();
+
+    std::vector<DatasetImage> images;
+    if (!ReadImageList(params.data_root, &images))
+    {
+        return false;
+    }
+
+    ThreadPool pool;
+    if (!pool.Initialize(params.num_threads))
+    {
+        LOGE("Failed to initialize thread pool");
+        return false;
+    }
+
+    // The same detector setup the app uses, with matching set up as when tracking
+    HarrisDetector harris;
+    harris.SetThreadPool(&pool);
+    FastDetector fast;
+    fast.SetThreadPool(&pool);
+    BriefExtractor brief;
+    DescriptorMatcher matcher;
+    matcher.SetThreadPool(&pool);
+    MatcherParams matcher_params;
+    matcher_params.mode = MatchMode::Grid;
+    matcher_params.max_distance = 50;
+    matcher_params.search_radius = 16.0f;
+    matcher.SetParams(matcher_params);
+
+    GaussianKernel smooth_kernel;
+    GenerateGaussian(0.5f, 9, &smooth_kernel);
+
+    PngDecoder decoder;
+    BufferPool image_pool;
+    ImageBuffer pixels;
+    std::vector<uint8_t> scratch;
+    std::vector<uint8_t> smoothed;
+    std::vector<HarrisFeature> harris_features;
+    std::vector<FastFeature> corners;
+    std::vector<BriefFeature> described;
+    std::vector<BriefFeature> previous_described;
+    std::vector<DescriptorMatch> matches;
+
+    uint32_t const stage_count = static_cast<uint32_t>(DatasetStage::Count);
+    std::vector<double> stage_samples[stage_count];
+    std::vector<double> total_samples;
+    uint64_t harris_count = 0;
+    uint64_t fast_count = 0;
+    uint64_t described_count = 0;
+    uint64_t match_count = 0;
+
+    uint32_t const measured_frames = params.max_frames > 0 ? params.max_frames : static_cast<uint32_t>(images.size());
+    uint32_t const total_frames = params.warmup_frames + measured_frames;
+    for (uint32_t frame = 0; frame < total_frames; ++frame)
+    {
+        TRACE_SCOPE("frame");
+        double times[stage_count];
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        char const *path = images[frame % images.size()].file_path.c_str();
+        if (!decoder.Decode(path, &image_pool, &width, &height, &pixels))
+        {
+            return false;
+        }
+        times[static_cast<uint32_t>(DatasetStage::Decode)] = GetElapsedMs(start);
+
+        int32_t const w = static_cast<int32_t>(width);
+        int32_t const h = static_cast<int32_t>(height);
+        size_t const size = static_cast<size_t>(width) * height;
+        scratch.resize(size);
+        smoothed.resize(size);
+
+        start = std::chrono::steady_clock::now();
+        SmoothImage(pixels.GetData(), w, h, smooth_kernel, scratch.data(), smoothed.data(), &pool);
+        times[static_cast<uint32_t>(DatasetStage::Smooth)] = GetElapsedMs(start);
+
+        start = std::chrono::steady_clock::now();
+        harris.Detect(smoothed.data(), w, h, &harris_features);
+        times[static_cast<uint32_t>(DatasetStage::Harris)] = GetElapsedMs(start);
+
+        start = std::chrono::steady_clock::now();
+        fast.Detect(pixels.GetData(), w, h, w, &corners);
+        times[static_cast<uint32_t>(DatasetStage::Fast)] = GetElapsedMs(start);
+
+        start = std::chrono::steady_clock::now();
+        described.clear();
+        brief.Compute(smoothed.data(), w, h, corners.data(), static_cast<uint32_t>(corners.size()), &described);
+        times[static_cast<uint32_t>(DatasetStage::Describe)] = GetElapsedMs(start);
+
+        // Indexing the previous frame is part of the cost, as it changes every frame
+        start = std::chrono::steady_clock::now();
+        matcher.SetTrain(previous_described.data(), static_cast<uint32_t>(previous_described.size()));
+        matches.clear();
+        matcher.Match(described.data(), static_cast<uint32_t>(described.size()), &matches);
+        times[static_cast<uint32_t>(DatasetStage::Match)] = GetElapsedMs(start);
+
+        std::swap(described, previous_described);
+
+        if (frame < params.warmup_frames)
+        {
+            continue;
+        }
+
+        double total_ms = 0.0;
+        for (uint32_t stage = 0; stage < stage_count; ++stage)
+        {
+            stage_samples[stage].push_back(times[stage]);
+            total_ms += times[stage];
+        }
+        total_samples.push_back(total_ms);
+
+        harris_count += harris_features.size();
+        fast_count += corners.size();
+        described_count += previous_described.size();
+        match_count += matches.size();
+        out_report->width = width;
+        out_report->height = height;
+    }
+
+    out_report->data_root = params.data_root;
+    out_report->num_threads = pool.GetThreadCount();
+    out_report->frames = measured_frames;
+    for (uint32_t stage = 0; stage < stage_count; ++stage)
+    {
+        ComputeLatencyStats(&stage_samples[stage], &out_report->stages[stage]);
+    }
+    ComputeLatencyStats(&total_samples, &out_report->total);
+
+    double const frames = static_cast<double>(measured_frames);
+    out_report->fps = 1000.0 / out_report->total.mean_ms;
+    out_report->harris_per_frame = harris_count / frames;
+    out_report->fast_per_frame = fast_count / frames;
+    out_report->described_per_frame = described_count / frames;
+    out_report->matches_per_frame = match_count / frames;
+    return true;
+}
+
+void PrintDatasetBenchmarkReport(DatasetBenchmarkReport const &report)
+{
+    printf("Dataset [%s], %u frames of %ux%u, %u threads\n", report.data_root, report.frames, report.width, report.height, report.num_threads);
+    printf("  %-10s %9s %9s %9s %9s %9s\n", "stage", "min ms", "p50 ms", "p99 ms", "max ms", "mean ms");
+
+    auto const print_stats = [](char const *name, LatencyStats const &stats)
+    {
+        printf("  %-10s %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, stats.min_ms, stats.p50_ms, stats.p99_ms, stats.max_ms, stats.mean_ms);
+    };
+    for (uint32_t stage = 0; stage < static_cast<uint32_t>(DatasetStage::Count); ++stage)
+    {
+        print_stats(GetDatasetStageName(static_cast<DatasetStage>(stage)), report.stages[stage]);
+    }
+    print_stats("total", report.total);
+
+    printf("  %.1f fps\n", report.fps);
+    printf("  per frame: %.1f harris features, %.1f fast corners, %.1f descriptors, %.1f matches\n",
+        report.harris_per_frame, report.fast_per_frame, report.described_per_frame, report.matches_per_frame);
+}
+
+bool WriteDatasetBenchmarkJson(DatasetBenchmarkReport const &report, char const *path)
+{
+    ReportFile report_file;
+    if (!report_file.Create(path))
+    {
+        return false;
+    }
+    FILE *file = report_file.GetFile();
+
+    auto const write_stats = [file](char const *name, LatencyStats const &stats, char const *separator)
+    {
+        fprintf(file, "    \"%s\": { \"min\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f }%s\n",
+            name, stats.min_ms, stats.p50_ms, stats.p99_ms, stats.max_ms, stats.mean_ms, separator);
+    };
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"data_root\": ");
+    WriteJsonString(file, report.data_root);
+    fprintf(file, ",\n");
+    fprintf(file, "  \"threads\": %u,\n", report.num_threads);
+    fprintf(file, "  \"width\": %u,\n", report.width);
+    fprintf(file, "  \"height\": %u,\n", report.height);
+    fprintf(file, "  \"frames\": %u,\n", report.frames);
+    fprintf(file, "  \"fps\": %.3f,\n", report.fps);
+    fprintf(file, "  \"latency_ms\": {\n");
+    for (uint32_t stage = 0; stage < static_cast<uint32_t>(DatasetStage::Count); ++stage)
+    {
+        write_stats(GetDatasetStageName(static_cast<DatasetStage>(stage)), report.stages[stage], ",");
+    }
+    write_stats("total", report.total, "");
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"per_frame\": { \"harris\": %.2f, \"fast\": %.2f, \"descriptors\": %.2f, \"matches\": %.2f }\n",
+        report.harris_per_frame, report.fast_per_frame, report.described_per_frame, report.matches_per_frame);
+    fprintf(file, "}\n");
+
+    return report_file.Close();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// Per frame latency of a stage, over every measured frame
+struct LatencyStats
+{
+    double min_ms = 0.0;
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+    double max_ms = 0.0;
+    double mean_ms = 0.0;
+};
+
+// Nearest rank percentiles of samples_ms, which gets sorted
+void ComputeLatencyStats(std::vector<double> *inout_samples_ms, LatencyStats *out_stats);
+
+enum class DatasetStage
+{
+    Decode,     // PNG to grayscale
+    Smooth,     // SmoothImage
+    Harris,     // HarrisDetector on the smoothed frame
+    Fast,       // FastDetector on the raw frame
+    Describe,   // BRIEF descriptors of the FAST corners, sampled from the smoothed frame
+    Match,      // descriptors against those of the previous frame
+    Count
+};
+
+char const *GetDatasetStageName(DatasetStage const stage);
+
+struct DatasetBenchmarkParams
+{
+    char const *data_root = nullptr;
+    uint32_t    num_threads = 0;        // 0 uses one per hardware thread
+    uint32_t    max_frames = 0;         // 0 runs every frame of the dataset once. More than that loops
+    uint32_t    warmup_frames = 10;     // run before measuring, so caches and pools have settled
+};
+
+struct DatasetBenchmarkReport
+{
+    char const  *data_root = nullptr;
+    uint32_t     num_threads = 0;
+    uint32_t     width = 0;
+    uint32_t     height = 0;
+    uint32_t     frames = 0;            // measured, excluding warmup
+    double       fps = 0.0;             // frames over the total time of every stage
+    LatencyStats stages[static_cast<uint32_t>(DatasetStage::Count)];
+    LatencyStats total;                 // of all stages of a frame
+    double       harris_per_frame = 0.0;
+    double       fast_per_frame = 0.0;
+    double       described_per_frame = 0.0;
+    double       matches_per_frame = 0.0;
+};
+
+// Runs every stage one after the other over the frames of a dataset, as fast as they go, timing each
+bool RunDatasetBenchmark(DatasetBenchmarkParams const &params, DatasetBenchmarkReport *out_report);
+
+void PrintDatasetBenchmarkReport(DatasetBenchmarkReport const &report);
+
+// Writes the report as JSON, with latencies in milliseconds
+bool WriteDatasetBenchmarkJson(DatasetBenchmarkReport const &report, char const *path);
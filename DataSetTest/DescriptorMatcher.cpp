@@ -0,0 +1,429 @@
+#include "Precomp.h"
+#include "DescriptorMatcher.h"
+#include "ThreadPool.h"
+
+// Descriptors per SoA block
+static uint32_t const BlockSize = 8;
+
+// 64-bit words per descriptor
+static uint32_t const DescriptorWords = 4;
+
+// Multi-index hashing substrings: 16 of 16 bits each
+static uint32_t const SubstringCount = 16;
+static uint32_t const SubstringBits = 16;
+
+static inline uint32_t GetSubstring(BriefDescriptor const &descriptor, uint32_t const substring)
+{
+    return static_cast<uint32_t>(descriptor.bits[substring / 4] >> (SubstringBits * (substring % 4))) & 0xFFFF;
+}
+
+static inline float ToLevelZero(int32_t const value, float const scale)
+{
+    return (static_cast<float>(value) + 0.5f) * scale - 0.5f;
+}
+
+void DescriptorMatcher::SetParams(MatcherParams const &params)
+{
+    params_ = params;
+
+    // BruteForce skips candidates no closer than the second best, which only the ratio test would have rejected
+    // anyway as long as best < ratio * second best can't hold for a tie
+    if (params_.ratio > 1.0f)
+    {
+        LOGW("Match ratio %.3f is above 1, clamping it to 1", params_.ratio);
+        params_.ratio = 1.0f;
+    }
+}
+
+void DescriptorMatcher::SetTrain(BriefFeature const *features, uint32_t const count)
+{
+    TRACE_SCOPE("DescriptorMatcher::SetTrain");
+    train_params_ = params_;
+    train_count_ = count;
+
+    // Bucket the features into a grid of search_radius cells, and sort them by cell
+    cell_size_ = std::max(train_params_.search_radius, 1.0f);
+    grid_min_x_ = std::numeric_limits<float>::max();
+    grid_min_y_ = std::numeric_limits<float>::max();
+    float grid_max_x = -std::numeric_limits<float>::max();
+    float grid_max_y = -std::numeric_limits<float>::max();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        float const x = ToLevelZero(features[i].x, features[i].scale);
+        float const y = ToLevelZero(features[i].y, features[i].scale);
+        grid_min_x_ = std::min(grid_min_x_, x);
+        grid_min_y_ = std::min(grid_min_y_, y);
+        grid_max_x = std::max(grid_max_x, x);
+        grid_max_y = std::max(grid_max_y, y);
+    }
+    cells_x_ = (count > 0) ? static_cast<int32_t>((grid_max_x - grid_min_x_) / cell_size_) + 1 : 0;
+    cells_y_ = (count > 0) ? static_cast<int32_t>((grid_max_y - grid_min_y_) / cell_size_) + 1 : 0;
+
+    auto get_cell = [&](BriefFeature const &feature)
+    {
+        int32_t const cx = static_cast<int32_t>((ToLevelZero(feature.x, feature.scale) - grid_min_x_) / cell_size_);
+        int32_t const cy = static_cast<int32_t>((ToLevelZero(feature.y, feature.scale) - grid_min_y_) / cell_size_);
+        return static_cast<uint32_t>(cy * cells_x_ + cx);
+    };
+
+    uint32_t const num_cells = static_cast<uint32_t>(cells_x_ * cells_y_);
+    cell_starts_.assign(num_cells + 1, 0);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        ++cell_starts_[get_cell(features[i]) + 1];
+    }
+    for (uint32_t c = 0; c < num_cells; ++c)
+    {
+        cell_starts_[c + 1] += cell_starts_[c];
+    }
+
+    uint32_t const num_blocks = (count + BlockSize - 1) / BlockSize;
+    order_.resize(count);
+    descriptors_.resize(count);
+    positions_.resize(2 * static_cast<size_t>(count));
+    words_.assign(static_cast<size_t>(num_blocks) * BlockSize * DescriptorWords, 0);
+
+    // cell_starts_ is used as the insertion cursor of each cell, then shifted back
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t const position = cell_starts_[get_cell(features[i])]++;
+        order_[position] = i;
+        descriptors_[position] = features[i].descriptor;
+        positions_[2 * position + 0] = ToLevelZero(features[i].x, features[i].scale);
+        positions_[2 * position + 1] = ToLevelZero(features[i].y, features[i].scale);
+
+        uint64_t *block = &words_[(position / BlockSize) * BlockSize * DescriptorWords];
+        for (uint32_t k = 0; k < DescriptorWords; ++k)
+        {
+            block[k * BlockSize + position % BlockSize] = features[i].descriptor.bits[k];
+        }
+    }
+    for (uint32_t c = num_cells; c > 0; --c)
+    {
+        cell_starts_[c] = cell_starts_[c - 1];
+    }
+    cell_starts_[0] = 0;
+
+    if (MatchMode::MultiIndex == train_params_.mode)
+    {
+        table_starts_.resize(SubstringCount);
+        table_entries_.resize(SubstringCount);
+        for (uint32_t s = 0; s < SubstringCount; ++s)
+        {
+            std::vector<uint32_t> &starts = table_starts_[s];
+            std::vector<uint32_t> &entries = table_entries_[s];
+            starts.assign((1 << SubstringBits) + 1, 0);
+            entries.resize(count);
+            for (uint32_t p = 0; p < count; ++p)
+            {
+                ++starts[GetSubstring(descriptors_[p], s) + 1];
+            }
+            for (uint32_t v = 0; v < (1 << SubstringBits); ++v)
+            {
+                starts[v + 1] += starts[v];
+            }
+            for (uint32_t p = 0; p < count; ++p)
+            {
+                entries[starts[GetSubstring(descriptors_[p], s)]++] = p;
+            }
+            for (uint32_t v = (1 << SubstringBits); v > 0; --v)
+            {
+                starts[v] = starts[v - 1];
+            }
+            starts[0] = 0;
+        }
+
+        uint32_t const substring_radius = train_params_.max_distance / SubstringCount;
+        probe_masks_.clear();
+        for (uint32_t mask = 0; mask < (1 << SubstringBits); ++mask)
+        {
+            if (_mm_popcnt_u32(mask) <= static_cast<int32_t>(substring_radius))
+            {
+                probe_masks_.push_back(static_cast<uint16_t>(mask));
+            }
+        }
+    }
+}
+
+static void ComputeDistancesScalar(uint64_t const *words, BriefDescriptor const &query, uint32_t const first_block, uint32_t const last_block, uint32_t *distances)
+{
+    for (uint32_t block = first_block; block < last_block; ++block)
+    {
+        uint64_t const *block_words = &words[block * BlockSize * DescriptorWords];
+        for (uint32_t i = 0; i < BlockSize; ++i)
+        {
+            uint64_t distance = 0;
+            for (uint32_t k = 0; k < DescriptorWords; ++k)
+            {
+                distance += _mm_popcnt_u64(block_words[k * BlockSize + i] ^ query.bits[k]);
+            }
+            distances[block * BlockSize + i] = static_cast<uint32_t>(distance);
+        }
+    }
+}
+
+#if defined(__AVX2__)
+static void ComputeDistancesAvx2(uint64_t const *words, BriefDescriptor const &query, uint32_t const first_block, uint32_t const last_block, uint32_t *distances)
+{
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const low_nibble = _mm256_set1_epi8(0x0F);
+    __m256i const nibble_counts = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    __m256i const low_halves = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i query_words[DescriptorWords];
+    for (uint32_t k = 0; k < DescriptorWords; ++k)
+    {
+        query_words[k] = _mm256_set1_epi64x(static_cast<long long>(query.bits[k]));
+    }
+
+    for (uint32_t block = first_block; block < last_block; ++block)
+    {
+        uint64_t const *block_words = &words[block * BlockSize * DescriptorWords];
+        for (uint32_t half = 0; half < 2; ++half)
+        {
+            // Per byte bit counts of all 4 words add up to at most 32, so they are summed as bytes first
+            __m256i counts = zero;
+            for (uint32_t k = 0; k < DescriptorWords; ++k)
+            {
+                __m256i const words = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(block_words + k * BlockSize + 4 * half));
+                __m256i const bits = _mm256_xor_si256(words, query_words[k]);
+                __m256i const low = _mm256_shuffle_epi8(nibble_counts, _mm256_and_si256(bits, low_nibble));
+                __m256i const high = _mm256_shuffle_epi8(nibble_counts, _mm256_and_si256(_mm256_srli_epi16(bits, 4), low_nibble));
+                counts = _mm256_add_epi8(counts, _mm256_add_epi8(low, high));
+            }
+            __m256i const sums = _mm256_permutevar8x32_epi32(_mm256_sad_epu8(counts, zero), low_halves);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(distances + block * BlockSize + 4 * half), _mm256_castsi256_si128(sums));
+        }
+    }
+}
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+static void ComputeDistancesAvx512(uint64_t const *words, BriefDescriptor const &query, uint32_t const first_block, uint32_t const last_block, uint32_t *distances)
+{
+    __m512i query_words[DescriptorWords];
+    for (uint32_t k = 0; k < DescriptorWords; ++k)
+    {
+        query_words[k] = _mm512_set1_epi64(static_cast<long long>(query.bits[k]));
+    }
+
+    for (uint32_t block = first_block; block < last_block; ++block)
+    {
+        uint64_t const *block_words = &words[block * BlockSize * DescriptorWords];
+        __m512i sums = _mm512_setzero_si512();
+        for (uint32_t k = 0; k < DescriptorWords; ++k)
+        {
+            __m512i const words = _mm512_loadu_si512(block_words + k * BlockSize);
+            sums = _mm512_add_epi64(sums, _mm512_popcnt_epi64(_mm512_xor_si512(words, query_words[k])));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(distances + block * BlockSize), _mm512_maskz_cvtepi64_epi32(0xFF, sums));
+    }
+}
+#endif
+
+bool DescriptorMatcher::IsKernelCompiled(DistanceKernel const kernel)
+{
+    switch (kernel)
+    {
+    case DistanceKernel::Scalar:
+        return true;
+    case DistanceKernel::Avx2:
+#if defined(__AVX2__)
+        return true;
+#else
+        return false;
+#endif
+    case DistanceKernel::Avx512:
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+bool DescriptorMatcher::SetDistanceKernel(DistanceKernel const kernel)
+{
+    if (!IsKernelCompiled(kernel))
+    {
+        LOGE("Distance kernel %d isn't compiled into this build", static_cast<int32_t>(kernel));
+        return false;
+    }
+    kernel_ = kernel;
+    return true;
+}
+
+void DescriptorMatcher::GetDistances(BriefDescriptor const &query, uint32_t *out_distances) const
+{
+    uint32_t const num_blocks = (train_count_ + BlockSize - 1) / BlockSize;
+    std::vector<uint32_t> distances(static_cast<size_t>(num_blocks) * BlockSize);
+    ComputeDistances(query, 0, num_blocks, distances.data());
+    for (uint32_t p = 0; p < train_count_; ++p)
+    {
+        out_distances[order_[p]] = distances[p];
+    }
+}
+
+void DescriptorMatcher::ComputeDistances(BriefDescriptor const &query, uint32_t const first_block, uint32_t const last_block, uint32_t *distances) const
+{
+    switch (kernel_)
+    {
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+    case DistanceKernel::Avx512: ComputeDistancesAvx512(words_.data(), query, first_block, last_block, distances); return;
+#endif
+#if defined(__AVX2__)
+    case DistanceKernel::Avx2:   ComputeDistancesAvx2(words_.data(), query, first_block, last_block, distances); return;
+#endif
+    default:                     ComputeDistancesScalar(words_.data(), query, first_block, last_block, distances); return;
+    }
+}
+
+void DescriptorMatcher::AddCandidate(uint32_t const position, uint32_t const distance, Candidates *inout_candidates) const
+{
+    uint32_t const capped = std::min(distance, train_params_.max_distance + 1);
+    uint32_t const train = order_[position];
+    if (capped < inout_candidates->best_distance || (capped == inout_candidates->best_distance && train < inout_candidates->best_train))
+    {
+        inout_candidates->second_distance = inout_candidates->best_distance;
+        inout_candidates->best_distance = capped;
+        inout_candidates->best_train = train;
+    }
+    else if (capped < inout_candidates->second_distance)
+    {
+        inout_candidates->second_distance = capped;
+    }
+}
+
+void DescriptorMatcher::MatchBruteForce(Band &band, BriefDescriptor const &query, Candidates *inout_candidates) const
+{
+    uint32_t *distances = band.distances.data();
+    ComputeDistances(query, 0, (train_count_ + BlockSize - 1) / BlockSize, distances);
+    // A candidate no closer than the second best can only reorder a tie for best that the ratio test rejects anyway
+    for (uint32_t p = 0; p < train_count_; ++p)
+    {
+        if (distances[p] < inout_candidates->second_distance)
+        {
+            AddCandidate(p, distances[p], inout_candidates);
+        }
+    }
+}
+
+void DescriptorMatcher::MatchGrid(Band &band, BriefFeature const &query, Candidates *inout_candidates) const
+{
+    float const radius = train_params_.search_radius;
+    float const x = ToLevelZero(query.x, query.scale);
+    float const y = ToLevelZero(query.y, query.scale);
+
+    int32_t const cx_begin = std::max(static_cast<int32_t>(floorf((x - radius - grid_min_x_) / cell_size_)), 0);
+    int32_t const cx_end = std::min(static_cast<int32_t>(floorf((x + radius - grid_min_x_) / cell_size_)) + 1, cells_x_);
+    int32_t const cy_begin = std::max(static_cast<int32_t>(floorf((y - radius - grid_min_y_) / cell_size_)), 0);
+    int32_t const cy_end = std::min(static_cast<int32_t>(floorf((y + radius - grid_min_y_) / cell_size_)) + 1, cells_y_);
+
+    // Cells are row major, so the cells of one grid row inside the window are a single range of train positions
+    uint32_t *distances = band.distances.data();
+    for (int32_t cy = cy_begin; cy < cy_end; ++cy)
+    {
+        if (cx_begin >= cx_end)
+        {
+            break;
+        }
+        uint32_t const begin = cell_starts_[cy * cells_x_ + cx_begin];
+        uint32_t const end = cell_starts_[cy * cells_x_ + cx_end];
+        if (begin == end)
+        {
+            continue;
+        }
+
+        ComputeDistances(query.descriptor, begin / BlockSize, (end + BlockSize - 1) / BlockSize, distances);
+        for (uint32_t p = begin; p < end; ++p)
+        {
+            float const dx = positions_[2 * p + 0] - x;
+            float const dy = positions_[2 * p + 1] - y;
+            if (dx * dx + dy * dy <= radius * radius)
+            {
+                AddCandidate(p, distances[p], inout_candidates);
+            }
+        }
+    }
+}
+
+void DescriptorMatcher::MatchMultiIndex(Band &band, BriefDescriptor const &query, uint32_t const stamp, Candidates *inout_candidates) const
+{
+    for (uint32_t s = 0; s < SubstringCount; ++s)
+    {
+        uint32_t const *starts = table_starts_[s].data();
+        uint32_t const *entries = table_entries_[s].data();
+        uint32_t const value = GetSubstring(query, s);
+        for (uint16_t const mask : probe_masks_)
+        {
+            uint32_t const bucket = value ^ mask;
+            for (uint32_t e = starts[bucket]; e < starts[bucket + 1]; ++e)
+            {
+                uint32_t const p = entries[e];
+                if (band.seen[p] != stamp)
+                {
+                    band.seen[p] = stamp;
+                    AddCandidate(p, HammingDistance(query, descriptors_[p]), inout_candidates);
+                }
+            }
+        }
+    }
+}
+
+void DescriptorMatcher::Match(BriefFeature const *queries, uint32_t const count, std::vector<DescriptorMatch> *out_matches)
+{
+    TRACE_SCOPE("DescriptorMatcher::Match");
+    if (0 == count || 0 == train_count_)
+    {
+        return;
+    }
+
+    uint32_t const num_bands = GetRowBandCount(pool_, static_cast<int32_t>(count), 64);
+    if (bands_.size() < num_bands)
+    {
+        bands_.resize(num_bands);
+    }
+
+    ParallelForRows(pool_, 0, static_cast<int32_t>(count), num_bands, [&](uint32_t const band_index, int32_t const begin, int32_t const end)
+    {
+        Band &band = bands_[band_index];
+        band.matches.clear();
+        band.distances.resize(((train_count_ + BlockSize - 1) / BlockSize) * BlockSize);
+        if (MatchMode::MultiIndex == train_params_.mode)
+        {
+            band.seen.assign(train_count_, UINT32_MAX);
+        }
+
+        for (int32_t q = begin; q < end; ++q)
+        {
+            Candidates candidates;
+            candidates.best_distance = train_params_.max_distance + 1;
+            candidates.best_train = UINT32_MAX;
+            candidates.second_distance = train_params_.max_distance + 1;
+
+            switch (train_params_.mode)
+            {
+            case MatchMode::BruteForce: MatchBruteForce(band, queries[q].descriptor, &candidates); break;
+            case MatchMode::Grid:       MatchGrid(band, queries[q], &candidates); break;
+            case MatchMode::MultiIndex: MatchMultiIndex(band, queries[q].descriptor, static_cast<uint32_t>(q), &candidates); break;
+            }
+
+            if (candidates.best_distance <= train_params_.max_distance &&
+                static_cast<float>(candidates.best_distance) < train_params_.ratio * static_cast<float>(candidates.second_distance))
+            {
+                DescriptorMatch match;
+                match.query = static_cast<uint32_t>(q);
+                match.train = candidates.best_train;
+                match.distance = candidates.best_distance;
+                band.matches.push_back(match);
+            }
+        }
+    });
+
+    for (uint32_t band = 0; band < num_bands; ++band)
+    {
+        out_matches->insert(out_matches->end(), bands_[band].matches.begin(), bands_[band].matches.end());
+    }
+}
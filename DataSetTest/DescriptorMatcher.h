@@ -0,0 +1,144 @@
+#pragma once
+
+#include "BriefDescriptor.h"
+
+class ThreadPool;
+
+enum class MatchMode
+{
+    BruteForce, // every query against every train feature
+    Grid,       // only train features within search_radius of the query
+    MultiIndex, // multi-index hashing on 16-bit substrings. Only finds matches within max_distance
+};
+
+// Instruction sets the train descriptors can be compared with. Avx512 is only compiled in with ENABLE_AVX512
+enum class DistanceKernel
+{
+    Scalar,
+    Avx2,
+    Avx512,
+};
+
+struct MatcherParams
+{
+    MatchMode mode            = MatchMode::BruteForce;
+    uint32_t  max_distance    = 64;    // matches further than this many bits apart are rejected
+    float     ratio           = 0.8f;  // best distance must be below ratio * second best distance. In (0, 1]
+    float     search_radius   = 32.0f; // Grid mode only, in level 0 pixels
+};
+
+struct DescriptorMatch
+{
+    uint32_t query;    // index into the query features
+    uint32_t train;    // index into the train features
+    uint32_t distance;
+};
+
+//
+// Binary descriptor matcher
+//
+// The train set is stored structure-of-arrays in blocks of 8 descriptors, word k of all 8 contiguous, so
+// one query word is compared against 8 candidates per instruction with AVX-512 VPOPCNTDQ, in builds with
+// ENABLE_AVX512. AVX2 has no 64-bit popcount: it counts bits of 4 candidates per register with a nibble
+// lookup table, and adds the byte counts up with sad. Every kernel gives the same distances.
+//
+// Every mode picks the same best match: the smallest distance, ties going to the lowest train index. The
+// ratio test compares it with the second smallest distance among the candidates of the mode, where any
+// distance above max_distance counts as max_distance + 1. So MultiIndex returns exactly what BruteForce
+// does, and Grid what BruteForce does when restricted to the search radius.
+//
+// Multi-index hashing splits descriptors into 16 substrings of 16 bits, each indexed in its own table.
+// Two descriptors within max_distance bits have a substring within max_distance / 16 bits of each other,
+// so only buckets that close are probed. This pays off for large train sets and a tight max_distance.
+//
+class DescriptorMatcher : private NonCopyable
+{
+public:
+    DescriptorMatcher() = default;
+
+    // Takes effect on the next SetTrain. A ratio above 1 is clamped to 1
+    void SetParams(MatcherParams const &params);
+    MatcherParams const &GetParams() const { return params_; }
+
+    // Optional. Queries are matched in parallel bands with a pool
+    void SetThreadPool(ThreadPool *pool) { pool_ = pool; }
+
+    // Whether kernel was compiled in. The matcher starts out with the widest one that was
+    static bool IsKernelCompiled(DistanceKernel const kernel);
+    bool SetDistanceKernel(DistanceKernel const kernel);
+    DistanceKernel GetDistanceKernel() const { return kernel_; }
+
+    // Indexes the features that queries are matched against. They are copied, so needn't stay valid
+    void SetTrain(BriefFeature const *features, uint32_t const count);
+
+    // Finds the best train feature of every query, and appends those that pass the distance & ratio tests to
+    // out_matches, in query order
+    void Match(BriefFeature const *queries, uint32_t const count, std::vector<DescriptorMatch> *out_matches);
+
+    uint32_t GetTrainCount() const { return train_count_; }
+
+    // Distances of query to every train feature, in train order, with the current kernel. For checking the kernels
+    // against each other
+    void GetDistances(BriefDescriptor const &query, uint32_t *out_distances) const;
+
+private:
+    // Best & second best distance of one query
+    struct Candidates
+    {
+        uint32_t best_distance;
+        uint32_t best_train;
+        uint32_t second_distance;
+    };
+
+    // Scratch for one band of queries
+    struct Band
+    {
+        std::vector<uint32_t>        distances; // per train position, padded to whole blocks
+        std::vector<uint32_t>        seen;      // MultiIndex: query that last probed each train position
+        std::vector<DescriptorMatch> matches;
+    };
+
+    void MatchBruteForce(Band &band, BriefDescriptor const &query, Candidates *inout_candidates) const;
+    void MatchGrid(Band &band, BriefFeature const &query, Candidates *inout_candidates) const;
+    void MatchMultiIndex(Band &band, BriefDescriptor const &query, uint32_t const stamp, Candidates *inout_candidates) const;
+
+    // Distances of the train descriptors in blocks [first_block, last_block) to query, into distances
+    void ComputeDistances(BriefDescriptor const &query, uint32_t const first_block, uint32_t const last_block, uint32_t *distances) const;
+
+    // Adds train position to candidates, with its distance
+    void AddCandidate(uint32_t const position, uint32_t const distance, Candidates *inout_candidates) const;
+
+private:
+    MatcherParams params_;
+    MatcherParams train_params_; // params_ as of the last SetTrain
+    ThreadPool   *pool_ = nullptr;
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+    DistanceKernel kernel_ = DistanceKernel::Avx512;
+#elif defined(__AVX2__)
+    DistanceKernel kernel_ = DistanceKernel::Avx2;
+#else
+    DistanceKernel kernel_ = DistanceKernel::Scalar;
+#endif
+
+    // Train set, sorted by grid cell. Positions refer to this order, and order_ maps them back to train indices
+    uint32_t                     train_count_ = 0;
+    std::vector<uint32_t>        order_;
+    std::vector<uint64_t>        words_;       // SoA blocks of 8 descriptors
+    std::vector<BriefDescriptor> descriptors_;
+    std::vector<float>           positions_;   // level 0 x, y of each
+
+    // Grid: train positions of cell c are [cell_starts_[c], cell_starts_[c + 1]). Cells are row major
+    float                 grid_min_x_ = 0.0f;
+    float                 grid_min_y_ = 0.0f;
+    float                 cell_size_ = 1.0f;
+    int32_t               cells_x_ = 0;
+    int32_t               cells_y_ = 0;
+    std::vector<uint32_t> cell_starts_;
+
+    // MultiIndex: train positions whose substring s is v are table_entries_[s][table_starts_[s][v]...[v + 1])
+    std::vector<std::vector<uint32_t>> table_starts_;
+    std::vector<std::vector<uint32_t>> table_entries_;
+    std::vector<uint16_t>              probe_masks_; // every 16-bit mask within max_distance / 16 bits
+
+    std::vector<Band> bands_;
+};
@@ -0,0 +1,1301 @@
+#include "Precomp.h"
+#include "DetectorAccuracy.h"
+#include "BriefDescriptor.h"
+#include "CameraModel.h"
+#include "DescriptorMatcher.h"
+#include "FastCorners.h"
+#include "GroundTruth.h"
+#include "HarrisCorners.h"
+#include "PlaybackFrameProvider.h"
+#include "PngDecoder.h"
+#include "PointUndistorter.h"
+#include "ThreadPool.h"
+#include "ToolSupport.h"
+#include "Utilities.h"
+
+// The scene plane is fitted to matches between frames PlaneFitGap apart, every PlaneFitStep frames
+static uint32_t const PlaneFitStep = 20;
+static uint32_t const PlaneFitGap = 30;
+static uint32_t const PlaneRansacIterations = 1000;
+
+// Points further from the plane than this fraction of their median depth are outliers. Triangulation with a few
+// degrees of parallax and pixel accurate features is only good to a few percent of the depth
+static double const PlaneInlierDistance = 0.05;
+
+// Fewer points, or a smaller fraction of inliers than this, and the scene isn't taken to be planar
+static uint32_t const MinPlanePoints = 50;
+static double const MinPlaneInlierFraction = 0.5;
+
+// Rays closer than this to parallel don't triangulate reliably. Cosine of 3 degrees
+static double const MaxParallaxCosine = 0.99862953475;
+
+// Matches whose triangulated point lands further than this from either feature, in pixels, are wrong matches
+static double const MaxReprojectionError = 2.0;
+
+// Detectors don't test pixels this close to the edges, so features predicted to land there don't count
+static int32_t const DetectorBorder = 3;
+
+//
+// Legacy pipeline
+//
+// Copies of the FAST, descriptor and Harris routines the app started out with, kept as they were so the scores
+// show what the rewritten kernels gained over them. The only changes: the descriptor pattern comes from a fixed
+// seed rather than the time, and the arithmetic that overflowed or converted out of range is spelled the way
+// x64 evaluated it, so it's defined. They're run on the reference smoothing, since the original SmoothImage read
+// outside the image along its edges
+//
+
+static unsigned int const LegacyDescriptorSeed = 1;
+
+// The original FAST call
+static uint8_t const LegacySegmentSize = 9;
+static uint8_t const LegacyThreshold = 20;
+static int const LegacyMaxFeatures = 100;
+
+// ComputeDescriptor leaves out features this close to the edges
+static int32_t const LegacyDescriptorBorder = 8;
+
+// Descriptors fewer bits apart than this were taken to be the same feature
+static uint32_t const LegacyMatchDistance = 5;
+
+struct LegacyFastFeature
+{
+    int x, y;
+    int score;
+    uint64_t descriptor[2];
+    uint32_t frame_count = 0;
+};
+
+struct LegacyHarrisFeature
+{
+    int32_t x, y;
+};
+
+// The original Convolve truncated the float sum to uint32_t, so negative sums wrapped
+static uint32_t LegacyConvolve(uint8_t const *input, int32_t const stride, int32_t const x, int32_t const y, float const *kernel, int32_t const kernel_rows, int32_t const kernel_columns)
+{
+    int32_t const half_kernel_rows = kernel_rows / 2;
+    int32_t const half_kernel_cols = kernel_columns / 2;
+
+    float accum = 0.0f;
+    for (int32_t ky = 0; ky < kernel_rows; ++ky)
+    {
+        int32_t const iy = y - half_kernel_rows + ky;
+        for (int32_t kx = 0; kx < kernel_columns; ++kx)
+        {
+            int32_t const ix = x - half_kernel_cols + kx;
+            accum += kernel[ky * kernel_columns + kx] * input[iy * stride + ix];
+        }
+    }
+    return static_cast<uint32_t>(static_cast<int64_t>(accum));
+}
+
+static bool LegacyComputeDescriptor(uint8_t const *source, int32_t const width, int32_t const height, int32_t const x, int32_t const y, uint64_t *inout_descriptor)
+{
+    static int32_t x_offsets[128]{};
+    static int32_t y_offsets[128]{};
+    static int32_t x_offsets2[128]{};
+    static int32_t y_offsets2[128]{};
+    static bool    offsets_initialized = false;
+
+    if (!offsets_initialized)
+    {
+        srand(LegacyDescriptorSeed);
+        for (int32_t i = 0; i < 128; ++i)
+        {
+            x_offsets[i] = rand() % 16 - 8;
+            y_offsets[i] = rand() % 16 - 8;
+            x_offsets2[i] = rand() % 16 - 8;
+            y_offsets2[i] = rand() % 16 - 8;
+        }
+        offsets_initialized = true;
+    }
+
+    if (x < 8 || x >= width - 8 || y < 8 || y >= height - 8)
+    {
+        return false;
+    }
+
+    inout_descriptor[0] = 0;
+    inout_descriptor[1] = 0;
+    for (int32_t i = 0; i < 128; ++i)
+    {
+        int32_t index = i / 64;
+        int32_t bit = i % 64;
+        uint8_t val1 = source[(y + y_offsets[i]) * width + (x + x_offsets[i])];
+        uint8_t val2 = source[(y + y_offsets2[i]) * width + (x + x_offsets2[i])];
+        uint64_t bit_value = (val1 < val2) ? 1 : 0;
+        inout_descriptor[index] |= (bit_value << bit);
+    }
+    return true;
+}
+
+static int LegacyFast(uint8_t const* source, uint8_t const *smoothed, int width, int height, int pixel_pitch, uint8_t segment_size, uint8_t threshold, int max_features, LegacyFastFeature* out_features)
+{
+    // x,y offsets to each of the pixels around the circle
+    static int const x_offsets[] =
+    {
+        0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1,
+    };
+    static int const y_offsets[] =
+    {
+        -3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3
+    };
+
+    static const int num_offsets = _countof(x_offsets);
+
+    int num_features = 0;
+    for (int y = 3; y < height - 3; ++y)
+    {
+        for (int x = 3; x < width - 3; ++x)
+        {
+            uint8_t Ip = source[y * pixel_pitch + x];
+
+            int last_non_bright = -1;
+            int last_non_dark = -1;
+            int bright_score = 0;
+            int dark_score = 0;
+
+            int match_score = 0;
+
+            for (int i = 0; i < num_offsets; ++i)
+            {
+                uint8_t I = source[(y + y_offsets[i]) * pixel_pitch + (x + x_offsets[i])];
+
+                if (I <= Ip + threshold)
+                {
+                    last_non_bright = i;
+                    bright_score = 0;
+                } else
+                {
+                    bright_score += abs((int)I - (int)Ip) - threshold;
+                }
+
+                if (I >= Ip - threshold)
+                {
+                    last_non_dark = i;
+                    dark_score = 0;
+                } else
+                {
+                    dark_score += abs((int)Ip - (int)I) - threshold;
+                }
+
+                if (i - (last_non_bright + 1) == segment_size)
+                {
+                    match_score = bright_score;
+                    break;
+                }
+                if (i - (last_non_dark + 1) == segment_size)
+                {
+                    match_score = dark_score;
+                    break;
+                }
+            }
+
+            if (match_score > 0)
+            {
+                out_features[num_features].x = x;
+                out_features[num_features].y = y;
+                out_features[num_features].score = match_score;
+                out_features[num_features].frame_count = 0;
+                if (LegacyComputeDescriptor(smoothed, width, height, x, y, out_features[num_features].descriptor))
+                {
+                    ++num_features;
+                    if (num_features == max_features)
+                    {
+                        return num_features;
+                    }
+                }
+            }
+        }
+    }
+    return num_features;
+}
+
+static uint32_t LegacyHammingDistance(uint64_t const descriptor[2], uint64_t const descriptor2[2])
+{
+    uint64_t dist1 = descriptor[0] ^ descriptor2[0];
+    uint64_t dist2 = descriptor[1] ^ descriptor2[1];
+    return static_cast<uint32_t>(_mm_popcnt_u64(dist1) + _mm_popcnt_u64(dist2));
+}
+
+// The derivatives are the wrapped uint32_t ones, and the sums of their products overflowed int64_t. Summed as
+// uint64_t here, which wraps the same way
+static inline void LegacyComputeM(uint8_t const *image, int32_t const stride, int32_t const x, int32_t const y, int32_t const window_half, int64_t out_m[2][2])
+{
+    static float sobel_operator_x[] =
+    {
+        1, 0, -1,
+        2, 0, -2,
+        1, 0, -1
+    };
+    static float sobel_operator_y[] =
+    {
+        1,  2,  1,
+        0,  0,  0,
+        -1, -2, -1
+    };
+
+    uint64_t m[2][2]{};
+    for (int32_t iy = y - window_half; iy <= y + window_half; ++iy)
+    {
+        for (int32_t ix = x - window_half; ix <= x + window_half; ++ix)
+        {
+            uint64_t const Ix = LegacyConvolve(image, stride, ix, iy, sobel_operator_x, 3, 3);
+            uint64_t const Iy = LegacyConvolve(image, stride, ix, iy, sobel_operator_y, 3, 3);
+            m[0][0] += (Ix * Ix);
+            m[0][1] += Ix * Iy;
+            m[1][0] += Ix * Iy;
+            m[1][1] += (Iy * Iy);
+        }
+    }
+    memcpy(out_m, m, sizeof(m));
+}
+
+// The response converted out of int64_t's range gave INT64_MIN on x64, and abs of that stayed negative, so those
+// pixels were never kept
+static void LegacyHarrisDetect(uint8_t const *image, int32_t const width, int32_t const height, std::vector<LegacyHarrisFeature> *out_features)
+{
+    static int32_t const  window_size = 3; // 3x3 with extents [-1, 1]
+
+    int32_t const window_half = window_size / 2;
+    float   const k           = 0.03f;
+
+    int64_t M[2][2]{};
+    int64_t detM = 0;
+    int64_t traceM = 0;
+
+    out_features->clear();
+
+    int64_t const threshold = static_cast<int64_t>(INT64_MAX) / 1000;
+    float const int64_range = 9.223372036854775808e18f;
+
+    for (int32_t y = window_half + 1; y < height - window_half - 1; ++y)
+    {
+        for (int32_t x = window_half + 1; x < width - window_half - 1; ++x)
+        {
+            LegacyComputeM(image, width, x, y, window_half, M);
+            detM = static_cast<int64_t>(static_cast<uint64_t>(M[0][0]) * static_cast<uint64_t>(M[1][1]) - static_cast<uint64_t>(M[0][1]) * static_cast<uint64_t>(M[1][0]));
+            traceM = static_cast<int64_t>(static_cast<uint64_t>(M[0][0]) + static_cast<uint64_t>(M[1][1]));
+            float const response = detM - k * static_cast<int64_t>(static_cast<uint64_t>(traceM) * static_cast<uint64_t>(traceM));
+            if (response <= -int64_range || response >= int64_range)
+            {
+                continue;
+            }
+
+            int64_t const R = static_cast<int64_t>(response);
+            if (llabs(R) > threshold)
+            {
+                LegacyHarrisFeature feature;
+                feature.x = x;
+                feature.y = y;
+                out_features->push_back(feature);
+            }
+        }
+    }
+}
+
+
+// The original tracking took a feature to be the first one of the other frame whose descriptor was near enough
+static void LegacyMatch(std::vector<LegacyFastFeature> const &queries, std::vector<LegacyFastFeature> const &train, std::vector<DescriptorMatch> *out_matches)
+{
+    out_matches->clear();
+    for (uint32_t i = 0; i < queries.size(); ++i)
+    {
+        for (uint32_t j = 0; j < train.size(); ++j)
+        {
+            uint32_t const distance = LegacyHammingDistance(queries[i].descriptor, train[j].descriptor);
+            if (distance < LegacyMatchDistance)
+            {
+                out_matches->push_back(DescriptorMatch{ i, j, distance });
+                break;
+            }
+        }
+    }
+}
+
+// Features found with each set of kernels on one frame
+struct PipelineFeatures
+{
+    std::vector<HarrisFeature> harris;
+    std::vector<FastFeature>   fast;
+    std::vector<BriefFeature>  described;
+};
+
+// Features found with the legacy routines on one frame. The FAST corners carry their descriptors
+struct LegacyFeatures
+{
+    std::vector<LegacyHarrisFeature> harris;
+    std::vector<LegacyFastFeature>   fast;
+};
+
+struct AccuracyFrame
+{
+    bool             has_pose = false;
+    double           rotation[9];    // camera to world, row major
+    double           position[3];
+    PipelineFeatures optimized;
+    PipelineFeatures reference;
+    LegacyFeatures   legacy;
+};
+
+
+// n . X = distance, in world coordinates
+struct ScenePlane
+{
+    double normal[3];
+    double distance;
+};
+
+// Found, matched, repeated and possible features, summed over frame pairs
+struct RepeatabilityCounts
+{
+    uint64_t frames = 0;             // second frames of the pairs, whose features are counted
+    uint64_t harris_features = 0;
+    uint64_t fast_features = 0;
+    uint64_t harris_repeated = 0;
+    uint64_t harris_possible = 0;
+    uint64_t fast_repeated = 0;
+    uint64_t fast_possible = 0;
+    uint64_t correct_matches = 0;
+    uint64_t matches = 0;
+    uint64_t match_possible = 0;
+};
+
+// Decoding, kernels and scratch shared by every frame
+struct AccuracyContext
+{
+    ThreadPool           pool;
+    PngDecoder           decoder;
+    BufferPool           image_pool;
+    ImageBuffer          pixels;
+    GaussianKernel       smooth_kernel;
+    HarrisDetector       harris;
+    FastDetector         fast;
+    BriefExtractor       brief;
+    DescriptorMatcher    matcher;
+    PointUndistorter     undistorter;
+    CameraModel          model;
+    double               max_radius2 = 0.0;  // of the normalized frame corners, so distortion never folds points back in
+    int32_t              width = 0;
+    int32_t              height = 0;
+    std::vector<uint8_t> scratch;
+    std::vector<uint8_t> smoothed;
+    std::vector<uint8_t> smoothed_reference;
+};
+
+static double Dot(double const *a, double const *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Camera to world rotation of a unit quaternion x, y, z, w
+static void GetRotation(Pose const &pose, double *out_rotation)
+{
+    double const x = pose.orientation[0];
+    double const y = pose.orientation[1];
+    double const z = pose.orientation[2];
+    double const w = pose.orientation[3];
+    out_rotation[0] = 1.0 - 2.0 * (y * y + z * z);
+    out_rotation[1] = 2.0 * (x * y - z * w);
+    out_rotation[2] = 2.0 * (x * z + y * w);
+    out_rotation[3] = 2.0 * (x * y + z * w);
+    out_rotation[4] = 1.0 - 2.0 * (x * x + z * z);
+    out_rotation[5] = 2.0 * (y * z - x * w);
+    out_rotation[6] = 2.0 * (x * z - y * w);
+    out_rotation[7] = 2.0 * (y * z + x * w);
+    out_rotation[8] = 1.0 - 2.0 * (x * x + y * y);
+}
+
+// World direction of the ray through normalized point (x, y)
+static void GetRay(AccuracyFrame const &frame, double const x, double const y, double *out_ray)
+{
+    for (int32_t i = 0; i < 3; ++i)
+    {
+        out_ray[i] = frame.rotation[i * 3] * x + frame.rotation[i * 3 + 1] * y + frame.rotation[i * 3 + 2];
+    }
+}
+
+// Squared distance, in normalized coordinates, from normalized point (x, y) of frame to where point lands in it
+static double GetReprojectionError2(AccuracyFrame const &frame, double const *point, float const *observed)
+{
+    double const offset[3] = { point[0] - frame.position[0], point[1] - frame.position[1], point[2] - frame.position[2] };
+    double camera[3];
+    for (int32_t i = 0; i < 3; ++i)
+    {
+        camera[i] = frame.rotation[i] * offset[0] + frame.rotation[3 + i] * offset[1] + frame.rotation[6 + i] * offset[2];
+    }
+    if (camera[2] <= 0.0)
+    {
+        return std::numeric_limits<double>::max();
+    }
+    double const dx = camera[0] / camera[2] - observed[0];
+    double const dy = camera[1] / camera[2] - observed[1];
+    return dx * dx + dy * dy;
+}
+
+// Midpoint of the closest approach of the rays through normalized points a of frame_a and b of frame_b. False when the
+// rays are too close to parallel, or miss each other by too much for the points to be the same
+static bool Triangulate(CameraModel const &model, AccuracyFrame const &frame_a, float const *a, AccuracyFrame const &frame_b, float const *b, double *out_point, double *out_depth)
+{
+    double ray_a[3];
+    double ray_b[3];
+    GetRay(frame_a, a[0], a[1], ray_a);
+    GetRay(frame_b, b[0], b[1], ray_b);
+
+    double const offset[3] = { frame_a.position[0] - frame_b.position[0], frame_a.position[1] - frame_b.position[1], frame_a.position[2] - frame_b.position[2] };
+    double const aa = Dot(ray_a, ray_a);
+    double const ab = Dot(ray_a, ray_b);
+    double const bb = Dot(ray_b, ray_b);
+    double const ao = Dot(ray_a, offset);
+    double const bo = Dot(ray_b, offset);
+    if (ab / sqrt(aa * bb) > MaxParallaxCosine)
+    {
+        return false;
+    }
+
+    double const determinant = aa * bb - ab * ab;
+    double const s = (ab * bo - bb * ao) / determinant;
+    double const t = (aa * bo - ab * ao) / determinant;
+    if (s <= 0.0 || t <= 0.0)
+    {
+        return false;
+    }
+
+    for (int32_t i = 0; i < 3; ++i)
+    {
+        out_point[i] = 0.5 * (frame_a.position[i] + s * ray_a[i] + frame_b.position[i] + t * ray_b[i]);
+    }
+    *out_depth = s * sqrt(aa);
+
+    double const max_error = MaxReprojectionError / model.fx;
+    return GetReprojectionError2(frame_a, out_point, a) < max_error * max_error && GetReprojectionError2(frame_b, out_point, b) < max_error * max_error;
+}
+
+// Pixel of to that normalized point (x, y) of from lands on, through the scene plane. False when it's behind either
+// camera or outside the field of view of to
+static bool TransferPoint(AccuracyContext const &context, ScenePlane const &plane, AccuracyFrame const &from, AccuracyFrame const &to, double const x, double const y, double *out_u, double *out_v)
+{
+    double ray[3];
+    GetRay(from, x, y, ray);
+    double const denominator = Dot(plane.normal, ray);
+    if (fabs(denominator) < 1.0e-12)
+    {
+        return false;
+    }
+    double const s = (plane.distance - Dot(plane.normal, from.position)) / denominator;
+    if (s <= 0.0)
+    {
+        return false;
+    }
+
+    double offset[3];
+    for (int32_t i = 0; i < 3; ++i)
+    {
+        offset[i] = from.position[i] + s * ray[i] - to.position[i];
+    }
+    double camera[3];
+    for (int32_t i = 0; i < 3; ++i)
+    {
+        camera[i] = to.rotation[i] * offset[0] + to.rotation[3 + i] * offset[1] + to.rotation[6 + i] * offset[2];
+    }
+    if (camera[2] <= 0.0)
+    {
+        return false;
+    }
+
+    double const tx = camera[0] / camera[2];
+    double const ty = camera[1] / camera[2];
+    if (tx * tx + ty * ty > context.max_radius2)
+    {
+        return false;
+    }
+    DistortPoint(context.model, tx, ty, out_u, out_v);
+    return true;
+}
+
+// Plane through the most points, refitted to its inliers by least squares
+static bool FitPlane(std::vector<double> const &points, std::vector<double> const &depths, ScenePlane *out_plane, uint32_t *out_inliers)
+{
+    uint32_t const count = static_cast<uint32_t>(depths.size());
+    std::vector<double> sorted_depths = depths;
+    std::nth_element(sorted_depths.begin(), sorted_depths.begin() + count / 2, sorted_depths.end());
+    double const threshold = PlaneInlierDistance * sorted_depths[count / 2];
+
+    auto const count_inliers = [&](ScenePlane const &plane)
+    {
+        uint32_t inliers = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            inliers += fabs(Dot(plane.normal, &points[i * 3]) - plane.distance) < threshold ? 1 : 0;
+        }
+        return inliers;
+    };
+
+    uint32_t state = 12345;
+    ScenePlane best{};
+    uint32_t best_inliers = 0;
+    for (uint32_t iteration = 0; iteration < PlaneRansacIterations; ++iteration)
+    {
+        uint32_t samples[3];
+        for (uint32_t &sample : samples)
+        {
+            state = state * 1664525u + 1013904223u;
+            sample = (state >> 8) % count;
+        }
+
+        double const *p0 = &points[samples[0] * 3];
+        double const *p1 = &points[samples[1] * 3];
+        double const *p2 = &points[samples[2] * 3];
+        double const u[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        double const v[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        ScenePlane plane;
+        plane.normal[0] = u[1] * v[2] - u[2] * v[1];
+        plane.normal[1] = u[2] * v[0] - u[0] * v[2];
+        plane.normal[2] = u[0] * v[1] - u[1] * v[0];
+        double const length = sqrt(Dot(plane.normal, plane.normal));
+        if (length < 1.0e-12)
+        {
+            continue;
+        }
+        for (double &component : plane.normal)
+        {
+            component /= length;
+        }
+        plane.distance = Dot(plane.normal, p0);
+
+        uint32_t const inliers = count_inliers(plane);
+        if (inliers > best_inliers)
+        {
+            best = plane;
+            best_inliers = inliers;
+        }
+    }
+    if (best_inliers < 3)
+    {
+        return false;
+    }
+
+    // Least squares on the inliers, solving for the coordinate the normal is closest to as a linear function of the
+    // other two, which is well conditioned
+    int32_t axis = 0;
+    for (int32_t i = 1; i < 3; ++i)
+    {
+        axis = fabs(best.normal[i]) > fabs(best.normal[axis]) ? i : axis;
+    }
+    int32_t const i0 = (axis + 1) % 3;
+    int32_t const i1 = (axis + 2) % 3;
+
+    double m[3][3]{};
+    double r[3]{};
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        double const *p = &points[i * 3];
+        if (fabs(Dot(best.normal, p) - best.distance) >= threshold)
+        {
+            continue;
+        }
+        double const row[3] = { p[i0], p[i1], 1.0 };
+        for (int32_t j = 0; j < 3; ++j)
+        {
+            for (int32_t k = 0; k < 3; ++k)
+            {
+                m[j][k] += row[j] * row[k];
+            }
+            r[j] += row[j] * p[axis];
+        }
+    }
+
+    auto const determinant = [](double const (&a)[3][3])
+    {
+        return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+               a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+               a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    };
+    double const d = determinant(m);
+    if (fabs(d) > 1.0e-12)
+    {
+        // Cramer's rule for axis = c0 * i0 + c1 * i1 + c2
+        double coefficients[3];
+        for (int32_t j = 0; j < 3; ++j)
+        {
+            double replaced[3][3];
+            memcpy(replaced, m, sizeof(m));
+            for (int32_t k = 0; k < 3; ++k)
+            {
+                replaced[k][j] = r[k];
+            }
+            coefficients[j] = determinant(replaced) / d;
+        }
+
+        ScenePlane refined;
+        refined.normal[i0] = -coefficients[0];
+        refined.normal[i1] = -coefficients[1];
+        refined.normal[axis] = 1.0;
+        double const length = sqrt(Dot(refined.normal, refined.normal));
+        for (double &component : refined.normal)
+        {
+            component /= length;
+        }
+        refined.distance = coefficients[2] / length;
+
+        uint32_t const inliers = count_inliers(refined);
+        if (inliers >= best_inliers)
+        {
+            best = refined;
+            best_inliers = inliers;
+        }
+    }
+
+    *out_plane = best;
+    *out_inliers = best_inliers;
+    return true;
+}
+
+static bool DecodeFrame(AccuracyContext *context, DatasetImage const &image)
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (!context->decoder.Decode(image.file_path.c_str(), &context->image_pool, &width, &height, &context->pixels))
+    {
+        return false;
+    }
+    if (context->width && (static_cast<int32_t>(width) != context->width || static_cast<int32_t>(height) != context->height))
+    {
+        LOGE("Frame [%s] is %ux%u, unlike the frames before it", image.file_path.c_str(), width, height);
+        return false;
+    }
+
+    context->width = static_cast<int32_t>(width);
+    context->height = static_cast<int32_t>(height);
+    size_t const size = static_cast<size_t>(width) * height;
+    context->scratch.resize(size);
+    context->smoothed.resize(size);
+    context->smoothed_reference.resize(size);
+    return true;
+}
+
+static bool GetFramePose(GroundTruth const &ground_truth, DatasetImage const &image, AccuracyFrame *out_frame)
+{
+    Pose pose;
+    out_frame->has_pose = ground_truth.GetPose(image.timestamp_us, &pose);
+    if (out_frame->has_pose)
+    {
+        GetRotation(pose, out_frame->rotation);
+        for (int32_t i = 0; i < 3; ++i)
+        {
+            out_frame->position[i] = pose.position[i];
+        }
+    }
+    return out_frame->has_pose;
+}
+
+// Normalized coordinates of each feature, as x, y pairs
+template <typename Feature>
+static void UndistortFeatures(AccuracyContext const &context, std::vector<Feature> const &features, std::vector<float> *out_points)
+{
+    uint32_t const count = static_cast<uint32_t>(features.size());
+    std::vector<int32_t> us(count);
+    std::vector<int32_t> vs(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        us[i] = features[i].x;
+        vs[i] = features[i].y;
+    }
+
+    std::vector<float> xs(count);
+    std::vector<float> ys(count);
+    context.undistorter.UndistortPixels(us.data(), vs.data(), count, xs.data(), ys.data());
+    out_points->resize(count * 2);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        (*out_points)[i * 2] = xs[i];
+        (*out_points)[i * 2 + 1] = ys[i];
+    }
+}
+
+// Triangulates BRIEF matches between frames PlaneFitGap apart with their ground truth poses, and fits the scene
+// plane to the points
+static bool FitScenePlane(AccuracyContext *context, std::vector<DatasetImage> const &images, GroundTruth const &ground_truth, ScenePlane *out_plane, DetectorAccuracyReport *out_report)
+{
+    std::vector<double> points;
+    std::vector<double> depths;
+    std::vector<FastFeature> corners;
+    std::vector<BriefFeature> described[2];
+    std::vector<DescriptorMatch> matches;
+    std::vector<float> normalized[2];
+    AccuracyFrame frames[2];
+
+    for (size_t first = 0; first + PlaneFitGap < images.size(); first += PlaneFitStep)
+    {
+        size_t const pair[2] = { first, first + PlaneFitGap };
+        bool posed = true;
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            posed = posed && GetFramePose(ground_truth, images[pair[i]], &frames[i]);
+        }
+        if (!posed)
+        {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            if (!DecodeFrame(context, images[pair[i]]))
+            {
+                return false;
+            }
+            SmoothImage(context->pixels.GetData(), context->width, context->height, context->smooth_kernel, context->scratch.data(), context->smoothed.data(), &context->pool);
+            context->fast.Detect(context->pixels.GetData(), context->width, context->height, context->width, &corners);
+            described[i].clear();
+            context->brief.Compute(context->smoothed.data(), context->width, context->height, corners.data(), static_cast<uint32_t>(corners.size()), &described[i]);
+            UndistortFeatures(*context, described[i], &normalized[i]);
+        }
+
+        context->matcher.SetTrain(described[1].data(), static_cast<uint32_t>(described[1].size()));
+        matches.clear();
+        context->matcher.Match(described[0].data(), static_cast<uint32_t>(described[0].size()), &matches);
+        for (DescriptorMatch const &match : matches)
+        {
+            double point[3];
+            double depth = 0.0;
+            if (Triangulate(context->model, frames[0], &normalized[0][match.query * 2], frames[1], &normalized[1][match.train * 2], point, &depth))
+            {
+                points.insert(points.end(), point, point + 3);
+                depths.push_back(depth);
+            }
+        }
+    }
+
+    out_report->plane_points = static_cast<uint32_t>(depths.size());
+    if (depths.size() < MinPlanePoints)
+    {
+        LOGW("Only %zu points triangulated, too few to fit the scene plane", depths.size());
+        return false;
+    }
+    if (!FitPlane(points, depths, out_plane, &out_report->plane_inliers) ||
+        out_report->plane_inliers < MinPlaneInlierFraction * out_report->plane_points)
+    {
+        LOGW("Only %u of %u triangulated points lie on a plane, so the scene isn't planar", out_report->plane_inliers, out_report->plane_points);
+        return false;
+    }
+    return true;
+}
+
+static float GetFeatureScore(HarrisFeature const &feature) { return feature.response; }
+static float GetFeatureScore(FastFeature const &feature) { return static_cast<float>(feature.score); }
+
+// Pairs optimized features with reference ones, exact positions first. grid is a width * height scratch of -1s,
+// and is left that way
+template <typename Feature>
+static void DiffFeatureSets(std::vector<Feature> const &reference, std::vector<Feature> const &optimized, int32_t const width, int32_t const height,
+    DetectorAccuracyParams const &params, std::vector<int32_t> *inout_grid, FeatureSetDiff *inout_diff)
+{
+    std::vector<int32_t> &grid = *inout_grid;
+    for (uint32_t i = 0; i < reference.size(); ++i)
+    {
+        grid[reference[i].y * width + reference[i].x] = static_cast<int32_t>(i);
+    }
+
+    std::vector<uint32_t> unpaired;
+    uint64_t paired = 0;
+    for (uint32_t i = 0; i < optimized.size(); ++i)
+    {
+        int32_t &cell = grid[optimized[i].y * width + optimized[i].x];
+        if (cell < 0)
+        {
+            unpaired.push_back(i);
+            continue;
+        }
+
+        float const reference_score = GetFeatureScore(reference[cell]);
+        float const difference = fabsf(GetFeatureScore(optimized[i]) - reference_score);
+        inout_diff->score_mismatches += difference > params.score_tolerance * std::max(fabsf(reference_score), std::numeric_limits<float>::min()) ? 1 : 0;
+        ++paired;
+        cell = -1;
+    }
+
+    int32_t const tolerance = params.position_tolerance;
+    uint64_t near = 0;
+    for (uint32_t const i : unpaired)
+    {
+        int32_t best_cell = -1;
+        int32_t best_distance = INT32_MAX;
+        for (int32_t y = std::max(optimized[i].y - tolerance, 0); y <= std::min(optimized[i].y + tolerance, height - 1); ++y)
+        {
+            for (int32_t x = std::max(optimized[i].x - tolerance, 0); x <= std::min(optimized[i].x + tolerance, width - 1); ++x)
+            {
+                int32_t const dx = x - optimized[i].x;
+                int32_t const dy = y - optimized[i].y;
+                if (grid[y * width + x] >= 0 && dx * dx + dy * dy < best_distance)
+                {
+                    best_cell = y * width + x;
+                    best_distance = dx * dx + dy * dy;
+                }
+            }
+        }
+
+        if (best_cell >= 0)
+        {
+            grid[best_cell] = -1;
+            ++near;
+        }
+    }
+
+    inout_diff->exact += paired;
+    inout_diff->near += near;
+    inout_diff->extra += unpaired.size() - near;
+    inout_diff->missing += reference.size() - paired - near;
+    for (Feature const &feature : reference)
+    {
+        grid[feature.y * width + feature.x] = -1;
+    }
+    inout_diff->reference += reference.size();
+    inout_diff->optimized += optimized.size();
+}
+
+static void DiffImages(uint8_t const *reference, uint8_t const *optimized, size_t const size, uint32_t const tolerance, ImageDiff *inout_diff)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint32_t const difference = static_cast<uint32_t>(abs(static_cast<int32_t>(reference[i]) - static_cast<int32_t>(optimized[i])));
+        inout_diff->differing += difference > tolerance ? 1 : 0;
+        inout_diff->max_difference = std::max(inout_diff->max_difference, difference);
+    }
+    inout_diff->pixels += size;
+}
+
+
+// Where each feature of from lands in to, as u, v pairs, and whether it lands at least border from the edges
+template <typename Feature>
+static void TransferFeatures(AccuracyContext const &context, ScenePlane const &plane, AccuracyFrame const &from, AccuracyFrame const &to, std::vector<Feature> const &features,
+    int32_t const border, std::vector<float> *out_positions, std::vector<uint8_t> *out_visible, uint64_t *out_visible_count)
+{
+    std::vector<float> normalized;
+    UndistortFeatures(context, features, &normalized);
+
+    out_positions->resize(features.size() * 2);
+    out_visible->resize(features.size());
+    *out_visible_count = 0;
+    for (size_t i = 0; i < features.size(); ++i)
+    {
+        double u = 0.0;
+        double v = 0.0;
+        bool const visible = TransferPoint(context, plane, from, to, normalized[i * 2], normalized[i * 2 + 1], &u, &v) &&
+            u >= border && u <= context.width - 1 - border && v >= border && v <= context.height - 1 - border;
+        (*out_positions)[i * 2] = static_cast<float>(u);
+        (*out_positions)[i * 2 + 1] = static_cast<float>(v);
+        (*out_visible)[i] = visible ? 1 : 0;
+        *out_visible_count += visible ? 1 : 0;
+    }
+}
+
+// Features of a that land within tolerance of a feature of b, and the fewest of either that land in the other frame
+template <typename Feature>
+static void CountRepeated(AccuracyContext const &context, ScenePlane const &plane, AccuracyFrame const &a, std::vector<Feature> const &a_features,
+    AccuracyFrame const &b, std::vector<Feature> const &b_features, float const tolerance, std::vector<int32_t> *inout_grid, uint64_t *inout_repeated, uint64_t *inout_possible)
+{
+    std::vector<float> a_positions;
+    std::vector<float> b_positions;
+    std::vector<uint8_t> a_visible;
+    std::vector<uint8_t> b_visible;
+    uint64_t a_count = 0;
+    uint64_t b_count = 0;
+    TransferFeatures(context, plane, a, b, a_features, DetectorBorder, &a_positions, &a_visible, &a_count);
+    TransferFeatures(context, plane, b, a, b_features, DetectorBorder, &b_positions, &b_visible, &b_count);
+
+    std::vector<int32_t> &grid = *inout_grid;
+    int32_t const width = context.width;
+    for (size_t i = 0; i < b_features.size(); ++i)
+    {
+        if (b_visible[i])
+        {
+            grid[b_features[i].y * width + b_features[i].x] = static_cast<int32_t>(i);
+        }
+    }
+
+    int32_t const radius = static_cast<int32_t>(ceilf(tolerance));
+    float const tolerance2 = tolerance * tolerance;
+    uint64_t repeated = 0;
+    for (size_t i = 0; i < a_features.size(); ++i)
+    {
+        if (!a_visible[i])
+        {
+            continue;
+        }
+
+        float const u = a_positions[i * 2];
+        float const v = a_positions[i * 2 + 1];
+        int32_t const center_x = static_cast<int32_t>(lroundf(u));
+        int32_t const center_y = static_cast<int32_t>(lroundf(v));
+        bool found = false;
+        for (int32_t y = std::max(center_y - radius, 0); !found && y <= std::min(center_y + radius, context.height - 1); ++y)
+        {
+            for (int32_t x = std::max(center_x - radius, 0); !found && x <= std::min(center_x + radius, width - 1); ++x)
+            {
+                found = grid[y * width + x] >= 0 && (x - u) * (x - u) + (y - v) * (y - v) <= tolerance2;
+            }
+        }
+        repeated += found ? 1 : 0;
+    }
+
+    for (Feature const &feature : b_features)
+    {
+        grid[feature.y * width + feature.x] = -1;
+    }
+
+    uint64_t const possible = std::min(a_count, b_count);
+    *inout_repeated += std::min(repeated, possible);
+    *inout_possible += possible;
+}
+
+static void MatchFeatures(AccuracyContext *context, std::vector<BriefFeature> const &queries, std::vector<BriefFeature> const &train, std::vector<DescriptorMatch> *out_matches)
+{
+    context->matcher.SetTrain(train.data(), static_cast<uint32_t>(train.size()));
+    out_matches->clear();
+    context->matcher.Match(queries.data(), static_cast<uint32_t>(queries.size()), out_matches);
+}
+
+static void MatchFeatures(AccuracyContext *context, std::vector<LegacyFastFeature> const &queries, std::vector<LegacyFastFeature> const &train, std::vector<DescriptorMatch> *out_matches)
+{
+    UNREFERENCED_PARAMETER(context);
+    LegacyMatch(queries, train, out_matches);
+}
+
+// Matches the descriptors of a that land in b against those of b that land in a. Descriptors reach border into
+// the image
+template <typename Feature>
+static void CountMatches(AccuracyContext *context, ScenePlane const &plane, AccuracyFrame const &a, std::vector<Feature> const &a_described,
+    AccuracyFrame const &b, std::vector<Feature> const &b_described, int32_t const border, float const tolerance, RepeatabilityCounts *inout_counts)
+{
+    std::vector<float> a_positions;
+    std::vector<float> b_positions;
+    std::vector<uint8_t> a_visible;
+    std::vector<uint8_t> b_visible;
+    uint64_t a_count = 0;
+    uint64_t b_count = 0;
+    TransferFeatures(*context, plane, a, b, a_described, border, &a_positions, &a_visible, &a_count);
+    TransferFeatures(*context, plane, b, a, b_described, border, &b_positions, &b_visible, &b_count);
+
+    std::vector<Feature> queries;
+    std::vector<uint32_t> query_indices;
+    for (size_t i = 0; i < a_described.size(); ++i)
+    {
+        if (a_visible[i])
+        {
+            queries.push_back(a_described[i]);
+            query_indices.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    std::vector<Feature> train;
+    for (size_t i = 0; i < b_described.size(); ++i)
+    {
+        if (b_visible[i])
+        {
+            train.push_back(b_described[i]);
+        }
+    }
+
+    std::vector<DescriptorMatch> matches;
+    MatchFeatures(context, queries, train, &matches);
+    for (DescriptorMatch const &match : matches)
+    {
+        uint32_t const query = query_indices[match.query];
+        float const dx = train[match.train].x - a_positions[query * 2];
+        float const dy = train[match.train].y - a_positions[query * 2 + 1];
+        inout_counts->correct_matches += dx * dx + dy * dy <= tolerance * tolerance ? 1 : 0;
+    }
+    inout_counts->matches += matches.size();
+    inout_counts->match_possible += std::min(a_count, b_count);
+}
+
+static void ScorePair(AccuracyContext *context, ScenePlane const &plane, AccuracyFrame const &a, PipelineFeatures const &a_features, AccuracyFrame const &b, PipelineFeatures const &b_features,
+    float const tolerance, std::vector<int32_t> *inout_grid, RepeatabilityCounts *inout_counts)
+{
+    ++inout_counts->frames;
+    inout_counts->harris_features += b_features.harris.size();
+    inout_counts->fast_features += b_features.fast.size();
+    CountRepeated(*context, plane, a, a_features.harris, b, b_features.harris, tolerance, inout_grid, &inout_counts->harris_repeated, &inout_counts->harris_possible);
+    CountRepeated(*context, plane, a, a_features.fast, b, b_features.fast, tolerance, inout_grid, &inout_counts->fast_repeated, &inout_counts->fast_possible);
+    CountMatches(context, plane, a, a_features.described, b, b_features.described, BriefBorder, tolerance, inout_counts);
+}
+
+static void ScorePair(AccuracyContext *context, ScenePlane const &plane, AccuracyFrame const &a, LegacyFeatures const &a_features, AccuracyFrame const &b, LegacyFeatures const &b_features,
+    float const tolerance, std::vector<int32_t> *inout_grid, RepeatabilityCounts *inout_counts)
+{
+    ++inout_counts->frames;
+    inout_counts->harris_features += b_features.harris.size();
+    inout_counts->fast_features += b_features.fast.size();
+    CountRepeated(*context, plane, a, a_features.harris, b, b_features.harris, tolerance, inout_grid, &inout_counts->harris_repeated, &inout_counts->harris_possible);
+    CountRepeated(*context, plane, a, a_features.fast, b, b_features.fast, tolerance, inout_grid, &inout_counts->fast_repeated, &inout_counts->fast_possible);
+    CountMatches(context, plane, a, a_features.fast, b, b_features.fast, LegacyDescriptorBorder, tolerance, inout_counts);
+}
+
+static void GetScores(RepeatabilityCounts const &counts, RepeatabilityScores *out_scores)
+{
+    auto const ratio = [](uint64_t const numerator, uint64_t const denominator)
+    {
+        return denominator > 0 ? static_cast<double>(numerator) / denominator : 0.0;
+    };
+    out_scores->harris_features = ratio(counts.harris_features, counts.frames);
+    out_scores->fast_features = ratio(counts.fast_features, counts.frames);
+    out_scores->harris = ratio(counts.harris_repeated, counts.harris_possible);
+    out_scores->fast = ratio(counts.fast_repeated, counts.fast_possible);
+    out_scores->matching_score = ratio(counts.correct_matches, counts.match_possible);
+    out_scores->match_precision = ratio(counts.correct_matches, counts.matches);
+}
+
+bool RunDetectorAccuracy(DetectorAccuracyParams const &params, DetectorAccuracyReport *out_report)
+{
+    *out_report = DetectorAccuracyReport();
+
+    std::vector<DatasetImage> images;
+    if (!ReadImageList(params.data_root, &images))
+    {
+        return false;
+    }
+    uint32_t const frame_count = params.max_frames > 0 ? std::min(params.max_frames, static_cast<uint32_t>(images.size())) : static_cast<uint32_t>(images.size());
+
+    std::unique_ptr<AccuracyContext> context = std::make_unique<AccuracyContext>();
+    if (!context->pool.Initialize(params.num_threads))
+    {
+        LOGE("Failed to initialize thread pool");
+        return false;
+    }
+    context->harris.SetThreadPool(&context->pool);
+    context->fast.SetThreadPool(&context->pool);
+    context->matcher.SetThreadPool(&context->pool);
+    GenerateGaussian(0.5f, 9, &context->smooth_kernel);
+
+    // Scoring needs the calibration and ground truth, and a planar scene
+    std::string const root = GetDatasetRoot(params.data_root);
+    std::string const calib_path = root + "calib.txt";
+    std::string const ground_truth_path = root + "groundtruth.txt";
+    GroundTruth ground_truth;
+    ScenePlane plane{};
+    bool scoring = std::ifstream(calib_path).is_open() && std::ifstream(ground_truth_path).is_open();
+    if (!scoring)
+    {
+        LOGW("No calib.txt and groundtruth.txt in [%s], so nothing is scored across frames", params.data_root);
+    }
+    else
+    {
+        if (!LoadCameraModel(calib_path.c_str(), &context->model) || !ground_truth.Load(ground_truth_path.c_str()) ||
+            !DecodeFrame(context.get(), images.front()))
+        {
+            return false;
+        }
+
+        context->undistorter.Initialize(context->model);
+        context->undistorter.BuildCache(context->width, context->height);
+        float const corner_us[4] = { 0.0f, context->width - 1.0f, 0.0f, context->width - 1.0f };
+        float const corner_vs[4] = { 0.0f, 0.0f, context->height - 1.0f, context->height - 1.0f };
+        float corner_xs[4];
+        float corner_ys[4];
+        UndistortPointsReference(context->model, corner_us, corner_vs, 4, corner_xs, corner_ys);
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            context->max_radius2 = std::max(context->max_radius2, static_cast<double>(corner_xs[i]) * corner_xs[i] + static_cast<double>(corner_ys[i]) * corner_ys[i]);
+        }
+
+        scoring = FitScenePlane(context.get(), images, ground_truth, &plane, out_report);
+    }
+
+    std::vector<AccuracyFrame> frames(params.frame_gap + 1);
+    std::vector<HarrisFeature> harris_reference;
+    std::vector<HarrisFeature> harris_fused;
+    std::vector<int32_t> grid;
+    RepeatabilityCounts optimized_counts;
+    RepeatabilityCounts reference_counts;
+    RepeatabilityCounts legacy_counts;
+    uint64_t descriptor_distance_sum = 0;
+    HarrisParams const &harris_params = context->harris.GetParams();
+    FastParams const &fast_params = context->fast.GetParams();
+
+    for (uint32_t index = 0; index < frame_count; ++index)
+    {
+        AccuracyFrame &frame = frames[index % frames.size()];
+        if (!DecodeFrame(context.get(), images[index]))
+        {
+            return false;
+        }
+        frame.has_pose = scoring && GetFramePose(ground_truth, images[index], &frame);
+
+        int32_t const width = context->width;
+        int32_t const height = context->height;
+        uint8_t const *pixels = context->pixels.GetData();
+        uint8_t const *smoothed = context->smoothed.data();
+        uint8_t const *smoothed_reference = context->smoothed_reference.data();
+        grid.resize(static_cast<size_t>(width) * height, -1);
+
+        SmoothImage(pixels, width, height, context->smooth_kernel, context->scratch.data(), context->smoothed.data(), &context->pool);
+        SmoothImageReference(pixels, width, height, context->smooth_kernel, context->scratch.data(), context->smoothed_reference.data());
+        DiffImages(smoothed_reference, smoothed, context->smoothed.size(), params.smooth_tolerance, &out_report->smooth);
+
+        // Each optimized kernel against its reference on the same input
+        PipelineFeatures &optimized = frame.optimized;
+        context->harris.Detect(smoothed, width, height, &optimized.harris);
+        HarrisDetectReference(smoothed, width, height, harris_params, &harris_reference);
+        DiffFeatureSets(harris_reference, optimized.harris, width, height, params, &grid, &out_report->harris);
+
+        context->harris.DetectFused(pixels, width, height, context->smooth_kernel, &harris_fused);
+        DiffFeatureSets(harris_reference, harris_fused, width, height, params, &grid, &out_report->harris_fused);
+
+        PipelineFeatures &reference = frame.reference;
+        context->fast.Detect(pixels, width, height, width, &optimized.fast);
+        FastDetectReference(pixels, width, height, width, fast_params, &reference.fast);
+        DiffFeatureSets(reference.fast, optimized.fast, width, height, params, &grid, &out_report->fast);
+
+        optimized.described.clear();
+        context->brief.Compute(smoothed, width, height, optimized.fast.data(), static_cast<uint32_t>(optimized.fast.size()), &optimized.described);
+        for (BriefFeature const &feature : optimized.described)
+        {
+            float angle = 0.0f;
+            BriefDescriptor descriptor;
+            ComputeBriefReference(smoothed, width, feature.x, feature.y, &angle, &descriptor);
+            uint32_t const distance = HammingDistance(descriptor, feature.descriptor);
+            out_report->brief.differing += distance > params.descriptor_tolerance || angle != feature.angle ? 1 : 0;
+            out_report->brief.max_distance = std::max(out_report->brief.max_distance, distance);
+            descriptor_distance_sum += distance;
+        }
+        out_report->brief.compared += optimized.described.size();
+
+        // The reference pipeline, end to end
+        HarrisDetectReference(smoothed_reference, width, height, harris_params, &reference.harris);
+        reference.described.clear();
+        for (uint32_t i = 0; i < reference.fast.size(); ++i)
+        {
+            FastFeature const &corner = reference.fast[i];
+            if (corner.x >= BriefBorder && corner.x < width - BriefBorder && corner.y >= BriefBorder && corner.y < height - BriefBorder)
+            {
+                BriefFeature feature{};
+                feature.x = corner.x;
+                feature.y = corner.y;
+                feature.scale = 1.0f;
+                feature.index = i;
+                ComputeBriefReference(smoothed_reference, width, corner.x, corner.y, &feature.angle, &feature.descriptor);
+                reference.described.push_back(feature);
+            }
+        }
+
+        // The legacy pipeline, which only ever ran on one thread
+        LegacyFeatures &legacy = frame.legacy;
+        LegacyHarrisDetect(smoothed_reference, width, height, &legacy.harris);
+        legacy.fast.resize(LegacyMaxFeatures);
+        legacy.fast.resize(LegacyFast(pixels, smoothed_reference, width, height, width, LegacySegmentSize, LegacyThreshold, LegacyMaxFeatures, legacy.fast.data()));
+
+        AccuracyFrame const &previous = frames[(index + 1) % frames.size()];
+        if (index >= params.frame_gap && frame.has_pose && previous.has_pose)
+        {
+            ScorePair(context.get(), plane, previous, previous.optimized, frame, frame.optimized, params.correspondence_tolerance, &grid, &optimized_counts);
+            ScorePair(context.get(), plane, previous, previous.reference, frame, frame.reference, params.correspondence_tolerance, &grid, &reference_counts);
+            ScorePair(context.get(), plane, previous, previous.legacy, frame, frame.legacy, params.correspondence_tolerance, &grid, &legacy_counts);
+            ++out_report->pairs;
+        }
+    }
+
+    out_report->data_root = params.data_root;
+    out_report->num_threads = context->pool.GetThreadCount();
+    out_report->width = static_cast<uint32_t>(context->width);
+    out_report->height = static_cast<uint32_t>(context->height);
+    out_report->frames = frame_count;
+    out_report->brief.mean_distance = out_report->brief.compared > 0 ? static_cast<double>(descriptor_distance_sum) / out_report->brief.compared : 0.0;
+    GetScores(optimized_counts, &out_report->optimized);
+    GetScores(reference_counts, &out_report->reference);
+    GetScores(legacy_counts, &out_report->legacy);
+    return true;
+}
+
+bool IsWithinTolerance(DetectorAccuracyReport const &report)
+{
+    auto const matches = [](FeatureSetDiff const &diff)
+    {
+        return 0 == diff.missing && 0 == diff.extra && 0 == diff.score_mismatches;
+    };
+    return 0 == report.smooth.differing && matches(report.harris) && matches(report.harris_fused) && matches(report.fast) && 0 == report.brief.differing;
+}
+
+void PrintDetectorAccuracyReport(DetectorAccuracyReport const &report)
+{
+    printf("Dataset [%s], %u frames of %ux%u, %u threads\n", report.data_root, report.frames, report.width, report.height, report.num_threads);
+
+    printf("  %-14s %10s %10s %10s %8s %8s %8s %8s\n", "kernel", "reference", "optimized", "exact", "near", "missing", "extra", "score");
+    auto const print_diff = [](char const *name, FeatureSetDiff const &diff)
+    {
+        printf("  %-14s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n",
+            name, diff.reference, diff.optimized, diff.exact, diff.near, diff.missing, diff.extra, diff.score_mismatches);
+    };
+    print_diff("harris", report.harris);
+    print_diff("harris fused", report.harris_fused);
+    print_diff("fast", report.fast);
+    printf("  smooth: %" PRIu64 " of %" PRIu64 " pixels out of tolerance, max difference %u\n",
+        report.smooth.differing, report.smooth.pixels, report.smooth.max_difference);
+    printf("  brief: %" PRIu64 " of %" PRIu64 " descriptors out of tolerance, max %u bits, mean %.3f bits\n",
+        report.brief.differing, report.brief.compared, report.brief.max_distance, report.brief.mean_distance);
+
+    if (report.pairs > 0)
+    {
+        printf("  scene plane fitted to %u of %u triangulated points\n", report.plane_inliers, report.plane_points);
+        printf("  %-14s %10s %10s %10s   over %u frame pairs\n", "score", "optimized", "reference", "legacy", report.pairs);
+        printf("  %-14s %10.1f %10.1f %10.1f\n", "harris/frame", report.optimized.harris_features, report.reference.harris_features, report.legacy.harris_features);
+        printf("  %-14s %10.1f %10.1f %10.1f\n", "fast/frame", report.optimized.fast_features, report.reference.fast_features, report.legacy.fast_features);
+        printf("  %-14s %10.4f %10.4f %10.4f\n", "harris repeat", report.optimized.harris, report.reference.harris, report.legacy.harris);
+        printf("  %-14s %10.4f %10.4f %10.4f\n", "fast repeat", report.optimized.fast, report.reference.fast, report.legacy.fast);
+        printf("  %-14s %10.4f %10.4f %10.4f\n", "matching", report.optimized.matching_score, report.reference.matching_score, report.legacy.matching_score);
+        printf("  %-14s %10.4f %10.4f %10.4f\n", "precision", report.optimized.match_precision, report.reference.match_precision, report.legacy.match_precision);
+    }
+
+    printf("  %s\n", IsWithinTolerance(report) ? "Every kernel matches its reference" : "Kernels differ from their reference");
+}
+
+bool WriteDetectorAccuracyJson(DetectorAccuracyReport const &report, char const *path)
+{
+    ReportFile report_file;
+    if (!report_file.Create(path))
+    {
+        return false;
+    }
+    FILE *file = report_file.GetFile();
+
+    auto const write_diff = [file](char const *name, FeatureSetDiff const &diff)
+    {
+        fprintf(file, "    \"%s\": { \"reference\": %" PRIu64 ", \"optimized\": %" PRIu64 ", \"exact\": %" PRIu64 ", \"near\": %" PRIu64
+            ", \"missing\": %" PRIu64 ", \"extra\": %" PRIu64 ", \"score_mismatches\": %" PRIu64 " },\n",
+            name, diff.reference, diff.optimized, diff.exact, diff.near, diff.missing, diff.extra, diff.score_mismatches);
+    };
+    auto const write_scores = [file](char const *name, RepeatabilityScores const &scores, char const *separator)
+    {
+        fprintf(file, "    \"%s\": { \"harris_features\": %.2f, \"fast_features\": %.2f, \"harris\": %.5f, \"fast\": %.5f, \"matching_score\": %.5f, \"match_precision\": %.5f }%s\n",
+            name, scores.harris_features, scores.fast_features, scores.harris, scores.fast, scores.matching_score, scores.match_precision, separator);
+    };
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"data_root\": ");
+    WriteJsonString(file, report.data_root);
+    fprintf(file, ",\n");
+    fprintf(file, "  \"threads\": %u,\n", report.num_threads);
+    fprintf(file, "  \"width\": %u,\n", report.width);
+    fprintf(file, "  \"height\": %u,\n", report.height);
+    fprintf(file, "  \"frames\": %u,\n", report.frames);
+    fprintf(file, "  \"within_tolerance\": %s,\n", IsWithinTolerance(report) ? "true" : "false");
+    fprintf(file, "  \"kernels\": {\n");
+    write_diff("harris", report.harris);
+    write_diff("harris_fused", report.harris_fused);
+    write_diff("fast", report.fast);
+    fprintf(file, "    \"smooth\": { \"pixels\": %" PRIu64 ", \"differing\": %" PRIu64 ", \"max_difference\": %u },\n",
+        report.smooth.pixels, report.smooth.differing, report.smooth.max_difference);
+    fprintf(file, "    \"brief\": { \"compared\": %" PRIu64 ", \"differing\": %" PRIu64 ", \"max_distance\": %u, \"mean_distance\": %.4f }\n",
+        report.brief.compared, report.brief.differing, report.brief.max_distance, report.brief.mean_distance);
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"plane_points\": %u,\n", report.plane_points);
+    fprintf(file, "  \"plane_inliers\": %u,\n", report.plane_inliers);
+    fprintf(file, "  \"pairs\": %u,\n", report.pairs);
+    fprintf(file, "  \"scores\": {\n");
+    write_scores("optimized", report.optimized, ",");
+    write_scores("reference", report.reference, ",");
+    write_scores("legacy", report.legacy, "");
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+
+    return report_file.Close();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// Agreement of an optimized image kernel with its reference
+struct ImageDiff
+{
+    uint64_t pixels = 0;
+    uint64_t differing = 0;         // further apart than the tolerance
+    uint32_t max_difference = 0;
+};
+
+// Agreement of the features an optimized detector finds with those its reference finds on the same image. Each
+// optimized feature is paired with a reference feature at the same position, or failing that with the nearest
+// unpaired one within the position tolerance
+struct FeatureSetDiff
+{
+    uint64_t reference = 0;         // features the reference found
+    uint64_t optimized = 0;
+    uint64_t exact = 0;             // paired at the same position
+    uint64_t near = 0;              // paired within the position tolerance
+    uint64_t missing = 0;           // reference features left unpaired
+    uint64_t extra = 0;             // optimized features left unpaired
+    uint64_t score_mismatches = 0;  // exact pairs whose scores differ by more than the score tolerance
+};
+
+// Agreement of optimized descriptors with reference ones, computed for the same features on the same image
+struct DescriptorDiff
+{
+    uint64_t compared = 0;
+    uint64_t differing = 0;         // more bits apart than the tolerance, or oriented differently
+    uint32_t max_distance = 0;      // bits
+    double   mean_distance = 0.0;
+};
+
+// How well features survive the camera motion between the two frames of a pair. Only features that land inside
+// both frames count, and each score is over the smaller of the two frames' counts. The scores mean little without
+// the feature counts: a detector that fires everywhere repeats perfectly
+struct RepeatabilityScores
+{
+    double harris_features = 0.0;   // found per frame
+    double fast_features = 0.0;
+    double harris = 0.0;            // features with a feature of the other frame within the correspondence tolerance
+    double fast = 0.0;
+    double matching_score = 0.0;    // BRIEF matches to the feature within the correspondence tolerance
+    double match_precision = 0.0;   // of all BRIEF matches, those to the feature within the correspondence tolerance
+};
+
+struct DetectorAccuracyParams
+{
+    char const *data_root = nullptr;
+    uint32_t    num_threads = 0;                    // of the optimized kernels. 0 uses one per hardware thread
+    uint32_t    max_frames = 0;                     // 0 runs every frame of the dataset
+    uint32_t    frame_gap = 1;                      // frames from the first frame of a pair to the second
+    uint32_t    smooth_tolerance = 1;               // intensity levels
+    int32_t     position_tolerance = 0;             // pixels along each axis
+    float       score_tolerance = 1.0e-4f;          // relative to the reference score
+    uint32_t    descriptor_tolerance = 0;           // bits
+    float       correspondence_tolerance = 2.5f;    // pixels from where a feature of the other frame is predicted to land
+};
+
+struct DetectorAccuracyReport
+{
+    char const         *data_root = nullptr;
+    uint32_t            num_threads = 0;
+    uint32_t            width = 0;
+    uint32_t            height = 0;
+    uint32_t            frames = 0;
+
+    ImageDiff           smooth;             // SmoothImage against SmoothImageReference
+    FeatureSetDiff      harris;             // HarrisDetector::Detect against HarrisDetectReference, on SmoothImage's output
+    FeatureSetDiff      harris_fused;       // HarrisDetector::DetectFused against the same
+    FeatureSetDiff      fast;               // FastDetector against FastDetectReference
+    DescriptorDiff      brief;              // BriefExtractor against ComputeBriefReference, for FastDetector's corners
+
+    uint32_t            plane_points = 0;   // triangulated to fit the scene plane
+    uint32_t            plane_inliers = 0;
+    uint32_t            pairs = 0;          // frame pairs scored, 0 without ground truth and calibration
+    RepeatabilityScores optimized;          // of the optimized kernels
+    RepeatabilityScores reference;          // of the reference implementations, smoothing included
+    RepeatabilityScores legacy;             // of the routines the kernels replaced, on the reference smoothing
+};
+
+//
+// Detector accuracy regression check
+//
+// Runs every optimized kernel next to its scalar reference on each frame of a dataset, with both given the same
+// input, and counts where their results differ by more than the tolerances. The references are the scalar
+// routines the kernels were written from, with the same behaviour changes: HarrisDetectReference computes the
+// normalized float response and threshold of HarrisDetector rather than the original HarrisDetect's (see it, and
+// the legacy pipeline below).
+//
+// Then scores both pipelines on what matters downstream: how many features are found again in the next frame,
+// and how many BRIEF matches are right. Where a feature should land in another frame is predicted from the ground
+// truth poses and the calibration. Our datasets film a planar scene, so it goes through the scene plane, which is
+// fitted to points triangulated from BRIEF matches between frames far enough apart to have parallax.
+//
+// A third, legacy pipeline is scored alongside as the baseline: copies of the original FAST, ComputeDescriptor
+// and HarrisDetect, faults and all. Its Harris derivatives wrap through the unsigned Convolve and it keeps every
+// |R| past a fixed threshold, so it fires on thousands of pixels a frame and repeats trivially; its FAST stops at
+// the first 100 corners from the top of the image, without suppression; and it matches the first 128-bit random
+// descriptor a few bits away. The feature counts printed with the scores show where the repeatability comes from.
+//
+bool RunDetectorAccuracy(DetectorAccuracyParams const &params, DetectorAccuracyReport *out_report);
+
+// Whether every optimized kernel matched its reference within the tolerances it was run with
+bool IsWithinTolerance(DetectorAccuracyReport const &report);
+
+void PrintDetectorAccuracyReport(DetectorAccuracyReport const &report);
+
+// Writes the report as JSON
+bool WriteDetectorAccuracyJson(DetectorAccuracyReport const &report, char const *path);
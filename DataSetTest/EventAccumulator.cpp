@@ -0,0 +1,255 @@
+#include "Precomp.h"
+#include "EventAccumulator.h"
+
+bool TimeSurface::Initialize(uint32_t const width, uint32_t const height, uint32_t const decay_us)
+{
+    if (0 == width || 0 == height || 0 == decay_us)
+    {
+        LOGE("Invalid %ux%u time surface with a decay of %uus", width, height, decay_us);
+        return false;
+    }
+
+    width_ = width;
+    height_ = height;
+    decay_us_ = decay_us;
+    timestamps_us_.resize(static_cast<size_t>(width) * height);
+    polarities_.resize(timestamps_us_.size());
+    Reset();
+
+    for (uint32_t i = 0; i < DecayTableSize; ++i)
+    {
+        double const age = (i + 0.5) * DecayRange / DecayTableSize;
+        decay_table_[i] = static_cast<int16_t>(lround(127.0 * exp(-age)));
+    }
+    return true;
+}
+
+void TimeSurface::Reset()
+{
+    std::fill(timestamps_us_.begin(), timestamps_us_.end(), 0);
+    std::fill(polarities_.begin(), polarities_.end(), static_cast<int8_t>(0));
+}
+
+void TimeSurface::Add(EventBatch const &batch, size_t const begin, size_t const end)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        uint32_t const x = batch.xs[i];
+        uint32_t const y = batch.ys[i];
+        if (x >= width_ || y >= height_)
+        {
+            continue;
+        }
+
+        size_t const pixel = static_cast<size_t>(y) * width_ + x;
+        timestamps_us_[pixel] = batch.timestamps_us[i];
+        polarities_[pixel] = batch.polarities[i] ? 1 : -1;
+    }
+}
+
+void TimeSurface::Render(uint64_t const timestamp_us, uint8_t *output) const
+{
+    uint64_t const range_us = static_cast<uint64_t>(decay_us_) * DecayRange;
+    float const index_scale = static_cast<float>(DecayTableSize) / range_us;
+
+    size_t const size = timestamps_us_.size();
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint64_t const pixel_timestamp_us = timestamps_us_[i];
+        uint64_t const age_us = timestamp_us > pixel_timestamp_us ? timestamp_us - pixel_timestamp_us : 0;
+        if (0 == polarities_[i] || age_us >= range_us)
+        {
+            output[i] = 128;
+            continue;
+        }
+
+        uint32_t const index = std::min(static_cast<uint32_t>(age_us * index_scale), DecayTableSize - 1);
+        output[i] = static_cast<uint8_t>(128 + polarities_[i] * decay_table_[index]);
+    }
+}
+
+bool EventFrameAccumulator::Initialize(uint32_t const width, uint32_t const height, EventFrameParams const &params)
+{
+    if ((EventWindow::FixedCount == params.window && 0 == params.event_count) ||
+        (EventWindow::FixedDuration == params.window && 0 == params.duration_us))
+    {
+        LOGE("Event frame windows must not be empty");
+        return false;
+    }
+
+    if (!time_surface_.Initialize(width, height, params.time_surface_decay_us))
+    {
+        return false;
+    }
+
+    width_ = width;
+    height_ = height;
+    params_ = params;
+    pixels_.Reset();
+    window_open_ = false;
+    window_events_ = 0;
+    return true;
+}
+
+void EventFrameAccumulator::StartWindow(BufferPool *pool, uint64_t const timestamp_us)
+{
+    pixels_ = pool->Acquire(static_cast<size_t>(width_) * height_);
+    if (EventRendering::EventFrame == params_.rendering)
+    {
+        memset(pixels_.GetData(), 128, pixels_.GetSize());
+    }
+
+    window_open_ = true;
+    window_start_us_ = timestamp_us;
+    last_timestamp_us_ = timestamp_us;
+    window_events_ = 0;
+}
+
+void EventFrameAccumulator::FinishWindow(uint64_t const timestamp_us, CameraFrame *out_frame)
+{
+    if (EventRendering::TimeSurface == params_.rendering)
+    {
+        time_surface_.Render(timestamp_us, pixels_.GetData());
+    }
+
+    out_frame->timestamp_us = timestamp_us;
+    out_frame->width = width_;
+    out_frame->height = height_;
+    out_frame->pixels = std::move(pixels_);
+    out_frame->has_pose = false;
+
+    window_open_ = false;
+    window_events_ = 0;
+}
+
+bool EventFrameAccumulator::Accumulate(BufferPool *pool, EventBatch const &batch, size_t *inout_index, CameraFrame *out_frame)
+{
+    size_t const begin = *inout_index;
+    size_t const count = batch.GetCount();
+    if (begin >= count)
+    {
+        return false;
+    }
+
+    uint64_t const *timestamps_us = batch.timestamps_us.data();
+    if (!window_open_)
+    {
+        StartWindow(pool, timestamps_us[begin]);
+    }
+
+    // Find where the window closes first, so the events in it can be added in one go
+    size_t end = count;
+    bool closes = false;
+    uint64_t const window_end_us = window_start_us_ + params_.duration_us;
+    if (EventWindow::FixedCount == params_.window)
+    {
+        size_t const remaining = params_.event_count - window_events_;
+        if (count - begin >= remaining)
+        {
+            end = begin + remaining;
+            closes = true;
+        }
+    }
+    else
+    {
+        end = static_cast<size_t>(std::lower_bound(timestamps_us + begin, timestamps_us + count, window_end_us) - timestamps_us);
+        closes = end < count;
+    }
+
+    if (EventRendering::EventFrame == params_.rendering)
+    {
+        uint8_t *pixels = pixels_.GetData();
+        int32_t const contrast = params_.contrast;
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint32_t const x = batch.xs[i];
+            uint32_t const y = batch.ys[i];
+            if (x >= width_ || y >= height_)
+            {
+                continue;
+            }
+
+            uint8_t &pixel = pixels[static_cast<size_t>(y) * width_ + x];
+            pixel = static_cast<uint8_t>(batch.polarities[i] ? std::min(pixel + contrast, 255) : std::max(pixel - contrast, 0));
+        }
+    }
+    else
+    {
+        time_surface_.Add(batch, begin, end);
+    }
+
+    if (end > begin)
+    {
+        window_events_ += static_cast<uint32_t>(end - begin);
+        last_timestamp_us_ = timestamps_us[end - 1];
+    }
+    *inout_index = end;
+
+    if (!closes)
+    {
+        return false;
+    }
+
+    // Fixed-duration windows follow each other without gaps, so the next one opens right away
+    if (EventWindow::FixedCount == params_.window)
+    {
+        FinishWindow(last_timestamp_us_, out_frame);
+    }
+    else
+    {
+        FinishWindow(window_end_us, out_frame);
+        StartWindow(pool, window_end_us);
+    }
+    return true;
+}
+
+bool EventFrameAccumulator::Flush(CameraFrame *out_frame)
+{
+    if (!window_open_ || 0 == window_events_)
+    {
+        pixels_.Reset();
+        window_open_ = false;
+        return false;
+    }
+
+    FinishWindow(last_timestamp_us_, out_frame);
+    return true;
+}
+
+bool EventFrameProvider::Initialize(EventSource *source, uint32_t const width, uint32_t const height, EventFrameParams const &params)
+{
+    source_ = source;
+    batch_.Clear();
+    next_event_ = 0;
+    ended_ = true;
+
+    if (!accumulator_.Initialize(width, height, params))
+    {
+        return false;
+    }
+
+    ended_ = false;
+    return true;
+}
+
+bool EventFrameProvider::GetNextFrame(CameraFrame *out_frame)
+{
+    while (!ended_)
+    {
+        if (next_event_ == batch_.GetCount())
+        {
+            next_event_ = 0;
+            if (!source_->ReadEvents(BatchSize, &batch_))
+            {
+                ended_ = true;
+                return accumulator_.Flush(out_frame);
+            }
+        }
+
+        if (accumulator_.Accumulate(&pool_, batch_, &next_event_, out_frame))
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "EventStream.h"
+
+enum class EventWindow
+{
+    FixedCount,     // a frame every event_count events
+    FixedDuration,  // a frame every duration_us of event time, even when no events arrived in it
+};
+
+enum class EventRendering
+{
+    EventFrame,     // the events of the window, added up per pixel around mid gray
+    TimeSurface,    // every pixel's latest event, fading exponentially with its age
+};
+
+struct EventFrameParams
+{
+    EventWindow    window = EventWindow::FixedDuration;
+    uint32_t       event_count = 5000;
+    uint64_t       duration_us = 33333;
+    EventRendering rendering = EventRendering::EventFrame;
+    uint8_t        contrast = 64;                   // per event brightening or darkening of an event frame
+    uint32_t       time_surface_decay_us = 30000;   // time constant of the time surface fading
+};
+
+//
+// Latest event of every pixel, rendered as an exponentially decaying time surface
+//
+// Adding an event only overwrites its pixel, so the cost of keeping the surface current is independent of its
+// size, and the exponential is only evaluated, through a table, when rendering.
+//
+class TimeSurface : private NonCopyable
+{
+public:
+    TimeSurface() = default;
+
+    bool Initialize(uint32_t const width, uint32_t const height, uint32_t const decay_us);
+
+    // Forgets every event
+    void Reset();
+
+    // Events outside of the surface are ignored
+    void Add(EventBatch const &batch, size_t const begin, size_t const end);
+
+    // 128 + or - 127 exp(-age / decay_us) by the polarity of each pixel's latest event, and 128 where there
+    // was none. Events newer than timestamp_us count as current
+    void Render(uint64_t const timestamp_us, uint8_t *output) const;
+
+private:
+    // Ages beyond this many time constants render as no event
+    static uint32_t const DecayRange = 8;
+    static uint32_t const DecayTableSize = 1024;
+
+private:
+    uint32_t              width_ = 0;
+    uint32_t              height_ = 0;
+    uint32_t              decay_us_ = 0;
+    std::vector<uint64_t> timestamps_us_;
+    std::vector<int8_t>   polarities_;                  // 1 or -1, or 0 for no event yet
+    int16_t               decay_table_[DecayTableSize]; // 127 exp(-age / decay_us) at ages in steps of DecayRange decay_us / DecayTableSize
+};
+
+//
+// Turns a stream of events into frames over fixed-count or fixed-duration windows
+//
+// The frame of the current window is updated event by event as events come in, so it is ready as soon as the
+// window closes. Frames come from the pool passed in, and are handed over to the caller.
+//
+class EventFrameAccumulator : private NonCopyable
+{
+public:
+    EventFrameAccumulator() = default;
+
+    bool Initialize(uint32_t const width, uint32_t const height, EventFrameParams const &params);
+
+    // Adds events of batch from *inout_index on, until the batch runs out or the current window closes. In
+    // the latter case, *inout_index is left at the first event of the next window, the frame of the closed window
+    // is returned in out_frame, timestamped at the end of the window, and this returns true
+    bool Accumulate(BufferPool *pool, EventBatch const &batch, size_t *inout_index, CameraFrame *out_frame);
+
+    // Closes the current window early, such as at the end of the stream. Returns false if it has no events
+    bool Flush(CameraFrame *out_frame);
+
+private:
+    void StartWindow(BufferPool *pool, uint64_t const timestamp_us);
+    void FinishWindow(uint64_t const timestamp_us, CameraFrame *out_frame);
+
+private:
+    uint32_t         width_ = 0;
+    uint32_t         height_ = 0;
+    EventFrameParams params_;
+    TimeSurface      time_surface_;
+    ImageBuffer      pixels_;                    // frame of the current window, while it is open
+    bool             window_open_ = false;
+    uint64_t         window_start_us_ = 0;
+    uint64_t         last_timestamp_us_ = 0;     // of the latest event in the window
+    uint32_t         window_events_ = 0;
+};
+
+//
+// Frames accumulated from an event stream
+//
+// Reads events in batches, so however long the stream is, memory use only depends on the frame size. Ends, after
+// the frame of the last partial window, when the stream ends.
+//
+class EventFrameProvider
+    : private NonCopyable
+    , public FrameProvider
+{
+public:
+    EventFrameProvider() = default;
+
+    // Takes events from source, which must outlive this. Events are in width x height pixel coordinates
+    bool Initialize(EventSource *source, uint32_t const width, uint32_t const height, EventFrameParams const &params);
+
+    // FrameProvider
+    virtual bool GetNextFrame(CameraFrame *out_frame) override;
+
+private:
+    // Events read from the source at a time
+    static uint32_t const BatchSize = 4096;
+
+private:
+    EventSource          *source_ = nullptr;
+    EventFrameAccumulator accumulator_;
+    BufferPool            pool_;
+    EventBatch            batch_;
+    size_t                next_event_ = 0;
+    bool                  ended_ = true;
+};
@@ -0,0 +1,195 @@
+#include "Precomp.h"
+#include "EventStream.h"
+
+void EventBatch::Clear()
+{
+    timestamps_us.clear();
+    xs.clear();
+    ys.clear();
+    polarities.clear();
+}
+
+void EventBatch::Add(uint64_t const timestamp_us, uint16_t const x, uint16_t const y, uint8_t const polarity)
+{
+    timestamps_us.push_back(timestamp_us);
+    xs.push_back(x);
+    ys.push_back(y);
+    polarities.push_back(polarity);
+}
+
+bool EventFileReader::Initialize(char const *path)
+{
+    path_ = path;
+    discarded_ = 0;
+    last_timestamp_us_ = 0;
+    reader_ = TextReader(nullptr, nullptr);
+
+    if (!file_.Open(path))
+    {
+        return false;
+    }
+
+    char const *text = reinterpret_cast<char const *>(file_.GetData());
+    reader_ = TextReader(text, text + file_.GetSize());
+
+    LOGD("Streaming events from [%s], %zu bytes", path, file_.GetSize());
+    return true;
+}
+
+bool EventFileReader::ReadEvents(uint32_t const max_count, EventBatch *out_batch)
+{
+    out_batch->Clear();
+
+    while (out_batch->GetCount() < max_count && reader_.NextLine())
+    {
+        uint64_t timestamp_us = 0;
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t polarity = 0;
+        if (!reader_.ReadTimestampUs(&timestamp_us) || !reader_.ReadUint32(&x) || !reader_.ReadUint32(&y) ||
+            !reader_.ReadUint32(&polarity) || !reader_.AtLineEnd() || x > UINT16_MAX || y > UINT16_MAX || polarity > 1)
+        {
+            LOGE("[%s] line %u isn't an event", path_.c_str(), reader_.GetLineNumber());
+            out_batch->Clear();
+            return false;
+        }
+        if (timestamp_us < last_timestamp_us_)
+        {
+            LOGE("[%s] line %u goes back in time", path_.c_str(), reader_.GetLineNumber());
+            out_batch->Clear();
+            return false;
+        }
+        last_timestamp_us_ = timestamp_us;
+
+        out_batch->Add(timestamp_us, static_cast<uint16_t>(x), static_cast<uint16_t>(y), static_cast<uint8_t>(polarity));
+    }
+
+    size_t const parsed = static_cast<size_t>(reader_.GetPosition() - reinterpret_cast<char const *>(file_.GetData()));
+    if (parsed - discarded_ >= DiscardGranularity)
+    {
+        file_.Discard(discarded_, parsed - discarded_);
+        discarded_ = parsed;
+    }
+
+    return out_batch->GetCount() > 0;
+}
+
+bool SyntheticEventSource::Initialize(FrameProvider *frames, SyntheticEventParams const &params)
+{
+    frames_ = frames;
+    params_ = params;
+    pending_.clear();
+    next_pending_ = 0;
+    ended_ = true;
+
+    if (!(params_.contrast_threshold > 0.0f))
+    {
+        LOGE("Invalid contrast threshold %f", params_.contrast_threshold);
+        return false;
+    }
+
+    // Offset by 1 so black stays finite
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        log_intensities_[i] = logf(static_cast<float>(i) + 1.0f);
+    }
+
+    CameraFrame frame;
+    if (!frames_->GetNextFrame(&frame))
+    {
+        LOGE("Failed to get the first frame to generate events from");
+        return false;
+    }
+
+    width_ = frame.width;
+    height_ = frame.height;
+    previous_timestamp_us_ = frame.timestamp_us;
+    previous_levels_.resize(static_cast<size_t>(width_) * height_);
+    uint8_t const *pixels = frame.pixels.GetData();
+    for (size_t i = 0; i < previous_levels_.size(); ++i)
+    {
+        previous_levels_[i] = log_intensities_[pixels[i]];
+    }
+    reference_levels_ = previous_levels_;
+
+    ended_ = false;
+    return true;
+}
+
+bool SyntheticEventSource::GenerateEvents()
+{
+    CameraFrame frame;
+    if (!frames_->GetNextFrame(&frame) || frame.timestamp_us <= previous_timestamp_us_)
+    {
+        return false;
+    }
+    if (frame.width != width_ || frame.height != height_)
+    {
+        LOGE("Frame size changed from %ux%u to %ux%u", width_, height_, frame.width, frame.height);
+        return false;
+    }
+
+    pending_.clear();
+    next_pending_ = 0;
+
+    float const threshold = params_.contrast_threshold;
+    float const interval_us = static_cast<float>(frame.timestamp_us - previous_timestamp_us_);
+    uint8_t const *pixels = frame.pixels.GetData();
+    for (uint32_t y = 0; y < height_; ++y)
+    {
+        for (uint32_t x = 0; x < width_; ++x)
+        {
+            size_t const i = static_cast<size_t>(y) * width_ + x;
+            float const level = log_intensities_[pixels[i]];
+            float const previous = previous_levels_[i];
+            float reference = reference_levels_[i];
+
+            // Each crossing is timestamped where the straight line from the previous level reaches it
+            float const step = level >= reference ? threshold : -threshold;
+            uint8_t const polarity = level >= reference ? 1 : 0;
+            float const inv_change = (level != previous) ? 1.0f / (level - previous) : 0.0f;
+            while (fabsf(level - reference) >= threshold)
+            {
+                reference += step;
+                float const fraction = std::min(std::max((reference - previous) * inv_change, 0.0f), 1.0f);
+                uint64_t const timestamp_us = previous_timestamp_us_ + static_cast<uint64_t>(fraction * interval_us);
+                pending_.push_back({ timestamp_us, static_cast<uint16_t>(x), static_cast<uint16_t>(y), polarity });
+            }
+
+            reference_levels_[i] = reference;
+            previous_levels_[i] = level;
+        }
+    }
+
+    // Pixels are visited in raster order, so ties keep it and the order is deterministic
+    std::sort(pending_.begin(), pending_.end(), [](PendingEvent const &a, PendingEvent const &b)
+    {
+        return a.timestamp_us != b.timestamp_us ? a.timestamp_us < b.timestamp_us : (a.y != b.y ? a.y < b.y : a.x < b.x);
+    });
+
+    previous_timestamp_us_ = frame.timestamp_us;
+    return true;
+}
+
+bool SyntheticEventSource::ReadEvents(uint32_t const max_count, EventBatch *out_batch)
+{
+    out_batch->Clear();
+
+    while (out_batch->GetCount() < max_count)
+    {
+        if (next_pending_ == pending_.size())
+        {
+            if (ended_ || !GenerateEvents())
+            {
+                ended_ = true;
+                break;
+            }
+            continue;
+        }
+
+        PendingEvent const &event = pending_[next_pending_++];
+        out_batch->Add(event.timestamp_us, event.x, event.y, event.polarity);
+    }
+
+    return out_batch->GetCount() > 0;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "FrameProvider.h"
+#include "MappedFile.h"
+#include "TextReader.h"
+
+// Events in time order, as one array per field
+struct EventBatch
+{
+    std::vector<uint64_t> timestamps_us;
+    std::vector<uint16_t> xs;
+    std::vector<uint16_t> ys;
+    std::vector<uint8_t>  polarities;   // 1 where the pixel got brighter, 0 where it got darker
+
+    size_t GetCount() const { return timestamps_us.size(); }
+
+    // Keeps the capacity, so refilling a batch doesn't allocate
+    void Clear();
+    void Add(uint64_t const timestamp_us, uint16_t const x, uint16_t const y, uint8_t const polarity);
+};
+
+class EventSource
+{
+public:
+    virtual ~EventSource() = default;
+
+    // Replaces the contents of out_batch with the next events, at most max_count of them. Returns false, with an
+    // empty batch, once the stream has ended or failed
+    virtual bool ReadEvents(uint32_t const max_count, EventBatch *out_batch) = 0;
+
+protected:
+    EventSource() = default;
+};
+
+// Sensor size of the DAVIS240 the event camera datasets were recorded with. events.txt doesn't say
+static uint32_t const Davis240Width = 240;
+static uint32_t const Davis240Height = 180;
+
+//
+// Streams an events.txt of "timestamp x y polarity" lines
+//
+// The whole file is mapped, but only parsed a batch at a time, and the pages behind the parser are discarded
+// as it goes, so memory use stays constant however large the file is.
+//
+class EventFileReader
+    : private NonCopyable
+    , public EventSource
+{
+public:
+    EventFileReader() = default;
+
+    bool Initialize(char const *path);
+
+    // EventSource
+    virtual bool ReadEvents(uint32_t const max_count, EventBatch *out_batch) override;
+
+private:
+    // Parsed bytes are discarded in steps of this, rather than a few pages at a time
+    static size_t const DiscardGranularity = 4 << 20;
+
+private:
+    std::string path_;
+    MappedFile  file_;
+    TextReader  reader_{ nullptr, nullptr };
+    size_t      discarded_ = 0;    // bytes at the start of the file already discarded
+    uint64_t    last_timestamp_us_ = 0;
+};
+
+struct SyntheticEventParams
+{
+    float contrast_threshold = 0.2f;    // change in log intensity that fires an event
+};
+
+//
+// Generates events from a sequence of frames, for testing without recorded events
+//
+// Follows the idealized sensor model: each pixel remembers the log intensity at its last event, and fires an
+// event every time the log intensity, assumed to change linearly from one frame to the next, moves another
+// contrast_threshold away from it. Events of a pair of frames are timestamped in between them, and sorted.
+// Stops once the frame timestamps stop increasing, such as at the end of a sequence that isn't looping.
+//
+class SyntheticEventSource
+    : private NonCopyable
+    , public EventSource
+{
+public:
+    SyntheticEventSource() = default;
+
+    // Takes frames from frames, which must outlive this
+    bool Initialize(FrameProvider *frames, SyntheticEventParams const &params);
+
+    // Size of the frames, and so the range of event coordinates
+    uint32_t GetWidth() const { return width_; }
+    uint32_t GetHeight() const { return height_; }
+
+    // EventSource
+    virtual bool ReadEvents(uint32_t const max_count, EventBatch *out_batch) override;
+
+private:
+    struct PendingEvent
+    {
+        uint64_t timestamp_us;
+        uint16_t x;
+        uint16_t y;
+        uint8_t  polarity;
+    };
+
+private:
+    // Generates the events between the previous frame and the next one. Returns false at the end of the frames
+    bool GenerateEvents();
+
+private:
+    FrameProvider            *frames_ = nullptr;
+    SyntheticEventParams      params_;
+    float                     log_intensities_[256];
+    uint32_t                  width_ = 0;
+    uint32_t                  height_ = 0;
+    uint64_t                  previous_timestamp_us_ = 0;
+    std::vector<float>        previous_levels_;      // log intensity of the previous frame
+    std::vector<float>        reference_levels_;     // log intensity at the last event of each pixel
+    std::vector<PendingEvent> pending_;
+    size_t                    next_pending_ = 0;
+    bool                      ended_ = true;
+};
@@ -0,0 +1,451 @@
+#include "Precomp.h"
+#include "FastCorners.h"
+#include "ThreadPool.h"
+
+// Bresenham circle of radius 3 around the candidate, clockwise from the top.
+// Indices 0, 4, 8 & 12 are the compass points used by the pretest
+static int32_t const CircleX[] = { 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1 };
+static int32_t const CircleY[] = { -3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3 };
+static int32_t const CircleSize = _countof(CircleX);
+static_assert(CircleSize == _countof(CircleY), "CircleX & CircleY don't match in size");
+static_assert(CircleSize == 16, "arc masks are 16 bits");
+
+// Radius of the circle. Pixels closer than this to the edge are never candidates
+static int32_t const Border = 3;
+
+static inline void ComputeCircleOffsets(int32_t const stride, int32_t out_offsets[CircleSize])
+{
+    for (int32_t i = 0; i < CircleSize; ++i)
+    {
+        out_offsets[i] = CircleY[i] * stride + CircleX[i];
+    }
+}
+
+static inline int32_t CountTrailingZeros(uint32_t const value)
+{
+    return static_cast<int32_t>(_mm_popcnt_u32((value & (0u - value)) - 1));
+}
+
+static inline uint32_t RotateRight16(uint32_t const mask, int32_t const shift)
+{
+    return ((mask >> shift) | (mask << (16 - shift))) & 0xFFFF;
+}
+
+// True if mask (one bit per circle pixel) has segment_size contiguous bits set, wrapping around the circle
+static inline bool HasArc(uint32_t const mask, int32_t const segment_size)
+{
+    uint32_t runs = mask & RotateRight16(mask, 1);   // bit k set if pixels [k, k + 2) are all set
+    runs &= RotateRight16(runs, 2);                  // [k, k + 4)
+    runs &= RotateRight16(runs, 4);                  // [k, k + 8)
+    runs &= RotateRight16(runs, segment_size - 8);   // [k, k + segment_size)
+    return 0 != runs;
+}
+
+static inline bool IsCorner(uint8_t const *center, int32_t const *offsets, int32_t const threshold, int32_t const segment_size)
+{
+    int32_t const ip = *center;
+    uint32_t bright = 0;
+    uint32_t dark = 0;
+    for (int32_t i = 0; i < CircleSize; ++i)
+    {
+        int32_t const value = center[offsets[i]];
+        bright |= static_cast<uint32_t>(value > ip + threshold) << i;
+        dark |= static_cast<uint32_t>(value < ip - threshold) << i;
+    }
+    return HasArc(bright, segment_size) || HasArc(dark, segment_size);
+}
+
+static inline int32_t ComputeScore(uint8_t const *center, int32_t const *offsets, int32_t const threshold)
+{
+    int32_t const ip = *center;
+    int32_t bright = 0;
+    int32_t dark = 0;
+    for (int32_t i = 0; i < CircleSize; ++i)
+    {
+        int32_t const diff = center[offsets[i]] - ip;
+        if (diff > threshold)
+        {
+            bright += diff - threshold;
+        }
+        else if (diff < -threshold)
+        {
+            dark += -diff - threshold;
+        }
+    }
+    return std::max(bright, dark);
+}
+
+//
+// SIMD segment tests. Each returns one bit per candidate in [center, center + lanes) that is a corner.
+//
+// With saturating arithmetic, a nonzero byte of subs(I, Ip + t) means I is bright, and of subs(Ip - t, I)
+// that it's dark, so the pretest can use or/min as and/or on those bytes directly.
+//
+#ifdef __AVX2__
+static inline __m256i RotateRight16(__m256i const masks, int32_t const shift)
+{
+    return _mm256_or_si256(_mm256_srl_epi16(masks, _mm_cvtsi32_si128(shift)), _mm256_sll_epi16(masks, _mm_cvtsi32_si128(16 - shift)));
+}
+
+static inline __m256i FindArcs(__m256i const masks, int32_t const segment_size)
+{
+    __m256i runs = _mm256_and_si256(masks, RotateRight16(masks, 1));
+    runs = _mm256_and_si256(runs, RotateRight16(runs, 2));
+    runs = _mm256_and_si256(runs, RotateRight16(runs, 4));
+    return _mm256_and_si256(runs, RotateRight16(runs, segment_size - 8));
+}
+
+static uint32_t TestCandidates32(uint8_t const *center, int32_t const *offsets, int32_t const threshold, int32_t const segment_size)
+{
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const t = _mm256_set1_epi8(static_cast<char>(threshold));
+    __m256i const ip = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(center));
+    __m256i const high = _mm256_adds_epu8(ip, t);
+    __m256i const low = _mm256_subs_epu8(ip, t);
+    auto load = [&](int32_t const i) { return _mm256_loadu_si256(reinterpret_cast<__m256i const *>(center + offsets[i])); };
+
+    // Compass pretest: an arc of 9 to 11 pixels covers at least 2 consecutive compass points, and of 12 covers 3
+    __m256i const c0 = load(0), c4 = load(4), c8 = load(8), c12 = load(12);
+    __m256i const b0 = _mm256_subs_epu8(c0, high), b4 = _mm256_subs_epu8(c4, high), b8 = _mm256_subs_epu8(c8, high), b12 = _mm256_subs_epu8(c12, high);
+    __m256i const d0 = _mm256_subs_epu8(low, c0), d4 = _mm256_subs_epu8(low, c4), d8 = _mm256_subs_epu8(low, c8), d12 = _mm256_subs_epu8(low, c12);
+    __m256i pass;
+    if (segment_size < 12)
+    {
+        pass = _mm256_or_si256(
+            _mm256_min_epu8(_mm256_or_si256(b0, b8), _mm256_or_si256(b4, b12)),
+            _mm256_min_epu8(_mm256_or_si256(d0, d8), _mm256_or_si256(d4, d12)));
+    }
+    else
+    {
+        pass = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_min_epu8(_mm256_min_epu8(b0, b8), _mm256_or_si256(b4, b12)),
+                _mm256_min_epu8(_mm256_min_epu8(b4, b12), _mm256_or_si256(b0, b8))),
+            _mm256_or_si256(
+                _mm256_min_epu8(_mm256_min_epu8(d0, d8), _mm256_or_si256(d4, d12)),
+                _mm256_min_epu8(_mm256_min_epu8(d4, d12), _mm256_or_si256(d0, d8))));
+    }
+    if (-1 == _mm256_movemask_epi8(_mm256_cmpeq_epi8(pass, zero)))
+    {
+        return 0;
+    }
+
+    // Classify the whole circle. Bits of circle pixels 0-7 and 8-15 are gathered in separate bytes,
+    // and interleaved into one 16-bit mask per candidate below
+    __m256i bright_lo = zero, bright_hi = zero, dark_lo = zero, dark_hi = zero;
+    for (int32_t i = 0; i < CircleSize; ++i)
+    {
+        __m256i const value = load(i);
+        __m256i const bit = _mm256_set1_epi8(static_cast<char>(1 << (i & 7)));
+        __m256i const bright = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(value, high), zero), bit);
+        __m256i const dark = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(low, value), zero), bit);
+        if (i < 8)
+        {
+            bright_lo = _mm256_or_si256(bright_lo, bright);
+            dark_lo = _mm256_or_si256(dark_lo, dark);
+        }
+        else
+        {
+            bright_hi = _mm256_or_si256(bright_hi, bright);
+            dark_hi = _mm256_or_si256(dark_hi, dark);
+        }
+    }
+
+    // unpack works within 128-bit lanes, and the pack below puts the candidates back in order
+    __m256i const arcs_lo = _mm256_or_si256(
+        FindArcs(_mm256_unpacklo_epi8(bright_lo, bright_hi), segment_size),
+        FindArcs(_mm256_unpacklo_epi8(dark_lo, dark_hi), segment_size));
+    __m256i const arcs_hi = _mm256_or_si256(
+        FindArcs(_mm256_unpackhi_epi8(bright_lo, bright_hi), segment_size),
+        FindArcs(_mm256_unpackhi_epi8(dark_lo, dark_hi), segment_size));
+    __m256i const no_arc = _mm256_packs_epi16(_mm256_cmpeq_epi16(arcs_lo, zero), _mm256_cmpeq_epi16(arcs_hi, zero));
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(no_arc));
+}
+#endif
+
+static inline __m128i RotateRight16(__m128i const masks, int32_t const shift)
+{
+    return _mm_or_si128(_mm_srl_epi16(masks, _mm_cvtsi32_si128(shift)), _mm_sll_epi16(masks, _mm_cvtsi32_si128(16 - shift)));
+}
+
+static inline __m128i FindArcs(__m128i const masks, int32_t const segment_size)
+{
+    __m128i runs = _mm_and_si128(masks, RotateRight16(masks, 1));
+    runs = _mm_and_si128(runs, RotateRight16(runs, 2));
+    runs = _mm_and_si128(runs, RotateRight16(runs, 4));
+    return _mm_and_si128(runs, RotateRight16(runs, segment_size - 8));
+}
+
+static uint32_t TestCandidates16(uint8_t const *center, int32_t const *offsets, int32_t const threshold, int32_t const segment_size)
+{
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const t = _mm_set1_epi8(static_cast<char>(threshold));
+    __m128i const ip = _mm_loadu_si128(reinterpret_cast<__m128i const *>(center));
+    __m128i const high = _mm_adds_epu8(ip, t);
+    __m128i const low = _mm_subs_epu8(ip, t);
+    auto load = [&](int32_t const i) { return _mm_loadu_si128(reinterpret_cast<__m128i const *>(center + offsets[i])); };
+
+    __m128i const c0 = load(0), c4 = load(4), c8 = load(8), c12 = load(12);
+    __m128i const b0 = _mm_subs_epu8(c0, high), b4 = _mm_subs_epu8(c4, high), b8 = _mm_subs_epu8(c8, high), b12 = _mm_subs_epu8(c12, high);
+    __m128i const d0 = _mm_subs_epu8(low, c0), d4 = _mm_subs_epu8(low, c4), d8 = _mm_subs_epu8(low, c8), d12 = _mm_subs_epu8(low, c12);
+    __m128i pass;
+    if (segment_size < 12)
+    {
+        pass = _mm_or_si128(
+            _mm_min_epu8(_mm_or_si128(b0, b8), _mm_or_si128(b4, b12)),
+            _mm_min_epu8(_mm_or_si128(d0, d8), _mm_or_si128(d4, d12)));
+    }
+    else
+    {
+        pass = _mm_or_si128(
+            _mm_or_si128(
+                _mm_min_epu8(_mm_min_epu8(b0, b8), _mm_or_si128(b4, b12)),
+                _mm_min_epu8(_mm_min_epu8(b4, b12), _mm_or_si128(b0, b8))),
+            _mm_or_si128(
+                _mm_min_epu8(_mm_min_epu8(d0, d8), _mm_or_si128(d4, d12)),
+                _mm_min_epu8(_mm_min_epu8(d4, d12), _mm_or_si128(d0, d8))));
+    }
+    if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi8(pass, zero)))
+    {
+        return 0;
+    }
+
+    __m128i bright_lo = zero, bright_hi = zero, dark_lo = zero, dark_hi = zero;
+    for (int32_t i = 0; i < CircleSize; ++i)
+    {
+        __m128i const value = load(i);
+        __m128i const bit = _mm_set1_epi8(static_cast<char>(1 << (i & 7)));
+        __m128i const bright = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(value, high), zero), bit);
+        __m128i const dark = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(low, value), zero), bit);
+        if (i < 8)
+        {
+            bright_lo = _mm_or_si128(bright_lo, bright);
+            dark_lo = _mm_or_si128(dark_lo, dark);
+        }
+        else
+        {
+            bright_hi = _mm_or_si128(bright_hi, bright);
+            dark_hi = _mm_or_si128(dark_hi, dark);
+        }
+    }
+
+    __m128i const arcs_lo = _mm_or_si128(
+        FindArcs(_mm_unpacklo_epi8(bright_lo, bright_hi), segment_size),
+        FindArcs(_mm_unpacklo_epi8(dark_lo, dark_hi), segment_size));
+    __m128i const arcs_hi = _mm_or_si128(
+        FindArcs(_mm_unpackhi_epi8(bright_lo, bright_hi), segment_size),
+        FindArcs(_mm_unpackhi_epi8(dark_lo, dark_hi), segment_size));
+    __m128i const no_arc = _mm_packs_epi16(_mm_cmpeq_epi16(arcs_lo, zero), _mm_cmpeq_epi16(arcs_hi, zero));
+    return ~static_cast<uint32_t>(_mm_movemask_epi8(no_arc)) & 0xFFFF;
+}
+
+// Appends the corners of row y to inout_corners, and writes their scores to row_scores, which must be 0 elsewhere
+static void DetectRow(uint8_t const *image, int32_t const width, int32_t const stride, int32_t const y, int32_t const *offsets, FastParams const &params, int32_t *row_scores, std::vector<FastFeature> *inout_corners)
+{
+    uint8_t const *row = image + y * stride;
+    int32_t const threshold = params.threshold;
+    int32_t const segment_size = params.segment_size;
+
+    auto add_corner = [&](int32_t const x)
+    {
+        FastFeature corner;
+        corner.x = x;
+        corner.y = y;
+        corner.score = ComputeScore(row + x, offsets, threshold);
+        row_scores[x] = corner.score;
+        inout_corners->push_back(corner);
+    };
+
+    int32_t x = Border;
+    int32_t const x_end = width - Border;
+#ifdef __AVX2__
+    for (; x + 32 <= x_end; x += 32)
+    {
+        for (uint32_t corners = TestCandidates32(row + x, offsets, threshold, segment_size); corners; corners &= corners - 1)
+        {
+            add_corner(x + CountTrailingZeros(corners));
+        }
+    }
+#endif
+    for (; x + 16 <= x_end; x += 16)
+    {
+        for (uint32_t corners = TestCandidates16(row + x, offsets, threshold, segment_size); corners; corners &= corners - 1)
+        {
+            add_corner(x + CountTrailingZeros(corners));
+        }
+    }
+    for (; x < x_end; ++x)
+    {
+        if (IsCorner(row + x, offsets, threshold, segment_size))
+        {
+            add_corner(x);
+        }
+    }
+}
+
+// Earlier neighbors in raster order must score strictly lower, and later ones no higher, so of a run of
+// equal scores only the first survives
+static inline bool IsLocalMaximum(int32_t const score, int32_t const *above, int32_t const *row, int32_t const *below, int32_t const x)
+{
+    return score > above[x - 1] && score > above[x] && score > above[x + 1] &&
+           score > row[x - 1] && score >= row[x + 1] &&
+           score >= below[x - 1] && score >= below[x] && score >= below[x + 1];
+}
+
+void FastDetector::DetectBand(Band &band, uint8_t const *image, int32_t const width, int32_t const height, int32_t const stride, int32_t const y_begin, int32_t const y_end)
+{
+    int32_t offsets[CircleSize];
+    ComputeCircleOffsets(stride, offsets);
+
+    band.features.clear();
+    band.scores.assign(3 * static_cast<size_t>(width), 0);
+    for (auto &corners : band.row_corners)
+    {
+        corners.clear();
+    }
+
+    auto detect_row = [&](int32_t const y)
+    {
+        // Only the scores of the previous corners in this slot need clearing
+        int32_t const slot = y % 3;
+        int32_t *row_scores = &band.scores[slot * width];
+        for (auto const &corner : band.row_corners[slot])
+        {
+            row_scores[corner.x] = 0;
+        }
+        band.row_corners[slot].clear();
+        if (y >= Border && y < height - Border)
+        {
+            DetectRow(image, width, stride, y, offsets, params_, row_scores, &band.row_corners[slot]);
+        }
+    };
+
+    if (!params_.nonmax_suppression)
+    {
+        for (int32_t y = y_begin; y < y_end; ++y)
+        {
+            detect_row(y);
+            band.features.insert(band.features.end(), band.row_corners[y % 3].begin(), band.row_corners[y % 3].end());
+        }
+        return;
+    }
+
+    // Rows are suppressed one behind detection, once the row below them is known. The rows just outside
+    // the band are detected again here rather than shared, so bands don't depend on each other
+    for (int32_t y = y_begin - 1; y <= y_end; ++y)
+    {
+        detect_row(y);
+
+        int32_t const suppress_y = y - 1;
+        if (suppress_y < y_begin)
+        {
+            continue;
+        }
+
+        int32_t const *above = &band.scores[((suppress_y - 1) % 3) * width];
+        int32_t const *row = &band.scores[(suppress_y % 3) * width];
+        int32_t const *below = &band.scores[(y % 3) * width];
+        for (auto const &corner : band.row_corners[suppress_y % 3])
+        {
+            if (IsLocalMaximum(corner.score, above, row, below, corner.x))
+            {
+                band.features.push_back(corner);
+            }
+        }
+    }
+}
+
+void FastDetector::Detect(uint8_t const *image, int32_t const width, int32_t const height, int32_t const stride, std::vector<FastFeature> *out_features)
+{
+    TRACE_SCOPE("FastDetector::Detect");
+    assert(params_.segment_size >= 9 && params_.segment_size <= 12);
+    assert(params_.threshold >= 0 && params_.threshold <= 255);
+
+    out_features->clear();
+    if (width <= 2 * Border || height <= 2 * Border)
+    {
+        return;
+    }
+
+    uint32_t const num_bands = GetRowBandCount(pool_, height - 2 * Border, 16);
+    if (bands_.size() < num_bands)
+    {
+        bands_.resize(num_bands);
+    }
+
+    ParallelForRows(pool_, Border, height - Border, num_bands, [&](uint32_t const band, int32_t const y_begin, int32_t const y_end)
+    {
+        DetectBand(bands_[band], image, width, height, stride, y_begin, y_end);
+    });
+
+    // Bands are in row order, so concatenating them keeps the features sorted
+    for (uint32_t band = 0; band < num_bands; ++band)
+    {
+        out_features->insert(out_features->end(), bands_[band].features.begin(), bands_[band].features.end());
+    }
+}
+
+void FastDetectReference(uint8_t const *image, int32_t const width, int32_t const height, int32_t const stride, FastParams const &params, std::vector<FastFeature> *out_features)
+{
+    int32_t const threshold = params.threshold;
+    int32_t const segment_size = params.segment_size;
+
+    out_features->clear();
+
+    std::vector<int32_t> scores(static_cast<size_t>(width) * height, 0);
+    std::vector<FastFeature> corners;
+    for (int32_t y = Border; y < height - Border; ++y)
+    {
+        for (int32_t x = Border; x < width - Border; ++x)
+        {
+            int32_t const ip = image[y * stride + x];
+            int32_t values[CircleSize];
+            for (int32_t i = 0; i < CircleSize; ++i)
+            {
+                values[i] = image[(y + CircleY[i]) * stride + (x + CircleX[i])];
+            }
+
+            bool is_corner = false;
+            for (int32_t start = 0; start < CircleSize && !is_corner; ++start)
+            {
+                bool all_bright = true;
+                bool all_dark = true;
+                for (int32_t i = 0; i < segment_size; ++i)
+                {
+                    int32_t const value = values[(start + i) % CircleSize];
+                    all_bright = all_bright && value > ip + threshold;
+                    all_dark = all_dark && value < ip - threshold;
+                }
+                is_corner = all_bright || all_dark;
+            }
+            if (!is_corner)
+            {
+                continue;
+            }
+
+            int32_t bright_score = 0;
+            int32_t dark_score = 0;
+            for (int32_t i = 0; i < CircleSize; ++i)
+            {
+                bright_score += std::max(values[i] - ip - threshold, 0);
+                dark_score += std::max(ip - values[i] - threshold, 0);
+            }
+
+            FastFeature corner;
+            corner.x = x;
+            corner.y = y;
+            corner.score = std::max(bright_score, dark_score);
+            scores[y * width + x] = corner.score;
+            corners.push_back(corner);
+        }
+    }
+
+    for (auto const &corner : corners)
+    {
+        int32_t const *row = &scores[corner.y * width];
+        if (!params.nonmax_suppression || IsLocalMaximum(corner.score, row - width, row, row + width, corner.x))
+        {
+            out_features->push_back(corner);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+class ThreadPool;
+
+struct FastFeature
+{
+    int32_t x, y;
+    int32_t score;
+};
+
+struct FastParams
+{
+    int32_t segment_size        = 9;    // contiguous circle pixels that must all be brighter or all darker. [9, 12]
+    int32_t threshold           = 20;   // how much brighter or darker than the center a circle pixel must be to count
+    bool    nonmax_suppression  = true; // keep only corners whose score is a 3x3 local maximum
+};
+
+//
+// FAST (Features from Accelerated Segment Test) corner detector
+//
+// Candidates are tested 32 at a time (16 without AVX2). The 4 compass points of the circle are tested
+// first, which rejects most pixels: an arc of segment_size pixels always covers segment_size / 4 consecutive
+// compass points. Survivors classify the whole circle into bright & dark bitmasks, one 16-bit word per
+// candidate, and an arc is found by ANDing each mask with rotated copies of itself.
+//
+// The score of a corner is the larger of the sums of (|I - Ip| - threshold) over its bright pixels and over
+// its dark pixels. Non-maximum suppression keeps a corner if no 3x3 neighbor scores higher. Ties go to the
+// first corner in raster order.
+//
+// Features are returned in raster order. With a thread pool, rows are split into bands, and the result is
+// the same for any number of threads.
+//
+class FastDetector : private NonCopyable
+{
+public:
+    FastDetector() = default;
+
+    void SetParams(FastParams const &params) { params_ = params; }
+    FastParams const &GetParams() const { return params_; }
+
+    // Optional. Detection runs on the calling thread when there is no pool
+    void SetThreadPool(ThreadPool *pool) { pool_ = pool; }
+
+    // stride is the distance between 2 consecutive rows, in pixels. The 3 pixel border is never tested
+    void Detect(uint8_t const *image, int32_t const width, int32_t const height, int32_t const stride, std::vector<FastFeature> *out_features);
+
+private:
+    // Scratch for one row band
+    struct Band
+    {
+        std::vector<int32_t>     scores;         // score of every pixel of the last 3 rows, 0 when not a corner
+        std::vector<FastFeature> row_corners[3]; // corners of the last 3 rows, before suppression
+        std::vector<FastFeature> features;
+    };
+
+    void DetectBand(Band &band, uint8_t const *image, int32_t const width, int32_t const height, int32_t const stride, int32_t const y_begin, int32_t const y_end);
+
+private:
+    FastParams        params_;
+    ThreadPool       *pool_ = nullptr;
+    std::vector<Band> bands_;
+};
+
+// Scalar reference implementation. Tests every start position of the arc directly, and suppresses with a full
+// score map. Produces the same features as FastDetector, and is only meant for validating it
+void FastDetectReference(uint8_t const *image, int32_t const width, int32_t const height, int32_t const stride, FastParams const &params, std::vector<FastFeature> *out_features);
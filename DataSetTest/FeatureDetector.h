@@ -1,5 +1,12 @@
 #pragma once
 
+#include "BriefDescriptor.h"
+#include "DescriptorMatcher.h"
+#include "FastCorners.h"
+#include "HarrisCorners.h"
+#include "ImagePyramid.h"
+#include "TrackStore.h"
+
 class FeatureDetector
 {
 public:
@@ -18,6 +25,50 @@ public:
     FeatureDetector(FeatureDetector const &) = delete;
     FeatureDetector &operator= (FeatureDetector const &) = delete;
 
+    // Optional. Detection runs on the calling thread when there is no pool
+    void SetThreadPool(ThreadPool *pool) { fast_.SetThreadPool(pool); harris_.SetThreadPool(pool); pyramid_.SetThreadPool(pool); matcher_.SetThreadPool(pool); }
+
+    void SetPyramidParams(PyramidParams const &params) { pyramid_.SetParams(params); }
+
     bool Detect(uint8_t *pixels, uint8_t const *smoothed, uint32_t const width, uint32_t const height);
+
+    // Same as smoothing pixels with kernel and calling Detect, but fuses smoothing & detection into a single
+    // pass over row strips so no full-frame intermediates are needed
+    bool DetectFused(uint8_t *pixels, GaussianKernel const &kernel, uint32_t const width, uint32_t const height);
+
+    // Detects corners on every level of a pyramid built from pixels (see SetPyramidParams), and marks them at
+    // their full resolution position
+    bool DetectPyramid(uint8_t *pixels, GaussianKernel const &kernel, uint32_t const width, uint32_t const height);
+
+    // Tracks FAST features from frame to frame by their BRIEF descriptors, and marks those that were observed in
+    // more than min_frames frames. Call once per frame of a sequence
+    bool Track(uint8_t *pixels, uint8_t const *smoothed, uint32_t const width, uint32_t const height, uint32_t const min_frames);
+
+    TrackStore const &GetTracks() const { return tracks_; }
+
 private:
+    // Most tracks alive at once
+    static uint32_t const MaxTracks = 4096;
+    // Positions kept per track
+    static uint32_t const TrackHistoryLength = 32;
+    // Tracks that go unobserved for more frames than this are dropped
+    static uint32_t const MaxMissedFrames = 2;
+
+private:
+    FastDetector      fast_;
+    BriefExtractor    brief_;
+    HarrisDetector    harris_;
+    ImagePyramid      pyramid_;
+    DescriptorMatcher matcher_;
+    TrackStore        tracks_;
+
+    // Per frame scratch, kept to avoid reallocating every frame
+    std::vector<HarrisFeature>   harris_features_;
+    std::vector<PyramidFeature>  pyramid_features_;
+    std::vector<FastFeature>     corners_;
+    std::vector<BriefFeature>    described_;
+    std::vector<BriefFeature>    track_features_;
+    std::vector<DescriptorMatch> matches_;
+    std::vector<uint8_t>         matched_;
+    std::vector<uint32_t>        surviving_;
 };
@@ -1,227 +1,123 @@
 #include "Precomp.h"
 #include "FeatureDetector.h"
 #include "Utilities.h"
-#include "HarrisCorners.h"
 
-struct FAST_feature
+bool FeatureDetector::DetectFused(uint8_t *pixels, GaussianKernel const &kernel, uint32_t const width, uint32_t const height)
 {
-    int x, y;
-    int score;
-    uint64_t descriptor[2];
-    uint32_t frame_count = 0;
-};
-
-static bool ComputeDescriptor(uint8_t const *source, int32_t const width, int32_t const height, int32_t const x, int32_t const y, uint64_t *inout_descriptor)
-{
-    static int32_t x_offsets[128]{};
-    static int32_t y_offsets[128]{};
-    static int32_t x_offsets2[128]{};
-    static int32_t y_offsets2[128]{};
-    static bool    offsets_initialized = false;
-
-    if (!offsets_initialized)
+    harris_.DetectFused(pixels, width, height, kernel, &harris_features_);
+    for (auto const &feature : harris_features_)
     {
-        srand(static_cast<int>(time(nullptr)));
-        for (int32_t i = 0; i < 128; ++i)
-        {
-            x_offsets[i] = rand() % 16 - 8;
-            y_offsets[i] = rand() % 16 - 8;
-            x_offsets2[i] = rand() % 16 - 8;
-            y_offsets2[i] = rand() % 16 - 8;
-        }
-        offsets_initialized = true;
+        pixels[feature.y * width + feature.x] = 0xFF;
     }
+    return true;
+}
 
-    if (x < 8 || x >= width - 8 || y < 8 || y >= height - 8)
-    {
-        return false;
-    }
+bool FeatureDetector::DetectPyramid(uint8_t *pixels, GaussianKernel const &kernel, uint32_t const width, uint32_t const height)
+{
+    pyramid_.Build(pixels, width, height, kernel);
 
-    inout_descriptor[0] = 0;
-    inout_descriptor[1] = 0;
-    for (int32_t i = 0; i < 128; ++i)
+    DetectPyramidHarris(pyramid_, &harris_, &harris_features_, &pyramid_features_);
+    for (auto const &feature : pyramid_features_)
     {
-        int32_t index = i / 64;
-        int32_t bit   = i % 64;
-
-        uint8_t val1 = source[(y + y_offsets[i]) * width + (x + x_offsets[i])];
-        uint8_t val2 = source[(y + y_offsets2[i]) * width + (x + x_offsets2[i])];
-        uint64_t bit_value = (val1 < val2) ? 1 : 0;
-        inout_descriptor[index] |= (bit_value << bit);
+        uint32_t const x = std::min(static_cast<uint32_t>(lroundf((feature.x + 0.5f) * feature.scale - 0.5f)), width - 1);
+        uint32_t const y = std::min(static_cast<uint32_t>(lroundf((feature.y + 0.5f) * feature.scale - 0.5f)), height - 1);
+        pixels[y * width + x] = 0xFF;
     }
-
     return true;
 }
 
-//
-// FAST (Features from Accelerated Segment Test) feature detector
-//
-// source       - input image as 8-bit luminance
-// width        - number of columns in the image
-// height       - number of rows in the image
-// pixel_pitch  - distance between 2 consecutive rows, in pixels
-// segment_size - length of segment before considering a pixel as a feature. Typical sizes are 9 & 12 (empirically, 9 performs better than 12)
-// threshold    - how much brigher or darker than current pixel the segment pixels can be and still count
-// max_features - maximum number of features to detect. once reached, the function will return even if the image has not been fully processed
-// out_features - buffer to hold the detected features. Must be at least max_features in size
-//
-// returns: number of features actually detected (and stored in out_features)
-//
-static int FAST(uint8_t const* source, uint8_t const *smoothed, int width, int height, int pixel_pitch, uint8_t segment_size, uint8_t threshold, int max_features, FAST_feature* out_features)
+bool FeatureDetector::Detect(uint8_t *pixels, uint8_t const *smoothed, uint32_t const width, uint32_t const height)
 {
-    // x,y offsets to each of the pixels around the circle
-    static int const x_offsets[] =
-    {
-        0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1,
-    };
-    static int const y_offsets[] =
+    harris_.Detect(smoothed, width, height, &harris_features_);
+    for (auto const &feature : harris_features_)
     {
-        -3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3
-    };
-
-    static const int num_offsets = _countof(x_offsets);
-
-    static_assert(num_offsets == _countof(y_offsets), "x_offsets & y_offsets don't match in size");
-    static_assert(num_offsets == 16, "expected 16 pixel circle");
+        pixels[feature.y * width + feature.x] = 0xFF;
+    }
+    return true;
+}
 
-    int num_features = 0;
-    // NOTE: for simplicity, we start 3 pixels in each from all edges.
-    // This allows us to always use the full circle, and not have to handle corner cases
-    for (int y = 3; y < height - 3; ++y)
+bool FeatureDetector::Track(uint8_t *pixels, uint8_t const *smoothed, uint32_t const width, uint32_t const height, uint32_t const min_frames)
+{
+    if (0 == tracks_.GetCapacity())
     {
-        for (int x = 3; x < width - 3; ++x)
+        if (!tracks_.Initialize(MaxTracks, TrackHistoryLength))
         {
-            // Luminance of the candidate pixel
-            uint8_t Ip = source[y * pixel_pitch + x];
-
-            // Track consecutive dark & light pixels & scores
-            // at the same time through a single loop
-            int last_non_bright = -1;
-            int last_non_dark = -1;
-            int bright_score = 0;
-            int dark_score = 0;
-
-            int match_score = 0;
-
-            for (int i = 0; i < num_offsets; ++i)
-            {
-                uint8_t I = source[(y + y_offsets[i]) * pixel_pitch + (x + x_offsets[i])];
+            LOGE("Failed to initialize track store");
+            return false;
+        }
 
-                if (I <= Ip + threshold)
-                {
-                    last_non_bright = i;
-                    bright_score = 0;
-                } else
-                {
-                    bright_score += abs((int)I - (int)Ip) - threshold;
-                }
+        // Features barely move between frames, so only nearby ones are candidates
+        MatcherParams params;
+        params.mode = MatchMode::Grid;
+        params.max_distance = 50;
+        params.search_radius = 16.0f;
+        matcher_.SetParams(params);
+    }
 
-                if (I >= Ip - threshold)
-                {
-                    last_non_dark = i;
-                    dark_score = 0;
-                } else
-                {
-                    dark_score += abs((int)Ip - (int)I) - threshold;
-                }
+    tracks_.BeginFrame();
 
-                if (i - (last_non_bright + 1) == segment_size)
-                {
-                    match_score = bright_score;
-                    break;
-                }
-                if (i - (last_non_dark + 1) == segment_size)
-                {
-                    match_score = dark_score;
-                    break;
-                }
-            }
+    fast_.Detect(pixels, width, height, width, &corners_);
+    described_.clear();
+    brief_.Compute(smoothed, width, height, corners_.data(), static_cast<uint32_t>(corners_.size()), &described_);
+    uint32_t const num_described = static_cast<uint32_t>(described_.size());
 
-            if (match_score > 0)
-            {
-                out_features[num_features].x = x;
-                out_features[num_features].y = y;
-                out_features[num_features].score = match_score;
-                out_features[num_features].frame_count = 0;
-                if (ComputeDescriptor(smoothed, width, height, x, y, out_features[num_features].descriptor))
-                {
-                    ++num_features;
-                    if (num_features == max_features)
-                    {
-                        return num_features;
-                    }
-                }
-            }
-        }
+    // Match the live tracks against this frame's features. BriefFeature::index of a track is its slot
+    track_features_.clear();
+    uint32_t const *slots = tracks_.GetSlots();
+    for (uint32_t i = 0; i < tracks_.GetCount(); ++i)
+    {
+        BriefFeature feature;
+        feature.x = static_cast<int32_t>(lroundf(tracks_.GetX(slots[i])));
+        feature.y = static_cast<int32_t>(lroundf(tracks_.GetY(slots[i])));
+        feature.level = 0;
+        feature.scale = 1.0f;
+        feature.index = slots[i];
+        feature.angle = 0.0f;
+        feature.descriptor = tracks_.GetDescriptor(slots[i]);
+        track_features_.push_back(feature);
     }
-    return num_features;
-}
 
-static uint32_t HammingDistance(uint64_t const descriptor[2], uint64_t const descriptor2[2])
-{
-    uint64_t dist1 = descriptor[0] ^ descriptor2[0];
-    uint64_t dist2 = descriptor[1] ^ descriptor2[1];
-    return static_cast<uint32_t>(_mm_popcnt_u64(dist1) + _mm_popcnt_u64(dist2));
-}
-
-bool FeatureDetector::Detect(uint8_t *pixels, uint8_t const *smoothed, uint32_t const width, uint32_t const height)
-{
-    UNREFERENCED_PARAMETER(smoothed);
+    matcher_.SetTrain(described_.data(), num_described);
+    matches_.clear();
+    matcher_.Match(track_features_.data(), static_cast<uint32_t>(track_features_.size()), &matches_);
 
-    std::vector<HarrisFeature> features;
-    HarrisDetect(smoothed, width, height, &features);
-    for (auto const &feature : features)
+    // A feature continues at most one track. Matches are in track order, so the first claim wins
+    matched_.assign(num_described, 0);
+    for (auto const &match : matches_)
     {
-        pixels[feature.y * width + feature.x] = 0xFF;
+        if (!matched_[match.train])
+        {
+            matched_[match.train] = 1;
+            BriefFeature const &feature = described_[match.train];
+            tracks_.Update(track_features_[match.query].index, static_cast<float>(feature.x), static_cast<float>(feature.y), feature.descriptor);
+        }
     }
-#if 0
-    static FAST_feature prev_features[400]{};
-    static int prev_num_features = 0;
-    FAST_feature features[400];
 
-    int num_features = FAST(pixels, smoothed, width, height, width, 9, 20, 100, features);
-    for (int i = 0; i < num_features; ++i)
+    tracks_.EvictStale(MaxMissedFrames);
+
+    // Every feature left over starts a track, as long as there's room
+    for (uint32_t i = 0; i < num_described; ++i)
     {
-        for (int j = 0; j < prev_num_features; ++j)
+        if (!matched_[i])
         {
-            if (HammingDistance(features[i].descriptor, prev_features[j].descriptor) < 5)
+            BriefFeature const &feature = described_[i];
+            if (TrackStore::InvalidSlot == tracks_.Insert(static_cast<float>(feature.x), static_cast<float>(feature.y), feature.descriptor))
             {
-                features[i].frame_count = prev_features[j].frame_count + 1;
-                if (features[i].frame_count > 5)
-                {
-                    pixels[features[i].y * width + features[i].x] = 0xFF;
-                }
                 break;
             }
         }
     }
-    memcpy(prev_features, features, num_features * sizeof(FAST_feature));
-    prev_num_features = num_features;
-#endif
-#if 0
 
-    uint32_t num_features = 0;
-    for (uint32_t y = 0; y < height; ++y)
+    surviving_.clear();
+    tracks_.GetSurvivingTracks(min_frames, &surviving_);
+    for (uint32_t const slot : surviving_)
     {
-        for (uint32_t x = 0; x < width; ++x)
+        if (tracks_.GetLastFrame(slot) == tracks_.GetFrame())
         {
-            if (32 > pixels[y * width + x])
-            {
-                pixels[y * width + x] = 0xFF;
-                Feature f;
-                f.x = x;
-                f.y = y;
-                f.desc = 128;
-                inout_features[num_features++] = f;
-                if (num_features >= max_features)
-                {
-                    *out_num_features = num_features;
-                    return true;
-                }
-            }
+            uint32_t const x = static_cast<uint32_t>(tracks_.GetX(slot));
+            uint32_t const y = static_cast<uint32_t>(tracks_.GetY(slot));
+            pixels[y * width + x] = 0xFF;
         }
     }
-    *out_num_features = num_features;
-#endif
     return true;
 }
@@ -1,11 +1,25 @@
 #pragma once
 
+#include "BufferPool.h"
+#include "GroundTruth.h"
+
 struct CameraFrame
 {
-    uint64_t timestamp_us;
-    uint32_t width;
-    uint32_t height;
-    std::vector<uint8_t> data;
+    uint64_t    timestamp_us;
+    uint32_t    width;
+    uint32_t    height;
+    ImageBuffer pixels;      // stride is width. Not shared with the provider, so it can be written to
+    bool        has_pose;    // whether the dataset has ground truth at timestamp_us
+    Pose        pose;
+};
+
+// A frame whose pixels belong to someone else, such as a mapped file, and stay valid as long as they do
+struct CameraFrameView
+{
+    uint64_t       timestamp_us;
+    uint32_t       width;
+    uint32_t       height;
+    uint8_t const *pixels;      // stride is width
 };
 
 class FrameProvider
@@ -0,0 +1,35 @@
+#pragma once
+
+template <typename Signature>
+class FunctionRef;
+
+//
+// Non-owning reference to a callable
+//
+// Unlike std::function, it never copies the callable or allocates, so lambdas capturing lots of state cost nothing
+// to pass. The callable must outlive the reference, so only use it for parameters of calls that don't keep it.
+//
+template <typename Result, typename... Args>
+class FunctionRef<Result(Args...)>
+{
+public:
+    template <typename Callable, typename = typename std::enable_if<!std::is_same<typename std::decay<Callable>::type, FunctionRef>::value>::type>
+    FunctionRef(Callable &&callable)
+        : callable_(const_cast<void *>(static_cast<void const *>(&callable)))
+        , invoke_(&Invoke<typename std::remove_reference<Callable>::type>)
+    {
+    }
+
+    Result operator()(Args... args) const { return invoke_(callable_, std::forward<Args>(args)...); }
+
+private:
+    template <typename Callable>
+    static Result Invoke(void *callable, Args... args)
+    {
+        return (*static_cast<Callable *>(callable))(std::forward<Args>(args)...);
+    }
+
+private:
+    void   *callable_;
+    Result (*invoke_)(void *, Args...);
+};
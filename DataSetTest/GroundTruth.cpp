@@ -0,0 +1,187 @@
+#include "Precomp.h"
+#include "GroundTruth.h"
+#include "MappedFile.h"
+#include "TextReader.h"
+
+// Above this cosine of the angle between orientations, slerp is replaced by a normalized lerp, which is
+// indistinguishable there and avoids dividing by a vanishing sine
+static float const SlerpLinearThreshold = 0.9995f;
+
+void GroundTruth::Clear()
+{
+    timestamps_us_.clear();
+    xs_.clear();
+    ys_.clear();
+    zs_.clear();
+    qxs_.clear();
+    qys_.clear();
+    qzs_.clear();
+    qws_.clear();
+    time_index_.clear();
+    bucket_us_ = 1;
+}
+
+bool GroundTruth::Load(char const *path)
+{
+    Clear();
+
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        return false;
+    }
+
+    char const *text = reinterpret_cast<char const *>(file.GetData());
+    TextReader reader(text, text + file.GetSize());
+
+    // Pose lines are around 90 bytes, so this is enough for all of them without growing
+    size_t const expected_count = file.GetSize() / 64 + 1;
+    timestamps_us_.reserve(expected_count);
+    for (auto *values : { &xs_, &ys_, &zs_, &qxs_, &qys_, &qzs_, &qws_ })
+    {
+        values->reserve(expected_count);
+    }
+
+    while (reader.NextLine())
+    {
+        uint64_t timestamp_us = 0;
+        float x = 0, y = 0, z = 0;
+        float qx = 0, qy = 0, qz = 0, qw = 0;
+        if (!reader.ReadTimestampUs(&timestamp_us) ||
+            !reader.ReadFloat(&x) || !reader.ReadFloat(&y) || !reader.ReadFloat(&z) ||
+            !reader.ReadFloat(&qx) || !reader.ReadFloat(&qy) || !reader.ReadFloat(&qz) || !reader.ReadFloat(&qw) ||
+            !reader.AtLineEnd())
+        {
+            LOGE("[%s] line %u isn't a pose", path, reader.GetLineNumber());
+            Clear();
+            return false;
+        }
+
+        if (!timestamps_us_.empty() && timestamp_us <= timestamps_us_.back())
+        {
+            LOGE("[%s] line %u goes back in time", path, reader.GetLineNumber());
+            Clear();
+            return false;
+        }
+
+        float const length = sqrtf(qx * qx + qy * qy + qz * qz + qw * qw);
+        if (!(length > 0.0f))
+        {
+            LOGE("[%s] line %u has an invalid orientation", path, reader.GetLineNumber());
+            Clear();
+            return false;
+        }
+
+        timestamps_us_.push_back(timestamp_us);
+        xs_.push_back(x);
+        ys_.push_back(y);
+        zs_.push_back(z);
+        qxs_.push_back(qx / length);
+        qys_.push_back(qy / length);
+        qzs_.push_back(qz / length);
+        qws_.push_back(qw / length);
+    }
+
+    if (timestamps_us_.empty())
+    {
+        LOGE("No poses in [%s]", path);
+        return false;
+    }
+
+    BuildTimeIndex();
+
+    LOGD("Loaded %u poses from [%s]", GetCount(), path);
+    return true;
+}
+
+void GroundTruth::BuildTimeIndex()
+{
+    uint32_t const count = GetCount();
+    uint64_t const start_us = timestamps_us_.front();
+    uint64_t const duration_us = timestamps_us_.back() - start_us;
+
+    bucket_us_ = std::max<uint64_t>(count > 1 ? duration_us / (count - 1) : 1, 1);
+    time_index_.resize(static_cast<size_t>(duration_us / bucket_us_) + 1);
+
+    uint32_t sample = 0;
+    for (size_t bucket = 0; bucket < time_index_.size(); ++bucket)
+    {
+        uint64_t const bucket_start_us = start_us + bucket * bucket_us_;
+        while (sample + 1 < count && timestamps_us_[sample + 1] <= bucket_start_us)
+        {
+            ++sample;
+        }
+        time_index_[bucket] = sample;
+    }
+}
+
+uint32_t GroundTruth::FindSample(uint64_t const timestamp_us) const
+{
+    uint32_t const count = GetCount();
+    uint32_t sample = time_index_[static_cast<size_t>((timestamp_us - timestamps_us_.front()) / bucket_us_)];
+    while (sample + 1 < count && timestamps_us_[sample + 1] <= timestamp_us)
+    {
+        ++sample;
+    }
+    return sample;
+}
+
+void GroundTruth::GetSample(uint32_t const index, Pose *out_pose) const
+{
+    out_pose->position[0] = xs_[index];
+    out_pose->position[1] = ys_[index];
+    out_pose->position[2] = zs_[index];
+    out_pose->orientation[0] = qxs_[index];
+    out_pose->orientation[1] = qys_[index];
+    out_pose->orientation[2] = qzs_[index];
+    out_pose->orientation[3] = qws_[index];
+}
+
+bool GroundTruth::GetPose(uint64_t const timestamp_us, Pose *out_pose) const
+{
+    if (timestamps_us_.empty() || timestamp_us < timestamps_us_.front() || timestamp_us > timestamps_us_.back())
+    {
+        return false;
+    }
+
+    uint32_t const i = FindSample(timestamp_us);
+    if (timestamps_us_[i] == timestamp_us)
+    {
+        GetSample(i, out_pose);
+        return true;
+    }
+
+    uint32_t const j = i + 1;
+    float const t = static_cast<float>(timestamp_us - timestamps_us_[i]) / static_cast<float>(timestamps_us_[j] - timestamps_us_[i]);
+
+    out_pose->position[0] = xs_[i] + (xs_[j] - xs_[i]) * t;
+    out_pose->position[1] = ys_[i] + (ys_[j] - ys_[i]) * t;
+    out_pose->position[2] = zs_[i] + (zs_[j] - zs_[i]) * t;
+
+    // q and -q are the same orientation, so interpolate towards whichever of them is nearer
+    float cos_angle = qxs_[i] * qxs_[j] + qys_[i] * qys_[j] + qzs_[i] * qzs_[j] + qws_[i] * qws_[j];
+    float const sign = cos_angle < 0.0f ? -1.0f : 1.0f;
+    cos_angle *= sign;
+
+    float weight_i = 1.0f - t;
+    float weight_j = t;
+    if (cos_angle < SlerpLinearThreshold)
+    {
+        float const angle = acosf(cos_angle);
+        float const inv_sin_angle = 1.0f / sinf(angle);
+        weight_i = sinf((1.0f - t) * angle) * inv_sin_angle;
+        weight_j = sinf(t * angle) * inv_sin_angle;
+    }
+    weight_j *= sign;
+
+    float const qx = qxs_[i] * weight_i + qxs_[j] * weight_j;
+    float const qy = qys_[i] * weight_i + qys_[j] * weight_j;
+    float const qz = qzs_[i] * weight_i + qzs_[j] * weight_j;
+    float const qw = qws_[i] * weight_i + qws_[j] * weight_j;
+    float const inv_length = 1.0f / sqrtf(qx * qx + qy * qy + qz * qz + qw * qw);
+    out_pose->orientation[0] = qx * inv_length;
+    out_pose->orientation[1] = qy * inv_length;
+    out_pose->orientation[2] = qz * inv_length;
+    out_pose->orientation[3] = qw * inv_length;
+    return true;
+}
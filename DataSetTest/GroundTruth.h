@@ -0,0 +1,53 @@
+#pragma once
+
+// Pose of the camera in the world frame of a dataset
+struct Pose
+{
+    float position[3];      // x, y, z
+    float orientation[4];   // unit quaternion x, y, z, w
+};
+
+//
+// Ground truth poses of a dataset, loaded from groundtruth.txt lines of "timestamp px py pz qx qy qz qw"
+//
+// Samples are stored as one array per component. Lookups go through a uniform time index with a bucket per
+// average sample interval, each holding the last sample at or before its start, so finding the samples around
+// a timestamp takes a step or two however many samples there are, as long as sampling is roughly regular.
+//
+class GroundTruth : private NonCopyable
+{
+public:
+    GroundTruth() = default;
+
+    // Replaces any poses loaded before. Timestamps must be increasing
+    bool Load(char const *path);
+    void Clear();
+
+    uint32_t GetCount() const { return static_cast<uint32_t>(timestamps_us_.size()); }
+    uint64_t const *GetTimestamps() const { return timestamps_us_.data(); }
+
+    void GetSample(uint32_t const index, Pose *out_pose) const;
+
+    // Pose at timestamp_us, with the position interpolated linearly and the orientation spherically between the
+    // samples around it. Returns false outside the time range of the samples
+    bool GetPose(uint64_t const timestamp_us, Pose *out_pose) const;
+
+private:
+    void BuildTimeIndex();
+
+    // Last sample at or before timestamp_us, which must be in range
+    uint32_t FindSample(uint64_t const timestamp_us) const;
+
+private:
+    std::vector<uint64_t> timestamps_us_;
+    std::vector<float>    xs_;
+    std::vector<float>    ys_;
+    std::vector<float>    zs_;
+    std::vector<float>    qxs_;
+    std::vector<float>    qys_;
+    std::vector<float>    qzs_;
+    std::vector<float>    qws_;
+
+    std::vector<uint32_t> time_index_;
+    uint64_t              bucket_us_ = 1;
+};
@@ -1,29 +1,299 @@
 #include "Precomp.h"
 #include "HarrisCorners.h"
-#include "Utilities.h"
+#include "Convolution.h"
+#include "ThreadPool.h"
 
-static inline void ComputeM(uint8_t const *image, int32_t const stride, int32_t const x, int32_t const y, int32_t const window_half, int64_t out_m[2][2])
+// Largest magnitude a 3x3 Sobel derivative of 8-bit data can have
+static float const MaxGradient = 4.0f * 255.0f;
+
+// Window sums are kept in 32 bits. Each product is at most MaxGradient^2, which bounds the window to 45x45
+static int32_t const MaxWindowSize = 45;
+
+static inline float ComputeResponse(int32_t const sum_xx, int32_t const sum_xy, int32_t const sum_yy, float const normalize, float const k)
+{
+    float const a = static_cast<float>(sum_xx) * normalize;
+    float const b = static_cast<float>(sum_xy) * normalize;
+    float const c = static_cast<float>(sum_yy) * normalize;
+    float const det = a * c - b * b;
+    float const trace = a + c;
+    return det - k * trace * trace;
+}
+
+void ComputeGradientRow(uint8_t const *above, uint8_t const *row, uint8_t const *below, int32_t const width, int16_t *out_ix, int16_t *out_iy)
+{
+    out_ix[0] = 0;
+    out_iy[0] = 0;
+    for (int32_t x = 1; x < width - 1; ++x)
+    {
+        int32_t const ix = (above[x + 1] - above[x - 1]) + 2 * (row[x + 1] - row[x - 1]) + (below[x + 1] - below[x - 1]);
+        int32_t const iy = (below[x - 1] - above[x - 1]) + 2 * (below[x] - above[x]) + (below[x + 1] - above[x + 1]);
+        out_ix[x] = static_cast<int16_t>(ix);
+        out_iy[x] = static_cast<int16_t>(iy);
+    }
+    out_ix[width - 1] = 0;
+    out_iy[width - 1] = 0;
+}
+
+void ComputeGradients(uint8_t const *image, int32_t const width, int32_t const height, int16_t *out_ix, int16_t *out_iy, ThreadPool *pool)
+{
+    // Every pixel is on the border
+    if (width < 3 || height < 3)
+    {
+        size_t const num_pixels = static_cast<size_t>(std::max(width, 0)) * std::max(height, 0);
+        memset(out_ix, 0, num_pixels * sizeof(int16_t));
+        memset(out_iy, 0, num_pixels * sizeof(int16_t));
+        return;
+    }
+
+    memset(out_ix, 0, width * sizeof(int16_t));
+    memset(out_iy, 0, width * sizeof(int16_t));
+    ParallelForRows(pool, 1, height - 1, GetRowBandCount(pool, height - 2, 8), [&](uint32_t, int32_t const y_begin, int32_t const y_end)
+    {
+        for (int32_t y = y_begin; y < y_end; ++y)
+        {
+            ComputeGradientRow(image + (y - 1) * width, image + y * width, image + (y + 1) * width, width, out_ix + y * width, out_iy + y * width);
+        }
+    });
+    memset(out_ix + (height - 1) * width, 0, width * sizeof(int16_t));
+    memset(out_iy + (height - 1) * width, 0, width * sizeof(int16_t));
+}
+
+// Adds (sign = 1) or removes (sign = -1) one row of gradient products to/from the column sums.
+// The sums are planar (all xx, then all xy, then all yy) so this vectorizes
+static inline void AccumulateRow(int16_t const *ix, int16_t const *iy, int32_t const width, int32_t const sign, int32_t *inout_column_sums)
 {
-    static float sobel_operator_x[] =
+    int32_t *sum_xx = inout_column_sums;
+    int32_t *sum_xy = inout_column_sums + width;
+    int32_t *sum_yy = inout_column_sums + 2 * width;
+    for (int32_t x = 0; x < width; ++x)
+    {
+        int32_t const gx = ix[x];
+        int32_t const gy = iy[x];
+        sum_xx[x] += sign * (gx * gx);
+        sum_xy[x] += sign * (gx * gy);
+        sum_yy[x] += sign * (gy * gy);
+    }
+}
+
+template <typename GetGradientRow>
+void HarrisDetector::ScoreRows(Band &band, int32_t const width, int32_t const y_first, int32_t const y_last, GetGradientRow const &get_gradient_row, float *out_response)
+{
+    int32_t const window_size = params_.window_size;
+    int32_t const window_half = window_size / 2;
+    float   const normalize   = 1.0f / (MaxGradient * MaxGradient * window_size * window_size);
+
+    int32_t const x_begin = window_half + 1;
+    int32_t const x_end   = width - window_half - 1;
+
+    band.features.clear();
+    band.column_sums.assign(3 * static_cast<size_t>(width), 0);
+    band.row_sums.resize(3 * static_cast<size_t>(width));
+    band.row_response.resize(width);
+
+    int32_t *column_sums = band.column_sums.data();
+    int32_t const *column_xx = column_sums;
+    int32_t const *column_xy = column_sums + width;
+    int32_t const *column_yy = column_sums + 2 * width;
+
+    int32_t *row_xx = band.row_sums.data();
+    int32_t *row_xy = row_xx + width;
+    int32_t *row_yy = row_xx + 2 * width;
+
+    int16_t const *ix = nullptr;
+    int16_t const *iy = nullptr;
+
+    // Prime the column sums with all but the last row of the first window
+    for (int32_t y = y_first - window_half; y < y_first + window_half; ++y)
     {
-        1, 0, -1,
-        2, 0, -2,
-        1, 0, -1
-    };
-    static float sobel_operator_y[] =
+        get_gradient_row(y, &ix, &iy);
+        AccumulateRow(ix, iy, width, 1, column_sums);
+    }
+
+    for (int32_t y = y_first; y < y_last; ++y)
     {
-        1,  2,  1,
-        0,  0,  0,
-        -1, -2, -1
-    };
+        get_gradient_row(y + window_half, &ix, &iy);
+        AccumulateRow(ix, iy, width, 1, column_sums);
+
+        // Slide the window across the row
+        int32_t sum_xx = 0;
+        int32_t sum_xy = 0;
+        int32_t sum_yy = 0;
+        for (int32_t x = x_begin - window_half; x < x_begin + window_half; ++x)
+        {
+            sum_xx += column_xx[x];
+            sum_xy += column_xy[x];
+            sum_yy += column_yy[x];
+        }
+        for (int32_t x = x_begin; x < x_end; ++x)
+        {
+            sum_xx += column_xx[x + window_half];
+            sum_xy += column_xy[x + window_half];
+            sum_yy += column_yy[x + window_half];
+            row_xx[x] = sum_xx;
+            row_xy[x] = sum_xy;
+            row_yy[x] = sum_yy;
+            sum_xx -= column_xx[x - window_half];
+            sum_xy -= column_xy[x - window_half];
+            sum_yy -= column_yy[x - window_half];
+        }
+
+        // Score the row, then collect corners, as separate loops so the scoring vectorizes
+        float const k = params_.k;
+        float *response_row = out_response ? out_response + y * width : band.row_response.data();
+        for (int32_t x = x_begin; x < x_end; ++x)
+        {
+            response_row[x] = ComputeResponse(row_xx[x], row_xy[x], row_yy[x], normalize, k);
+        }
+
+        float const threshold = params_.threshold;
+        for (int32_t x = x_begin; x < x_end; ++x)
+        {
+            if (response_row[x] > threshold)
+            {
+                HarrisFeature feature;
+                feature.x = x;
+                feature.y = y;
+                feature.response = response_row[x];
+                band.features.push_back(feature);
+            }
+        }
+
+        get_gradient_row(y - window_half, &ix, &iy);
+        AccumulateRow(ix, iy, width, -1, column_sums);
+    }
+}
 
-    memset(out_m, 0, sizeof(int64_t) * 4);
+void HarrisDetector::ScoreBands(int32_t const width, int32_t const height, FunctionRef<void(Band &, int32_t, int32_t)> const score_band, std::vector<HarrisFeature> *out_features)
+{
+    int32_t const window_size = params_.window_size;
+    int32_t const window_half = window_size / 2;
+
+    assert(window_size > 0 && (window_size & 1) && window_size <= MaxWindowSize);
+
+    out_features->clear();
+
+    // Only pixels whose entire window has valid (non-border) gradients are evaluated
+    int32_t const x_begin = window_half + 1;
+    int32_t const x_end   = width - window_half - 1;
+    int32_t const y_begin = window_half + 1;
+    int32_t const y_end   = height - window_half - 1;
+    if (x_begin >= x_end || y_begin >= y_end)
+    {
+        return;
+    }
+
+    // Each band re-reads window_size - 1 halo rows to prime its sums, so keep bands well above that
+    uint32_t const num_bands = GetRowBandCount(pool_, y_end - y_begin, 4 * window_size);
+    if (bands_.size() < num_bands)
+    {
+        bands_.resize(num_bands);
+    }
+
+    ParallelForRows(pool_, y_begin, y_end, num_bands, [&](uint32_t const band, int32_t const y_first, int32_t const y_last)
+    {
+        score_band(bands_[band], y_first, y_last);
+    });
+
+    // Bands are in row order, so concatenating them keeps the features sorted
+    for (uint32_t band = 0; band < num_bands; ++band)
+    {
+        out_features->insert(out_features->end(), bands_[band].features.begin(), bands_[band].features.end());
+    }
+}
+
+void HarrisDetector::Detect(uint8_t const *image, int32_t const width, int32_t const height, std::vector<HarrisFeature> *out_features)
+{
+    TRACE_SCOPE("HarrisDetector::Detect");
+    size_t const num_pixels = static_cast<size_t>(width) * height;
+    ix_.resize(num_pixels);
+    iy_.resize(num_pixels);
+    response_.assign(num_pixels, 0.0f);
+
+    ComputeGradients(image, width, height, ix_.data(), iy_.data(), pool_);
+
+    ScoreBands(width, height, [&](Band &band, int32_t const y_first, int32_t const y_last)
+    {
+        ScoreRows(band, width, y_first, y_last, [&](int32_t const y, int16_t const **out_ix, int16_t const **out_iy)
+        {
+            *out_ix = &ix_[y * width];
+            *out_iy = &iy_[y * width];
+        }, response_.data());
+    }, out_features);
+}
+
+void HarrisDetector::DetectFused(uint8_t const *image, int32_t const width, int32_t const height, GaussianKernel const &kernel, std::vector<HarrisFeature> *out_features)
+{
+    TRACE_SCOPE("HarrisDetector::DetectFused");
+    int32_t const num_taps    = static_cast<int32_t>(kernel.fixed_values.size());
+    int32_t const radius      = num_taps / 2;
+    int32_t const ring_rows   = 2 * radius + 1; // rows [y - radius, y + radius], one more than the taps when even
+    int32_t const window_size = params_.window_size;
+    int32_t const window_half = window_size / 2;
+
+    assert(num_taps <= MaxKernelTaps);
+
+    ScoreBands(width, height, [&](Band &band, int32_t const y_first, int32_t const y_last)
+    {
+        band.horizontal_ring.resize(static_cast<size_t>(ring_rows) * width);
+        band.smoothed_ring.resize(3 * static_cast<size_t>(width));
+        band.gradient_ring.resize(2 * static_cast<size_t>(window_size) * width);
+
+        uint8_t const *vertical_rows[MaxKernelTaps];
+
+        // Index of the next row each stage will produce. Each stage pulls rows from the previous one on demand,
+        // starting from the halo rows the first window of the band needs
+        int32_t next_gradient = y_first - window_half;
+        int32_t next_smoothed = next_gradient - 1;
+        int32_t next_horizontal = std::max(next_smoothed - radius, 0);
+
+        auto produce_smoothed_row = [&](int32_t const y)
+        {
+            // The vertical taps of row y cover rows [y - radius, y + radius], clamped to the image
+            int32_t const last_needed = std::min(y + radius, height - 1);
+            for (; next_horizontal <= last_needed; ++next_horizontal)
+            {
+                SmoothRowHorizontal(image + next_horizontal * width, width, kernel, &band.horizontal_ring[(next_horizontal % ring_rows) * width]);
+            }
+            for (int32_t k = 0; k < num_taps; ++k)
+            {
+                int32_t const source_y = std::min(std::max(y - radius + k, 0), height - 1);
+                vertical_rows[k] = &band.horizontal_ring[(source_y % ring_rows) * width];
+            }
+            SmoothRowVertical(vertical_rows, width, kernel, &band.smoothed_ring[(y % 3) * width]);
+        };
+
+        auto produce_gradient_row = [&](int32_t const y)
+        {
+            for (; next_smoothed <= y + 1; ++next_smoothed)
+            {
+                produce_smoothed_row(next_smoothed);
+            }
+            int16_t *ix = &band.gradient_ring[(2 * (y % window_size) + 0) * width];
+            int16_t *iy = &band.gradient_ring[(2 * (y % window_size) + 1) * width];
+            ComputeGradientRow(&band.smoothed_ring[((y - 1) % 3) * width], &band.smoothed_ring[(y % 3) * width], &band.smoothed_ring[((y + 1) % 3) * width], width, ix, iy);
+        };
+
+        ScoreRows(band, width, y_first, y_last, [&](int32_t const y, int16_t const **out_ix, int16_t const **out_iy)
+        {
+            for (; next_gradient <= y; ++next_gradient)
+            {
+                produce_gradient_row(next_gradient);
+            }
+            *out_ix = &band.gradient_ring[(2 * (y % window_size) + 0) * width];
+            *out_iy = &band.gradient_ring[(2 * (y % window_size) + 1) * width];
+        }, nullptr);
+    }, out_features);
+}
+
+static inline void ComputeM(uint8_t const *image, int32_t const stride, int32_t const x, int32_t const y, int32_t const window_half, int32_t out_m[2][2])
+{
+    memset(out_m, 0, sizeof(int32_t) * 4);
     for (int32_t iy = y - window_half; iy <= y + window_half; ++iy)
     {
         for (int32_t ix = x - window_half; ix <= x + window_half; ++ix)
         {
-            int64_t const Ix = static_cast<int64_t>(Convolve(image, stride, ix, iy, sobel_operator_x, 3, 3));
-            int64_t const Iy = static_cast<int64_t>(Convolve(image, stride, ix, iy, sobel_operator_y, 3, 3));
+            int32_t const Ix = Convolve<SobelX>(image, stride, ix, iy);
+            int32_t const Iy = Convolve<SobelY>(image, stride, ix, iy);
             out_m[0][0] += (Ix * Ix);
             out_m[0][1] += Ix * Iy;
             out_m[1][0] += Ix * Iy;
@@ -32,37 +302,30 @@ static inline void ComputeM(uint8_t const *image, int32_t const stride, int32_t
     }
 }
 
-void HarrisDetect(uint8_t const *image, int32_t const width, int32_t const height, std::vector<HarrisFeature> *out_features)
+void HarrisDetectReference(uint8_t const *image, int32_t const width, int32_t const height, HarrisParams const &params, std::vector<HarrisFeature> *out_features)
 {
-    static int32_t const  window_size = 3; // 3x3 with extents [-1, 1]
-
+    int32_t const window_size = params.window_size;
     int32_t const window_half = window_size / 2;
-    float   const k           = 0.03f;
+    float   const normalize   = 1.0f / (MaxGradient * MaxGradient * window_size * window_size);
 
-    int64_t M[2][2]{};
-    int64_t detM = 0;
-    int64_t traceM = 0;
-    int64_t R = 0;
+    int32_t M[2][2]{};
 
     out_features->clear();
 
-    int64_t const threshold = static_cast<int64_t>(INT64_MAX) / 1000;
-
-    // TODO: To avoid handling boundaries, we only search in the inner rectangle of the image
+    // To avoid handling boundaries, we only search in the inner rectangle of the image
     // such that our entire evaluation window is within the image
     for (int32_t y = window_half + 1; y < height - window_half - 1; ++y)
     {
         for (int32_t x = window_half + 1; x < width - window_half - 1; ++x)
         {
             ComputeM(image, width, x, y, window_half, M);
-            detM = (M[0][0] * M[1][1]) - (M[0][1] * M[1][0]);
-            traceM = M[0][0] + M[1][1];
-            R = static_cast<int64_t>(detM - k * (traceM * traceM));
-            if (abs(R) > threshold)
+            float const R = ComputeResponse(M[0][0], M[0][1], M[1][1], normalize, params.k);
+            if (R > params.threshold)
             {
                 HarrisFeature feature;
                 feature.x = x;
                 feature.y = y;
+                feature.response = R;
                 out_features->push_back(feature);
             }
         }
@@ -1,8 +1,104 @@
 #pragma once
 
+#include "FunctionRef.h"
+#include "Utilities.h"
+
 struct HarrisFeature
 {
     int32_t x, y;
+    float   response;
+};
+
+struct HarrisParams
+{
+    int32_t window_size = 3;       // side of the square summation window. Must be odd
+    float   k           = 0.04f;   // sensitivity. Typical values are [0.04, 0.06]
+    float   threshold   = 1.0e-4f; // minimum response to count as a corner (see HarrisDetector)
+};
+
+// Computes the 3x3 Sobel derivatives of a single row, given the row and its neighbors above and below.
+// The first and last columns have no full neighborhood and are written as 0
+void ComputeGradientRow(uint8_t const *above, uint8_t const *row, uint8_t const *below, int32_t const width, int16_t *out_ix, int16_t *out_iy);
+
+// Computes the 3x3 Sobel derivatives of the whole image. Border pixels are written as 0.
+// Runs in parallel row bands when pool isn't null
+void ComputeGradients(uint8_t const *image, int32_t const width, int32_t const height, int16_t *out_ix, int16_t *out_iy, ThreadPool *pool);
+
+//
+// Harris corner detector
+//
+// Gradients are computed once per frame into int16 planes, and the structure tensor
+// M = sum(Ix*Ix, Ix*Iy, Iy*Iy) over the window is maintained with running column & row sums,
+// so the cost per pixel does not depend on window_size.
+//
+// The response R = det(M) - k * trace(M)^2 is computed on M normalized to [0, 1]
+// (gradients scaled by the maximum Sobel magnitude, sums averaged over the window),
+// so thresholds do not depend on window_size either.
+//
+// With a thread pool, rows are split into bands that each prime their own window sums from the halo
+// rows above them, and band results are concatenated in order, so the features are the same for any
+// number of threads.
+//
+class HarrisDetector : private NonCopyable
+{
+public:
+    HarrisDetector() = default;
+
+    void SetParams(HarrisParams const &params) { params_ = params; }
+    HarrisParams const &GetParams() const { return params_; }
+
+    // Optional. Detection runs on the calling thread when there is no pool
+    void SetThreadPool(ThreadPool *pool) { pool_ = pool; }
+
+    // Computes the response map of image, and returns every pixel whose response exceeds the threshold
+    void Detect(uint8_t const *image, int32_t const width, int32_t const height, std::vector<HarrisFeature> *out_features);
+
+    // Smooths image with kernel and detects corners in one pass over row strips. Each stage keeps only the
+    // few rows the next stage needs in small ring buffers, so no full-frame intermediate is written.
+    // Returns the same features as SmoothImage followed by Detect. Does not update the response map
+    void DetectFused(uint8_t const *image, int32_t const width, int32_t const height, GaussianKernel const &kernel, std::vector<HarrisFeature> *out_features);
+
+    // Response map of the last call to Detect (width * height). Pixels that were not evaluated are 0
+    float const *GetResponse() const { return response_.data(); }
+
+private:
+    // Scratch for one row band
+    struct Band
+    {
+        std::vector<int32_t>       column_sums;  // planar xx, xy, yy sums of each column over the window
+        std::vector<int32_t>       row_sums;     // planar xx, xy, yy sums of each window of the current row
+        std::vector<float>         row_response; // response of the current row, when there's no response map
+        std::vector<HarrisFeature> features;
+
+        // Ring buffers for DetectFused
+        std::vector<uint8_t>       horizontal_ring; // horizontally smoothed rows, as many as the vertical taps span
+        std::vector<uint8_t>       smoothed_ring;   // fully smoothed rows, 3 for the Sobel operator
+        std::vector<int16_t>       gradient_ring;   // ix & iy rows, window_size of each
+    };
+
+    // Scores rows [y_first, y_last) into band.features. get_gradient_row(y, &ix, &iy) returns gradient row y.
+    // Rows are first requested in increasing order, and are only requested again while they are still
+    // inside the current window. out_response is optional
+    template <typename GetGradientRow>
+    void ScoreRows(Band &band, int32_t const width, int32_t const y_first, int32_t const y_last, GetGradientRow const &get_gradient_row, float *out_response);
+
+    // Splits the evaluated rows into bands, runs score_band(band, y_first, y_last) for each, and merges the results
+    void ScoreBands(int32_t const width, int32_t const height, FunctionRef<void(Band &, int32_t, int32_t)> const score_band, std::vector<HarrisFeature> *out_features);
+
+private:
+    HarrisParams         params_;
+    ThreadPool          *pool_ = nullptr;
+    std::vector<int16_t> ix_;
+    std::vector<int16_t> iy_;
+    std::vector<float>   response_;
+    std::vector<Band>    bands_;
 };
 
-void HarrisDetect(uint8_t const *image, int32_t const width, int32_t const height, std::vector<HarrisFeature> *out_features);
+// Scalar reference implementation. Recomputes the gradients for every pixel of every window.
+// Produces the same features as HarrisDetector, and is only meant for validating it.
+//
+// This is the original per-pixel HarrisDetect, with the same fixes and changes as HarrisDetector, so it isn't
+// a record of how the original behaved. Its derivatives wrapped through Convolve's unsigned return, it used
+// int64 sums with a fixed k of 0.03 and a 3x3 window, and it kept pixels whose |R| exceeded INT64_MAX / 1000,
+// edges included. Now R is computed on the normalized tensor, and only R > HarrisParams::threshold is kept
+void HarrisDetectReference(uint8_t const *image, int32_t const width, int32_t const height, HarrisParams const &params, std::vector<HarrisFeature> *out_features);
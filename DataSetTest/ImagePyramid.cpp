@@ -0,0 +1,256 @@
+#include "Precomp.h"
+#include "ImagePyramid.h"
+#include "FastCorners.h"
+#include "HarrisCorners.h"
+
+// Fractional bits of the bilinear weights. Weighted sums of 8-bit pixels stay within 16 bits
+static int32_t const BilinearShift = 8;
+
+void DownsampleHalf(uint8_t const *input, int32_t const width, int32_t const height, uint8_t *output)
+{
+    int32_t const output_width = width / 2;
+    int32_t const output_height = height / 2;
+
+    for (int32_t y = 0; y < output_height; ++y)
+    {
+        uint8_t const *row0 = input + (2 * y) * width;
+        uint8_t const *row1 = row0 + width;
+        uint8_t *output_row = output + y * output_width;
+        int32_t x = 0;
+
+        // maddubs with all ones adds horizontal pairs into 16 bits
+#ifdef __AVX2__
+        __m256i const ones = _mm256_set1_epi8(1);
+        __m256i const round = _mm256_set1_epi16(2);
+        for (; x + 16 <= output_width; x += 16)
+        {
+            __m256i const top = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(row0 + 2 * x)), ones);
+            __m256i const bottom = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(row1 + 2 * x)), ones);
+            __m256i const sums = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(top, bottom), round), 2);
+            __m256i const bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums, sums), 0xD8);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(output_row + x), _mm256_castsi256_si128(bytes));
+        }
+#endif
+
+        __m128i const ones4 = _mm_set1_epi8(1);
+        __m128i const round4 = _mm_set1_epi16(2);
+        for (; x + 8 <= output_width; x += 8)
+        {
+            __m128i const top = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(row0 + 2 * x)), ones4);
+            __m128i const bottom = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(row1 + 2 * x)), ones4);
+            __m128i const sums = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(top, bottom), round4), 2);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(output_row + x), _mm_packus_epi16(sums, sums));
+        }
+
+        for (; x < output_width; ++x)
+        {
+            output_row[x] = static_cast<uint8_t>((row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2);
+        }
+    }
+}
+
+// Source position of destination pixel i, aligned on pixel centers and clamped to the image.
+// Returns the first of the 2 source pixels, and the weight of the second in BilinearShift fixed point
+static inline int32_t MapBilinear(int32_t const i, float const ratio, int32_t const size, int32_t *out_weight)
+{
+    float const source = std::min(std::max((static_cast<float>(i) + 0.5f) * ratio - 0.5f, 0.0f), static_cast<float>(size - 1));
+    int32_t const first = static_cast<int32_t>(source);
+    *out_weight = static_cast<int32_t>(lroundf((source - static_cast<float>(first)) * (1 << BilinearShift)));
+    return first;
+}
+
+void ResampleBilinear(uint8_t const *input, int32_t const width, int32_t const height, uint8_t *output, int32_t const output_width, int32_t const output_height, int32_t *column_lut, uint16_t *vertical_row)
+{
+    float const ratio_x = static_cast<float>(width) / output_width;
+    float const ratio_y = static_cast<float>(height) / output_height;
+
+    for (int32_t x = 0; x < output_width; ++x)
+    {
+        column_lut[2 * x + 0] = MapBilinear(x, ratio_x, width, &column_lut[2 * x + 1]);
+    }
+
+    for (int32_t y = 0; y < output_height; ++y)
+    {
+        int32_t weight1 = 0;
+        int32_t const y0 = MapBilinear(y, ratio_y, height, &weight1);
+        int32_t const weight0 = (1 << BilinearShift) - weight1;
+        uint8_t const *row0 = input + y0 * width;
+        uint8_t const *row1 = input + std::min(y0 + 1, height - 1) * width;
+
+        // Blend the 2 source rows into vertical_row first, where it vectorizes. Results keep BilinearShift fraction bits
+        int32_t x = 0;
+#ifdef __AVX2__
+        __m256i const w0 = _mm256_set1_epi16(static_cast<int16_t>(weight0));
+        __m256i const w1 = _mm256_set1_epi16(static_cast<int16_t>(weight1));
+        for (; x + 16 <= width; x += 16)
+        {
+            __m256i const a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(row0 + x)));
+            __m256i const b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(row1 + x)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(vertical_row + x), _mm256_add_epi16(_mm256_mullo_epi16(a, w0), _mm256_mullo_epi16(b, w1)));
+        }
+#endif
+        __m128i const w0_4 = _mm_set1_epi16(static_cast<int16_t>(weight0));
+        __m128i const w1_4 = _mm_set1_epi16(static_cast<int16_t>(weight1));
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i const a = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(row0 + x)));
+            __m128i const b = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(row1 + x)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(vertical_row + x), _mm_add_epi16(_mm_mullo_epi16(a, w0_4), _mm_mullo_epi16(b, w1_4)));
+        }
+        for (; x < width; ++x)
+        {
+            vertical_row[x] = static_cast<uint16_t>(row0[x] * weight0 + row1[x] * weight1);
+        }
+
+        // Then pick & blend columns through the lookup table
+        uint8_t *output_row = output + y * output_width;
+        for (int32_t ox = 0; ox < output_width; ++ox)
+        {
+            int32_t const x0 = column_lut[2 * ox + 0];
+            int32_t const x1 = std::min(x0 + 1, width - 1);
+            int32_t const column_weight1 = column_lut[2 * ox + 1];
+            int32_t const column_weight0 = (1 << BilinearShift) - column_weight1;
+            int32_t const value = vertical_row[x0] * column_weight0 + vertical_row[x1] * column_weight1;
+            output_row[ox] = static_cast<uint8_t>((value + (1 << (2 * BilinearShift - 1))) >> (2 * BilinearShift));
+        }
+    }
+}
+
+void ImagePyramid::Allocate(int32_t const width, int32_t const height)
+{
+    assert(params_.num_levels > 0 && params_.scale_factor > 1.0f);
+
+    levels_.clear();
+    pixels_offsets_.clear();
+    smoothed_offsets_.clear();
+
+    size_t storage_size = 0;
+    float scale = 1.0f;
+    int32_t level_width = width;
+    int32_t level_height = height;
+    for (int32_t i = 0; i < params_.num_levels; ++i)
+    {
+        if (i > 0)
+        {
+            scale *= params_.scale_factor;
+            if (2.0f == params_.scale_factor)
+            {
+                level_width /= 2;
+                level_height /= 2;
+            }
+            else
+            {
+                level_width = static_cast<int32_t>(lroundf(width / scale));
+                level_height = static_cast<int32_t>(lroundf(height / scale));
+            }
+        }
+        if (level_width < MinLevelSize || level_height < MinLevelSize)
+        {
+            break;
+        }
+
+        Level level;
+        level.width = level_width;
+        level.height = level_height;
+        level.scale = scale;
+        levels_.push_back(level);
+
+        // Level 0's pixels are the input image
+        size_t const level_size = static_cast<size_t>(level_width) * level_height;
+        pixels_offsets_.push_back(storage_size);
+        storage_size += (i > 0) ? level_size : 0;
+        smoothed_offsets_.push_back(storage_size);
+        storage_size += level_size;
+    }
+
+    level_count_ = static_cast<uint32_t>(levels_.size());
+    storage_.resize(storage_size);
+    scratch_.resize(static_cast<size_t>(width) * height);
+    column_lut_.resize(2 * static_cast<size_t>(width));
+    vertical_row_.resize(width);
+
+    allocated_width_ = width;
+    allocated_height_ = height;
+    allocated_params_ = params_;
+
+    LOGD("Allocated %u pyramid levels for %dx%d", level_count_, width, height);
+}
+
+void ImagePyramid::Build(uint8_t const *image, int32_t const width, int32_t const height, GaussianKernel const &kernel)
+{
+    TRACE_SCOPE("ImagePyramid::Build");
+    if (width != allocated_width_ || height != allocated_height_ ||
+        params_.num_levels != allocated_params_.num_levels || params_.scale_factor != allocated_params_.scale_factor)
+    {
+        Allocate(width, height);
+    }
+
+    for (uint32_t i = 0; i < level_count_; ++i)
+    {
+        Level &level = levels_[i];
+        if (0 == i)
+        {
+            level.pixels = image;
+        }
+        else
+        {
+            Level const &previous = levels_[i - 1];
+            uint8_t *pixels = storage_.data() + pixels_offsets_[i];
+            if (2.0f == params_.scale_factor)
+            {
+                DownsampleHalf(previous.smoothed, previous.width, previous.height, pixels);
+            }
+            else
+            {
+                ResampleBilinear(previous.smoothed, previous.width, previous.height, pixels, level.width, level.height, column_lut_.data(), vertical_row_.data());
+            }
+            level.pixels = pixels;
+        }
+
+        uint8_t *smoothed = storage_.data() + smoothed_offsets_[i];
+        SmoothImage(level.pixels, level.width, level.height, kernel, scratch_.data(), smoothed, pool_);
+        level.smoothed = smoothed;
+    }
+}
+
+void DetectPyramidFast(ImagePyramid const &pyramid, FastDetector *detector, std::vector<FastFeature> *level_features, std::vector<PyramidFeature> *out_features)
+{
+    out_features->clear();
+
+    for (uint32_t i = 0; i < pyramid.GetLevelCount(); ++i)
+    {
+        ImagePyramid::Level const &level = pyramid.GetLevel(i);
+        detector->Detect(level.pixels, level.width, level.height, level.width, level_features);
+        for (auto const &feature : *level_features)
+        {
+            PyramidFeature pyramid_feature;
+            pyramid_feature.x = feature.x;
+            pyramid_feature.y = feature.y;
+            pyramid_feature.level = static_cast<int32_t>(i);
+            pyramid_feature.scale = level.scale;
+            pyramid_feature.response = static_cast<float>(feature.score);
+            out_features->push_back(pyramid_feature);
+        }
+    }
+}
+
+void DetectPyramidHarris(ImagePyramid const &pyramid, HarrisDetector *detector, std::vector<HarrisFeature> *level_features, std::vector<PyramidFeature> *out_features)
+{
+    out_features->clear();
+
+    for (uint32_t i = 0; i < pyramid.GetLevelCount(); ++i)
+    {
+        ImagePyramid::Level const &level = pyramid.GetLevel(i);
+        detector->Detect(level.smoothed, level.width, level.height, level_features);
+        for (auto const &feature : *level_features)
+        {
+            PyramidFeature pyramid_feature;
+            pyramid_feature.x = feature.x;
+            pyramid_feature.y = feature.y;
+            pyramid_feature.level = static_cast<int32_t>(i);
+            pyramid_feature.scale = level.scale;
+            pyramid_feature.response = feature.response;
+            out_features->push_back(pyramid_feature);
+        }
+    }
+}
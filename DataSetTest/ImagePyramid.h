@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Utilities.h"
+
+class FastDetector;
+class HarrisDetector;
+struct FastFeature;
+struct HarrisFeature;
+
+struct PyramidParams
+{
+    int32_t num_levels   = 4;    // including the full resolution level
+    float   scale_factor = 2.0f; // size ratio between consecutive levels. 2 and ~1.2 are typical
+};
+
+// A feature detected on one level of a pyramid
+struct PyramidFeature
+{
+    int32_t x, y;     // position in its level
+    int32_t level;
+    float   scale;    // level 0 position is (x + 0.5) * scale - 0.5, as levels are aligned on pixel centers
+    float   response; // detector score (FAST score or Harris response)
+};
+
+//
+// Scale-space image pyramid
+//
+// Level 0 is the input image. Each following level is resampled from the smoothed previous level, so the
+// Gaussian that detection needs anyway doubles as the anti-aliasing filter, and a level costs about
+// 1 / scale_factor^2 of the one before it.
+//
+// A scale factor of exactly 2 averages 2x2 blocks. Any other factor is bilinear. Both are aligned on pixel
+// centers, so a 2x2 average is what the bilinear path would produce at that ratio.
+//
+// Levels are allocated on the first Build, and reused as long as the image size and params don't change.
+//
+class ImagePyramid : private NonCopyable
+{
+public:
+    struct Level
+    {
+        int32_t        width = 0;
+        int32_t        height = 0;
+        float          scale = 1.0f;      // level size relative to level 0 is 1 / scale
+        uint8_t const *pixels = nullptr;  // stride is width
+        uint8_t const *smoothed = nullptr;
+    };
+
+public:
+    ImagePyramid() = default;
+
+    // Takes effect on the next Build
+    void SetParams(PyramidParams const &params) { params_ = params; }
+    PyramidParams const &GetParams() const { return params_; }
+
+    // Optional. Levels are built on the calling thread when there is no pool
+    void SetThreadPool(ThreadPool *pool) { pool_ = pool; }
+
+    // Builds every level from image, which must stay valid while the pyramid is used since level 0 points to it.
+    // Levels are dropped once they would be smaller than MinLevelSize on either side
+    void Build(uint8_t const *image, int32_t const width, int32_t const height, GaussianKernel const &kernel);
+
+    uint32_t GetLevelCount() const { return level_count_; }
+    Level const &GetLevel(uint32_t const index) const { return levels_[index]; }
+
+    // Smallest width or height a level can have
+    static int32_t const MinLevelSize = 16;
+
+private:
+    void Allocate(int32_t const width, int32_t const height);
+
+private:
+    PyramidParams         params_;
+    ThreadPool           *pool_ = nullptr;
+    std::vector<Level>    levels_;
+    uint32_t              level_count_ = 0;
+    std::vector<uint8_t>  storage_;         // pixels & smoothed of every level, back to back
+    std::vector<size_t>   pixels_offsets_;  // into storage_, per level. Unused for level 0
+    std::vector<size_t>   smoothed_offsets_;
+    std::vector<uint8_t>  scratch_;         // for SmoothImage
+    std::vector<int32_t>  column_lut_;      // for ResampleBilinear
+    std::vector<uint16_t> vertical_row_;
+    int32_t               allocated_width_ = 0;
+    int32_t               allocated_height_ = 0;
+    PyramidParams         allocated_params_;
+};
+
+// Halves an image by averaging 2x2 blocks. Output is (width / 2) x (height / 2)
+void DownsampleHalf(uint8_t const *input, int32_t const width, int32_t const height, uint8_t *output);
+
+// Bilinear resize to output_width x output_height, aligned on pixel centers.
+// column_lut holds 2 ints per output column, and vertical_row input width uint16s, as scratch
+void ResampleBilinear(uint8_t const *input, int32_t const width, int32_t const height, uint8_t *output, int32_t const output_width, int32_t const output_height, int32_t *column_lut, uint16_t *vertical_row);
+
+// Runs detector on the pixels of every level. Features are sorted by level, then in raster order.
+// level_features is scratch for the features of one level
+void DetectPyramidFast(ImagePyramid const &pyramid, FastDetector *detector, std::vector<FastFeature> *level_features, std::vector<PyramidFeature> *out_features);
+
+// Runs detector on the smoothed pixels of every level. Features are sorted by level, then in raster order.
+// level_features is scratch for the features of one level
+void DetectPyramidHarris(ImagePyramid const &pyramid, HarrisDetector *detector, std::vector<HarrisFeature> *level_features, std::vector<PyramidFeature> *out_features);
@@ -1,14 +1,95 @@
 #include "Precomp.h"
 #include "Logging.h"
+#include "ThreadPool.h"
 
 // Set default log level based on debug/release build
 #ifdef _DEBUG
-static LogLevel s_log_level = LogLevel::Debug;
+std::atomic<int32_t> g_log_level{ static_cast<int32_t>(LogLevel::Debug) };
 #else
-static LogLevel s_log_level = LogLevel::Warning;
+std::atomic<int32_t> g_log_level{ static_cast<int32_t>(LogLevel::Warning) };
 #endif
 
-static bool s_log_to_console = false;
+static std::atomic<bool> s_log_to_console{ false };
+
+// Records each thread can have waiting for the writer
+static uint32_t const LogQueueCapacity = 512;
+
+// Single producer, single consumer ring of the messages of one thread
+struct LogQueue
+{
+    std::unique_ptr<LogRecord[]> records{ new LogRecord[LogQueueCapacity] };
+    std::atomic<uint64_t>        head{ 0 };        // records committed by the owning thread
+    std::atomic<uint64_t>        tail{ 0 };        // records written by the writer
+    std::atomic<bool>            orphaned{ false };  // the owning thread exited, so it's freed once written
+};
+
+static void WriterLoop();
+
+// Owns the writer thread, which is started by the first message logged, and stopped once everything has been written
+// when the program exits. Messages logged while it isn't running are written by the thread logging them
+class LogWriter : private NonCopyable
+{
+public:
+    ~LogWriter();
+
+    // Returns a new queue for the calling thread, or nullptr once the writer has stopped
+    LogQueue *AddQueue();
+
+    // Writes every committed record of every queue, oldest first
+    void WritePending();
+
+    void Flush();
+    void Run();
+
+    // Wakes the writer without waiting for it
+    void Wake();
+
+    // Wakes the writer if it is waiting for records, after the calling thread committed one
+    void OnCommit();
+
+    bool IsRunning() const { return running_.load(std::memory_order_acquire); }
+
+private:
+    // Whether any queue has records the writer hasn't written
+    bool HasPending();
+
+private:
+    std::mutex                              queues_lock_;
+    std::vector<std::unique_ptr<LogQueue>>  queues_;
+    std::vector<LogQueue *>                 pending_queues_;    // writer thread only
+
+    std::mutex                              wake_lock_;
+    std::condition_variable                 wake_;              // wakes the writer early
+    std::condition_variable                 flushed_;
+    uint64_t                                flush_requested_ = 0;
+    uint64_t                                flush_completed_ = 0;
+    bool                                    wake_requested_ = false;
+    bool                                    stopping_ = false;
+
+    // Set while the writer waits for records, so committing one only takes a lock when it needs to wake it
+    std::atomic<bool>                       idle_{ false };
+    std::atomic<bool>                       running_{ false };
+    std::thread                             thread_;
+};
+
+static LogWriter s_writer;
+
+// Marks the queue of a thread orphaned when the thread exits
+struct LogQueueOwner
+{
+    LogQueue *queue = nullptr;
+
+    ~LogQueueOwner()
+    {
+        if (queue && s_writer.IsRunning())
+        {
+            queue->orphaned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local LogQueueOwner s_thread_queue;
+static thread_local LogRecord s_direct_record;
 
 static char const *LevelLabel(LogLevel const level)
 {
@@ -26,56 +107,464 @@ static char const *LevelLabel(LogLevel const level)
 
 void SetLogLevel(LogLevel const level)
 {
-    s_log_level = level;
+    g_log_level.store(static_cast<int32_t>(level), std::memory_order_relaxed);
 }
 
 void LogToConsole(bool const log_to_console)
 {
-    s_log_to_console = log_to_console;
+    s_log_to_console.store(log_to_console, std::memory_order_relaxed);
 }
 
-void __cdecl LogMessage(LogLevel const level, char const *format, ...)
+static int64_t GetLogArgInteger(LogRecord const &record, uint32_t const index)
 {
-    if (static_cast<int32_t>(level) > static_cast<int32_t>(s_log_level))
+    switch (record.arg_types[index])
     {
-        // Filtered out
-        return;
+    case LogArgType::Double:  return static_cast<int64_t>(record.args[index].d);
+    case LogArgType::Pointer: return static_cast<int64_t>(reinterpret_cast<uintptr_t>(record.args[index].p));
+    case LogArgType::String:  return 0;
+    default:                  return record.args[index].i;
+    }
+}
+
+static double GetLogArgDouble(LogRecord const &record, uint32_t const index)
+{
+    switch (record.arg_types[index])
+    {
+    case LogArgType::Signed:   return static_cast<double>(record.args[index].i);
+    case LogArgType::Unsigned: return static_cast<double>(record.args[index].u);
+    case LogArgType::Double:   return record.args[index].d;
+    default:                   return 0.0;
+    }
+}
+
+// Formats one argument with a single conversion such as %-8.3f or %zu. Integers are narrowed to the size the
+// length modifier says they were passed as, then printed as long long, so no argument is read as the wrong type.
+// Arguments that don't match their conversion are converted rather than misread
+static int32_t FormatLogArg(LogRecord const &record, uint32_t const index, char const *spec, size_t const spec_length, char *output, size_t const size)
+{
+    char const conversion = spec[spec_length - 1];
+
+    // Flags, width and precision, without the length modifier and the conversion
+    char format[40];
+    size_t modifier = 0;
+    while (modifier < spec_length - 1 && nullptr == strchr("hljztL", spec[modifier]))
+    {
+        ++modifier;
     }
+    memcpy(format, spec, modifier);
+    char const *length = spec + modifier;
+    size_t const length_size = spec_length - 1 - modifier;
+
+    switch (conversion)
+    {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+    {
+        int64_t value = GetLogArgInteger(record, index);
+        bool const is_signed = 'd' == conversion || 'i' == conversion;
+        if (0 == length_size || (1 == length_size && 'l' == length[0] && sizeof(long) == sizeof(int32_t)))
+        {
+            value = is_signed ? static_cast<int64_t>(static_cast<int32_t>(value)) : static_cast<int64_t>(static_cast<uint32_t>(value));
+        }
+        else if (2 == length_size && 'h' == length[0])
+        {
+            value = is_signed ? static_cast<int64_t>(static_cast<int8_t>(value)) : static_cast<int64_t>(static_cast<uint8_t>(value));
+        }
+        else if ('h' == length[0])
+        {
+            value = is_signed ? static_cast<int64_t>(static_cast<int16_t>(value)) : static_cast<int64_t>(static_cast<uint16_t>(value));
+        }
+        format[modifier] = 'l';
+        format[modifier + 1] = 'l';
+        format[modifier + 2] = conversion;
+        format[modifier + 3] = '\0';
+        return is_signed ? snprintf(output, size, format, static_cast<long long>(value)) : snprintf(output, size, format, static_cast<unsigned long long>(value));
+    }
+
+    case 'c':
+        format[modifier] = 'c';
+        format[modifier + 1] = '\0';
+        return snprintf(output, size, format, static_cast<int32_t>(GetLogArgInteger(record, index)));
+
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        format[modifier] = conversion;
+        format[modifier + 1] = '\0';
+        return snprintf(output, size, format, GetLogArgDouble(record, index));
 
-    SYSTEMTIME local_time{};
-    GetLocalTime(&local_time);
+    case 's':
+        format[modifier] = 's';
+        format[modifier + 1] = '\0';
+        return snprintf(output, size, format, LogArgType::String == record.arg_types[index] ? record.text + record.args[index].text_offset : "(invalid)");
 
+    case 'p':
+        format[modifier] = 'p';
+        format[modifier + 1] = '\0';
+        return snprintf(output, size, format, LogArgType::Pointer == record.arg_types[index] ?
+            record.args[index].p : reinterpret_cast<void const *>(static_cast<uintptr_t>(GetLogArgInteger(record, index))));
+
+    default:
+        return snprintf(output, size, "%.*s", static_cast<int32_t>(spec_length), spec);
+    }
+}
+
+// Formats the message of a record the way printf would, returning its length
+static size_t FormatLogRecord(LogRecord const &record, char *message, size_t const size)
+{
+    size_t length = 0;
+    uint32_t arg = 0;
+    char const *cursor = record.format;
+    while (*cursor && length + 1 < size)
+    {
+        if ('%' != cursor[0] || '%' == cursor[1])
+        {
+            message[length++] = cursor[0];
+            cursor += '%' == cursor[0] ? 2 : 1;
+            continue;
+        }
+
+        size_t spec_length = 1;
+        while (cursor[spec_length] && nullptr != strchr("-+ #0123456789.hljztL", cursor[spec_length]))
+        {
+            ++spec_length;
+        }
+        if (!cursor[spec_length] || spec_length + 1 > 32)
+        {
+            break;
+        }
+        ++spec_length;
+
+        int32_t const written = arg < record.arg_count ?
+            FormatLogArg(record, arg++, cursor, spec_length, message + length, size - length) :
+            snprintf(message + length, size - length, "(missing)");
+        if (written > 0)
+        {
+            length = std::min(length + written, size - 1);
+        }
+        cursor += spec_length;
+    }
+
+    message[length] = '\0';
+    return length;
+}
+
+// Only the writer writes while it runs, so this is only ever contended around its start and stop
+static std::mutex s_write_lock;
+
+static void WriteLogRecord(LogRecord const &record)
+{
+#ifndef _WIN32
+    // The debugger output is the only other destination
+    if (!record.console)
+    {
+        return;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(s_write_lock);
     char message[2048]{};
 
-    // Fill in standard prefix
-    sprintf_s(message, "%04u-%02u-%02u %02u:%02u:%02u.%03u  [%s]: ",
-        local_time.wYear, local_time.wMonth, local_time.wDay,
-        local_time.wHour, local_time.wMinute, local_time.wSecond,
-        local_time.wMilliseconds, LevelLabel(level));
+    // Fill in standard prefix. Converting to local time is slow, so it's only done when the second changes
+    static time_t s_last_seconds = 0;
+    static struct tm s_local_time{};
+    std::chrono::system_clock::time_point const time(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(record.time_ns)));
+    time_t const seconds = std::chrono::system_clock::to_time_t(time);
+    uint32_t const milliseconds = static_cast<uint32_t>(record.time_ns / 1000000 % 1000);
+    if (seconds != s_last_seconds)
+    {
+        s_last_seconds = seconds;
+#ifdef _WIN32
+        localtime_s(&s_local_time, &seconds);
+#else
+        localtime_r(&seconds, &s_local_time);
+#endif
+    }
+    struct tm const &local_time = s_local_time;
+
+    snprintf(message, sizeof(message), "%04d-%02d-%02d %02d:%02d:%02d.%03u  [%s]: ",
+        local_time.tm_year + 1900, local_time.tm_mon + 1, local_time.tm_mday,
+        local_time.tm_hour, local_time.tm_min, local_time.tm_sec,
+        milliseconds, LevelLabel(record.level));
 
-    // Concatenate on the provided message
-    va_list list;
-    va_start(list, format);
-    vsprintf_s(message + strlen(message), sizeof(message) - strlen(message), format, list);
-    va_end(list);
+    // Concatenate on the provided message, leaving room for the newline
+    size_t const prefix_length = strlen(message);
+    size_t const length = prefix_length + FormatLogRecord(record, message + prefix_length, sizeof(message) - prefix_length - 1);
+    message[length] = '\n';
+    message[length + 1] = '\0';
 
-    strcat_s(message, "\n");
+#ifdef _WIN32
     OutputDebugStringA(message);
+#endif
 
-    if (s_log_to_console)
+    if (record.console)
     {
-        printf(message);
+        fputs(message, stdout);
     }
+}
 
-    if (LogLevel::Fatal == level)
+LogWriter::~LogWriter()
+{
     {
-        if (IsDebuggerPresent())
+        std::lock_guard<std::mutex> lock(wake_lock_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+    running_.store(false, std::memory_order_release);
+
+    // Anything committed while the writer was stopping
+    WritePending();
+    fflush(stdout);
+}
+
+LogQueue *LogWriter::AddQueue()
+{
+    std::lock_guard<std::mutex> lock(queues_lock_);
+    {
+        std::lock_guard<std::mutex> wake_lock(wake_lock_);
+        if (stopping_)
         {
-            abort();
+            return nullptr;
+        }
+    }
+
+    if (!thread_.joinable())
+    {
+        running_.store(true, std::memory_order_release);
+        thread_ = std::thread(&WriterLoop);
+    }
+
+    queues_.push_back(std::make_unique<LogQueue>());
+    return queues_.back().get();
+}
+
+void LogWriter::WritePending()
+{
+    {
+        std::lock_guard<std::mutex> lock(queues_lock_);
+        pending_queues_.clear();
+        for (size_t i = 0; i < queues_.size();)
+        {
+            LogQueue *queue = queues_[i].get();
+            if (queue->orphaned.load(std::memory_order_acquire) &&
+                queue->tail.load(std::memory_order_relaxed) == queue->head.load(std::memory_order_acquire))
+            {
+                queues_[i] = std::move(queues_.back());
+                queues_.pop_back();
+                continue;
+            }
+            pending_queues_.push_back(queue);
+            ++i;
+        }
+    }
+
+    // Merge the queues by time, so messages come out in the order they were logged
+    for (;;)
+    {
+        LogQueue *oldest = nullptr;
+        uint64_t oldest_time_ns = UINT64_MAX;
+        for (LogQueue *queue : pending_queues_)
+        {
+            uint64_t const tail = queue->tail.load(std::memory_order_relaxed);
+            if (tail != queue->head.load(std::memory_order_acquire))
+            {
+                uint64_t const time_ns = queue->records[tail % LogQueueCapacity].time_ns;
+                if (time_ns < oldest_time_ns)
+                {
+                    oldest = queue;
+                    oldest_time_ns = time_ns;
+                }
+            }
+        }
+        if (!oldest)
+        {
+            break;
+        }
+
+        uint64_t const tail = oldest->tail.load(std::memory_order_relaxed);
+        WriteLogRecord(oldest->records[tail % LogQueueCapacity]);
+        oldest->tail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+bool LogWriter::HasPending()
+{
+    std::lock_guard<std::mutex> lock(queues_lock_);
+    for (auto const &queue : queues_)
+    {
+        if (queue->tail.load(std::memory_order_relaxed) != queue->head.load(std::memory_order_acquire))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LogWriter::Wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_lock_);
+        wake_requested_ = true;
+    }
+    wake_.notify_one();
+}
+
+void LogWriter::OnCommit()
+{
+    // Pairs with the fence in Run: either the writer sees the record before it waits, or this sees it idle
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_.load(std::memory_order_relaxed) && idle_.exchange(false, std::memory_order_relaxed))
+    {
+        Wake();
+    }
+}
+
+void LogWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(wake_lock_);
+    if (!running_.load(std::memory_order_acquire) || stopping_)
+    {
+        return;
+    }
+
+    uint64_t const flush = ++flush_requested_;
+    wake_.notify_one();
+    flushed_.wait(lock, [&]() { return flush_completed_ >= flush || stopping_; });
+}
+
+void LogWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(wake_lock_);
+    for (;;)
+    {
+        uint64_t const flush = flush_requested_;
+        bool const stopping = stopping_;
+        lock.unlock();
+
+        WritePending();
+        fflush(stdout);
+
+        lock.lock();
+        flush_completed_ = flush;
+        flushed_.notify_all();
+        if (stopping)
+        {
+            return;
+        }
+        lock.unlock();
+
+        // Sleep until a record is committed, a queue fills up, or a flush or the exit asks for the writer
+        idle_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool const pending = HasPending();
+
+        lock.lock();
+        if (!pending)
+        {
+            wake_.wait(lock, [&]() { return wake_requested_ || stopping_ || flush != flush_requested_; });
+        }
+        idle_.store(false, std::memory_order_relaxed);
+        wake_requested_ = false;
+    }
+}
+
+static void WriterLoop()
+{
+    s_writer.Run();
+}
+
+void FlushLog()
+{
+    s_writer.Flush();
+}
+
+LogRecord *BeginLogRecord(LogLevel const level, char const *format)
+{
+    LogRecord *record = &s_direct_record;
+    if (!s_thread_queue.queue)
+    {
+        s_thread_queue.queue = s_writer.AddQueue();
+    }
+
+    // Queues are freed with the writer, so they are only touched while it runs
+    LogQueue *queue = s_thread_queue.queue;
+    if (queue && s_writer.IsRunning())
+    {
+        uint64_t const head = queue->head.load(std::memory_order_relaxed);
+        uint32_t attempts = 0;
+        while (head - queue->tail.load(std::memory_order_acquire) >= LogQueueCapacity && s_writer.IsRunning())
+        {
+            if (0 == attempts)
+            {
+                s_writer.Wake();
+            }
+            Backoff(&attempts);
+        }
+        if (s_writer.IsRunning())
+        {
+            record = &queue->records[head % LogQueueCapacity];
+        }
+    }
+
+    record->time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    record->format = format;
+    record->level = level;
+    record->console = s_log_to_console.load(std::memory_order_relaxed);
+    record->arg_count = 0;
+    record->text_used = 0;
+    return record;
+}
+
+void EncodeLogArg(LogRecord *record, char const *value)
+{
+    if (!value)
+    {
+        value = "(null)";
+    }
+
+    // A string that doesn't fit is cut short. Once the text is full, the last terminator doubles as an empty string
+    uint32_t const offset = std::min(record->text_used, LogTextSize - 1);
+    size_t const copied = std::min(strlen(value), static_cast<size_t>(LogTextSize - 1 - offset));
+    memcpy(record->text + offset, value, copied);
+    record->text[offset + copied] = '\0';
+    record->text_used = offset + static_cast<uint32_t>(copied) + 1;
+
+    LogArgValue arg;
+    arg.text_offset = offset;
+    AddLogArg(record, LogArgType::String, arg);
+}
+
+void CommitLogRecord(LogRecord *record)
+{
+    if (record == &s_direct_record)
+    {
+        WriteLogRecord(*record);
+    }
+    else
+    {
+        LogQueue *queue = s_thread_queue.queue;
+        queue->head.store(queue->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        if (record->level <= LogLevel::Error)
+        {
+            s_writer.Flush();
         }
         else
         {
-            exit(-1);
+            s_writer.OnCommit();
+        }
+    }
+
+    if (LogLevel::Fatal == record->level)
+    {
+        fflush(stdout);
+#ifdef _WIN32
+        if (IsDebuggerPresent())
+        {
+            abort();
         }
+#endif
+        exit(-1);
     }
 }
@@ -11,14 +11,157 @@ enum class LogLevel
     MaxLogLevels
 };
 
+// Messages less severe than this level are compiled out, along with the evaluation of their arguments. Fatal
+// messages never are, as they exit
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL 5
+#endif
+
+extern std::atomic<int32_t> g_log_level;
+
 void SetLogLevel(LogLevel const level);
 void LogToConsole(bool const log_to_console);
-void __cdecl LogMessage(LogLevel const level, char const *format, ...);
-
-#define LOG(level, format, ...) LogMessage(LogLevel::##level, format, __VA_ARGS__);
-#define LOGF(format, ...) LOG(Fatal, format, __VA_ARGS__);
-#define LOGE(format, ...) LOG(Error, format, __VA_ARGS__);
-#define LOGW(format, ...) LOG(Warning, format, __VA_ARGS__);
-#define LOGD(format, ...) LOG(Debug, format, __VA_ARGS__);
-#define LOGI(format, ...) LOG(Info, format, __VA_ARGS__);
-#define LOGV(format, ...) LOG(Verbose, format, __VA_ARGS__);
+
+inline bool IsLogLevelEnabled(LogLevel const level)
+{
+    return static_cast<int32_t>(level) <= g_log_level.load(std::memory_order_relaxed);
+}
+
+// Blocks until every message logged before the call has been written
+void FlushLog();
+
+//
+// Asynchronous logging
+//
+// Logging a message copies its level, a timestamp, the format pointer and the arguments into a queue owned by the
+// calling thread, which takes no locks. A writer thread formats the queued messages of every thread, and writes them
+// in the order they were logged. Errors are written before the call returns, so they aren't lost to a crash, and
+// show up in order with whatever is printed after them. When a queue is full, its thread waits for the writer.
+//
+// The format isn't copied, so it must be a literal. String arguments are copied, as far as the record has room.
+//
+
+// Arguments of a message, and bytes for the strings among them
+static uint32_t const LogMaxArgs = 12;
+static uint32_t const LogTextSize = 360;
+
+enum class LogArgType : uint8_t
+{
+    Signed,
+    Unsigned,
+    Double,
+    Pointer,
+    String,
+};
+
+union LogArgValue
+{
+    int64_t     i;
+    uint64_t    u;
+    double      d;
+    void const *p;
+    uint32_t    text_offset;    // of the string in LogRecord::text
+};
+
+struct LogRecord
+{
+    uint64_t    time_ns;        // since the system clock's epoch
+    char const *format;
+    LogLevel    level;
+    bool        console;        // whether console logging was on when it was logged
+    uint32_t    arg_count;
+    uint32_t    text_used;
+    LogArgType  arg_types[LogMaxArgs];
+    LogArgValue args[LogMaxArgs];
+    char        text[LogTextSize];
+};
+
+// Claims the calling thread's next record, which CommitLogRecord then hands to the writer
+LogRecord *BeginLogRecord(LogLevel const level, char const *format);
+void CommitLogRecord(LogRecord *record);
+
+inline void AddLogArg(LogRecord *record, LogArgType const type, LogArgValue const value)
+{
+    record->arg_types[record->arg_count] = type;
+    record->args[record->arg_count++] = value;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type EncodeLogArg(LogRecord *record, T const value)
+{
+    LogArgValue arg;
+    arg.i = value;
+    AddLogArg(record, LogArgType::Signed, arg);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type EncodeLogArg(LogRecord *record, T const value)
+{
+    LogArgValue arg;
+    arg.u = value;
+    AddLogArg(record, LogArgType::Unsigned, arg);
+}
+
+inline void EncodeLogArg(LogRecord *record, double const value)
+{
+    LogArgValue arg;
+    arg.d = value;
+    AddLogArg(record, LogArgType::Double, arg);
+}
+
+template <typename T>
+inline void EncodeLogArg(LogRecord *record, T const *value)
+{
+    LogArgValue arg;
+    arg.p = value;
+    AddLogArg(record, LogArgType::Pointer, arg);
+}
+
+// Copies the string into the record
+void EncodeLogArg(LogRecord *record, char const *value);
+
+template <typename... Args>
+inline void LogMessage(LogLevel const level, char const *format, Args const... args)
+{
+    static_assert(sizeof...(Args) <= LogMaxArgs, "Too many arguments to log");
+
+    LogRecord *record = BeginLogRecord(level, format);
+    int const encoded[] = { 0, (EncodeLogArg(record, args), 0)... };
+    UNREFERENCED_PARAMETER(encoded);
+    CommitLogRecord(record);
+}
+
+// Filtered out messages don't evaluate their arguments
+#define LOG(level, format, ...) do { if (IsLogLevelEnabled(LogLevel::level)) { LogMessage(LogLevel::level, format, ##__VA_ARGS__); } } while (0);
+
+#define LOGF(format, ...) LOG(Fatal, format, ##__VA_ARGS__);
+
+#if LOG_MAX_LEVEL >= 1
+#define LOGE(format, ...) LOG(Error, format, ##__VA_ARGS__);
+#else
+#define LOGE(format, ...)
+#endif
+
+#if LOG_MAX_LEVEL >= 2
+#define LOGW(format, ...) LOG(Warning, format, ##__VA_ARGS__);
+#else
+#define LOGW(format, ...)
+#endif
+
+#if LOG_MAX_LEVEL >= 3
+#define LOGD(format, ...) LOG(Debug, format, ##__VA_ARGS__);
+#else
+#define LOGD(format, ...)
+#endif
+
+#if LOG_MAX_LEVEL >= 4
+#define LOGI(format, ...) LOG(Info, format, ##__VA_ARGS__);
+#else
+#define LOGI(format, ...)
+#endif
+
+#if LOG_MAX_LEVEL >= 5
+#define LOGV(format, ...) LOG(Verbose, format, ##__VA_ARGS__);
+#else
+#define LOGV(format, ...)
+#endif
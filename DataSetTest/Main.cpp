@@ -1,13 +1,34 @@
 #include "Precomp.h"
 #include "AppWindow.h"
+#include "EventAccumulator.h"
+#include "PackedFrameProvider.h"
+#include "Pipeline.h"
 #include "PlaybackFrameProvider.h"
+#include "SharedFrameRing.h"
 #include "Graphics.h"
 #include "FeatureDetector.h"
 #include "Utilities.h"
+#include "Benchmark.h"
+#include "ThreadPool.h"
+#include "Undistorter.h"
 
 struct Params
 {
     char const *data_root = nullptr;
+    char const *packed_path = nullptr;
+    char const *shared_ring = nullptr;
+    char const *benchmark = nullptr;
+    char const *events = nullptr;  // events.txt path, or "synthetic"
+    char const *trace_path = nullptr;
+    EventFrameParams event_frames;
+    uint32_t num_threads = 0;
+    int32_t pyramid_levels = 1;
+    int32_t track_frames = -1;   // negative doesn't track
+    uint32_t prefetch_frames = 4;
+    PlaybackParams playback;
+    bool undistort = false;
+    bool pipelined = false;
+    BackpressurePolicy backpressure = BackpressurePolicy::Block;
     LogLevel log_level = LogLevel::Verbose;
     bool log_to_console = true;
 };
@@ -26,10 +47,21 @@ int __cdecl main(int32_t const argc, char const *argv[])
     SetLogLevel(params.log_level);
     LogToConsole(params.log_to_console);
 
+    // Benchmarks run headless, and don't need any data
+    if (params.benchmark)
+    {
+        if (!RunBenchmark(params.benchmark))
+        {
+            LOGE("Unknown benchmark [%s]", params.benchmark);
+            PrintUsage();
+        }
+        return 0;
+    }
+
     // Check for necessary params
-    if (!params.data_root)
+    if (!params.data_root && !params.packed_path && !params.events && !params.shared_ring)
     {
-        LOGE("Required --root parameter not provided.");
+        LOGE("Required --root, --packed, --events or --shared parameter not provided.");
         PrintUsage();
         return 0;
     }
@@ -48,48 +80,271 @@ int __cdecl main(int32_t const argc, char const *argv[])
 
     window->Show(true);
 
-    LOGD("Initializing playback frame provider with root [%s]", params.data_root)
-    std::unique_ptr<PlaybackFrameProvider> frame_provider = std::make_unique<PlaybackFrameProvider>();
-    if (!frame_provider->Initialize(params.data_root, true))
+    // Synthetic events are generated from playback frames, and both have to outlive the provider
+    std::unique_ptr<PlaybackFrameProvider> event_frames;
+    std::unique_ptr<EventSource> event_source;
+
+    std::unique_ptr<FrameProvider> frame_provider;
+    CameraModel camera_model;
+    if (params.events)
+    {
+        uint32_t width = Davis240Width;
+        uint32_t height = Davis240Height;
+        if (0 == _stricmp(params.events, "SYNTHETIC"))
+        {
+            if (!params.data_root)
+            {
+                LOGF("Synthetic events are generated from the frames of --root");
+            }
+
+            LOGD("Initializing synthetic events from root [%s]", params.data_root)
+            PlaybackParams playback_params;
+            playback_params.mode = PlaybackMode::Virtual;
+            event_frames = std::make_unique<PlaybackFrameProvider>();
+            if (!event_frames->Initialize(params.data_root, false, playback_params))
+            {
+                LOGF("Failed to initialize playback provider");
+            }
+            if (params.undistort && !event_frames->HasCameraModel())
+            {
+                LOGF("Undistortion needs a dataset with a calib.txt");
+            }
+            camera_model = event_frames->GetCameraModel();
+
+            std::unique_ptr<SyntheticEventSource> synthetic_source = std::make_unique<SyntheticEventSource>();
+            if (!synthetic_source->Initialize(event_frames.get(), SyntheticEventParams()))
+            {
+                LOGF("Failed to initialize synthetic events");
+            }
+            width = synthetic_source->GetWidth();
+            height = synthetic_source->GetHeight();
+            event_source = std::move(synthetic_source);
+        }
+        else
+        {
+            LOGD("Initializing events from [%s]", params.events)
+            std::unique_ptr<EventFileReader> file_reader = std::make_unique<EventFileReader>();
+            if (!file_reader->Initialize(params.events))
+            {
+                LOGF("Failed to open events");
+            }
+            if (params.undistort)
+            {
+                LOGF("Undistortion needs a dataset with a calib.txt");
+            }
+            event_source = std::move(file_reader);
+        }
+
+        std::unique_ptr<EventFrameProvider> event_provider = std::make_unique<EventFrameProvider>();
+        if (!event_provider->Initialize(event_source.get(), width, height, params.event_frames))
+        {
+            LOGF("Failed to initialize event frame provider");
+        }
+        frame_provider = std::move(event_provider);
+    }
+    else if (params.shared_ring)
+    {
+        LOGD("Initializing shared memory frame provider with ring [%s]", params.shared_ring)
+        std::unique_ptr<SharedMemoryFrameProvider> shared_provider = std::make_unique<SharedMemoryFrameProvider>();
+        if (!shared_provider->Initialize(params.shared_ring, SharedFrameParams()))
+        {
+            LOGF("Failed to initialize shared memory provider");
+        }
+        if (params.undistort)
+        {
+            LOGF("Undistortion needs a dataset with a calib.txt");
+        }
+        frame_provider = std::move(shared_provider);
+    }
+    else if (params.packed_path)
+    {
+        LOGD("Initializing packed frame provider with [%s]", params.packed_path)
+        std::unique_ptr<PackedFrameProvider> packed_provider = std::make_unique<PackedFrameProvider>();
+        if (!packed_provider->Initialize(params.packed_path, true))
+        {
+            LOGF("Failed to initialize packed provider");
+        }
+        if (params.undistort)
+        {
+            LOGF("Undistortion needs a dataset with a calib.txt");
+        }
+        frame_provider = std::move(packed_provider);
+    }
+    else
+    {
+        LOGD("Initializing playback frame provider with root [%s]", params.data_root)
+        std::unique_ptr<PlaybackFrameProvider> playback_provider = std::make_unique<PlaybackFrameProvider>();
+        PrefetchParams prefetch_params;
+        prefetch_params.frames_ahead = params.prefetch_frames;
+        playback_provider->SetPrefetchParams(prefetch_params);
+        if (!playback_provider->Initialize(params.data_root, true, params.playback))
+        {
+            LOGF("Failed to initialize playback provider");
+        }
+        if (params.undistort && !playback_provider->HasCameraModel())
+        {
+            LOGF("Undistortion needs a dataset with a calib.txt");
+        }
+        camera_model = playback_provider->GetCameraModel();
+        frame_provider = std::move(playback_provider);
+    }
+
+    std::unique_ptr<ThreadPool> thread_pool = std::make_unique<ThreadPool>();
+    if (!thread_pool->Initialize(params.num_threads))
     {
-        LOGF("Failed to initialize playback provider");
+        LOGF("Failed to initialize thread pool");
     }
 
     std::unique_ptr<FeatureDetector> detector = std::make_unique<FeatureDetector>();
+    detector->SetThreadPool(thread_pool.get());
 
-    CameraFrame frame;
-    std::vector<uint8_t> scratch;
-    std::vector<uint8_t> smoothed;
+    PyramidParams pyramid_params;
+    pyramid_params.num_levels = params.pyramid_levels;
+    detector->SetPyramidParams(pyramid_params);
+
+    // Intermediate images come from a pool, so frames stop allocating once it has warmed up
+    BufferPool image_pool;
 
     GaussianKernel smooth_kernel;
     GenerateGaussian(0.5f, 9, &smooth_kernel);
 
-    window->Run([&]() 
+    bool const smoothing = params.track_frames >= 0 || params.pyramid_levels <= 1;
+
+    // The remap table is built for the size of the first frame
+    Undistorter undistorter;
+    undistorter.SetThreadPool(thread_pool.get());
+
+    // Frame processing is split into stages, which run one after the other or each on its own pipeline thread
+    auto const acquire_stage = [&](PipelineFrame *inout_frame)
     {
-        if (!frame_provider->GetNextFrame(&frame))
+        TRACE_SCOPE("acquire");
+        if (!frame_provider->GetNextFrame(&inout_frame->camera))
         {
             LOGE("Failed to get next frame from provider");
             return false;
         }
+        return true;
+    };
+
+    auto const undistort_stage = [&](PipelineFrame *inout_frame)
+    {
+        TRACE_SCOPE("undistort");
+        CameraFrame &camera = inout_frame->camera;
+        if (params.undistort)
+        {
+            if ((undistorter.GetWidth() != camera.width || undistorter.GetHeight() != camera.height) &&
+                !undistorter.Initialize(camera_model, camera.width, camera.height))
+            {
+                return false;
+            }
+            return undistorter.Undistort(&image_pool, &camera);
+        }
+        return true;
+    };
 
-        scratch.resize(frame.data.size());
-        smoothed.resize(frame.data.size());
+    auto const smooth_stage = [&](PipelineFrame *inout_frame)
+    {
+        TRACE_SCOPE("smooth");
+        if (smoothing)
+        {
+            CameraFrame const &camera = inout_frame->camera;
+            ImageBuffer scratch = image_pool.Acquire(camera.pixels.GetSize());
+            inout_frame->smoothed = image_pool.Acquire(camera.pixels.GetSize());
+
+            SmoothImage(camera.pixels.GetData(), camera.width, camera.height, smooth_kernel, scratch.GetData(), inout_frame->smoothed.GetData(), thread_pool.get());
+        }
+        return true;
+    };
 
-        SmoothImage(frame.data.data(), frame.width, frame.height, smooth_kernel, scratch.data(), smoothed.data());
+    auto const detect_stage = [&](PipelineFrame *inout_frame)
+    {
+        TRACE_SCOPE("detect");
+        CameraFrame &camera = inout_frame->camera;
+        uint8_t *pixels = camera.pixels.GetData();
+        if (params.track_frames >= 0)
+        {
+            detector->Track(pixels, inout_frame->smoothed.GetData(), camera.width, camera.height, static_cast<uint32_t>(params.track_frames));
+        }
+        else if (smoothing)
+        {
+            detector->Detect(pixels, inout_frame->smoothed.GetData(), camera.width, camera.height);
+        }
+        else
+        {
+            detector->DetectPyramid(pixels, smooth_kernel, camera.width, camera.height);
+        }
+        inout_frame->smoothed.Reset();
+        return true;
+    };
 
-        detector->Detect(frame.data.data(), smoothed.data(), frame.width, frame.height);
-        graphics->UpdateSource(frame.data.data(), frame.width, frame.height);
+    auto const present = [&](PipelineFrame const &frame)
+    {
+        TRACE_SCOPE("present");
+        graphics->UpdateSource(frame.camera.pixels.GetData(), frame.camera.width, frame.camera.height);
 
         if (!graphics->Refresh(true))
         {
             LOGE("Failed to refresh graphics");
             return false;
         }
-
         return true;
+    };
+
+    std::unique_ptr<Pipeline> pipeline;
+    if (params.pipelined)
+    {
+        PipelineStageParams stage_params;
+        stage_params.policy = params.backpressure;
+
+        pipeline = std::make_unique<Pipeline>();
+        if (!pipeline->AddStage("acquire", stage_params, acquire_stage) ||
+            (params.undistort && !pipeline->AddStage("undistort", stage_params, undistort_stage)) ||
+            !pipeline->AddStage("smooth", stage_params, smooth_stage) ||
+            !pipeline->AddStage("detect", stage_params, detect_stage) ||
+            !pipeline->Start())
+        {
+            LOGF("Failed to start pipeline");
+        }
+    }
+
+    if (params.trace_path)
+    {
+        SetTraceThreadName("main");
+        StartTracing();
+    }
+
+    window->Run([&]() 
+    {
+        PipelineFrame frame;
+        if (pipeline)
+        {
+            if (!pipeline->GetNextFrame(&frame))
+            {
+                LOGE("Pipeline stopped");
+                return false;
+            }
+        }
+        else if (!acquire_stage(&frame) || !undistort_stage(&frame) || !smooth_stage(&frame) || !detect_stage(&frame))
+        {
+            return false;
+        }
+
+        return present(frame);
     });
 
+    // The pipeline threads stop first, as trace buffers are read without locks
+    pipeline.reset();
+    if (params.trace_path)
+    {
+        StopTracing();
+        WriteChromeTrace(params.trace_path);
+    }
+
     frame_provider.reset();
+    event_source.reset();
+    event_frames.reset();
+    detector.reset();
+    thread_pool.reset();
     graphics.reset();
     window.reset();
     return 0;
@@ -103,9 +358,179 @@ void CommandLineParse(int32_t const argc, char const *argv[], Params *out_params
         {
             out_params->data_root = argv[i + 1];
         }
+        else if (0 == strcmp(argv[i], "--packed"))
+        {
+            out_params->packed_path = argv[i + 1];
+        }
+        else if (0 == strcmp(argv[i], "--shared"))
+        {
+            out_params->shared_ring = argv[i + 1];
+        }
+        else if (0 == strcmp(argv[i], "--benchmark"))
+        {
+            out_params->benchmark = argv[i + 1];
+        }
+        else if (0 == strcmp(argv[i], "--threads"))
+        {
+            int32_t const num_threads = atoi(argv[i + 1]);
+            if (num_threads >= 0)
+            {
+                out_params->num_threads = static_cast<uint32_t>(num_threads);
+            }
+            else
+            {
+                LOGE("Invalid thread count specified");
+            }
+        }
+        else if (0 == strcmp(argv[i], "--levels"))
+        {
+            int32_t const levels = atoi(argv[i + 1]);
+            if (levels > 0)
+            {
+                out_params->pyramid_levels = levels;
+            }
+            else
+            {
+                LOGE("Invalid number of pyramid levels specified");
+            }
+        }
+        else if (0 == strcmp(argv[i], "--prefetch"))
+        {
+            int32_t const frames = atoi(argv[i + 1]);
+            if (frames > 0)
+            {
+                out_params->prefetch_frames = static_cast<uint32_t>(frames);
+            }
+            else
+            {
+                LOGE("Invalid number of prefetch frames specified");
+            }
+        }
+        else if (0 == strcmp(argv[i], "--playback"))
+        {
+            if (isalpha(static_cast<unsigned char>(argv[i + 1][0])))
+            {
+                if (0 == _stricmp(argv[i + 1], "REALTIME"))
+                {
+                    out_params->playback.mode = PlaybackMode::RealTime;
+                }
+                else if (0 == _stricmp(argv[i + 1], "VIRTUAL"))
+                {
+                    out_params->playback.mode = PlaybackMode::Virtual;
+                }
+                else
+                {
+                    LOGE("Invalid playback mode specified");
+                }
+            }
+            else
+            {
+                double const speed = atof(argv[i + 1]);
+                if (speed > 0.0)
+                {
+                    out_params->playback.mode = PlaybackMode::Scaled;
+                    out_params->playback.speed = speed;
+                }
+                else
+                {
+                    LOGE("Invalid playback speed specified");
+                }
+            }
+        }
+        else if (0 == strcmp(argv[i], "--undistort"))
+        {
+            if (0 == _stricmp(argv[i + 1], "TRUE") || 0 == strcmp(argv[i + 1], "1"))
+            {
+                out_params->undistort = true;
+            }
+            else if (0 == _stricmp(argv[i + 1], "FALSE") || 0 == strcmp(argv[i + 1], "0"))
+            {
+                out_params->undistort = false;
+            }
+            else
+            {
+                LOGE("Invalid undistort parameter specified");
+            }
+        }
+        else if (0 == strcmp(argv[i], "--pipeline"))
+        {
+            out_params->pipelined = true;
+            if (0 == _stricmp(argv[i + 1], "BLOCK"))
+            {
+                out_params->backpressure = BackpressurePolicy::Block;
+            }
+            else if (0 == _stricmp(argv[i + 1], "DROPOLDEST"))
+            {
+                out_params->backpressure = BackpressurePolicy::DropOldest;
+            }
+            else if (0 == _stricmp(argv[i + 1], "KEEPLATEST"))
+            {
+                out_params->backpressure = BackpressurePolicy::KeepLatest;
+            }
+            else
+            {
+                out_params->pipelined = false;
+                LOGE("Invalid pipeline backpressure policy specified");
+            }
+        }
+        else if (0 == strcmp(argv[i], "--events"))
+        {
+            out_params->events = argv[i + 1];
+        }
+        else if (0 == strcmp(argv[i], "--eventwindow"))
+        {
+            // A number of events, or a duration with a us suffix
+            char *end = nullptr;
+            long long const size = strtoll(argv[i + 1], &end, 10);
+            if (size > 0 && 0 == *end && size <= UINT32_MAX)
+            {
+                out_params->event_frames.window = EventWindow::FixedCount;
+                out_params->event_frames.event_count = static_cast<uint32_t>(size);
+            }
+            else if (size > 0 && 0 == _stricmp(end, "US"))
+            {
+                out_params->event_frames.window = EventWindow::FixedDuration;
+                out_params->event_frames.duration_us = static_cast<uint64_t>(size);
+            }
+            else
+            {
+                LOGE("Invalid event window specified");
+            }
+        }
+        else if (0 == strcmp(argv[i], "--eventrender"))
+        {
+            if (0 == _stricmp(argv[i + 1], "FRAME"))
+            {
+                out_params->event_frames.rendering = EventRendering::EventFrame;
+            }
+            else if (0 == _stricmp(argv[i + 1], "SURFACE"))
+            {
+                out_params->event_frames.rendering = EventRendering::TimeSurface;
+            }
+            else
+            {
+                LOGE("Invalid event rendering specified");
+            }
+        }
+        else if (0 == strcmp(argv[i], "--trace"))
+        {
+            out_params->trace_path = argv[i + 1];
+        }
+        else if (0 == strcmp(argv[i], "--track"))
+        {
+            int32_t const frames = atoi(argv[i + 1]);
+            if (frames >= 0)
+            {
+                out_params->track_frames = frames;
+            }
+            else
+            {
+                LOGE("Invalid number of track frames specified");
+            }
+        }
         else if (0 == strcmp(argv[i], "--loglevel"))
         {
-            if (isalpha(argv[i + 1][0]))
+            if (isalpha(static_cast<unsigned char>(argv[i + 1][0])))
             {
                 if (0 == _stricmp(argv[i + 1], "FATAL"))
                 {
@@ -151,7 +576,7 @@ void CommandLineParse(int32_t const argc, char const *argv[], Params *out_params
         }
         else if (0 == strcmp(argv[i], "--logconsole"))
         {
-            if (isalpha(argv[i + 1][0]))
+            if (isalpha(static_cast<unsigned char>(argv[i + 1][0])))
             {
                 if (0 == _stricmp(argv[i + 1], "TRUE"))
                 {
@@ -186,8 +611,41 @@ void PrintUsage()
 {
     wprintf(
         L"USAGE:\n"
-        L"  --root <path_to_data>       (REQUIRED) Path to source data for playback.\n"
+        L"  --root <path_to_data>       Path to source data for playback. This or --packed is required\n"
+        L"  --packed <file>             Play back a dataset packed by the PackDataset tool instead\n"
+        L"  --shared <name>             Play back frames another process, such as RingProducer,\n"
+        L"                                  publishes to the shared memory frame ring <name> instead\n"
+        L"  --events <file>             Play back frames accumulated from an events.txt of a DAVIS240\n"
+        L"                                  instead, or from events generated from the frames of\n"
+        L"                                  --root with synthetic\n"
+        L"  --eventwindow <size>        Events per event frame, or a duration such as 33333us\n"
+        L"                                  (default)\n"
+        L"  --eventrender <mode>        Frame (default) adds up the events of each window, Surface\n"
+        L"                                  shows the latest event of each pixel fading with its age\n"
         L"  --loglevel <level>          Set log filter level. Values are Fatal (0), Error (1),\n"
         L"                                  Warning (2), Debug (3), Info (4), and Verbose (5)\n"
-        L"  --logconsole <true/false>   Enable logging to the console window.\n");
+        L"  --logconsole <true/false>   Enable logging to the console window.\n"
+        L"  --threads <count>           Number of threads used for processing. 0 (default) uses\n"
+        L"                                  one per hardware thread\n"
+        L"  --levels <count>            Number of pyramid levels to detect features on. Default 1\n"
+        L"  --prefetch <frames>         Number of frames decoded ahead of playback. Default 4\n"
+        L"  --playback <mode>           RealTime (default) paces frames by their timestamps, Virtual\n"
+        L"                                  delivers every frame as fast as it is processed, and a\n"
+        L"                                  number such as 2 or 0.5 plays back at that speed\n"
+        L"  --undistort <true/false>    Remove lens distortion before detection, using the calib.txt\n"
+        L"                                  of the dataset. Default false\n"
+        L"  --pipeline <policy>         Acquire, undistort, smooth and detect frames on separate\n"
+        L"                                  threads. When a stage falls behind, the stage feeding it\n"
+        L"                                  waits (Block) or drops its oldest queued frame (DropOldest),\n"
+        L"                                  or the slow stage skips to the newest queued frame\n"
+        L"                                  (KeepLatest)\n"
+        L"  --track <frames>            Track features across frames, and only mark those observed\n"
+        L"                                  in more than this many frames\n"
+        L"  --trace <file>              Record how long each stage and kernel takes on each thread,\n"
+        L"                                  and write it to <file> on exit, for chrome://tracing or\n"
+        L"                                  ui.perfetto.dev to show as a timeline\n"
+        L"  --benchmark <name>          Run a kernel benchmark instead of playback. Values are\n"
+        L"                                  brief, convolve, fast, match, points, pyramid,\n"
+        L"                                  threads, undistort and all, or sweep to measure every\n"
+        L"                                  kernel over sizes up to 4K, content and thread counts\n");
 }
@@ -0,0 +1,140 @@
+#include "Precomp.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(char const *path)
+{
+    Close();
+
+    file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == file_)
+    {
+        LOGE("Failed to open [%s]", path);
+        return false;
+    }
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file_, &size) || 0 == size.QuadPart)
+    {
+        LOGE("Failed to get the size of [%s], or it is empty", path);
+        Close();
+        return false;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_)
+    {
+        LOGE("Failed to create a mapping of [%s]", path);
+        Close();
+        return false;
+    }
+
+    data_ = static_cast<uint8_t const *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (!data_)
+    {
+        LOGE("Failed to map [%s]", path);
+        Close();
+        return false;
+    }
+
+    size_ = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data_)
+    {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    if (mapping_)
+    {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+    if (INVALID_HANDLE_VALUE != file_)
+    {
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+    }
+    size_ = 0;
+}
+
+void MappedFile::Discard(size_t const offset, size_t const size) const
+{
+    // Trims the pages from the working set. It reports an error as they were never locked, but trims them anyway
+    VirtualUnlock(const_cast<uint8_t *>(data_ + offset), size);
+}
+
+#else
+
+bool MappedFile::Open(char const *path)
+{
+    Close();
+
+    int const file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        LOGE("Failed to open [%s]", path);
+        return false;
+    }
+
+    struct stat status{};
+    if (0 != fstat(file, &status) || 0 == status.st_size)
+    {
+        LOGE("Failed to get the size of [%s], or it is empty", path);
+        close(file);
+        return false;
+    }
+
+    // The mapping keeps the file referenced, so the descriptor isn't needed past this
+    void *data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (MAP_FAILED == data)
+    {
+        LOGE("Failed to map [%s]", path);
+        return false;
+    }
+
+    data_ = static_cast<uint8_t const *>(data);
+    size_ = static_cast<size_t>(status.st_size);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data_)
+    {
+        munmap(const_cast<uint8_t *>(data_), size_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+}
+
+void MappedFile::Discard(size_t const offset, size_t const size) const
+{
+    // Only whole pages can be dropped
+    size_t const page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t const begin = (offset + page_size - 1) / page_size * page_size;
+    size_t const end = (offset + size) / page_size * page_size;
+    if (end > begin)
+    {
+        madvise(const_cast<uint8_t *>(data_ + begin), end - begin, MADV_DONTNEED);
+    }
+}
+
+#endif
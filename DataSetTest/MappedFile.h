@@ -0,0 +1,30 @@
+#pragma once
+
+//
+// Read-only memory mapping of a whole file
+//
+class MappedFile : private NonCopyable
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    // Maps the file at path, unmapping any previous one
+    bool Open(char const *path);
+    void Close();
+
+    uint8_t const *GetData() const { return data_; }
+    size_t GetSize() const { return size_; }
+
+    // Hints that [offset, offset + size) won't be read again, so its pages can be dropped from memory instead of
+    // piling up while streaming through a large file. The data stays readable
+    void Discard(size_t const offset, size_t const size) const;
+
+private:
+    uint8_t const *data_ = nullptr;
+    size_t         size_ = 0;
+#ifdef _WIN32
+    HANDLE         file_ = INVALID_HANDLE_VALUE;
+    HANDLE         mapping_ = nullptr;
+#endif
+};
@@ -0,0 +1,169 @@
+#include "Precomp.h"
+#include "PackedFrameProvider.h"
+#include "PlaybackFrameProvider.h"
+#include "PngDecoder.h"
+
+static uint64_t AlignUp(uint64_t const value)
+{
+    return (value + PackedAlignment - 1) & ~static_cast<uint64_t>(PackedAlignment - 1);
+}
+
+bool WritePackedDataset(char const *data_path, char const *output_path)
+{
+    std::vector<DatasetImage> images;
+    if (!ReadImageList(data_path, &images))
+    {
+        return false;
+    }
+
+    std::ofstream output(output_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!output)
+    {
+        LOGE("Failed to create [%s]", output_path);
+        return false;
+    }
+
+    PackedHeader header{};
+    memcpy(header.magic, PackedMagic, sizeof(header.magic));
+    header.version = PackedVersion;
+    header.frame_count = static_cast<uint32_t>(images.size());
+    header.index_offset = sizeof(PackedHeader);
+
+    // Frames are written as they are decoded, and the index once all their offsets are known
+    std::vector<PackedFrameEntry> index(images.size());
+    uint64_t offset = AlignUp(header.index_offset + index.size() * sizeof(PackedFrameEntry));
+    output.seekp(static_cast<std::streamoff>(offset));
+
+    static uint8_t const padding[PackedAlignment] = {};
+    PngDecoder decoder;
+    BufferPool pool;
+    ImageBuffer pixels;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        PackedFrameEntry &entry = index[i];
+        if (!decoder.Decode(images[i].file_path.c_str(), &pool, &entry.width, &entry.height, &pixels))
+        {
+            return false;
+        }
+        entry.timestamp_us = images[i].timestamp_us;
+        entry.offset = offset;
+
+        uint64_t const size = pixels.GetSize();
+        uint64_t const aligned_size = AlignUp(size);
+        output.write(reinterpret_cast<char const *>(pixels.GetData()), static_cast<std::streamsize>(size));
+        output.write(reinterpret_cast<char const *>(padding), static_cast<std::streamsize>(aligned_size - size));
+        offset += aligned_size;
+
+        if (0 == (i + 1) % 100)
+        {
+            LOGI("Packed %zu / %zu frames", i + 1, images.size());
+        }
+    }
+
+    output.seekp(0);
+    output.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    output.write(reinterpret_cast<char const *>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(PackedFrameEntry)));
+    if (!output)
+    {
+        LOGE("Failed to write [%s]", output_path);
+        return false;
+    }
+
+    LOGI("Packed %zu frames into [%s], %" PRIu64 " bytes", images.size(), output_path, offset);
+    return true;
+}
+
+bool PackedFrameProvider::Initialize(char const *pack_path, bool const loop_playback)
+{
+    index_ = nullptr;
+    frame_count_ = 0;
+    next_frame_ = 0;
+    loop_playback_ = loop_playback;
+
+    if (!file_.Open(pack_path))
+    {
+        return false;
+    }
+
+    // Validate everything up front, so frames can be handed out without checks
+    uint8_t const *data = file_.GetData();
+    uint64_t const size = file_.GetSize();
+    PackedHeader const *header = reinterpret_cast<PackedHeader const *>(data);
+    if (size < sizeof(PackedHeader) || 0 != memcmp(header->magic, PackedMagic, sizeof(PackedMagic)))
+    {
+        LOGE("[%s] is not a packed dataset", pack_path);
+        return false;
+    }
+    if (PackedVersion != header->version)
+    {
+        LOGE("[%s] is version %u, expected %u", pack_path, header->version, PackedVersion);
+        return false;
+    }
+    if (0 == header->frame_count || 0 != header->index_offset % sizeof(uint64_t) ||
+        header->index_offset > size || (size - header->index_offset) / sizeof(PackedFrameEntry) < header->frame_count)
+    {
+        LOGE("[%s] has an invalid frame index", pack_path);
+        return false;
+    }
+
+    PackedFrameEntry const *index = reinterpret_cast<PackedFrameEntry const *>(data + header->index_offset);
+    for (uint32_t i = 0; i < header->frame_count; ++i)
+    {
+        uint64_t const frame_size = static_cast<uint64_t>(index[i].width) * index[i].height;
+        if (0 != index[i].offset % PackedAlignment || index[i].offset > size || size - index[i].offset < frame_size)
+        {
+            LOGE("[%s] frame %u is out of bounds", pack_path, i);
+            return false;
+        }
+    }
+
+    index_ = index;
+    frame_count_ = header->frame_count;
+
+    LOGD("Mapped %u packed frames from [%s]", frame_count_, pack_path);
+    return true;
+}
+
+void PackedFrameProvider::GetFrame(uint32_t const index, CameraFrameView *out_view) const
+{
+    PackedFrameEntry const &entry = index_[index];
+    out_view->timestamp_us = entry.timestamp_us;
+    out_view->width = entry.width;
+    out_view->height = entry.height;
+    out_view->pixels = file_.GetData() + entry.offset;
+}
+
+void PackedFrameProvider::GetNextFrameView(CameraFrameView *out_view)
+{
+    GetFrame(next_frame_, out_view);
+
+    if (next_frame_ + 1 < frame_count_)
+    {
+        ++next_frame_;
+    }
+    else if (loop_playback_)
+    {
+        next_frame_ = 0;
+    }
+}
+
+bool PackedFrameProvider::GetNextFrame(CameraFrame *out_frame)
+{
+    if (0 == frame_count_)
+    {
+        LOGE("No packed dataset loaded");
+        return false;
+    }
+
+    CameraFrameView view;
+    GetNextFrameView(&view);
+
+    out_frame->timestamp_us = view.timestamp_us;
+    out_frame->width = view.width;
+    out_frame->height = view.height;
+    out_frame->has_pose = false;
+    size_t const size = static_cast<size_t>(view.width) * view.height;
+    out_frame->pixels = pool_.Acquire(size);
+    memcpy(out_frame->pixels.GetData(), view.pixels, size);
+    return true;
+}
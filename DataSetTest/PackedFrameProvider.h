@@ -0,0 +1,73 @@
+#pragma once
+
+#include "FrameProvider.h"
+#include "MappedFile.h"
+
+//
+// Packed dataset file
+//
+// A PackedHeader, then an index of frame_count PackedFrameEntry, then the raw 8-bit frames, each starting on a
+// PackedAlignment boundary so they can be used in place by aligned SIMD loads. Everything is little endian.
+//
+static char const     PackedMagic[8] = { 'C', 'V', 'P', 'A', 'C', 'K', '\0', '\0' };
+static uint32_t const PackedVersion = 1;
+static uint32_t const PackedAlignment = 64;
+
+struct PackedHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t frame_count;
+    uint64_t index_offset;  // from the start of the file
+    uint8_t  reserved[40];
+};
+static_assert(sizeof(PackedHeader) == PackedAlignment, "PackedHeader should fill exactly one alignment unit");
+
+struct PackedFrameEntry
+{
+    uint64_t timestamp_us;
+    uint64_t offset;        // of the pixels, from the start of the file
+    uint32_t width;
+    uint32_t height;
+};
+static_assert(sizeof(PackedFrameEntry) == 24, "PackedFrameEntry must not change size");
+
+// Decodes every frame listed in the images.txt of the dataset at data_path into a packed file at output_path
+bool WritePackedDataset(char const *data_path, char const *output_path);
+
+//
+// Plays back a packed dataset
+//
+// The file is memory mapped, and views point straight into the mapping: no decode, no copy. Frames are
+// delivered in order, each one once, as fast as they are asked for, with their dataset timestamps. Without
+// looping, the last frame keeps being delivered once reached. Packed files carry no ground truth, so frames
+// come without a pose.
+//
+class PackedFrameProvider
+    : private NonCopyable
+    , public FrameProvider
+{
+public:
+    PackedFrameProvider() = default;
+
+    bool Initialize(char const *pack_path, bool const loop_playback);
+
+    uint32_t GetFrameCount() const { return frame_count_; }
+
+    // View of any frame, valid until the next Initialize or the provider is destroyed
+    void GetFrame(uint32_t const index, CameraFrameView *out_view) const;
+
+    // View of the next frame
+    void GetNextFrameView(CameraFrameView *out_view);
+
+    // FrameProvider. Copies the next frame, for consumers that modify its pixels
+    virtual bool GetNextFrame(CameraFrame *out_frame) override;
+
+private:
+    MappedFile              file_;
+    BufferPool              pool_;
+    PackedFrameEntry const *index_ = nullptr;
+    uint32_t                frame_count_ = 0;
+    uint32_t                next_frame_ = 0;
+    bool                    loop_playback_ = false;
+};
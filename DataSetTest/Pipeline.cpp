@@ -0,0 +1,180 @@
+#include "Precomp.h"
+#include "Pipeline.h"
+#include "ThreadPool.h"
+
+Pipeline::~Pipeline()
+{
+    Stop();
+}
+
+bool Pipeline::AddStage(char const *name, PipelineStageParams const &params, StageFunction const &function)
+{
+    if (running_.load(std::memory_order_acquire))
+    {
+        LOGE("Stages can't be added to a running pipeline");
+        return false;
+    }
+
+    std::unique_ptr<Stage> stage = std::make_unique<Stage>();
+    stage->name = name;
+    stage->params = params;
+    stage->function = function;
+    if (!stage->output.Initialize(params.queue_capacity))
+    {
+        return false;
+    }
+
+    stages_.push_back(std::move(stage));
+    return true;
+}
+
+bool Pipeline::Start()
+{
+    if (stages_.empty())
+    {
+        LOGE("Pipeline has no stages");
+        return false;
+    }
+
+    Stop();
+
+    next_sequence_ = 0;
+    for (auto &stage : stages_)
+    {
+        stage->output.Initialize(stage->params.queue_capacity);
+        stage->processed.store(0, std::memory_order_relaxed);
+        stage->dropped.store(0, std::memory_order_relaxed);
+    }
+
+    running_.store(true, std::memory_order_release);
+    for (uint32_t i = 0; i < stages_.size(); ++i)
+    {
+        stages_[i]->thread = std::thread(&Pipeline::StageLoop, this, i);
+    }
+
+    LOGD("Started pipeline with %zu stages", stages_.size());
+    return true;
+}
+
+void Pipeline::Stop()
+{
+    running_.store(false, std::memory_order_release);
+    for (auto &stage : stages_)
+    {
+        if (stage->thread.joinable())
+        {
+            stage->thread.join();
+            LOGD("Pipeline stage [%s] processed %" PRIu64 " frames, dropped %" PRIu64, stage->name.c_str(),
+                stage->processed.load(std::memory_order_relaxed), stage->dropped.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+bool Pipeline::GetNextFrame(PipelineFrame *out_frame)
+{
+    uint32_t attempts = 0;
+    while (!TryPopFrame(stages_.back().get(), out_frame))
+    {
+        if (!running_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        Backoff(&attempts);
+    }
+    return true;
+}
+
+void Pipeline::GetStageStats(uint32_t const stage, PipelineStageStats *out_stats) const
+{
+    out_stats->processed = stages_[stage]->processed.load(std::memory_order_relaxed);
+    out_stats->dropped = stages_[stage]->dropped.load(std::memory_order_relaxed);
+}
+
+void Pipeline::StageLoop(uint32_t const index)
+{
+    Stage *stage = stages_[index].get();
+    Stage *input = index > 0 ? stages_[index - 1].get() : nullptr;
+    SetTraceThreadName(stage->name.c_str());
+
+    while (running_.load(std::memory_order_acquire))
+    {
+        PipelineFrame frame;
+        if (input)
+        {
+            uint32_t attempts = 0;
+            bool popped = false;
+            while (!(popped = TryPopFrame(input, &frame)) && running_.load(std::memory_order_acquire))
+            {
+                Backoff(&attempts);
+            }
+            if (!popped)
+            {
+                break;
+            }
+        }
+        else
+        {
+            frame.sequence = next_sequence_++;
+        }
+
+        // Stages show up under their thread's name, so the scope needs no label of its own
+        bool succeeded = false;
+        {
+            TRACE_SCOPE("Pipeline stage");
+            succeeded = stage->function(&frame);
+        }
+        if (!succeeded)
+        {
+            LOGE("Pipeline stage [%s] failed, stopping", stage->name.c_str());
+            running_.store(false, std::memory_order_release);
+            break;
+        }
+        stage->processed.fetch_add(1, std::memory_order_relaxed);
+
+        if (!PushFrame(stage, &frame))
+        {
+            break;
+        }
+    }
+}
+
+bool Pipeline::PushFrame(Stage *stage, PipelineFrame *frame)
+{
+    uint32_t attempts = 0;
+    while (!stage->output.TryPush(std::move(*frame)))
+    {
+        if (!running_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        PipelineFrame oldest;
+        if (BackpressurePolicy::Block != stage->params.policy && stage->output.TryPop(&oldest))
+        {
+            stage->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            Backoff(&attempts);
+        }
+    }
+    return true;
+}
+
+bool Pipeline::TryPopFrame(Stage *stage, PipelineFrame *out_frame)
+{
+    if (!stage->output.TryPop(out_frame))
+    {
+        return false;
+    }
+
+    if (BackpressurePolicy::KeepLatest == stage->params.policy)
+    {
+        // Each newer frame replaces the one popped before it, which drops it
+        while (stage->output.TryPop(out_frame))
+        {
+            stage->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return true;
+}
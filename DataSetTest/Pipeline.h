@@ -0,0 +1,88 @@
+#pragma once
+
+#include "FrameProvider.h"
+#include "SpscQueue.h"
+
+// What a stage does with a finished frame when the queue to the next stage is full
+enum class BackpressurePolicy
+{
+    Block,      // waits for room, so every frame goes through
+    DropOldest, // drops the oldest queued frame to make room
+    KeepLatest, // as DropOldest, and the next stage also skips to the newest queued frame when it takes one
+};
+
+// A frame on its way through the pipeline. Buffers go back to their pool when a frame is dropped
+struct PipelineFrame
+{
+    uint64_t    sequence = 0;   // assigned by the pipeline when the first stage produces the frame
+    CameraFrame camera{};
+    ImageBuffer smoothed;
+};
+
+struct PipelineStageParams
+{
+    uint32_t           queue_capacity = 2;  // finished frames waiting for the next stage
+    BackpressurePolicy policy = BackpressurePolicy::Block;
+};
+
+struct PipelineStageStats
+{
+    uint64_t processed = 0;     // frames the stage finished
+    uint64_t dropped = 0;       // finished frames dropped from its queue
+};
+
+//
+// Multi-stage frame pipeline
+//
+// Each stage runs on its own thread, takes frames from the queue of the stage before it, and puts them in its
+// own queue once done, so stages work on different frames at the same time and throughput is set by the
+// slowest stage rather than the sum of them all. The first stage produces frames, and the caller takes them
+// from the queue of the last one. Queues are lock-free, and waiting threads back off from spinning to
+// sleeping so idle stages don't hold on to a core.
+//
+class Pipeline : private NonCopyable
+{
+public:
+    // Processes a frame in place. The first stage gets an empty frame to fill. Returning false stops the pipeline
+    typedef std::function<bool(PipelineFrame *)> StageFunction;
+
+public:
+    Pipeline() = default;
+    ~Pipeline();
+
+    // Stages run in the order they are added. Only while stopped
+    bool AddStage(char const *name, PipelineStageParams const &params, StageFunction const &function);
+
+    bool Start();
+
+    // Waits for the stage threads to exit. Frames still queued are dropped on the next Start
+    void Stop();
+
+    // Waits for the next frame out of the last stage. Returns false once the pipeline stopped
+    bool GetNextFrame(PipelineFrame *out_frame);
+
+    uint32_t GetStageCount() const { return static_cast<uint32_t>(stages_.size()); }
+    void GetStageStats(uint32_t const stage, PipelineStageStats *out_stats) const;
+
+private:
+    struct Stage
+    {
+        std::string                 name;
+        PipelineStageParams         params;
+        StageFunction               function;
+        SpscQueue<PipelineFrame>    output;
+        std::thread                 thread;
+        std::atomic<uint64_t>       processed{ 0 };
+        std::atomic<uint64_t>       dropped{ 0 };
+    };
+
+private:
+    void StageLoop(uint32_t const index);
+    bool PushFrame(Stage *stage, PipelineFrame *frame);
+    bool TryPopFrame(Stage *stage, PipelineFrame *out_frame);
+
+private:
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::atomic<bool>                   running_{ false };
+    uint64_t                            next_sequence_ = 0;  // only touched by the first stage
+};
@@ -1,68 +1,210 @@
 #include "Precomp.h"
 #include "PlaybackFrameProvider.h"
+#include "MappedFile.h"
+#include "PngDecoder.h"
+#include "TextReader.h"
 
-PlaybackFrameProvider::PlaybackFrameProvider()
-    : hr_coinit_(CoInitialize(nullptr))
+std::string GetDatasetRoot(char const *data_path)
 {
+    std::string root(data_path);
+    if (!root.empty() && '\\' != root[root.size() - 1] && '/' != root[root.size() - 1])
+    {
+        root += "/";
+    }
+    return root;
 }
 
-PlaybackFrameProvider::~PlaybackFrameProvider()
+bool ReadImageList(char const *data_path, std::vector<DatasetImage> *out_images)
 {
-    factory_ = nullptr;
-    if (SUCCEEDED(hr_coinit_))
+    std::string const root = GetDatasetRoot(data_path);
+    std::string const images_file_path = root + "images.txt";
+
+    out_images->clear();
+
+    MappedFile images_file;
+    if (!images_file.Open(images_file_path.c_str()))
     {
-        CoUninitialize();
+        return false;
     }
+
+    char const *text = reinterpret_cast<char const *>(images_file.GetData());
+    TextReader reader(text, text + images_file.GetSize());
+
+    DatasetImage image;
+    std::string  image_path;
+    while (reader.NextLine())
+    {
+        if (!reader.ReadTimestampUs(&image.timestamp_us) || !reader.ReadToken(&image_path) || !reader.AtLineEnd())
+        {
+            LOGE("[%s] line %u isn't a timestamp and image path", images_file_path.c_str(), reader.GetLineNumber());
+            out_images->clear();
+            return false;
+        }
+        image.file_path = root + image_path;
+
+        out_images->push_back(image);
+    }
+
+    if (out_images->empty())
+    {
+        LOGE("No images listed in [%s]", images_file_path.c_str());
+        return false;
+    }
+    return true;
 }
 
-bool PlaybackFrameProvider::Initialize(char const *data_path, bool const loop_playback)
+PlaybackFrameProvider::~PlaybackFrameProvider()
+{
+    StopWorkers();
+}
+
+bool PlaybackFrameProvider::Initialize(char const *data_path, bool const loop_playback, PlaybackParams const &playback_params)
 {
+    StopWorkers();
+
+    if (PlaybackMode::Scaled == playback_params.mode && !(playback_params.speed > 0.0))
+    {
+        LOGE("Invalid playback speed %f", playback_params.speed);
+        return false;
+    }
+
     loop_playback_ = loop_playback;
-    current_frame_ = 0;
+    playback_params_ = playback_params;
+    if (PlaybackMode::RealTime == playback_params_.mode)
+    {
+        playback_params_.speed = 1.0;
+    }
+    current_sequence_ = 0;
     start_timestamp_us_ = 0;
 
-    CHECKHR(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory_)));
+    if (!ReadImageList(data_path, &image_list_))
+    {
+        return false;
+    }
 
-    std::string root(data_path);
-    if ('\\' != root[root.size() - 1])
+    // Calibration and ground truth are optional
+    std::string const root = GetDatasetRoot(data_path);
+    std::string const calib_path = root + "calib.txt";
+    has_camera_model_ = false;
+    if (std::ifstream(calib_path).is_open())
     {
-        root += "\\";
+        if (!LoadCameraModel(calib_path.c_str(), &camera_model_))
+        {
+            return false;
+        }
+        has_camera_model_ = true;
     }
 
-    std::string calib_file_path = root + "calib.txt";
-    std::ifstream calib_file(calib_file_path, std::ios::in);
+    std::string const ground_truth_path = root + "groundtruth.txt";
+    ground_truth_.Clear();
+    if (std::ifstream(ground_truth_path).is_open() && !ground_truth_.Load(ground_truth_path.c_str()))
+    {
+        return false;
+    }
 
-    // TODO: Read in calibration
+    // A loop lasts as long as the sequence, plus one average frame interval from the last frame back to the first
+    uint64_t const first_us = image_list_.front().timestamp_us;
+    uint64_t const last_us = image_list_.back().timestamp_us;
+    loop_duration_us_ = last_us - first_us;
+    if (image_list_.size() > 1)
+    {
+        loop_duration_us_ += loop_duration_us_ / (image_list_.size() - 1);
+    }
+    loop_duration_us_ = std::max<uint64_t>(loop_duration_us_, 1);
 
-    std::string images_file_path = root + "images.txt";
-    std::ifstream images_file(images_file_path, std::ios::in);
+    if (0 == prefetch_params_.frames_ahead || 0 == prefetch_params_.num_workers)
+    {
+        LOGE("Prefetch needs at least one frame and one worker");
+        return false;
+    }
 
-    ImageInfo    image;
-    double       timestamp = 0;
-    std::string  image_path;
+    slots_.clear();
+    slots_.resize(prefetch_params_.frames_ahead);
+    next_decode_ = 0;
+    next_consume_ = 0;
+    last_sequence_ = loop_playback_ ? std::numeric_limits<uint64_t>::max() : image_list_.size() - 1;
+    shutdown_ = false;
+
+    for (uint32_t i = 0; i < prefetch_params_.num_workers; ++i)
+    {
+        workers_.emplace_back(&PlaybackFrameProvider::WorkerLoop, this);
+    }
+
+    LOGD("Playing back %zu frames in %s mode at %.2fx, decoding %u ahead on %u threads", image_list_.size(),
+        PlaybackMode::RealTime == playback_params_.mode ? "real time" : (PlaybackMode::Scaled == playback_params_.mode ? "scaled" : "virtual"),
+        playback_params_.speed, prefetch_params_.frames_ahead, prefetch_params_.num_workers);
+    return true;
+}
+
+void PlaybackFrameProvider::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        shutdown_ = true;
+    }
+    work_available_.notify_all();
+
+    for (auto &worker : workers_)
+    {
+        worker.join();
+    }
+    workers_.clear();
+}
+
+void PlaybackFrameProvider::WorkerLoop()
+{
+    // Created on this thread, as WIC requires
+    PngDecoder decoder;
 
-    while (!images_file.eof())
+    std::unique_lock<std::mutex> lock(lock_);
+    for (;;)
     {
-        images_file >> timestamp >> image_path;
-        if (image_path.empty())
+        work_available_.wait(lock, [&]()
         {
-            continue;
+            return shutdown_ || (next_decode_ <= last_sequence_ && next_decode_ < next_consume_ + slots_.size() &&
+                SlotState::Empty == slots_[next_decode_ % slots_.size()].state);
+        });
+        if (shutdown_)
+        {
+            break;
         }
 
-        // Convert from seconds to microseconds
-        image.timestamp_us = static_cast<uint64_t>(timestamp * 1000 * 1000);
-        image.file_path = root + image_path;
+        // The previous frame of this slot is gone, so nobody else touches it until it is ready
+        uint64_t const sequence = next_decode_++;
+        Slot &slot = slots_[sequence % slots_.size()];
+        DatasetImage const &image = image_list_[sequence % image_list_.size()];
+        slot.sequence = sequence;
+        slot.state = SlotState::Decoding;
 
-        image_list_.push_back(image);
-    }
+        lock.unlock();
+        bool const decoded = decoder.Decode(image.file_path.c_str(), &pool_, &slot.frame.width, &slot.frame.height, &slot.frame.pixels);
+        lock.lock();
 
-    return true;
+        if (sequence < next_consume_)
+        {
+            // Dropped while it was decoding, which held up the slot's next frame
+            slot.state = SlotState::Empty;
+            slot.frame.pixels.Reset();
+            work_available_.notify_all();
+        }
+        else
+        {
+            slot.state = decoded ? SlotState::Ready : SlotState::Failed;
+            frame_ready_.notify_all();
+        }
+    }
 }
 
-bool PlaybackFrameProvider::GetNextFrame(CameraFrame *out_frame)
+uint64_t PlaybackFrameProvider::GetTargetSequence()
 {
-    ImageInfo &image = image_list_[current_frame_];
-    uint64_t const now_us = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) / 1000;
+    // The consumer sets the pace, so the target is always the frame after the last one handed over
+    if (PlaybackMode::Virtual == playback_params_.mode)
+    {
+        return next_consume_;
+    }
+
+    uint64_t const now_us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
 
     // If first frame, start the video stream
     if (0 == start_timestamp_us_)
@@ -71,20 +213,18 @@ bool PlaybackFrameProvider::GetNextFrame(CameraFrame *out_frame)
     }
 
     // Advance the frames until we're at the right place in the stream
-    while (now_us >= start_timestamp_us_ + image.timestamp_us)
+    uint64_t const count = image_list_.size();
+    while (static_cast<double>(now_us - start_timestamp_us_) * playback_params_.speed >= image_list_[current_sequence_ % count].timestamp_us)
     {
-        if (current_frame_ + 1 < image_list_.size())
+        if ((current_sequence_ % count) + 1 < count)
         {
-            ++current_frame_;
-            image = image_list_[current_frame_];
-            continue;
+            ++current_sequence_;
         }
         else if (loop_playback_)
         {
-            current_frame_ = 0;
+            ++current_sequence_;
             start_timestamp_us_ = now_us;
-            image = image_list_[current_frame_];
-            continue;
+            break;
         }
         else
         {
@@ -93,19 +233,89 @@ bool PlaybackFrameProvider::GetNextFrame(CameraFrame *out_frame)
         }
     }
 
-    out_frame->timestamp_us = start_timestamp_us_ + image.timestamp_us;
+    return current_sequence_;
+}
+
+uint64_t PlaybackFrameProvider::GetSequenceTimestamp(uint64_t const sequence) const
+{
+    uint64_t const count = image_list_.size();
+    uint64_t const dataset_us = image_list_[sequence % count].timestamp_us;
+    if (PlaybackMode::Virtual == playback_params_.mode)
+    {
+        return dataset_us + (sequence / count) * loop_duration_us_;
+    }
+    return start_timestamp_us_ + static_cast<uint64_t>(dataset_us / playback_params_.speed);
+}
+
+bool PlaybackFrameProvider::GetNextFrame(CameraFrame *out_frame)
+{
+    // Each frame is handed over once. When the current one already was, wait until the next one is due
+    uint64_t target = GetTargetSequence();
+    while (target < next_consume_)
+    {
+        uint64_t const due_us = GetSequenceTimestamp(target);
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(due_us)));
+        target = GetTargetSequence();
+    }
+
+    std::unique_lock<std::mutex> lock(lock_);
+
+    // Drop the frames playback has fallen behind on without waiting for them. Those still decoding are released
+    // by their worker, and those not started yet are skipped, so decoding catches up with playback
+    if (next_consume_ < target)
+    {
+        uint64_t const end = std::min<uint64_t>(target, next_consume_ + slots_.size());
+        for (uint64_t sequence = next_consume_; sequence < end; ++sequence)
+        {
+            Slot &dropped = slots_[sequence % slots_.size()];
+            if (sequence == dropped.sequence && (SlotState::Ready == dropped.state || SlotState::Failed == dropped.state))
+            {
+                dropped.state = SlotState::Empty;
+                dropped.frame.pixels.Reset();
+            }
+        }
+        next_consume_ = target;
+        next_decode_ = std::max(next_decode_, target);
+        work_available_.notify_all();
+    }
+
+    Slot &slot = slots_[target % slots_.size()];
+    frame_ready_.wait(lock, [&]()
+    {
+        return target == slot.sequence && (SlotState::Ready == slot.state || SlotState::Failed == slot.state);
+    });
+    if (SlotState::Failed == slot.state)
+    {
+        LOGE("Failed to decode [%s]", image_list_[target % image_list_.size()].file_path.c_str());
 
-    ComPtr<IWICBitmapDecoder> decoder;
-    ComPtr<IWICBitmapFrameDecode> frame;
-    std::wstring wide_path(image.file_path.length(), ' ');
-    std::copy(image.file_path.begin(), image.file_path.end(), wide_path.begin());
-    CHECKHR(factory_->CreateDecoderFromFilename(wide_path.c_str(), nullptr, GENERIC_READ, WICDecodeOptions::WICDecodeMetadataCacheOnLoad, &decoder));
-    CHECKHR(decoder->GetFrame(0, &frame));
+        // Skipped, so the next call moves on. Without looping, a failed last frame ends playback
+        if (target != last_sequence_)
+        {
+            slot.state = SlotState::Empty;
+            ++next_consume_;
+            work_available_.notify_all();
+        }
+        return false;
+    }
 
-    CHECKHR(frame->GetSize(&out_frame->width, &out_frame->height));
-    out_frame->data.resize(out_frame->width * out_frame->height);
+    out_frame->timestamp_us = GetSequenceTimestamp(target);
+    out_frame->width = slot.frame.width;
+    out_frame->height = slot.frame.height;
+    out_frame->has_pose = ground_truth_.GetPose(image_list_[target % image_list_.size()].timestamp_us, &out_frame->pose);
 
-    CHECKHR(frame->CopyPixels(nullptr, out_frame->width * sizeof(uint8_t),
-        out_frame->width * out_frame->height * sizeof(uint8_t), reinterpret_cast<BYTE *>(out_frame->data.data())));
+    if (target == last_sequence_)
+    {
+        // The last frame keeps being handed out, so it stays in the ring and the caller gets a copy it can write to
+        size_t const size = slot.frame.pixels.GetSize();
+        out_frame->pixels = pool_.Acquire(size);
+        memcpy(out_frame->pixels.GetData(), slot.frame.pixels.GetData(), size);
+    }
+    else
+    {
+        out_frame->pixels = std::move(slot.frame.pixels);
+        slot.state = SlotState::Empty;
+        ++next_consume_;
+        work_available_.notify_one();
+    }
     return true;
 }
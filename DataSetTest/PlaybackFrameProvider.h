@@ -1,32 +1,130 @@
 #pragma once
 
+#include "CameraModel.h"
 #include "FrameProvider.h"
 
+// A frame of a recorded sequence, as listed in images.txt
+struct DatasetImage
+{
+    uint64_t     timestamp_us = 0;
+    std::string  file_path;     // including the dataset root
+};
+
+// data_path with a trailing path separator, so dataset file names can be appended to it
+std::string GetDatasetRoot(char const *data_path);
+
+// Reads the images.txt of the dataset at data_path, with lines of "timestamp path"
+bool ReadImageList(char const *data_path, std::vector<DatasetImage> *out_images);
+
+enum class PlaybackMode
+{
+    RealTime,   // frames are due at their dataset timestamps, and late ones are dropped
+    Scaled,     // as RealTime, with the dataset clock running speed times faster
+    Virtual,    // every frame in order, with its dataset timestamp, as fast as they are asked for
+};
+
+struct PlaybackParams
+{
+    PlaybackMode mode = PlaybackMode::RealTime;
+    double       speed = 1.0;  // dataset seconds per wall clock second, for PlaybackMode::Scaled
+};
+
+struct PrefetchParams
+{
+    uint32_t frames_ahead = 4; // decoded frames kept ready ahead of the consumer
+    uint32_t num_workers  = 2; // decode threads
+};
+
+//
+// Plays back a recorded sequence of PNG frames listed in images.txt
+//
+// In RealTime and Scaled mode, frames are paced by their timestamps against the wall clock, and the clock is
+// re-based on every loop. In Virtual mode nothing waits and nothing is dropped: the consumer sets the pace, and
+// timestamps are those of the dataset, offset by a whole sequence duration per loop so they keep increasing.
+// Only Virtual mode is deterministic.
+//
+// Worker threads decode frames in sequence order into a ring of frames_ahead frames, and stop once the ring is
+// full. GetNextFrame hands the next ready frame's buffer over to the caller without copying it, and buffers
+// return to the provider's pool once the caller drops them. Each frame is handed over once: GetNextFrame waits
+// for the next frame to be due, and when playback falls behind the timestamps, frames are dropped from the ring
+// rather than delivered late (except in Virtual mode). Decoding skips ahead to the frame due, so it doesn't spend
+// time on dropped ones. Without looping, the last frame keeps being handed out once reached.
+//
+// A frame that fails to decode makes GetNextFrame return false once, and playback moves on past it. Without
+// looping, a last frame that fails to decode keeps failing.
+//
+// When the dataset has a groundtruth.txt, frames come with the pose at their dataset timestamp.
+//
 class PlaybackFrameProvider
     : private NonCopyable
     , public FrameProvider
 {
 public:
-    PlaybackFrameProvider();
+    PlaybackFrameProvider() = default;
     ~PlaybackFrameProvider();
 
-    bool Initialize(char const *data_path, bool const loop_playback);
+    // Takes effect on the next Initialize
+    void SetPrefetchParams(PrefetchParams const &params) { prefetch_params_ = params; }
+
+    bool Initialize(char const *data_path, bool const loop_playback, PlaybackParams const &playback_params);
+
+    // From the calib.txt of the dataset, when it has one
+    bool HasCameraModel() const { return has_camera_model_; }
+    CameraModel const &GetCameraModel() const { return camera_model_; }
 
     // FrameProvider
     virtual bool GetNextFrame(CameraFrame *out_frame) override;
 
 private:
-    struct ImageInfo
+    enum class SlotState
+    {
+        Empty,
+        Decoding,
+        Ready,
+        Failed,
+    };
+
+    // One frame of the prefetch ring. Holds a frame whose sequence % ring size is its index
+    struct Slot
     {
-        uint64_t     timestamp_us = 0;
-        std::string  file_path;
+        SlotState   state = SlotState::Empty;
+        uint64_t    sequence = 0;   // of the frame decoding or decoded into it
+        CameraFrame frame;
     };
 
 private:
-    HRESULT const              hr_coinit_ = S_OK;
-    ComPtr<IWICImagingFactory> factory_;
-    std::vector<ImageInfo>     image_list_;
-    size_t                     current_frame_ = 0;
-    uint64_t                   start_timestamp_us_ = 0;
-    bool                       loop_playback_ = false;
+    void WorkerLoop();
+    void StopWorkers();
+
+    // Sequence of the frame the current time falls on. Sequences keep increasing across loops
+    uint64_t GetTargetSequence();
+
+    // Timestamp of a sequence: on the wall clock when it is due, or on the dataset clock in Virtual mode
+    uint64_t GetSequenceTimestamp(uint64_t const sequence) const;
+
+private:
+    PrefetchParams            prefetch_params_;
+    PlaybackParams            playback_params_;
+    BufferPool                pool_;
+    std::vector<DatasetImage> image_list_;
+    GroundTruth               ground_truth_;
+    CameraModel               camera_model_;
+    bool                      has_camera_model_ = false;
+    bool                      loop_playback_ = false;
+    uint64_t                  loop_duration_us_ = 0; // dataset time from one loop to the next
+
+    // Playback position. Only touched by the consumer
+    uint64_t                  current_sequence_ = 0;
+    uint64_t                  start_timestamp_us_ = 0;
+
+    // Prefetch ring, guarded by lock_
+    std::vector<Slot>        slots_;
+    uint64_t                 next_decode_ = 0;   // next sequence to decode
+    uint64_t                 next_consume_ = 0;  // oldest sequence still in the ring
+    uint64_t                 last_sequence_ = 0; // no sequence past this is decoded
+    bool                     shutdown_ = false;
+    std::mutex               lock_;
+    std::condition_variable  work_available_;
+    std::condition_variable  frame_ready_;
+    std::vector<std::thread> workers_;
 };
@@ -0,0 +1,92 @@
+#include "Precomp.h"
+#include "PngDecoder.h"
+
+#ifndef _WIN32
+#include <png.h>
+#endif
+
+#ifdef _WIN32
+
+PngDecoder::PngDecoder()
+    : hr_coinit_(CoInitializeEx(nullptr, COINIT_MULTITHREADED))
+{
+}
+
+PngDecoder::~PngDecoder()
+{
+    factory_ = nullptr;
+    if (SUCCEEDED(hr_coinit_))
+    {
+        CoUninitialize();
+    }
+}
+
+bool PngDecoder::Decode(char const *path, BufferPool *pool, uint32_t *out_width, uint32_t *out_height, ImageBuffer *out_pixels)
+{
+    TRACE_SCOPE("PngDecoder::Decode");
+    if (!factory_)
+    {
+        CHECKHR(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory_)));
+    }
+
+    std::string const narrow_path(path);
+    std::wstring wide_path(narrow_path.length(), ' ');
+    std::copy(narrow_path.begin(), narrow_path.end(), wide_path.begin());
+
+    ComPtr<IWICBitmapDecoder> decoder;
+    ComPtr<IWICBitmapFrameDecode> frame;
+    ComPtr<IWICFormatConverter> converter;
+    CHECKHR(factory_->CreateDecoderFromFilename(wide_path.c_str(), nullptr, GENERIC_READ, WICDecodeOptions::WICDecodeMetadataCacheOnLoad, &decoder));
+    CHECKHR(decoder->GetFrame(0, &frame));
+    CHECKHR(factory_->CreateFormatConverter(&converter));
+    CHECKHR(converter->Initialize(frame.Get(), GUID_WICPixelFormat8bppGray, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom));
+
+    UINT width = 0;
+    UINT height = 0;
+    CHECKHR(converter->GetSize(&width, &height));
+    *out_pixels = pool->Acquire(static_cast<size_t>(width) * height);
+
+    CHECKHR(converter->CopyPixels(nullptr, width * sizeof(uint8_t),
+        width * height * sizeof(uint8_t), reinterpret_cast<BYTE *>(out_pixels->GetData())));
+
+    *out_width = width;
+    *out_height = height;
+    return true;
+}
+
+#else
+
+PngDecoder::PngDecoder()
+{
+}
+
+PngDecoder::~PngDecoder()
+{
+}
+
+bool PngDecoder::Decode(char const *path, BufferPool *pool, uint32_t *out_width, uint32_t *out_height, ImageBuffer *out_pixels)
+{
+    TRACE_SCOPE("PngDecoder::Decode");
+    png_image image{};
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, path))
+    {
+        LOGE("Failed to open [%s]: %s", path, image.message);
+        return false;
+    }
+
+    image.format = PNG_FORMAT_GRAY;
+    *out_pixels = pool->Acquire(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, nullptr, out_pixels->GetData(), 0, nullptr))
+    {
+        LOGE("Failed to decode [%s]: %s", path, image.message);
+        png_image_free(&image);
+        return false;
+    }
+
+    *out_width = image.width;
+    *out_height = image.height;
+    return true;
+}
+
+#endif
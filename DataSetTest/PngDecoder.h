@@ -0,0 +1,25 @@
+#pragma once
+
+#include "BufferPool.h"
+
+//
+// PNG decoder producing 8-bit grayscale
+//
+// Uses WIC on Windows and libpng elsewhere. WIC needs COM initialized on the thread it runs on, so create and
+// use each decoder on a single thread.
+//
+class PngDecoder : private NonCopyable
+{
+public:
+    PngDecoder();
+    ~PngDecoder();
+
+    // Decodes the image at path into a width x height buffer from pool, converting it to grayscale if needed
+    bool Decode(char const *path, BufferPool *pool, uint32_t *out_width, uint32_t *out_height, ImageBuffer *out_pixels);
+
+private:
+#ifdef _WIN32
+    HRESULT const              hr_coinit_ = S_OK;
+    ComPtr<IWICImagingFactory> factory_;
+#endif
+};
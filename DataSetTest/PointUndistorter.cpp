@@ -0,0 +1,240 @@
+#include "Precomp.h"
+#include "PointUndistorter.h"
+
+// Points converted from integers at a time, so they can go through Undistort
+static uint32_t const PixelBatchSize = 64;
+
+void PointUndistorter::Initialize(CameraModel const &model)
+{
+    model_ = model;
+    ClearCache();
+}
+
+bool PointUndistorter::BuildCache(uint32_t const width, uint32_t const height)
+{
+    if (0 == width || 0 == height)
+    {
+        LOGE("Can't cache %ux%u frames", width, height);
+        return false;
+    }
+
+    size_t const size = static_cast<size_t>(width) * height;
+    cache_xs_.resize(size);
+    cache_ys_.resize(size);
+
+    // A row at a time through the batched path
+    std::vector<float> us(width);
+    std::vector<float> vs(width);
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        us[x] = static_cast<float>(x);
+    }
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        std::fill(vs.begin(), vs.end(), static_cast<float>(y));
+        Undistort(us.data(), vs.data(), width, cache_xs_.data() + y * width, cache_ys_.data() + y * width);
+    }
+
+    cache_width_ = width;
+    cache_height_ = height;
+    LOGD("Cached undistorted points for %ux%u frames", width, height);
+    return true;
+}
+
+void PointUndistorter::ClearCache()
+{
+    cache_width_ = 0;
+    cache_height_ = 0;
+    cache_xs_.clear();
+    cache_ys_.clear();
+}
+
+void PointUndistorter::Undistort(float const *us, float const *vs, uint32_t const count, float *out_xs, float *out_ys) const
+{
+    float const inv_fx = 1.0f / model_.fx;
+    float const inv_fy = 1.0f / model_.fy;
+    float const k1 = model_.k1;
+    float const k2 = model_.k2;
+    float const k3 = model_.k3;
+    float const p1 = model_.p1;
+    float const p2 = model_.p2;
+
+    uint32_t i = 0;
+
+#ifdef __AVX2__
+    __m256 const cx8 = _mm256_set1_ps(model_.cx);
+    __m256 const cy8 = _mm256_set1_ps(model_.cy);
+    __m256 const inv_fx8 = _mm256_set1_ps(inv_fx);
+    __m256 const inv_fy8 = _mm256_set1_ps(inv_fy);
+    __m256 const k1_8 = _mm256_set1_ps(k1);
+    __m256 const k2_8 = _mm256_set1_ps(k2);
+    __m256 const k3_8 = _mm256_set1_ps(k3);
+    __m256 const p1_8 = _mm256_set1_ps(p1);
+    __m256 const p2_8 = _mm256_set1_ps(p2);
+    __m256 const two_p1 = _mm256_set1_ps(2.0f * p1);
+    __m256 const two_p2 = _mm256_set1_ps(2.0f * p2);
+    __m256 const one = _mm256_set1_ps(1.0f);
+    __m256 const two = _mm256_set1_ps(2.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 const xd = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(us + i), cx8), inv_fx8);
+        __m256 const yd = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(vs + i), cy8), inv_fy8);
+
+        __m256 x = xd;
+        __m256 y = yd;
+        for (uint32_t iteration = 0; iteration < PointUndistortIterations; ++iteration)
+        {
+            __m256 const xx = _mm256_mul_ps(x, x);
+            __m256 const yy = _mm256_mul_ps(y, y);
+            __m256 const xy = _mm256_mul_ps(x, y);
+            __m256 const r2 = _mm256_add_ps(xx, yy);
+
+            __m256 radial = _mm256_add_ps(k2_8, _mm256_mul_ps(r2, k3_8));
+            radial = _mm256_add_ps(k1_8, _mm256_mul_ps(r2, radial));
+            radial = _mm256_add_ps(one, _mm256_mul_ps(r2, radial));
+
+            __m256 const delta_x = _mm256_add_ps(_mm256_mul_ps(two_p1, xy), _mm256_mul_ps(p2_8, _mm256_add_ps(r2, _mm256_mul_ps(two, xx))));
+            __m256 const delta_y = _mm256_add_ps(_mm256_mul_ps(p1_8, _mm256_add_ps(r2, _mm256_mul_ps(two, yy))), _mm256_mul_ps(two_p2, xy));
+
+            x = _mm256_div_ps(_mm256_sub_ps(xd, delta_x), radial);
+            y = _mm256_div_ps(_mm256_sub_ps(yd, delta_y), radial);
+        }
+
+        _mm256_storeu_ps(out_xs + i, x);
+        _mm256_storeu_ps(out_ys + i, y);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        float const xd = (us[i] - model_.cx) * inv_fx;
+        float const yd = (vs[i] - model_.cy) * inv_fy;
+
+        float x = xd;
+        float y = yd;
+        for (uint32_t iteration = 0; iteration < PointUndistortIterations; ++iteration)
+        {
+            float const xx = x * x;
+            float const yy = y * y;
+            float const xy = x * y;
+            float const r2 = xx + yy;
+            float const radial = 1.0f + r2 * (k1 + r2 * (k2 + r2 * k3));
+            float const delta_x = 2.0f * p1 * xy + p2 * (r2 + 2.0f * xx);
+            float const delta_y = p1 * (r2 + 2.0f * yy) + 2.0f * p2 * xy;
+            x = (xd - delta_x) / radial;
+            y = (yd - delta_y) / radial;
+        }
+
+        out_xs[i] = x;
+        out_ys[i] = y;
+    }
+}
+
+void PointUndistorter::UndistortPixels(int32_t const *us, int32_t const *vs, uint32_t const count, float *out_xs, float *out_ys) const
+{
+    int32_t const width = static_cast<int32_t>(cache_width_);
+    int32_t const height = static_cast<int32_t>(cache_height_);
+    auto const is_cached = [&](uint32_t const i) { return us[i] >= 0 && us[i] < width && vs[i] >= 0 && vs[i] < height; };
+
+    uint32_t i = 0;
+
+#ifdef __AVX2__
+    if (!cache_xs_.empty())
+    {
+        __m256i const minus_one = _mm256_set1_epi32(-1);
+        __m256i const width8 = _mm256_set1_epi32(width);
+        __m256i const height8 = _mm256_set1_epi32(height);
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i const u = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(us + i));
+            __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(vs + i));
+            __m256i const inside = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpgt_epi32(u, minus_one), _mm256_cmpgt_epi32(width8, u)),
+                _mm256_and_si256(_mm256_cmpgt_epi32(v, minus_one), _mm256_cmpgt_epi32(height8, v)));
+            if (-1 != _mm256_movemask_epi8(inside))
+            {
+                // Rare enough to not be worth gathering around
+                for (uint32_t lane = i; lane < i + 8; ++lane)
+                {
+                    UndistortPixels(us + lane, vs + lane, 1, out_xs + lane, out_ys + lane);
+                }
+                continue;
+            }
+
+            __m256i const index = _mm256_add_epi32(_mm256_mullo_epi32(v, width8), u);
+            _mm256_storeu_ps(out_xs + i, _mm256_i32gather_ps(cache_xs_.data(), index, 4));
+            _mm256_storeu_ps(out_ys + i, _mm256_i32gather_ps(cache_ys_.data(), index, 4));
+        }
+    }
+#endif
+
+    // Whatever isn't cached goes through Undistort in batches
+    float batch_us[PixelBatchSize];
+    float batch_vs[PixelBatchSize];
+    uint32_t batch_indices[PixelBatchSize];
+    float batch_xs[PixelBatchSize];
+    float batch_ys[PixelBatchSize];
+    uint32_t batch_count = 0;
+    auto const flush = [&]()
+    {
+        Undistort(batch_us, batch_vs, batch_count, batch_xs, batch_ys);
+        for (uint32_t b = 0; b < batch_count; ++b)
+        {
+            out_xs[batch_indices[b]] = batch_xs[b];
+            out_ys[batch_indices[b]] = batch_ys[b];
+        }
+        batch_count = 0;
+    };
+
+    for (; i < count; ++i)
+    {
+        if (is_cached(i))
+        {
+            size_t const index = static_cast<size_t>(vs[i]) * width + us[i];
+            out_xs[i] = cache_xs_[index];
+            out_ys[i] = cache_ys_[index];
+            continue;
+        }
+
+        batch_us[batch_count] = static_cast<float>(us[i]);
+        batch_vs[batch_count] = static_cast<float>(vs[i]);
+        batch_indices[batch_count] = i;
+        if (++batch_count == PixelBatchSize)
+        {
+            flush();
+        }
+    }
+    if (batch_count > 0)
+    {
+        flush();
+    }
+}
+
+void UndistortPointsReference(CameraModel const &model, float const *us, float const *vs, uint32_t const count, float *out_xs, float *out_ys)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        double const xd = (us[i] - static_cast<double>(model.cx)) / model.fx;
+        double const yd = (vs[i] - static_cast<double>(model.cy)) / model.fy;
+
+        double x = xd;
+        double y = yd;
+        for (uint32_t iteration = 0; iteration < 100; ++iteration)
+        {
+            double const r2 = x * x + y * y;
+            double const radial = 1.0 + r2 * (model.k1 + r2 * (model.k2 + r2 * model.k3));
+            double const next_x = (xd - (2.0 * model.p1 * x * y + model.p2 * (r2 + 2.0 * x * x))) / radial;
+            double const next_y = (yd - (model.p1 * (r2 + 2.0 * y * y) + 2.0 * model.p2 * x * y)) / radial;
+            bool const converged = fabs(next_x - x) < 1e-12 && fabs(next_y - y) < 1e-12;
+            x = next_x;
+            y = next_y;
+            if (converged)
+            {
+                break;
+            }
+        }
+
+        out_xs[i] = static_cast<float>(x);
+        out_ys[i] = static_cast<float>(y);
+    }
+}
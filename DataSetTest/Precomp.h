@@ -1,5 +1,6 @@
 #pragma once
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <Windows.h>
@@ -8,27 +9,42 @@
 #include <DirectXMath.h>
 #include <wincodec.h>
 #include <wrl.h>
+#else
+#include <strings.h>
+#endif
 
 #include <inttypes.h>
 #include <assert.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <nmmintrin.h>
+#include <immintrin.h>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <istream>
 #include <fstream>
 #include <functional>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-#include "NonCopyable.h"
-#include "Logging.h"
+#ifdef _WIN32
 
 // Yes, I'm lazy and I know this is bad...
 using Microsoft::WRL::ComPtr;
@@ -43,3 +59,27 @@ using namespace DirectX;
         return false;               \
     }                               \
 }
+
+#else
+
+// Stand-ins for the MSVC extensions the portable code uses
+#define __cdecl
+#define UNREFERENCED_PARAMETER(x) (void)(x)
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#define _stricmp strcasecmp
+
+template <size_t N>
+inline int sprintf_s(char (&buffer)[N], char const *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    int const result = vsnprintf(buffer, N, format, list);
+    va_end(list);
+    return result;
+}
+
+#endif
+
+#include "NonCopyable.h"
+#include "Logging.h"
+#include "Tracing.h"
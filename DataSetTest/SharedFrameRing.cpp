@@ -0,0 +1,306 @@
+#include "Precomp.h"
+#include "SharedFrameRing.h"
+#include "ThreadPool.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+static uint32_t GetThisProcessId()
+{
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<uint32_t>(getpid());
+#endif
+}
+
+static bool IsProcessRunning(uint32_t const pid)
+{
+#ifdef _WIN32
+    // Never asked, as rings go away with their last handle
+    UNREFERENCED_PARAMETER(pid);
+    return true;
+#else
+    // Signal 0 only checks that the process exists. EPERM means it does, as someone else's
+    return 0 == kill(static_cast<pid_t>(pid), 0) || EPERM == errno;
+#endif
+}
+
+static uint64_t AlignUp(uint64_t const value)
+{
+    return (value + SharedRingAlignment - 1) & ~static_cast<uint64_t>(SharedRingAlignment - 1);
+}
+
+SharedFrameWriter::~SharedFrameWriter()
+{
+    Close();
+}
+
+bool SharedFrameWriter::Initialize(char const *name, uint32_t const slot_count, size_t const max_frame_size)
+{
+    Close();
+
+    // A single slot would always be the one being overwritten
+    if (slot_count < 2 || 0 == max_frame_size)
+    {
+        LOGE("Invalid frame ring of %u slots of %zu bytes", slot_count, max_frame_size);
+        return false;
+    }
+
+    if (SharedMemory::Exists(name) && !RemoveStaleRing(name))
+    {
+        return false;
+    }
+
+    uint64_t const slot_size = AlignUp(sizeof(SharedSlotHeader) + max_frame_size);
+    if (!memory_.Create(name, static_cast<size_t>(sizeof(SharedRingHeader) + slot_count * slot_size)))
+    {
+        return false;
+    }
+
+    // The memory starts zeroed, so every slot starts out never written, and the state as Creating
+    header_ = reinterpret_cast<SharedRingHeader *>(memory_.GetData());
+    memcpy(header_->magic, SharedRingMagic, sizeof(header_->magic));
+    header_->version = SharedRingVersion;
+    header_->slot_count = slot_count;
+    header_->slot_size = slot_size;
+    header_->max_frame_size = max_frame_size;
+    header_->producer_pid = GetThisProcessId();
+    header_->published.store(0, std::memory_order_relaxed);
+    header_->state.store(static_cast<uint32_t>(SharedRingState::Live), std::memory_order_release);
+    next_frame_ = 0;
+
+    LOGD("Created frame ring [%s] of %u slots of %zu bytes", name, slot_count, max_frame_size);
+    return true;
+}
+
+bool SharedFrameWriter::WriteFrame(uint64_t const timestamp_us, uint32_t const width, uint32_t const height, uint8_t const *pixels)
+{
+    size_t const size = static_cast<size_t>(width) * height;
+    if (!header_ || size > header_->max_frame_size)
+    {
+        LOGE("A %ux%u frame doesn't fit the frame ring", width, height);
+        return false;
+    }
+
+    uint64_t const frame = next_frame_++;
+    uint8_t *slot_data = memory_.GetData() + sizeof(SharedRingHeader) + (frame % header_->slot_count) * header_->slot_size;
+    SharedSlotHeader *slot = reinterpret_cast<SharedSlotHeader *>(slot_data);
+
+    // The release fence keeps the writes below from becoming visible before the slot is marked as being written
+    slot->sequence.store(2 * frame + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->timestamp_us = timestamp_us;
+    slot->width = width;
+    slot->height = height;
+    memcpy(slot_data + sizeof(SharedSlotHeader), pixels, size);
+
+    slot->sequence.store(2 * frame + 2, std::memory_order_release);
+    header_->published.store(frame + 1, std::memory_order_release);
+    return true;
+}
+
+bool SharedFrameWriter::RemoveStaleRing(char const *name)
+{
+    SharedMemory existing;
+    if (!existing.Open(name))
+    {
+        return false;
+    }
+
+    // Memory that isn't a ring, or a ring still being created, isn't ours to remove
+    SharedRingHeader const *header = reinterpret_cast<SharedRingHeader const *>(existing.GetData());
+    if (existing.GetSize() < sizeof(SharedRingHeader) || 0 != memcmp(header->magic, SharedRingMagic, sizeof(header->magic)) ||
+        SharedRingState::Creating == static_cast<SharedRingState>(header->state.load(std::memory_order_acquire)))
+    {
+        LOGE("Shared memory [%s] already exists, and isn't a frame ring", name);
+        return false;
+    }
+
+    uint32_t const producer_pid = header->producer_pid;
+    if (SharedRingState::Live == static_cast<SharedRingState>(header->state.load(std::memory_order_acquire)) && IsProcessRunning(producer_pid))
+    {
+        LOGE("Frame ring [%s] is in use by process %u", name, producer_pid);
+        return false;
+    }
+
+    LOGW("Replacing frame ring [%s] left behind by process %u", name, producer_pid);
+    existing.Close();
+    SharedMemory::Remove(name);
+    return true;
+}
+
+void SharedFrameWriter::Close()
+{
+    if (header_)
+    {
+        header_->state.store(static_cast<uint32_t>(SharedRingState::Closed), std::memory_order_release);
+        header_ = nullptr;
+    }
+    memory_.Close();
+}
+
+bool SharedMemoryFrameProvider::Initialize(char const *name, SharedFrameParams const &params)
+{
+    header_ = nullptr;
+    name_ = name;
+    params_ = params;
+    view_sequence_ = 0;
+    dropped_ = 0;
+
+    if (!memory_.Open(name))
+    {
+        return false;
+    }
+
+    // Validate the layout up front, so slots can be addressed without checks
+    SharedRingHeader const *header = reinterpret_cast<SharedRingHeader const *>(memory_.GetData());
+    size_t const size = memory_.GetSize();
+    if (size < sizeof(SharedRingHeader) || SharedRingState::Creating == static_cast<SharedRingState>(header->state.load(std::memory_order_acquire)) ||
+        0 != memcmp(header->magic, SharedRingMagic, sizeof(SharedRingMagic)))
+    {
+        LOGE("[%s] is not a frame ring, or isn't ready yet", name);
+        return false;
+    }
+    if (SharedRingVersion != header->version)
+    {
+        LOGE("[%s] is version %u, expected %u", name, header->version, SharedRingVersion);
+        return false;
+    }
+    if (header->slot_count < 2 || header->slot_size != AlignUp(sizeof(SharedSlotHeader) + header->max_frame_size) ||
+        (size - sizeof(SharedRingHeader)) / header->slot_size < header->slot_count)
+    {
+        LOGE("[%s] has an invalid slot layout", name);
+        return false;
+    }
+
+    header_ = header;
+
+    // Live: the newest frame is the first one handed out
+    uint64_t const published = header_->published.load(std::memory_order_acquire);
+    next_frame_ = published > 0 ? published - 1 : 0;
+
+    LOGD("Opened frame ring [%s] of %u slots, %" PRIu64 " frames published so far", name, header_->slot_count, published);
+    return true;
+}
+
+SharedSlotHeader const *SharedMemoryFrameProvider::GetSlot(uint64_t const frame) const
+{
+    return reinterpret_cast<SharedSlotHeader const *>(memory_.GetData() + sizeof(SharedRingHeader) + (frame % header_->slot_count) * header_->slot_size);
+}
+
+bool SharedMemoryFrameProvider::WaitForFrame()
+{
+    auto const start = std::chrono::steady_clock::now();
+    uint32_t attempts = 0;
+    for (;;)
+    {
+        uint64_t const published = header_->published.load(std::memory_order_acquire);
+        if (published > next_frame_)
+        {
+            // The producer is writing frame published, over frame published - slot_count
+            if (published - next_frame_ >= header_->slot_count)
+            {
+                dropped_ += published - 1 - next_frame_;
+                next_frame_ = published - 1;
+            }
+            return true;
+        }
+
+        if (SharedRingState::Closed == static_cast<SharedRingState>(header_->state.load(std::memory_order_acquire)))
+        {
+            LOGD("Frame ring [%s] was closed", name_.c_str());
+            return false;
+        }
+
+        if (params_.timeout_ms > 0 && std::chrono::steady_clock::now() - start > std::chrono::milliseconds(params_.timeout_ms))
+        {
+            LOGE("No frame published to [%s] in %u ms", name_.c_str(), params_.timeout_ms);
+            return false;
+        }
+
+        Backoff(&attempts);
+    }
+}
+
+bool SharedMemoryFrameProvider::AcquireFrameView(CameraFrameView *out_view)
+{
+    if (!header_)
+    {
+        LOGE("No frame ring opened");
+        return false;
+    }
+
+    for (;;)
+    {
+        if (!WaitForFrame())
+        {
+            return false;
+        }
+
+        // Published frames are complete, so any other sequence means the slot was lapped since
+        SharedSlotHeader const *slot = GetSlot(next_frame_);
+        uint64_t const sequence = slot->sequence.load(std::memory_order_acquire);
+        uint64_t const size = static_cast<uint64_t>(slot->width) * slot->height;
+        if (2 * next_frame_ + 2 != sequence || size > header_->max_frame_size)
+        {
+            ++dropped_;
+            ++next_frame_;
+            continue;
+        }
+
+        out_view->timestamp_us = slot->timestamp_us;
+        out_view->width = slot->width;
+        out_view->height = slot->height;
+        out_view->pixels = reinterpret_cast<uint8_t const *>(slot) + sizeof(SharedSlotHeader);
+        view_sequence_ = sequence;
+        return true;
+    }
+}
+
+bool SharedMemoryFrameProvider::ReleaseFrameView()
+{
+    if (0 == view_sequence_)
+    {
+        return false;
+    }
+
+    // The acquire fence keeps the reads of the view from moving past the check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool const intact = GetSlot(next_frame_)->sequence.load(std::memory_order_relaxed) == view_sequence_;
+    if (!intact)
+    {
+        ++dropped_;
+    }
+
+    view_sequence_ = 0;
+    ++next_frame_;
+    return intact;
+}
+
+bool SharedMemoryFrameProvider::GetNextFrame(CameraFrame *out_frame)
+{
+    CameraFrameView view;
+    while (AcquireFrameView(&view))
+    {
+        size_t const size = static_cast<size_t>(view.width) * view.height;
+        ImageBuffer pixels = pool_.Acquire(size);
+        memcpy(pixels.GetData(), view.pixels, size);
+        if (!ReleaseFrameView())
+        {
+            continue;
+        }
+
+        out_frame->timestamp_us = view.timestamp_us;
+        out_frame->width = view.width;
+        out_frame->height = view.height;
+        out_frame->pixels = std::move(pixels);
+        out_frame->has_pose = false;
+        return true;
+    }
+    return false;
+}
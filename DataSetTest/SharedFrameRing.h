@@ -0,0 +1,135 @@
+#pragma once
+
+#include "FrameProvider.h"
+#include "SharedMemory.h"
+
+//
+// Shared memory frame ring
+//
+// A SharedRingHeader, then slot_count slots of slot_size bytes, each a SharedSlotHeader followed by the pixels of
+// up to max_frame_size bytes, aligned to SharedRingAlignment. Frame f goes into slot f % slot_count.
+//
+// Each slot is a seqlock: its sequence is 2 f + 1 while the producer writes frame f into it, and 2 f + 2 once it
+// is complete, after which published is raised to f + 1. A consumer reading frame f checks the sequence before
+// and after reading, and if it changed, the producer lapped it and what it read is torn.
+//
+static char const     SharedRingMagic[8] = { 'C', 'V', 'R', 'I', 'N', 'G', '\0', '\0' };
+static uint32_t const SharedRingVersion = 1;
+static uint32_t const SharedRingAlignment = 64;
+
+static_assert(sizeof(std::atomic<uint32_t>) == 4 && sizeof(std::atomic<uint64_t>) == 8, "Shared atomics must have the layout of plain integers");
+
+enum class SharedRingState : uint32_t
+{
+    Creating,   // the header isn't valid yet
+    Live,
+    Closed,     // the producer stopped, and no more frames will be published
+};
+
+struct SharedRingHeader
+{
+    char                  magic[8];
+    uint32_t              version;
+    uint32_t              slot_count;
+    uint64_t              slot_size;        // from one slot to the next
+    uint64_t              max_frame_size;   // pixel bytes a slot holds
+    std::atomic<uint32_t> state;            // SharedRingState
+    uint32_t              producer_pid;     // process that created the ring
+    uint8_t               reserved[24];
+
+    // Frames published so far, on a cache line of its own as the consumer polls it
+    std::atomic<uint64_t> published;
+    uint8_t               padding[56];
+};
+static_assert(sizeof(SharedRingHeader) == 2 * SharedRingAlignment, "SharedRingHeader must not change size");
+
+struct SharedSlotHeader
+{
+    std::atomic<uint64_t> sequence;         // 0 until the slot is first written
+    uint64_t              timestamp_us;
+    uint32_t              width;
+    uint32_t              height;           // stride is width
+    uint8_t               reserved[40];
+};
+static_assert(sizeof(SharedSlotHeader) == SharedRingAlignment, "SharedSlotHeader must not change size");
+
+//
+// Producer side of a shared memory frame ring
+//
+// Never waits for consumers: when they fall behind, their oldest frames are overwritten.
+//
+class SharedFrameWriter : private NonCopyable
+{
+public:
+    SharedFrameWriter() = default;
+    ~SharedFrameWriter();
+
+    // Creates the ring under name, with slot_count slots that each hold a frame of up to max_frame_size bytes.
+    // Fails if another producer's ring is live under name, and replaces one whose producer is gone
+    bool Initialize(char const *name, uint32_t const slot_count, size_t const max_frame_size);
+
+    // Copies the frame into the next slot and publishes it
+    bool WriteFrame(uint64_t const timestamp_us, uint32_t const width, uint32_t const height, uint8_t const *pixels);
+
+    // Tells consumers no more frames are coming, and removes the ring
+    void Close();
+
+private:
+    // Removes the ring under name if its producer closed it or is gone, or returns false if it is still live
+    static bool RemoveStaleRing(char const *name);
+
+private:
+    SharedMemory      memory_;
+    SharedRingHeader *header_ = nullptr;
+    uint64_t          next_frame_ = 0;
+};
+
+struct SharedFrameParams
+{
+    uint32_t timeout_ms = 1000;     // how long to wait for a new frame before giving up. 0 waits forever
+};
+
+//
+// Plays back the frames a producer process publishes into a shared memory frame ring
+//
+// Starts at the newest frame published, and hands out every frame after it in order, as they are published.
+// When the consumer falls behind far enough that the producer is about to overwrite the next frame, the frames in
+// between are dropped and it skips to the newest one, so latency stays bounded by the ring size. Ends when the
+// producer closes the ring, or publishes nothing for longer than the timeout.
+//
+class SharedMemoryFrameProvider
+    : private NonCopyable
+    , public FrameProvider
+{
+public:
+    SharedMemoryFrameProvider() = default;
+
+    bool Initialize(char const *name, SharedFrameParams const &params);
+
+    // View of the next frame, straight in the ring. It stays in place until ReleaseFrameView, which returns false if
+    // the producer overwrote it in the meantime, in which case anything read from the view is garbage
+    bool AcquireFrameView(CameraFrameView *out_view);
+    bool ReleaseFrameView();
+
+    // Frames skipped or overwritten so far
+    uint64_t GetDroppedCount() const { return dropped_; }
+
+    // FrameProvider. Copies the next frame that survives being copied
+    virtual bool GetNextFrame(CameraFrame *out_frame) override;
+
+private:
+    // Waits for frame next_frame_ to be published, skipping ahead if the producer is lapping it
+    bool WaitForFrame();
+
+    SharedSlotHeader const *GetSlot(uint64_t const frame) const;
+
+private:
+    SharedMemory            memory_;
+    SharedRingHeader const *header_ = nullptr;
+    std::string             name_;
+    SharedFrameParams       params_;
+    BufferPool              pool_;
+    uint64_t                next_frame_ = 0;
+    uint64_t                view_sequence_ = 0;     // of the slot holding the acquired view, or 0 for none
+    uint64_t                dropped_ = 0;
+};
@@ -0,0 +1,206 @@
+#include "Precomp.h"
+#include "SharedMemory.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SharedMemory::~SharedMemory()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool SharedMemory::Create(char const *name, size_t const size)
+{
+    Close();
+
+    uint64_t const size64 = size;
+    mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64), name);
+    if (!mapping_ || ERROR_ALREADY_EXISTS == GetLastError())
+    {
+        // Named mappings go away with their last handle, so an existing one is still in use
+        LOGE("Failed to create shared memory [%s], or it is already in use", name);
+        Close();
+        return false;
+    }
+
+    data_ = static_cast<uint8_t *>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size));
+    if (!data_)
+    {
+        LOGE("Failed to map shared memory [%s]", name);
+        Close();
+        return false;
+    }
+
+    size_ = size;
+    return true;
+}
+
+bool SharedMemory::Open(char const *name)
+{
+    Close();
+
+    mapping_ = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (!mapping_)
+    {
+        LOGE("Failed to open shared memory [%s]", name);
+        return false;
+    }
+
+    data_ = static_cast<uint8_t *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    MEMORY_BASIC_INFORMATION info{};
+    if (!data_ || 0 == VirtualQuery(data_, &info, sizeof(info)))
+    {
+        LOGE("Failed to map shared memory [%s]", name);
+        Close();
+        return false;
+    }
+
+    // Rounded up to whole pages, which is harmless as users validate their own layout
+    size_ = info.RegionSize;
+    return true;
+}
+
+bool SharedMemory::Exists(char const *name)
+{
+    HANDLE const mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (!mapping)
+    {
+        return false;
+    }
+    CloseHandle(mapping);
+    return true;
+}
+
+void SharedMemory::Remove(char const *)
+{
+}
+
+void SharedMemory::Close()
+{
+    if (data_)
+    {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    if (mapping_)
+    {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+    size_ = 0;
+    name_.clear();
+}
+
+#else
+
+// POSIX names are a single path component with a leading slash
+static std::string GetSystemName(char const *name)
+{
+    return std::string("/") + name;
+}
+
+bool SharedMemory::Create(char const *name, size_t const size)
+{
+    Close();
+
+    std::string const system_name = GetSystemName(name);
+    int const file = shm_open(system_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (file < 0)
+    {
+        LOGE("Failed to create shared memory [%s], or it already exists", name);
+        return false;
+    }
+    name_ = system_name;
+
+    if (0 != ftruncate(file, static_cast<off_t>(size)))
+    {
+        LOGE("Failed to size shared memory [%s] to %zu bytes", name, size);
+        close(file);
+        Close();
+        return false;
+    }
+
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    close(file);
+    if (MAP_FAILED == data)
+    {
+        LOGE("Failed to map shared memory [%s]", name);
+        Close();
+        return false;
+    }
+
+    data_ = static_cast<uint8_t *>(data);
+    size_ = size;
+    return true;
+}
+
+bool SharedMemory::Open(char const *name)
+{
+    Close();
+
+    int const file = shm_open(GetSystemName(name).c_str(), O_RDONLY, 0);
+    if (file < 0)
+    {
+        LOGE("Failed to open shared memory [%s]", name);
+        return false;
+    }
+
+    struct stat status{};
+    if (0 != fstat(file, &status) || 0 == status.st_size)
+    {
+        LOGE("Failed to get the size of shared memory [%s], or it is empty", name);
+        close(file);
+        return false;
+    }
+
+    void *data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (MAP_FAILED == data)
+    {
+        LOGE("Failed to map shared memory [%s]", name);
+        return false;
+    }
+
+    data_ = static_cast<uint8_t *>(data);
+    size_ = static_cast<size_t>(status.st_size);
+    return true;
+}
+
+bool SharedMemory::Exists(char const *name)
+{
+    int const file = shm_open(GetSystemName(name).c_str(), O_RDONLY, 0);
+    if (file < 0)
+    {
+        return false;
+    }
+    close(file);
+    return true;
+}
+
+void SharedMemory::Remove(char const *name)
+{
+    shm_unlink(GetSystemName(name).c_str());
+}
+
+void SharedMemory::Close()
+{
+    if (data_)
+    {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    if (!name_.empty())
+    {
+        shm_unlink(name_.c_str());
+        name_.clear();
+    }
+    size_ = 0;
+}
+
+#endif
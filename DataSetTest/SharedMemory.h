@@ -0,0 +1,40 @@
+#pragma once
+
+//
+// Named shared memory, for handing data between processes
+//
+// The process that creates the memory owns its name, and removes it when closing. Others open it by name, read
+// only. On POSIX systems this is shm_open, on Windows a pagefile backed file mapping.
+//
+class SharedMemory : private NonCopyable
+{
+public:
+    SharedMemory() = default;
+    ~SharedMemory();
+
+    // Creates size bytes of zeroed memory under name. Fails if the name is taken, even by memory a process that
+    // didn't close it left behind, which only Remove replaces
+    bool Create(char const *name, size_t const size);
+
+    // Whether memory exists under name
+    static bool Exists(char const *name);
+
+    // Removes the name of memory left behind by a process that didn't close it. Processes that have it mapped
+    // keep it. On Windows the memory goes away with its last handle, so there is never any to remove
+    static void Remove(char const *name);
+
+    // Maps the memory created under name
+    bool Open(char const *name);
+    void Close();
+
+    uint8_t *GetData() const { return data_; }
+    size_t GetSize() const { return size_; }
+
+private:
+    uint8_t     *data_ = nullptr;
+    size_t       size_ = 0;
+    std::string  name_;     // system name, set while this owns it
+#ifdef _WIN32
+    HANDLE       mapping_ = nullptr;
+#endif
+};
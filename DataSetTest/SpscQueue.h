@@ -0,0 +1,108 @@
+#pragma once
+
+//
+// Bounded lock-free queue between a producer thread and a consumer thread
+//
+// Each slot carries a sequence number telling whether it is free to be written or ready to be read, as in
+// Vyukov's bounded queue. Pops claim their slot with a compare-exchange, so besides the consumer, the producer
+// may also pop, to evict the oldest item when the queue is full. There must only ever be one thread pushing.
+// Items are moved in and out, so T must be default constructible and move assignable.
+//
+template <typename T>
+class SpscQueue : private NonCopyable
+{
+public:
+    SpscQueue() = default;
+
+    // Capacity is rounded up to a power of two. Not thread safe, and drops any queued items
+    bool Initialize(uint32_t const capacity)
+    {
+        if (0 == capacity || capacity > (1u << 31))
+        {
+            LOGE("Invalid queue capacity %u", capacity);
+            return false;
+        }
+
+        uint32_t rounded = 1;
+        while (rounded < capacity)
+        {
+            rounded <<= 1;
+        }
+
+        slots_.reset(new Slot[rounded]);
+        for (uint32_t i = 0; i < rounded; ++i)
+        {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask_ = rounded - 1;
+        head_.store(0, std::memory_order_relaxed);
+        tail_ = 0;
+        return true;
+    }
+
+    uint32_t GetCapacity() const { return static_cast<uint32_t>(mask_ + 1); }
+
+    // Producer only. Moves item into the queue, or leaves it untouched and returns false when full
+    bool TryPush(T &&item)
+    {
+        Slot &slot = slots_[tail_ & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != tail_)
+        {
+            return false;
+        }
+
+        slot.item = std::move(item);
+        slot.sequence.store(tail_ + 1, std::memory_order_release);
+        ++tail_;
+        return true;
+    }
+
+    // Moves the oldest item out, or returns false when empty
+    bool TryPop(T *out_item)
+    {
+        uint64_t position = head_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot &slot = slots_[position & mask_];
+            int64_t const state = static_cast<int64_t>(slot.sequence.load(std::memory_order_acquire) - (position + 1));
+            if (state < 0)
+            {
+                return false;
+            }
+
+            if (0 == state)
+            {
+                if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    *out_item = std::move(slot.item);
+                    // Hand the slot back to the producer, for the item one lap ahead
+                    slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else
+            {
+                // Popped by the other side in the meantime
+                position = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence{ 0 };
+        T                     item;
+    };
+
+    // Keeps the indices of both sides on separate cache lines
+    static size_t const CacheLineSize = 64;
+
+private:
+    std::unique_ptr<Slot[]> slots_;
+    uint64_t                mask_ = 0;
+    uint8_t                 padding0_[CacheLineSize];
+    std::atomic<uint64_t>   head_{ 0 }; // next position to pop
+    uint8_t                 padding1_[CacheLineSize];
+    uint64_t                tail_ = 0;  // next position to push, only touched by the producer
+};
@@ -0,0 +1,265 @@
+#include "Precomp.h"
+#include "TextReader.h"
+
+// Powers of ten that are exact as doubles
+static double const ExactPowersOf10[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Largest mantissa that converts to a double exactly
+static uint64_t const MaxExactMantissa = 1ull << 53;
+
+// Largest mantissa another digit can be appended to, so it stays below MaxExactMantissa whatever the digit
+static uint64_t const MaxExtendableMantissa = (MaxExactMantissa - 10) / 10;
+
+static bool IsSpace(char const c)
+{
+    return ' ' == c || '\t' == c || '\r' == c;
+}
+
+static bool IsDigit(char const c)
+{
+    return c >= '0' && c <= '9';
+}
+
+TextReader::TextReader(char const *begin, char const *end)
+    : current_(begin)
+    , end_(end)
+    , line_end_(begin)
+{
+}
+
+bool TextReader::NextLine()
+{
+    for (;;)
+    {
+        if (line_number_ > 0)
+        {
+            if (line_end_ == end_)
+            {
+                current_ = end_;
+                return false;
+            }
+            current_ = line_end_ + 1;
+        }
+        if (current_ == end_)
+        {
+            line_end_ = end_;
+            return false;
+        }
+
+        ++line_number_;
+        line_end_ = static_cast<char const *>(memchr(current_, '\n', end_ - current_));
+        if (!line_end_)
+        {
+            line_end_ = end_;
+        }
+
+        SkipSpaces();
+        if (current_ < line_end_ && '#' != *current_)
+        {
+            return true;
+        }
+    }
+}
+
+bool TextReader::AtLineEnd()
+{
+    SkipSpaces();
+    return current_ == line_end_;
+}
+
+void TextReader::SkipSpaces()
+{
+    while (current_ < line_end_ && IsSpace(*current_))
+    {
+        ++current_;
+    }
+}
+
+bool TextReader::ReadTimestampUs(uint64_t *out_timestamp_us)
+{
+    SkipSpaces();
+
+    char const *p = current_;
+    uint64_t seconds = 0;
+    while (p < line_end_ && IsDigit(*p))
+    {
+        seconds = seconds * 10 + static_cast<uint64_t>(*p - '0');
+        ++p;
+    }
+    bool valid = p > current_;
+
+    uint64_t microseconds = 0;
+    uint32_t fraction_digits = 0;
+    if (p < line_end_ && '.' == *p)
+    {
+        ++p;
+        for (; p < line_end_ && IsDigit(*p); ++p, ++fraction_digits)
+        {
+            // Digits past microseconds are truncated
+            if (fraction_digits < 6)
+            {
+                microseconds = microseconds * 10 + static_cast<uint64_t>(*p - '0');
+            }
+        }
+        valid = valid || fraction_digits > 0;
+    }
+    for (; fraction_digits < 6; ++fraction_digits)
+    {
+        microseconds *= 10;
+    }
+
+    if (!valid || (p < line_end_ && !IsSpace(*p)))
+    {
+        return false;
+    }
+
+    current_ = p;
+    *out_timestamp_us = seconds * 1000 * 1000 + microseconds;
+    return true;
+}
+
+bool TextReader::ReadDouble(double *out_value)
+{
+    SkipSpaces();
+
+    char const *p = current_;
+    bool negative = false;
+    if (p < line_end_ && ('-' == *p || '+' == *p))
+    {
+        negative = '-' == *p;
+        ++p;
+    }
+
+    // Gather the significant digits as an integer, and where the decimal point goes as a power of ten
+    uint64_t mantissa = 0;
+    int32_t exponent = 0;
+    uint32_t digits = 0;
+    for (; p < line_end_ && IsDigit(*p); ++p, ++digits)
+    {
+        if (mantissa <= MaxExtendableMantissa)
+        {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+        }
+        else
+        {
+            // Past the precision of a double, so only its magnitude matters
+            ++exponent;
+        }
+    }
+    if (p < line_end_ && '.' == *p)
+    {
+        for (++p; p < line_end_ && IsDigit(*p); ++p, ++digits)
+        {
+            if (mantissa <= MaxExtendableMantissa)
+            {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                --exponent;
+            }
+        }
+    }
+    if (0 == digits)
+    {
+        return false;
+    }
+
+    if (p < line_end_ && ('e' == *p || 'E' == *p))
+    {
+        ++p;
+        bool negative_exponent = false;
+        if (p < line_end_ && ('-' == *p || '+' == *p))
+        {
+            negative_exponent = '-' == *p;
+            ++p;
+        }
+        if (p == line_end_ || !IsDigit(*p))
+        {
+            return false;
+        }
+
+        int32_t written_exponent = 0;
+        for (; p < line_end_ && IsDigit(*p); ++p)
+        {
+            written_exponent = std::min(written_exponent * 10 + (*p - '0'), 100000);
+        }
+        exponent += negative_exponent ? -written_exponent : written_exponent;
+    }
+
+    if (p < line_end_ && !IsSpace(*p))
+    {
+        return false;
+    }
+
+    // When both the mantissa and the power of ten are exact, a single multiply or divide rounds correctly
+    double value = static_cast<double>(mantissa);
+    int32_t const max_exact_exponent = static_cast<int32_t>(_countof(ExactPowersOf10)) - 1;
+    if (exponent >= -max_exact_exponent && exponent <= max_exact_exponent)
+    {
+        value = exponent < 0 ? value / ExactPowersOf10[-exponent] : value * ExactPowersOf10[exponent];
+    }
+    else
+    {
+        value *= pow(10.0, exponent);
+    }
+
+    current_ = p;
+    *out_value = negative ? -value : value;
+    return true;
+}
+
+bool TextReader::ReadFloat(float *out_value)
+{
+    double value = 0;
+    if (!ReadDouble(&value))
+    {
+        return false;
+    }
+    *out_value = static_cast<float>(value);
+    return true;
+}
+
+bool TextReader::ReadUint32(uint32_t *out_value)
+{
+    SkipSpaces();
+
+    char const *p = current_;
+    uint64_t value = 0;
+    for (; p < line_end_ && IsDigit(*p); ++p)
+    {
+        value = value * 10 + static_cast<uint64_t>(*p - '0');
+        if (value > UINT32_MAX)
+        {
+            return false;
+        }
+    }
+    if (p == current_ || (p < line_end_ && !IsSpace(*p)))
+    {
+        return false;
+    }
+
+    current_ = p;
+    *out_value = static_cast<uint32_t>(value);
+    return true;
+}
+
+bool TextReader::ReadToken(std::string *out_token)
+{
+    SkipSpaces();
+
+    char const *p = current_;
+    while (p < line_end_ && !IsSpace(*p))
+    {
+        ++p;
+    }
+    if (p == current_)
+    {
+        return false;
+    }
+
+    out_token->assign(current_, p);
+    current_ = p;
+    return true;
+}
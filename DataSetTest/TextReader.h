@@ -0,0 +1,49 @@
+#pragma once
+
+//
+// Line by line reader of whitespace separated values, for dataset text files
+//
+// Works in place over text that is already in memory, such as a mapped file, and parses numbers without going
+// through locales or streams. Lines end with \n or \r\n, and blank lines and lines starting with # are skipped.
+// Values never extend past the end of their line, so a short line fails to parse rather than running on.
+//
+class TextReader
+{
+public:
+    TextReader(char const *begin, char const *end);
+
+    // Moves to the start of the next line with content. Returns false at the end of the text
+    bool NextLine();
+
+    // 1-based number of the current line, for error messages
+    uint32_t GetLineNumber() const { return line_number_; }
+
+    // Where reading continues from
+    char const *GetPosition() const { return current_; }
+
+    // Whether only whitespace is left on the current line
+    bool AtLineEnd();
+
+    // Decimal seconds, such as 0.044530322, truncated to whole microseconds. Negative values aren't allowed
+    bool ReadTimestampUs(uint64_t *out_timestamp_us);
+
+    // Decimal number with optional sign, fraction and exponent. Correctly rounded whenever the digits fit in a
+    // double and the exponent is small, which covers every value in our datasets
+    bool ReadDouble(double *out_value);
+    bool ReadFloat(float *out_value);
+
+    // Unsigned decimal integer
+    bool ReadUint32(uint32_t *out_value);
+
+    // Run of non-whitespace characters
+    bool ReadToken(std::string *out_token);
+
+private:
+    void SkipSpaces();
+
+private:
+    char const *current_;
+    char const *end_;
+    char const *line_end_;
+    uint32_t    line_number_ = 0;   // 0 before the first line
+};
@@ -0,0 +1,216 @@
+#include "Precomp.h"
+#include "ThreadPool.h"
+
+// Queue owned by the current thread. Threads that aren't workers share the last queue
+static thread_local uint32_t s_queue_index = UINT32_MAX;
+
+// Bands per thread. More than one lets threads that finish early steal the rest of the work
+static uint32_t const BandsPerThread = 4;
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_lock_);
+        shutdown_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto &worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+bool ThreadPool::Initialize(uint32_t const num_threads)
+{
+    assert(workers_.empty());
+
+    uint32_t thread_count = num_threads;
+    if (0 == thread_count)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    num_queues_ = thread_count;
+    queues_.reset(new Queue[num_queues_]);
+
+    for (uint32_t i = 0; i + 1 < thread_count; ++i)
+    {
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+
+    LOGD("Thread pool initialized with %u threads", thread_count);
+    return true;
+}
+
+void ThreadPool::ParallelFor(uint32_t const count, FunctionRef<void(uint32_t)> const task)
+{
+    if (0 == count)
+    {
+        return;
+    }
+
+    Job job;
+    job.task = &task;
+    job.remaining = count;
+
+    // Count the tasks before they become visible, so the count never goes negative
+    {
+        std::lock_guard<std::mutex> lock(wake_lock_);
+        queued_tasks_ += count;
+    }
+
+    // Give each queue a contiguous slice, so neighboring indices (usually neighboring rows) tend to
+    // stay on the same thread unless they get stolen
+    for (uint32_t q = 0; q < num_queues_; ++q)
+    {
+        uint32_t const first = static_cast<uint32_t>(static_cast<uint64_t>(count) * q / num_queues_);
+        uint32_t const last = static_cast<uint32_t>(static_cast<uint64_t>(count) * (q + 1) / num_queues_);
+        if (first == last)
+        {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(queues_[q].lock);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            queues_[q].tasks.push_back(Task{ &job, i });
+        }
+    }
+
+    wake_.notify_all();
+
+    // Help out until every task of this job has completed. This may run other jobs' tasks too
+    uint32_t const queue_index = std::min(s_queue_index, num_queues_ - 1);
+    while (job.remaining.load(std::memory_order_acquire) > 0)
+    {
+        Task next;
+        if (PopOrSteal(queue_index, &next))
+        {
+            (*next.job->task)(next.index);
+            next.job->remaining.fetch_sub(1, std::memory_order_release);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ThreadPool::PopOrSteal(uint32_t const queue_index, Task *out_task)
+{
+    // Own queue first, from the front
+    {
+        Queue &queue = queues_[queue_index];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (queue.head < queue.tasks.size())
+        {
+            *out_task = queue.tasks[queue.head++];
+            if (queue.head == queue.tasks.size())
+            {
+                queue.tasks.clear();
+                queue.head = 0;
+            }
+            --queued_tasks_;
+            return true;
+        }
+    }
+
+    // Then steal from the back of everyone else's
+    for (uint32_t i = 1; i < num_queues_; ++i)
+    {
+        Queue &victim = queues_[(queue_index + i) % num_queues_];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (victim.head < victim.tasks.size())
+        {
+            *out_task = victim.tasks.back();
+            victim.tasks.pop_back();
+            if (victim.head == victim.tasks.size())
+            {
+                victim.tasks.clear();
+                victim.head = 0;
+            }
+            --queued_tasks_;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::WorkerLoop(uint32_t const queue_index)
+{
+    s_queue_index = queue_index;
+    SetTraceThreadName("worker");
+
+    for (;;)
+    {
+        Task task;
+        if (PopOrSteal(queue_index, &task))
+        {
+            // The job lives on the stack of the thread that called ParallelFor, and may be gone as soon as
+            // remaining reaches 0, so it must not be touched after the decrement
+            (*task.job->task)(task.index);
+            task.job->remaining.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_lock_);
+        wake_.wait(lock, [this]() { return shutdown_ || queued_tasks_ > 0; });
+        if (shutdown_)
+        {
+            return;
+        }
+    }
+}
+
+uint32_t GetRowBandCount(ThreadPool const *pool, int32_t const rows, int32_t const min_band_rows)
+{
+    if (!pool || rows <= 0)
+    {
+        return 1;
+    }
+
+    uint32_t const max_bands = static_cast<uint32_t>(std::max(rows / std::max(min_band_rows, 1), 1));
+    return std::min(pool->GetThreadCount() * BandsPerThread, max_bands);
+}
+
+void ParallelForRows(ThreadPool *pool, int32_t const begin, int32_t const end, uint32_t const num_bands, FunctionRef<void(uint32_t, int32_t, int32_t)> const func)
+{
+    int64_t const rows = std::max(end - begin, 0);
+    auto run_band = [&](uint32_t const band)
+    {
+        TRACE_SCOPE("ParallelForRows band");
+        int32_t const band_begin = begin + static_cast<int32_t>(rows * band / num_bands);
+        int32_t const band_end = begin + static_cast<int32_t>(rows * (band + 1) / num_bands);
+        func(band, band_begin, band_end);
+    };
+
+    if (!pool || num_bands <= 1)
+    {
+        for (uint32_t band = 0; band < num_bands; ++band)
+        {
+            run_band(band);
+        }
+        return;
+    }
+
+    pool->ParallelFor(num_bands, run_band);
+}
+
+void Backoff(uint32_t *inout_attempts)
+{
+    uint32_t const attempts = (*inout_attempts)++;
+    if (attempts < 64)
+    {
+        _mm_pause();
+    }
+    else if (attempts < 128)
+    {
+        std::this_thread::yield();
+    }
+    else
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "FunctionRef.h"
+
+//
+// Work-stealing thread pool
+//
+// Each thread owns a queue. ParallelFor splits its range evenly across the queues, and a thread that runs
+// out of work steals from the back of the other queues. The calling thread takes part in the work too,
+// so a pool of N threads has N - 1 workers, and ParallelFor can safely be nested.
+//
+class ThreadPool : private NonCopyable
+{
+public:
+    ThreadPool() = default;
+    ~ThreadPool();
+
+    // num_threads includes the calling thread. 0 means one thread per hardware thread
+    bool Initialize(uint32_t const num_threads);
+
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers_.size()) + 1; }
+
+    // Runs task(i) for every i in [0, count), and returns once all of them have completed
+    void ParallelFor(uint32_t const count, FunctionRef<void(uint32_t)> const task);
+
+private:
+    struct Job
+    {
+        FunctionRef<void(uint32_t)> const *task = nullptr;
+        std::atomic<uint32_t>              remaining{ 0 };
+    };
+
+    struct Task
+    {
+        Job      *job;
+        uint32_t  index;
+    };
+
+    // Tasks [head, tasks.size()) are queued. Storage is kept once grown, so queueing doesn't allocate
+    struct Queue
+    {
+        std::mutex        lock;
+        std::vector<Task> tasks;
+        size_t            head = 0;
+    };
+
+private:
+    bool PopOrSteal(uint32_t const queue_index, Task *out_task);
+    void WorkerLoop(uint32_t const queue_index);
+
+private:
+    std::vector<std::thread> workers_;
+    std::unique_ptr<Queue[]> queues_;           // one per worker, and the last one for the calling threads
+    uint32_t                 num_queues_ = 0;
+    std::atomic<uint32_t>    queued_tasks_{ 0 };
+    std::mutex               wake_lock_;
+    std::condition_variable  wake_;
+    bool                     shutdown_ = false;
+};
+
+// Number of bands ParallelForRows splits rows into. Callers with per-band scratch use this to size it.
+// Bands are at least min_band_rows tall. A null pool always uses a single band
+uint32_t GetRowBandCount(ThreadPool const *pool, int32_t const rows, int32_t const min_band_rows);
+
+// Splits rows [begin, end) into num_bands contiguous bands, and runs func(band, band_begin, band_end) for each.
+// Bands only own their output rows: kernels read whatever halo rows they need around the band from the input.
+// Runs on the calling thread when pool is null
+void ParallelForRows(ThreadPool *pool, int32_t const begin, int32_t const end, uint32_t const num_bands, FunctionRef<void(uint32_t, int32_t, int32_t)> const func);
+
+// Spins briefly, then yields, then sleeps, for polling loops that should react quickly to what they wait for
+// without burning a core when it takes a while. Start attempts at 0, and keep passing it in while waiting
+void Backoff(uint32_t *inout_attempts);
@@ -0,0 +1,86 @@
+#include "Precomp.h"
+#include "ToolSupport.h"
+
+bool ParseCount(char const *value, uint32_t *out_count)
+{
+    char *end = nullptr;
+    long long const count = strtoll(value, &end, 10);
+    if (end == value || 0 != *end || count < 0 || count > UINT32_MAX)
+    {
+        return false;
+    }
+    *out_count = static_cast<uint32_t>(count);
+    return true;
+}
+
+bool ParseFloat(char const *value, float *out_value)
+{
+    char *end = nullptr;
+    float const parsed = strtof(value, &end);
+    if (end == value || 0 != *end || !(parsed >= 0.0f))
+    {
+        return false;
+    }
+    *out_value = parsed;
+    return true;
+}
+
+void WriteJsonString(FILE *file, char const *value)
+{
+    fputc('"', file);
+    for (char const *c = value; *c; ++c)
+    {
+        unsigned char const ch = static_cast<unsigned char>(*c);
+        if ('"' == ch || '\\' == ch)
+        {
+            fputc('\\', file);
+            fputc(ch, file);
+        }
+        else if (ch < 0x20)
+        {
+            fprintf(file, "\\u%04x", ch);
+        }
+        else
+        {
+            fputc(ch, file);
+        }
+    }
+    fputc('"', file);
+}
+
+ReportFile::~ReportFile()
+{
+    Close();
+}
+
+bool ReportFile::Create(char const *path)
+{
+    Close();
+
+    file_ = fopen(path, "w");
+    if (!file_)
+    {
+        LOGE("Failed to create [%s]", path);
+        return false;
+    }
+    path_ = path;
+    return true;
+}
+
+bool ReportFile::Close()
+{
+    if (!file_)
+    {
+        return true;
+    }
+
+    bool const written = !ferror(file_);
+    bool const closed = 0 == fclose(file_);
+    file_ = nullptr;
+    if (!written || !closed)
+    {
+        LOGE("Failed to write [%s]", path_.c_str());
+        return false;
+    }
+    return true;
+}
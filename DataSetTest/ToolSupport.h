@@ -0,0 +1,39 @@
+#pragma once
+
+//
+// Helpers shared by the headless tools
+//
+
+// Reads a count option, or returns false if it isn't a non-negative number
+bool ParseCount(char const *value, uint32_t *out_count);
+
+// Reads a non-negative number option
+bool ParseFloat(char const *value, float *out_value);
+
+// Writes value to file as a quoted JSON string, escaping quotes, backslashes (as in Windows paths) and control
+// characters
+void WriteJsonString(FILE *file, char const *value);
+
+//
+// File a tool writes its JSON report to
+//
+// Failures to create, write or close it are logged with its path. Reports print to GetFile() directly, and only
+// learn whether every write made it from Close.
+//
+class ReportFile : private NonCopyable
+{
+public:
+    ReportFile() = default;
+    ~ReportFile();
+
+    bool Create(char const *path);
+
+    FILE *GetFile() const { return file_; }
+
+    // Returns false if anything failed to be written since Create
+    bool Close();
+
+private:
+    FILE        *file_ = nullptr;
+    std::string  path_;
+};
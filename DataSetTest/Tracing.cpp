@@ -0,0 +1,134 @@
+#include "Precomp.h"
+#include "Tracing.h"
+
+#if ENABLE_TRACING
+
+std::atomic<bool> g_tracing{ false };
+
+struct TraceRecord
+{
+    char const *label;
+    uint64_t    start_ns;
+    uint64_t    end_ns;
+};
+
+// Written only by its thread. count is published with release, so a reader that acquires it sees the records
+struct TraceBuffer
+{
+    std::unique_ptr<TraceRecord[]> records{ new TraceRecord[TraceBufferCapacity] };
+    std::atomic<uint64_t>          count{ 0 };
+    uint32_t                       thread_id = 0;
+    std::string                    name;         // guarded by s_buffers_lock
+};
+
+// Buffers outlive their threads, so scopes of threads that have exited still make it into the trace. A thread
+// only gets one once it records a scope, so threads that never run while tracing cost nothing
+static std::mutex s_buffers_lock;
+static std::vector<std::unique_ptr<TraceBuffer>> s_buffers;
+static std::atomic<uint64_t> s_start_ns{ 0 };
+static thread_local TraceBuffer *s_thread_buffer = nullptr;
+static thread_local std::string s_thread_name;
+
+static TraceBuffer *GetThreadBuffer()
+{
+    if (!s_thread_buffer)
+    {
+        std::lock_guard<std::mutex> lock(s_buffers_lock);
+        s_buffers.push_back(std::make_unique<TraceBuffer>());
+        s_thread_buffer = s_buffers.back().get();
+        s_thread_buffer->thread_id = static_cast<uint32_t>(s_buffers.size());
+        s_thread_buffer->name = s_thread_name;
+    }
+    return s_thread_buffer;
+}
+
+void StartTracing()
+{
+    s_start_ns.store(GetTraceTime(), std::memory_order_relaxed);
+    g_tracing.store(true, std::memory_order_release);
+}
+
+void StopTracing()
+{
+    g_tracing.store(false, std::memory_order_release);
+}
+
+void RecordTraceScope(char const *label, uint64_t const start_ns, uint64_t const end_ns)
+{
+    // Scopes still open when tracing stopped are dropped, so nothing is written once it has
+    if (!IsTracing())
+    {
+        return;
+    }
+
+    TraceBuffer *buffer = GetThreadBuffer();
+    uint64_t const count = buffer->count.load(std::memory_order_relaxed);
+    TraceRecord &record = buffer->records[count & (TraceBufferCapacity - 1)];
+    record.label = label;
+    record.start_ns = start_ns;
+    record.end_ns = end_ns;
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+void SetTraceThreadName(char const *name)
+{
+    s_thread_name = name;
+    if (s_thread_buffer)
+    {
+        std::lock_guard<std::mutex> lock(s_buffers_lock);
+        s_thread_buffer->name = name;
+    }
+}
+
+bool WriteChromeTrace(char const *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        LOGE("Failed to create [%s]", path);
+        return false;
+    }
+
+    // Timestamps are microseconds since StartTracing. Labels are literals, so they are written without escaping
+    uint64_t const start_ns = s_start_ns.load(std::memory_order_relaxed);
+    uint64_t written = 0;
+    fprintf(file, "{\"traceEvents\":[\n");
+    {
+        std::lock_guard<std::mutex> lock(s_buffers_lock);
+        for (auto const &buffer : s_buffers)
+        {
+            if (!buffer->name.empty())
+            {
+                fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}\n",
+                    written++ ? "," : "", buffer->thread_id, buffer->name.c_str());
+            }
+
+            uint64_t const count = buffer->count.load(std::memory_order_acquire);
+            uint64_t const first = count > TraceBufferCapacity ? count - TraceBufferCapacity : 0;
+            for (uint64_t i = first; i < count; ++i)
+            {
+                TraceRecord const &record = buffer->records[i & (TraceBufferCapacity - 1)];
+                if (record.start_ns < start_ns)
+                {
+                    continue;
+                }
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}\n",
+                    written++ ? "," : "", record.label, buffer->thread_id,
+                    (record.start_ns - start_ns) / 1000.0, (record.end_ns - record.start_ns) / 1000.0);
+            }
+        }
+    }
+    fprintf(file, "]}\n");
+
+    bool const failed = 0 != ferror(file);
+    if (0 != fclose(file) || failed)
+    {
+        LOGE("Failed to write [%s]", path);
+        return false;
+    }
+
+    LOGI("Wrote %" PRIu64 " trace events to [%s]", written, path);
+    return true;
+}
+
+#endif
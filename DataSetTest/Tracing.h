@@ -0,0 +1,81 @@
+#pragma once
+
+// Builds without it compile every TRACE_SCOPE to nothing
+#ifndef ENABLE_TRACING
+#define ENABLE_TRACING 1
+#endif
+
+#if ENABLE_TRACING
+
+//
+// Scoped hot path tracing
+//
+// While tracing is started, every TRACE_SCOPE records its label, and when it was entered and left, into a ring
+// buffer of the thread it ran on. Each thread only ever writes its own buffer, so recording takes no locks, and
+// costs two clock reads and a few stores. Buffers keep the latest TraceBufferCapacity scopes of their thread.
+// When tracing is stopped, scopes cost a single relaxed load.
+//
+// WriteChromeTrace dumps what was recorded as Chrome trace event JSON, which chrome://tracing and
+// ui.perfetto.dev display as a timeline per thread.
+//
+
+// Scopes each thread keeps, the oldest being overwritten first
+static uint32_t const TraceBufferCapacity = 1 << 16;
+
+extern std::atomic<bool> g_tracing;
+
+// Starts recording on every thread. Scopes recorded before are dropped
+void StartTracing();
+void StopTracing();
+
+inline bool IsTracing() { return g_tracing.load(std::memory_order_relaxed); }
+
+// Nanoseconds on a monotonic clock, never 0
+inline uint64_t GetTraceTime()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()) | 1;
+}
+
+// Records a completed scope on the calling thread. label must stay valid until the trace is written
+void RecordTraceScope(char const *label, uint64_t const start_ns, uint64_t const end_ns);
+
+// Name the calling thread shows up with in the trace
+void SetTraceThreadName(char const *name);
+
+// Writes every thread's scopes since StartTracing. Stop tracing first, as buffers are read without locks
+bool WriteChromeTrace(char const *path);
+
+class TraceScope : private NonCopyable
+{
+public:
+    explicit TraceScope(char const *label) : label_(label), start_ns_(IsTracing() ? GetTraceTime() : 0) {}
+    ~TraceScope()
+    {
+        if (start_ns_)
+        {
+            RecordTraceScope(label_, start_ns_, GetTraceTime());
+        }
+    }
+
+private:
+    char const *label_;
+    uint64_t    start_ns_;     // 0 when tracing was stopped on entry
+};
+
+#define TRACE_CONCATENATE_INNER(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_INNER(a, b)
+
+// Traces the rest of the enclosing scope. label must be a string literal, or otherwise outlive the trace
+#define TRACE_SCOPE(label) TraceScope TRACE_CONCATENATE(trace_scope_, __LINE__)(label)
+
+#else
+
+inline void StartTracing() {}
+inline void StopTracing() {}
+inline bool IsTracing() { return false; }
+inline void SetTraceThreadName(char const *) {}
+inline bool WriteChromeTrace(char const *) { LOGE("Tracing isn't compiled in"); return false; }
+
+#define TRACE_SCOPE(label)
+
+#endif
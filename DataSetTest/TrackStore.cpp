@@ -0,0 +1,162 @@
+#include "Precomp.h"
+#include "TrackStore.h"
+
+// Every array in the arena starts on a cache line
+static size_t const ArenaAlignment = 64;
+
+template <typename T>
+size_t TrackStore::Reserve(size_t const count, size_t *inout_size)
+{
+    size_t const offset = (*inout_size + ArenaAlignment - 1) & ~(ArenaAlignment - 1);
+    *inout_size = offset + count * sizeof(T);
+    return offset;
+}
+
+bool TrackStore::Initialize(uint32_t const capacity, uint32_t const history_length)
+{
+    if (0 == capacity || 0 == history_length)
+    {
+        LOGE("Track store needs a capacity and history length");
+        return false;
+    }
+
+    size_t const history_size = static_cast<size_t>(capacity) * history_length;
+
+    size_t size = 0;
+    size_t const ids_offset = Reserve<uint64_t>(capacity, &size);
+    size_t const first_frames_offset = Reserve<uint32_t>(capacity, &size);
+    size_t const last_frames_offset = Reserve<uint32_t>(capacity, &size);
+    size_t const frame_counts_offset = Reserve<uint32_t>(capacity, &size);
+    size_t const xs_offset = Reserve<float>(capacity, &size);
+    size_t const ys_offset = Reserve<float>(capacity, &size);
+    size_t const descriptors_offset = Reserve<BriefDescriptor>(capacity, &size);
+    size_t const history_xs_offset = Reserve<float>(history_size, &size);
+    size_t const history_ys_offset = Reserve<float>(history_size, &size);
+    size_t const history_heads_offset = Reserve<uint32_t>(capacity, &size);
+    size_t const live_indices_offset = Reserve<uint32_t>(capacity, &size);
+    size_t const live_offset = Reserve<uint32_t>(capacity, &size);
+    size_t const free_offset = Reserve<uint32_t>(capacity, &size);
+
+    // new[] only guarantees fundamental alignment, so the base is aligned by hand
+    arena_.reset(new (std::nothrow) uint8_t[size + ArenaAlignment]);
+    if (!arena_)
+    {
+        LOGE("Failed to allocate track store of %zu bytes", size);
+        return false;
+    }
+    uint8_t *base = arena_.get() + ((ArenaAlignment - reinterpret_cast<uintptr_t>(arena_.get()) % ArenaAlignment) % ArenaAlignment);
+
+    ids_ = reinterpret_cast<uint64_t *>(base + ids_offset);
+    first_frames_ = reinterpret_cast<uint32_t *>(base + first_frames_offset);
+    last_frames_ = reinterpret_cast<uint32_t *>(base + last_frames_offset);
+    frame_counts_ = reinterpret_cast<uint32_t *>(base + frame_counts_offset);
+    xs_ = reinterpret_cast<float *>(base + xs_offset);
+    ys_ = reinterpret_cast<float *>(base + ys_offset);
+    descriptors_ = reinterpret_cast<BriefDescriptor *>(base + descriptors_offset);
+    history_xs_ = reinterpret_cast<float *>(base + history_xs_offset);
+    history_ys_ = reinterpret_cast<float *>(base + history_ys_offset);
+    history_heads_ = reinterpret_cast<uint32_t *>(base + history_heads_offset);
+    live_indices_ = reinterpret_cast<uint32_t *>(base + live_indices_offset);
+    live_ = reinterpret_cast<uint32_t *>(base + live_offset);
+    free_ = reinterpret_cast<uint32_t *>(base + free_offset);
+
+    capacity_ = capacity;
+    history_length_ = history_length;
+    Clear();
+
+    LOGD("Allocated track store for %u tracks, %zu bytes", capacity, size);
+    return true;
+}
+
+void TrackStore::Clear()
+{
+    live_count_ = 0;
+
+    // Lowest slots are handed out first
+    free_count_ = capacity_;
+    for (uint32_t i = 0; i < capacity_; ++i)
+    {
+        free_[i] = capacity_ - 1 - i;
+    }
+}
+
+uint32_t TrackStore::Insert(float const x, float const y, BriefDescriptor const &descriptor)
+{
+    if (0 == free_count_)
+    {
+        return InvalidSlot;
+    }
+
+    uint32_t const slot = free_[--free_count_];
+    live_indices_[slot] = live_count_;
+    live_[live_count_++] = slot;
+
+    ids_[slot] = next_id_++;
+    first_frames_[slot] = frame_;
+    frame_counts_[slot] = 0;
+    history_heads_[slot] = history_length_ - 1;
+    Update(slot, x, y, descriptor);
+    return slot;
+}
+
+void TrackStore::Update(uint32_t const slot, float const x, float const y, BriefDescriptor const &descriptor)
+{
+    last_frames_[slot] = frame_;
+    ++frame_counts_[slot];
+    xs_[slot] = x;
+    ys_[slot] = y;
+    descriptors_[slot] = descriptor;
+
+    uint32_t const head = (history_heads_[slot] + 1 == history_length_) ? 0 : history_heads_[slot] + 1;
+    size_t const history_index = static_cast<size_t>(slot) * history_length_ + head;
+    history_xs_[history_index] = x;
+    history_ys_[history_index] = y;
+    history_heads_[slot] = head;
+}
+
+void TrackStore::Evict(uint32_t const slot)
+{
+    // Move the last live slot into the hole
+    uint32_t const index = live_indices_[slot];
+    uint32_t const last = live_[--live_count_];
+    live_[index] = last;
+    live_indices_[last] = index;
+
+    free_[free_count_++] = slot;
+}
+
+void TrackStore::EvictStale(uint32_t const max_missed)
+{
+    // Walk backwards, so slots moved into evicted ones have already been visited
+    for (uint32_t i = live_count_; i > 0; --i)
+    {
+        uint32_t const slot = live_[i - 1];
+        if (frame_ - last_frames_[slot] > max_missed)
+        {
+            Evict(slot);
+        }
+    }
+}
+
+void TrackStore::GetHistory(uint32_t const slot, uint32_t const index, float *out_x, float *out_y) const
+{
+    assert(index < GetHistoryCount(slot));
+
+    uint32_t const head = history_heads_[slot];
+    uint32_t const ring_index = (head >= index) ? head - index : head + history_length_ - index;
+    size_t const history_index = static_cast<size_t>(slot) * history_length_ + ring_index;
+    *out_x = history_xs_[history_index];
+    *out_y = history_ys_[history_index];
+}
+
+void TrackStore::GetSurvivingTracks(uint32_t const min_frames, std::vector<uint32_t> *out_slots) const
+{
+    for (uint32_t i = 0; i < live_count_; ++i)
+    {
+        uint32_t const slot = live_[i];
+        if (frame_counts_[slot] > min_frames)
+        {
+            out_slots->push_back(slot);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "BriefDescriptor.h"
+
+//
+// Persistent feature tracks
+//
+// Every track has an id that is never reused, the frame it started on and the number of frames it was observed
+// in, its last descriptor, and a ring of its most recent positions.
+//
+// Tracks live in slots. All per-slot state is structure-of-arrays, carved out of a single arena allocated by
+// Initialize, so inserting, updating and evicting tracks never touches the heap. Free slots are a stack, and
+// live slots a dense list where an evicted slot is swapped with the last one, so both insert & evict are O(1).
+// A slot stays the same for the life of its track, but is reused once the track is evicted.
+//
+class TrackStore : private NonCopyable
+{
+public:
+    static uint32_t const InvalidSlot = 0xFFFFFFFF;
+
+public:
+    TrackStore() = default;
+
+    // Allocates room for capacity tracks of history_length positions each, and clears the store
+    bool Initialize(uint32_t const capacity, uint32_t const history_length);
+
+    // Evicts every track. Ids keep increasing
+    void Clear();
+
+    // Starts a new frame. Tracks inserted or updated until the next call are observed on it
+    void BeginFrame() { ++frame_; }
+    uint32_t GetFrame() const { return frame_; }
+
+    // Starts a track observed on the current frame. Returns its slot, or InvalidSlot when the store is full
+    uint32_t Insert(float const x, float const y, BriefDescriptor const &descriptor);
+
+    // Records a new observation of the track in slot on the current frame
+    void Update(uint32_t const slot, float const x, float const y, BriefDescriptor const &descriptor);
+
+    void Evict(uint32_t const slot);
+
+    // Evicts tracks that weren't observed in the last max_missed frames
+    void EvictStale(uint32_t const max_missed);
+
+    uint32_t GetCount() const { return live_count_; }
+    uint32_t GetCapacity() const { return capacity_; }
+    uint32_t GetHistoryLength() const { return history_length_; }
+
+    // Slots of every live track. Evicting reorders them
+    uint32_t const *GetSlots() const { return live_; }
+
+    uint64_t GetId(uint32_t const slot) const { return ids_[slot]; }
+    uint32_t GetFirstFrame(uint32_t const slot) const { return first_frames_[slot]; }
+    uint32_t GetLastFrame(uint32_t const slot) const { return last_frames_[slot]; }
+    uint32_t GetFrameCount(uint32_t const slot) const { return frame_counts_[slot]; }
+    float GetX(uint32_t const slot) const { return xs_[slot]; }
+    float GetY(uint32_t const slot) const { return ys_[slot]; }
+    BriefDescriptor const &GetDescriptor(uint32_t const slot) const { return descriptors_[slot]; }
+
+    // Number of positions in the history of slot, up to the history length
+    uint32_t GetHistoryCount(uint32_t const slot) const { return std::min(frame_counts_[slot], history_length_); }
+
+    // Position index observations ago, 0 being the last one. index must be below GetHistoryCount
+    void GetHistory(uint32_t const slot, uint32_t const index, float *out_x, float *out_y) const;
+
+    // Appends the slots of tracks observed in more than min_frames frames to out_slots
+    void GetSurvivingTracks(uint32_t const min_frames, std::vector<uint32_t> *out_slots) const;
+
+private:
+    // Reserves count elements of T at the end of the arena layout, and returns their offset
+    template <typename T>
+    static size_t Reserve(size_t const count, size_t *inout_size);
+
+private:
+    std::unique_ptr<uint8_t[]> arena_;
+    uint32_t                   capacity_ = 0;
+    uint32_t                   history_length_ = 0;
+    uint32_t                   frame_ = 0;
+    uint64_t                   next_id_ = 0;
+
+    // Per slot, in the arena
+    uint64_t        *ids_ = nullptr;
+    uint32_t        *first_frames_ = nullptr;
+    uint32_t        *last_frames_ = nullptr;
+    uint32_t        *frame_counts_ = nullptr;
+    float           *xs_ = nullptr;
+    float           *ys_ = nullptr;
+    BriefDescriptor *descriptors_ = nullptr;
+    float           *history_xs_ = nullptr;   // history_length_ per slot, as a ring
+    float           *history_ys_ = nullptr;
+    uint32_t        *history_heads_ = nullptr; // ring index of the last position
+    uint32_t        *live_indices_ = nullptr;  // index of each live slot in live_
+
+    uint32_t        *live_ = nullptr;          // live_count_ live slots
+    uint32_t         live_count_ = 0;
+    uint32_t        *free_ = nullptr;          // stack of free_count_ free slots
+    uint32_t         free_count_ = 0;
+};
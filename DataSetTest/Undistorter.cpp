@@ -0,0 +1,180 @@
+#include "Precomp.h"
+#include "Undistorter.h"
+#include "ThreadPool.h"
+
+// Where output pixel (x, y) samples the input, or false when that is outside of it
+static bool GetSourcePosition(CameraModel const &model, int32_t const x, int32_t const y, int32_t const width, int32_t const height, double *out_u, double *out_v)
+{
+    DistortPoint(model, (x - model.cx) / model.fx, (y - model.cy) / model.fy, out_u, out_v);
+    return *out_u >= 0.0 && *out_u <= width - 1 && *out_v >= 0.0 && *out_v <= height - 1;
+}
+
+bool Undistorter::Initialize(CameraModel const &model, uint32_t const width, uint32_t const height)
+{
+    if (width < 2 || height < 2)
+    {
+        LOGE("Can't undistort %ux%u frames", width, height);
+        return false;
+    }
+
+    width_ = width;
+    height_ = height;
+    offsets_.resize(static_cast<size_t>(width) * height);
+    weights_.resize(offsets_.size());
+
+    int32_t const w = static_cast<int32_t>(width);
+    int32_t const h = static_cast<int32_t>(height);
+    double const fraction_scale = static_cast<double>(1 << RemapFractionBits);
+    for (int32_t y = 0; y < h; ++y)
+    {
+        for (int32_t x = 0; x < w; ++x)
+        {
+            size_t const i = static_cast<size_t>(y) * w + x;
+            double u = 0;
+            double v = 0;
+            if (!GetSourcePosition(model, x, y, w, h, &u, &v))
+            {
+                offsets_[i] = -1;
+                weights_[i] = 0;
+                continue;
+            }
+
+            // The neighborhood stays inside the frame, so samples on the last row or column get a weight of 1
+            int32_t const x0 = std::min(static_cast<int32_t>(u), w - 2);
+            int32_t const y0 = std::min(static_cast<int32_t>(v), h - 2);
+            uint32_t const fraction_x = static_cast<uint32_t>(lround((u - x0) * fraction_scale));
+            uint32_t const fraction_y = static_cast<uint32_t>(lround((v - y0) * fraction_scale));
+
+            offsets_[i] = y0 * w + x0;
+            weights_[i] = fraction_x | (fraction_y << 16);
+        }
+    }
+
+    LOGD("Built undistortion table for %ux%u frames", width, height);
+    return true;
+}
+
+void Undistorter::RemapRow(uint8_t const *input, int32_t const y, uint8_t *output) const
+{
+    int32_t const width = static_cast<int32_t>(width_);
+    int32_t const *offsets = offsets_.data() + static_cast<size_t>(y) * width;
+    uint32_t const *weights = weights_.data() + static_cast<size_t>(y) * width;
+    int32_t const round = 1 << (2 * RemapFractionBits - 1);
+
+    int32_t x = 0;
+
+#ifdef __AVX2__
+    // Each lane gathers 4 bytes holding its top pair of pixels first, and 4 bytes ending with its bottom pair,
+    // so neither gather reads past the frame
+    __m256i const outside = _mm256_set1_epi32(-1);
+    __m256i const byte_mask = _mm256_set1_epi32(0xFF);
+    __m256i const fraction_mask = _mm256_set1_epi32(0xFFFF);
+    __m256i const rounding = _mm256_set1_epi32(round);
+    int const *top_base = reinterpret_cast<int const *>(input);
+    int const *bottom_base = reinterpret_cast<int const *>(input + width - 2);
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i const offset = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(offsets + x));
+        __m256i const inside = _mm256_cmpgt_epi32(offset, outside);
+        __m256i const top = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), top_base, offset, inside, 1);
+        __m256i const bottom = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), bottom_base, offset, inside, 1);
+
+        __m256i const weight = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(weights + x));
+        __m256i const fraction_x = _mm256_and_si256(weight, fraction_mask);
+        __m256i const fraction_y = _mm256_srli_epi32(weight, 16);
+
+        __m256i const p00 = _mm256_and_si256(top, byte_mask);
+        __m256i const p01 = _mm256_and_si256(_mm256_srli_epi32(top, 8), byte_mask);
+        __m256i const p10 = _mm256_and_si256(_mm256_srli_epi32(bottom, 16), byte_mask);
+        __m256i const p11 = _mm256_srli_epi32(bottom, 24);
+
+        __m256i const upper = _mm256_add_epi32(_mm256_slli_epi32(p00, RemapFractionBits), _mm256_mullo_epi32(_mm256_sub_epi32(p01, p00), fraction_x));
+        __m256i const lower = _mm256_add_epi32(_mm256_slli_epi32(p10, RemapFractionBits), _mm256_mullo_epi32(_mm256_sub_epi32(p11, p10), fraction_x));
+        __m256i blended = _mm256_add_epi32(_mm256_slli_epi32(upper, RemapFractionBits), _mm256_mullo_epi32(_mm256_sub_epi32(lower, upper), fraction_y));
+        blended = _mm256_srli_epi32(_mm256_add_epi32(blended, rounding), 2 * RemapFractionBits);
+
+        // 8 x 32 bits down to 8 bytes. Packing works within 128-bit lanes, so each lane ends up with 4 of them
+        __m256i const packed16 = _mm256_packus_epi32(blended, blended);
+        __m256i const packed8 = _mm256_packus_epi16(packed16, packed16);
+        uint32_t const low = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm256_castsi256_si128(packed8)));
+        uint32_t const high = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm256_extracti128_si256(packed8, 1)));
+        uint64_t const result = low | (static_cast<uint64_t>(high) << 32);
+        memcpy(output + x, &result, sizeof(result));
+    }
+#endif
+
+    for (; x < width; ++x)
+    {
+        int32_t const offset = offsets[x];
+        if (offset < 0)
+        {
+            output[x] = 0;
+            continue;
+        }
+
+        int32_t const fraction_x = static_cast<int32_t>(weights[x] & 0xFFFF);
+        int32_t const fraction_y = static_cast<int32_t>(weights[x] >> 16);
+        uint8_t const *source = input + offset;
+
+        int32_t const upper = (source[0] << RemapFractionBits) + (source[1] - source[0]) * fraction_x;
+        int32_t const lower = (source[width] << RemapFractionBits) + (source[width + 1] - source[width]) * fraction_x;
+        output[x] = static_cast<uint8_t>(((upper << RemapFractionBits) + (lower - upper) * fraction_y + round) >> (2 * RemapFractionBits));
+    }
+}
+
+void Undistorter::Undistort(uint8_t const *input, uint8_t *output) const
+{
+    TRACE_SCOPE("Undistorter::Undistort");
+    int32_t const width = static_cast<int32_t>(width_);
+    int32_t const height = static_cast<int32_t>(height_);
+
+    uint32_t const num_bands = GetRowBandCount(pool_, height, 8);
+    ParallelForRows(pool_, 0, height, num_bands, [&](uint32_t, int32_t const y_begin, int32_t const y_end)
+    {
+        for (int32_t y = y_begin; y < y_end; ++y)
+        {
+            RemapRow(input, y, output + static_cast<size_t>(y) * width);
+        }
+    });
+}
+
+bool Undistorter::Undistort(BufferPool *pool, CameraFrame *inout_frame) const
+{
+    if (inout_frame->width != width_ || inout_frame->height != height_)
+    {
+        LOGE("Undistorter is set up for %ux%u frames, not %ux%u", width_, height_, inout_frame->width, inout_frame->height);
+        return false;
+    }
+
+    ImageBuffer undistorted = pool->Acquire(static_cast<size_t>(width_) * height_);
+    Undistort(inout_frame->pixels.GetData(), undistorted.GetData());
+    inout_frame->pixels = std::move(undistorted);
+    return true;
+}
+
+void UndistortImageReference(CameraModel const &model, uint8_t const *input, int32_t const width, int32_t const height, uint8_t *output)
+{
+    for (int32_t y = 0; y < height; ++y)
+    {
+        for (int32_t x = 0; x < width; ++x)
+        {
+            double u = 0;
+            double v = 0;
+            if (!GetSourcePosition(model, x, y, width, height, &u, &v))
+            {
+                output[y * width + x] = 0;
+                continue;
+            }
+
+            int32_t const x0 = std::min(static_cast<int32_t>(u), width - 2);
+            int32_t const y0 = std::min(static_cast<int32_t>(v), height - 2);
+            float const fraction_x = static_cast<float>(u - x0);
+            float const fraction_y = static_cast<float>(v - y0);
+            uint8_t const *source = input + y0 * width + x0;
+
+            float const upper = source[0] + (source[1] - source[0]) * fraction_x;
+            float const lower = source[width] + (source[width + 1] - source[width]) * fraction_x;
+            output[y * width + x] = static_cast<uint8_t>(upper + (lower - upper) * fraction_y + 0.5f);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "CameraModel.h"
+#include "FrameProvider.h"
+
+class ThreadPool;
+
+// Fractional bits of the bilinear weights in the remap table
+static int32_t const RemapFractionBits = 8;
+
+//
+// Removes lens distortion from whole frames
+//
+// Initialize evaluates the camera model once per output pixel, and stores where it samples the input as the
+// offset of the top left of its 2x2 neighborhood plus fixed point bilinear weights. Undistorting a frame is
+// then just gathers and integer blending, 8 pixels at a time with AVX2. Undistorted frames keep the intrinsics
+// of the model, and pixels that see outside the distorted frame are black.
+//
+class Undistorter : private NonCopyable
+{
+public:
+    Undistorter() = default;
+
+    // Optional. Frames are remapped on the calling thread when there is no pool
+    void SetThreadPool(ThreadPool *pool) { pool_ = pool; }
+
+    // Builds the remap table for width x height frames
+    bool Initialize(CameraModel const &model, uint32_t const width, uint32_t const height);
+
+    uint32_t GetWidth() const { return width_; }
+    uint32_t GetHeight() const { return height_; }
+
+    // Remaps input into output, both width x height with a stride of width
+    void Undistort(uint8_t const *input, uint8_t *output) const;
+
+    // Replaces the pixels of frame with an undistorted copy, in a buffer from pool
+    bool Undistort(BufferPool *pool, CameraFrame *inout_frame) const;
+
+private:
+    void RemapRow(uint8_t const *input, int32_t const y, uint8_t *output) const;
+
+private:
+    ThreadPool           *pool_ = nullptr;
+    uint32_t              width_ = 0;
+    uint32_t              height_ = 0;
+    std::vector<int32_t>  offsets_;  // of the top left input pixel, or -1 when outside the frame
+    std::vector<uint32_t> weights_;  // x fraction | y fraction << 16, each in [0, 1 << RemapFractionBits]
+};
+
+// Floating point version of Undistorter, evaluating the camera model at every pixel. Undistorter matches it
+// to within 1
+void UndistortImageReference(CameraModel const &model, uint8_t const *input, int32_t const width, int32_t const height, uint8_t *output);
@@ -1,5 +1,6 @@
 #include "Precomp.h"
 #include "Utilities.h"
+#include "ThreadPool.h"
 
 static float const Pi = 3.141592654f;
 
@@ -17,16 +18,197 @@ void GenerateGaussian(float const sigma, uint32_t const size, GaussianKernel *ou
         sum += out_kernel->values.back();
     }
     out_kernel->scale = 1.0f / sum;
+
+    // Quantize the normalized taps, and fold the rounding error into the center tap
+    // so the fixed point kernel preserves brightness exactly
+    int32_t fixed_sum = 0;
+    out_kernel->fixed_values.clear();
+    for (float const value : out_kernel->values)
+    {
+        int32_t const fixed = static_cast<int32_t>(lroundf(value * out_kernel->scale * (1 << GaussianFixedShift)));
+        out_kernel->fixed_values.push_back(static_cast<int16_t>(fixed));
+        fixed_sum += fixed;
+    }
+    out_kernel->fixed_values[size / 2] += static_cast<int16_t>((1 << GaussianFixedShift) - fixed_sum);
+}
+
+static inline int32_t Clamp(int32_t const value, int32_t const min_value, int32_t const max_value)
+{
+    return std::min(std::max(value, min_value), max_value);
+}
+
+// NumTaps > 0 fixes the tap count at compile time, so the tap loops fully unroll. NumTaps == 0 uses runtime_num_taps
+template <int32_t NumTaps>
+static void ConvolveFixedTaps(uint8_t const * const *sources, int16_t const *taps, int32_t const runtime_num_taps, int32_t const count, uint8_t *output)
+{
+    int32_t const num_taps = NumTaps > 0 ? NumTaps : runtime_num_taps;
+    int32_t x = 0;
+
+    // Taps are processed in pairs: interleaving two source rows lets madd do two multiply-adds per 32-bit lane
+#ifdef __AVX2__
+    __m256i const round = _mm256_set1_epi32(1 << (GaussianFixedShift - 1));
+    for (; x + 16 <= count; x += 16)
+    {
+        __m256i accum_lo = round;
+        __m256i accum_hi = round;
+        for (int32_t k = 0; k < num_taps; k += 2)
+        {
+            bool const has_pair = k + 1 < num_taps;
+            __m256i const a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(sources[k] + x)));
+            __m256i const b = has_pair ? _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(sources[k + 1] + x))) : _mm256_setzero_si256();
+            __m256i const tap_pair = _mm256_set1_epi32((has_pair ? (taps[k + 1] << 16) : 0) | static_cast<uint16_t>(taps[k]));
+            accum_lo = _mm256_add_epi32(accum_lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), tap_pair));
+            accum_hi = _mm256_add_epi32(accum_hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), tap_pair));
+        }
+        accum_lo = _mm256_srai_epi32(accum_lo, GaussianFixedShift);
+        accum_hi = _mm256_srai_epi32(accum_hi, GaussianFixedShift);
+
+        // unpack/pack work within 128-bit lanes, so only the final 64-bit halves need reordering
+        __m256i const words = _mm256_packs_epi32(accum_lo, accum_hi);
+        __m256i const bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + x), _mm256_castsi256_si128(bytes));
+    }
+#endif
+
+    __m128i const round4 = _mm_set1_epi32(1 << (GaussianFixedShift - 1));
+    for (; x + 8 <= count; x += 8)
+    {
+        __m128i accum_lo = round4;
+        __m128i accum_hi = round4;
+        for (int32_t k = 0; k < num_taps; k += 2)
+        {
+            bool const has_pair = k + 1 < num_taps;
+            __m128i const a = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(sources[k] + x)));
+            __m128i const b = has_pair ? _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(sources[k + 1] + x))) : _mm_setzero_si128();
+            __m128i const tap_pair = _mm_set1_epi32((has_pair ? (taps[k + 1] << 16) : 0) | static_cast<uint16_t>(taps[k]));
+            accum_lo = _mm_add_epi32(accum_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), tap_pair));
+            accum_hi = _mm_add_epi32(accum_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), tap_pair));
+        }
+        accum_lo = _mm_srai_epi32(accum_lo, GaussianFixedShift);
+        accum_hi = _mm_srai_epi32(accum_hi, GaussianFixedShift);
+
+        __m128i const words = _mm_packs_epi32(accum_lo, accum_hi);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(output + x), _mm_packus_epi16(words, words));
+    }
+
+    for (; x < count; ++x)
+    {
+        int32_t accum = 1 << (GaussianFixedShift - 1);
+        for (int32_t k = 0; k < num_taps; ++k)
+        {
+            accum += taps[k] * sources[k][x];
+        }
+        output[x] = static_cast<uint8_t>(accum >> GaussianFixedShift);
+    }
+}
+
+void ConvolveFixed(uint8_t const * const *sources, int16_t const *taps, int32_t const num_taps, int32_t const count, uint8_t *output)
+{
+    switch (num_taps)
+    {
+    case 3:  ConvolveFixedTaps<3>(sources, taps, num_taps, count, output); break;
+    case 5:  ConvolveFixedTaps<5>(sources, taps, num_taps, count, output); break;
+    case 7:  ConvolveFixedTaps<7>(sources, taps, num_taps, count, output); break;
+    case 9:  ConvolveFixedTaps<9>(sources, taps, num_taps, count, output); break;
+    default: ConvolveFixedTaps<0>(sources, taps, num_taps, count, output); break;
+    }
+}
+
+void SmoothRowHorizontal(uint8_t const *input, int32_t const width, GaussianKernel const &kernel, uint8_t *output)
+{
+    int32_t const num_taps = static_cast<int32_t>(kernel.fixed_values.size());
+    int32_t const radius = num_taps / 2;
+    int16_t const *taps = kernel.fixed_values.data();
+
+    assert(num_taps <= MaxKernelTaps);
+
+    // Columns whose footprint falls off either edge are clamped one pixel at a time
+    int32_t const interior_begin = std::min(radius, width);
+    int32_t const interior_end = std::max(width - radius, interior_begin);
+    auto convolve_clamped = [&](int32_t const x)
+    {
+        int32_t accum = 1 << (GaussianFixedShift - 1);
+        for (int32_t k = 0; k < num_taps; ++k)
+        {
+            accum += taps[k] * input[Clamp(x - radius + k, 0, width - 1)];
+        }
+        output[x] = static_cast<uint8_t>(accum >> GaussianFixedShift);
+    };
+
+    for (int32_t x = 0; x < interior_begin; ++x)
+    {
+        convolve_clamped(x);
+    }
+
+    uint8_t const *sources[MaxKernelTaps];
+    for (int32_t k = 0; k < num_taps; ++k)
+    {
+        sources[k] = input + k;
+    }
+    ConvolveFixed(sources, taps, num_taps, interior_end - interior_begin, output + interior_begin);
+
+    for (int32_t x = interior_end; x < width; ++x)
+    {
+        convolve_clamped(x);
+    }
 }
 
-void SmoothImage(uint8_t const *input, int32_t const width, int32_t const height, GaussianKernel const &kernel, uint8_t *scratch, uint8_t *output)
+void SmoothRowVertical(uint8_t const * const *rows, int32_t const width, GaussianKernel const &kernel, uint8_t *output)
 {
+    ConvolveFixed(rows, kernel.fixed_values.data(), static_cast<int32_t>(kernel.fixed_values.size()), width, output);
+}
+
+void SmoothImage(uint8_t const *input, int32_t const width, int32_t const height, GaussianKernel const &kernel, uint8_t *scratch, uint8_t *output, ThreadPool *pool)
+{
+    TRACE_SCOPE("SmoothImage");
+    int32_t const num_taps = static_cast<int32_t>(kernel.fixed_values.size());
+    int32_t const radius = num_taps / 2;
+
+    assert(num_taps <= MaxKernelTaps);
+
+    uint32_t const num_bands = GetRowBandCount(pool, height, 8);
+
+    // horizontal pass
+    ParallelForRows(pool, 0, height, num_bands, [&](uint32_t, int32_t const y_begin, int32_t const y_end)
+    {
+        for (int32_t y = y_begin; y < y_end; ++y)
+        {
+            SmoothRowHorizontal(input + y * width, width, kernel, scratch + y * width);
+        }
+    });
+
+    // vertical pass. Bands read radius rows of the horizontal pass above and below themselves,
+    // which is why the passes can't be fused per band without recomputing those rows
+    ParallelForRows(pool, 0, height, num_bands, [&](uint32_t, int32_t const y_begin, int32_t const y_end)
+    {
+        uint8_t const *rows[MaxKernelTaps];
+        for (int32_t y = y_begin; y < y_end; ++y)
+        {
+            for (int32_t k = 0; k < num_taps; ++k)
+            {
+                rows[k] = scratch + Clamp(y - radius + k, 0, height - 1) * width;
+            }
+            SmoothRowVertical(rows, width, kernel, output + y * width);
+        }
+    });
+}
+
+void SmoothImageReference(uint8_t const *input, int32_t const width, int32_t const height, GaussianKernel const &kernel, uint8_t *scratch, uint8_t *output)
+{
+    int32_t const num_taps = static_cast<int32_t>(kernel.values.size());
+    int32_t const radius = num_taps / 2;
+
     // horizontal pass
     for (int32_t y = 0; y < height; ++y)
     {
         for (int32_t x = 0; x < width; ++x)
         {
-            scratch[y * width + x] = static_cast<uint8_t>(Convolve(input, width, x, y, kernel.values.data(), 1, static_cast<int32_t>(kernel.values.size())) * kernel.scale);
+            float accum = 0.0f;
+            for (int32_t k = 0; k < num_taps; ++k)
+            {
+                accum += kernel.values[k] * input[y * width + Clamp(x - radius + k, 0, width - 1)];
+            }
+            scratch[y * width + x] = static_cast<uint8_t>(accum * kernel.scale + 0.5f);
         }
     }
 
@@ -35,12 +217,17 @@ void SmoothImage(uint8_t const *input, int32_t const width, int32_t const height
     {
         for (int32_t x = 0; x < width; ++x)
         {
-            output[y * width + x] = static_cast<uint8_t>(Convolve(scratch, width, x, y, kernel.values.data(), static_cast<int32_t>(kernel.values.size()), 1) * kernel.scale);
+            float accum = 0.0f;
+            for (int32_t k = 0; k < num_taps; ++k)
+            {
+                accum += kernel.values[k] * scratch[Clamp(y - radius + k, 0, height - 1) * width + x];
+            }
+            output[y * width + x] = static_cast<uint8_t>(accum * kernel.scale + 0.5f);
         }
     }
 }
 
-uint32_t Convolve(uint8_t const *input, int32_t const stride, int32_t const x, int32_t const y, float const *kernel, int32_t const kernel_rows, int32_t const kernel_columns)
+int32_t Convolve(uint8_t const *input, int32_t const stride, int32_t const x, int32_t const y, float const *kernel, int32_t const kernel_rows, int32_t const kernel_columns)
 {
     int32_t const half_kernel_rows = kernel_rows / 2;
     int32_t const half_kernel_cols = kernel_columns / 2;
@@ -55,5 +242,5 @@ uint32_t Convolve(uint8_t const *input, int32_t const stride, int32_t const x, i
             accum += kernel[ky * kernel_columns + kx] * input[iy * stride + ix];
         }
     }
-    return static_cast<uint32_t>(accum);
+    return static_cast<int32_t>(accum);
 }
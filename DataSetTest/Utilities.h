@@ -1,14 +1,38 @@
 #pragma once
 
-uint32_t Convolve(uint8_t const *input, int32_t const stride, int32_t const x, int32_t const y, float const *kernel, int32_t const kernel_rows, int32_t const kernel_columns);
+class ThreadPool;
+
+int32_t Convolve(uint8_t const *input, int32_t const stride, int32_t const x, int32_t const y, float const *kernel, int32_t const kernel_rows, int32_t const kernel_columns);
+
+// Number of fractional bits in GaussianKernel::fixed_values
+static int32_t const GaussianFixedShift = 14;
+
+// Upper bound on the number of taps of a separable kernel, so row pointers can live on the stack
+static int32_t const MaxKernelTaps = 64;
 
 struct GaussianKernel
 {
-    float              sigma = 0.0f;
-    float              scale = 1.0f;
-    std::vector<float> values;
+    float                sigma = 0.0f;
+    float                scale = 1.0f;
+    std::vector<float>   values;
+    std::vector<int16_t> fixed_values; // normalized values, quantized so they sum to exactly 1 << GaussianFixedShift
 };
 
 void GenerateGaussian(float const sigma, uint32_t const size, GaussianKernel *out_kernel);
-void SmoothImage(uint8_t const *input, int32_t const width, int32_t const height, GaussianKernel const &kernel, uint8_t *scratch, uint8_t *output);
 
+// Separable Gaussian blur. Borders are handled by clamping to the nearest edge pixel.
+// scratch must be width * height bytes, and holds the result of the horizontal pass.
+// Each pass runs in parallel row bands when pool isn't null
+void SmoothImage(uint8_t const *input, int32_t const width, int32_t const height, GaussianKernel const &kernel, uint8_t *scratch, uint8_t *output, ThreadPool *pool);
+
+// Scalar floating point version of SmoothImage. SmoothImage matches it to within 1
+void SmoothImageReference(uint8_t const *input, int32_t const width, int32_t const height, GaussianKernel const &kernel, uint8_t *scratch, uint8_t *output);
+
+// Horizontal pass of SmoothImage for a single row
+void SmoothRowHorizontal(uint8_t const *input, int32_t const width, GaussianKernel const &kernel, uint8_t *output);
+
+// Vertical pass of SmoothImage for a single row. rows holds one row pointer per kernel tap, already clamped to the image
+void SmoothRowVertical(uint8_t const * const *rows, int32_t const width, GaussianKernel const &kernel, uint8_t *output);
+
+// output[x] = sum(taps[k] * sources[k][x]) >> GaussianFixedShift, rounded, for x in [0, count)
+void ConvolveFixed(uint8_t const * const *sources, int16_t const *taps, int32_t const num_taps, int32_t const count, uint8_t *output);
@@ -0,0 +1,101 @@
+#include "Precomp.h"
+#include "DatasetBenchmark.h"
+#include "ToolSupport.h"
+
+static void PrintUsage()
+{
+    printf(
+        "USAGE:\n"
+        "  DatasetBenchmark <path_to_data> [options]\n"
+        "    Runs decode, smoothing, Harris, FAST, BRIEF and matching over the frames of\n"
+        "    <path_to_data>/images.txt without a window, and reports the latency of each stage\n"
+        "    per frame, the frame rate and the features found per frame\n"
+        "  --frames <count>     Frames to measure. Default 0 runs the dataset once, more loops it\n"
+        "  --warmup <count>     Frames run before measuring. Default 10\n"
+        "  --threads <count>    Number of threads. Default 0 uses one per hardware thread\n"
+        "  --json <file>        Also write the report to <file> as JSON\n"
+        "  --trace <file>       Also write a Chrome trace of every frame, warmup included, to <file>\n");
+}
+
+// Measures the vision pipeline on a dataset, headless:
+//   DatasetBenchmark <path_to_data> [--frames N] [--warmup N] [--threads N] [--json <file>] [--trace <file>]
+int __cdecl main(int32_t const argc, char const *argv[])
+{
+    LogToConsole(true);
+    SetLogLevel(LogLevel::Warning);
+
+    if (argc < 2 || 0 != argc % 2)
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    DatasetBenchmarkParams params;
+    params.data_root = argv[1];
+    char const *json_path = nullptr;
+    char const *trace_path = nullptr;
+    for (int32_t i = 2; i + 1 < argc; i += 2)
+    {
+        bool valid = true;
+        if (0 == strcmp(argv[i], "--frames"))
+        {
+            valid = ParseCount(argv[i + 1], &params.max_frames);
+        }
+        else if (0 == strcmp(argv[i], "--warmup"))
+        {
+            valid = ParseCount(argv[i + 1], &params.warmup_frames);
+        }
+        else if (0 == strcmp(argv[i], "--threads"))
+        {
+            valid = ParseCount(argv[i + 1], &params.num_threads);
+        }
+        else if (0 == strcmp(argv[i], "--json"))
+        {
+            json_path = argv[i + 1];
+        }
+        else if (0 == strcmp(argv[i], "--trace"))
+        {
+            trace_path = argv[i + 1];
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            LOGE("Invalid option %s %s", argv[i], argv[i + 1]);
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if (trace_path)
+    {
+        SetTraceThreadName("main");
+        StartTracing();
+    }
+
+    DatasetBenchmarkReport report;
+    if (!RunDatasetBenchmark(params, &report))
+    {
+        LOGE("Failed to benchmark [%s]", params.data_root);
+        return -1;
+    }
+
+    if (trace_path)
+    {
+        StopTracing();
+        if (!WriteChromeTrace(trace_path))
+        {
+            return -1;
+        }
+    }
+
+    PrintDatasetBenchmarkReport(report);
+    if (json_path && !WriteDatasetBenchmarkJson(report, json_path))
+    {
+        return -1;
+    }
+    return 0;
+}
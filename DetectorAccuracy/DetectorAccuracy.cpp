@@ -0,0 +1,104 @@
+#include "Precomp.h"
+#include "DetectorAccuracy.h"
+#include "ToolSupport.h"
+
+static void PrintUsage()
+{
+    printf(
+        "USAGE:\n"
+        "  DetectorAccuracy <path_to_data> [options]\n"
+        "    Runs the optimized smoothing, Harris, FAST and BRIEF kernels next to their scalar\n"
+        "    references over the frames of <path_to_data>/images.txt, reports where they differ,\n"
+        "    and scores repeatability and matching between frames against the ground truth.\n"
+        "    Exits with 1 when a kernel differs from its reference beyond the tolerances\n"
+        "  --frames <count>         Frames to check. Default 0 checks every frame\n"
+        "  --gap <count>            Frames from the first frame of a scored pair to the second. Default 1\n"
+        "  --threads <count>        Threads of the optimized kernels. Default 0 uses one per hardware thread\n"
+        "  --tolerance <pixels>     How far an optimized feature may be from its reference. Default 0\n"
+        "  --scoretolerance <f>     Relative difference allowed between feature scores. Default 0.0001\n"
+        "  --bittolerance <bits>    Bits an optimized descriptor may differ by. Default 0\n"
+        "  --correspondence <px>    How close to its predicted position a feature is found again. Default 2.5\n"
+        "  --json <file>            Also write the report to <file> as JSON\n");
+}
+
+// Checks the optimized kernels against their references on a dataset:
+//   DetectorAccuracy <path_to_data> [--frames N] [--gap N] [--threads N] [--tolerance N] [--scoretolerance F]
+//                    [--bittolerance N] [--correspondence F] [--json <file>]
+int __cdecl main(int32_t const argc, char const *argv[])
+{
+    LogToConsole(true);
+    SetLogLevel(LogLevel::Warning);
+
+    if (argc < 2 || 0 != argc % 2)
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    DetectorAccuracyParams params;
+    params.data_root = argv[1];
+    char const *json_path = nullptr;
+    for (int32_t i = 2; i + 1 < argc; i += 2)
+    {
+        bool valid = true;
+        uint32_t position_tolerance = 0;
+        if (0 == strcmp(argv[i], "--frames"))
+        {
+            valid = ParseCount(argv[i + 1], &params.max_frames);
+        }
+        else if (0 == strcmp(argv[i], "--gap"))
+        {
+            valid = ParseCount(argv[i + 1], &params.frame_gap) && params.frame_gap > 0;
+        }
+        else if (0 == strcmp(argv[i], "--threads"))
+        {
+            valid = ParseCount(argv[i + 1], &params.num_threads);
+        }
+        else if (0 == strcmp(argv[i], "--tolerance"))
+        {
+            valid = ParseCount(argv[i + 1], &position_tolerance) && position_tolerance <= 16;
+            params.position_tolerance = static_cast<int32_t>(position_tolerance);
+        }
+        else if (0 == strcmp(argv[i], "--scoretolerance"))
+        {
+            valid = ParseFloat(argv[i + 1], &params.score_tolerance);
+        }
+        else if (0 == strcmp(argv[i], "--bittolerance"))
+        {
+            valid = ParseCount(argv[i + 1], &params.descriptor_tolerance);
+        }
+        else if (0 == strcmp(argv[i], "--correspondence"))
+        {
+            valid = ParseFloat(argv[i + 1], &params.correspondence_tolerance);
+        }
+        else if (0 == strcmp(argv[i], "--json"))
+        {
+            json_path = argv[i + 1];
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            LOGE("Invalid option %s %s", argv[i], argv[i + 1]);
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    DetectorAccuracyReport report;
+    if (!RunDetectorAccuracy(params, &report))
+    {
+        LOGE("Failed to check [%s]", params.data_root);
+        return -1;
+    }
+
+    PrintDetectorAccuracyReport(report);
+    if (json_path && !WriteDetectorAccuracyJson(report, json_path))
+    {
+        return -1;
+    }
+    return IsWithinTolerance(report) ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#include "Precomp.h"
+#include "Benchmark.h"
+
+// Runs the kernel benchmarks of the app's --benchmark without a window:
+//   KernelBenchmark <name>
+int __cdecl main(int32_t const argc, char const *argv[])
+{
+    LogToConsole(true);
+    SetLogLevel(LogLevel::Warning);
+
+    if (argc != 2)
+    {
+        printf(
+            "USAGE:\n"
+            "  KernelBenchmark <name>\n"
+            "    Values are brief, convolve, fast, match, points, pyramid, threads, undistort and all,\n"
+            "    or sweep to measure every kernel over sizes up to 4K, content and thread counts\n");
+        return -1;
+    }
+
+    if (!RunBenchmark(argv[1]))
+    {
+        LOGE("Unknown benchmark [%s]", argv[1]);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include "Precomp.h"
+#include "PackedFrameProvider.h"
+
+// Converts a dataset to the packed format PackedFrameProvider plays back:
+//   PackDataset <path_to_data> <output_file>
+int __cdecl main(int32_t const argc, char const *argv[])
+{
+    LogToConsole(true);
+    SetLogLevel(LogLevel::Info);
+
+    if (argc != 3)
+    {
+        printf(
+            "USAGE:\n"
+            "  PackDataset <path_to_data> <output_file>\n"
+            "    Decodes every frame listed in <path_to_data>/images.txt into <output_file>\n");
+        return -1;
+    }
+
+    if (!WritePackedDataset(argv[1], argv[2]))
+    {
+        LOGE("Failed to pack [%s]", argv[1]);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "Precomp.h"
+#include "PlaybackFrameProvider.h"
+#include "SharedFrameRing.h"
+
+#include <csignal>
+
+// Slots in the ring. At 30 fps, a consumer can fall a quarter second behind before frames get overwritten
+static uint32_t const RingSlots = 8;
+
+static std::atomic<bool> stop_requested{ false };
+
+static void OnSignal(int)
+{
+    stop_requested.store(true);
+}
+
+// Replays a dataset into a shared memory frame ring, looping, as a capture process would:
+//   RingProducer <path_to_data> <ring_name> [speed]
+int __cdecl main(int32_t const argc, char const *argv[])
+{
+    LogToConsole(true);
+    SetLogLevel(LogLevel::Info);
+
+    if (argc != 3 && argc != 4)
+    {
+        printf(
+            "USAGE:\n"
+            "  RingProducer <path_to_data> <ring_name> [speed]\n"
+            "    Publishes the frames of <path_to_data>/images.txt to the frame ring <ring_name>, paced by\n"
+            "    their timestamps, until interrupted. speed is a number such as 2 or 0.5 to play back\n"
+            "    faster or slower, or virtual to publish frames as fast as they are decoded\n");
+        return -1;
+    }
+
+    PlaybackParams playback_params;
+    if (4 == argc)
+    {
+        if (0 == _stricmp(argv[3], "VIRTUAL"))
+        {
+            playback_params.mode = PlaybackMode::Virtual;
+        }
+        else if (atof(argv[3]) > 0.0)
+        {
+            playback_params.mode = PlaybackMode::Scaled;
+            playback_params.speed = atof(argv[3]);
+        }
+        else
+        {
+            LOGE("Invalid playback speed [%s]", argv[3]);
+            return -1;
+        }
+    }
+
+    PlaybackFrameProvider provider;
+    if (!provider.Initialize(argv[1], true, playback_params))
+    {
+        LOGE("Failed to initialize playback of [%s]", argv[1]);
+        return -1;
+    }
+
+    // The ring is sized for the first frame, as datasets keep the same size throughout
+    CameraFrame frame;
+    if (!provider.GetNextFrame(&frame))
+    {
+        LOGE("Failed to get the first frame of [%s]", argv[1]);
+        return -1;
+    }
+
+    SharedFrameWriter writer;
+    if (!writer.Initialize(argv[2], RingSlots, static_cast<size_t>(frame.width) * frame.height))
+    {
+        return -1;
+    }
+
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+
+    LOGI("Publishing %ux%u frames to [%s]", frame.width, frame.height, argv[2]);
+    uint64_t published = 0;
+    do
+    {
+        if (!writer.WriteFrame(frame.timestamp_us, frame.width, frame.height, frame.pixels.GetData()))
+        {
+            return -1;
+        }
+        if (0 == ++published % 1000)
+        {
+            LOGI("Published %" PRIu64 " frames", published);
+        }
+    } while (!stop_requested.load() && provider.GetNextFrame(&frame));
+
+    writer.Close();
+    LOGI("Published %" PRIu64 " frames", published);
+    return 0;
+}